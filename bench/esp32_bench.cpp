@@ -0,0 +1,250 @@
+#include <Arduino.h>
+#include "controller.h"
+#include "can_signals.h"
+#include "config.h"
+
+/**
+ * @file esp32_bench.cpp
+ * @brief Benchmark firmware for the esp32-bench environment: times the control and motor hot
+ * paths on the board with CCOUNT instead of running the controller.
+ *
+ * Every case is timed one call at a time, warm (after a few untimed calls) and cold (after
+ * reading BENCH_EVICT_BYTES of flash-resident data, which pushes the case's code out of the
+ * flash cache). Median and max show how much interrupts add on top of the minimum. The
+ * driver outputs stay disabled, so the step pulses from move_steps never turn the motor.
+ *
+ * One line per result:
+ *   bench,<case>,cache=warm|cold,calls=N,min_cycles=..,median_cycles=..,mean_cycles=..,max_cycles=..,cpu_mhz=..
+ * followed by bench_done,results=N. Send "run" to repeat. tools/esp32_bench.py collects them.
+ */
+
+#define BENCH_WARM_CALLS 1000  // timed calls per warm result
+#define BENCH_COLD_CALLS 200   // timed calls per cold result, each after a cache eviction
+#define BENCH_WARMUP_CALLS 16  // untimed calls before the warm run
+#define BENCH_EVICT_BYTES 65536 // twice the per-core flash cache
+#define BENCH_CACHE_LINE 32
+#define BENCH_INPUTS 64        // entries in each input table, a power of two
+
+#ifndef ARDUINO_BOARD
+#define ARDUINO_BOARD "unknown"
+#endif
+
+/**
+ * @brief One timed operation. run() is called with the call index so it can cycle its inputs.
+ */
+struct BenchCase {
+  const char *name;
+  void (*run)(void *arg, uint32_t call);
+  void *arg;
+};
+
+/**
+ * @brief Flash-resident bytes read to evict the cache. Nonzero so it lands in .rodata.
+ */
+static const uint8_t evictBuffer[BENCH_EVICT_BYTES] = {1};
+
+static volatile int32_t benchSink; // keeps results observable so calls are not optimized away
+static uint32_t samples[BENCH_WARM_CALLS];
+static uint32_t overheadCycles;     // cost of an empty case, subtracted from every sample
+static int results;
+
+static DRV8462 driver;
+static CalibrationValues cal;
+static LowPassFilter filter(ANALOG_FILTER_ALPHA);
+static int moveStepCounts[] = {1, 100, 800, MAX_PULSES};
+
+static struct {
+  int setpoint;
+  int position;
+  float velocity;
+  float rpm;
+  int16_t count;
+  int16_t lastCount;
+  int64_t elapsedUs;
+  int speedHz;
+} inputs[BENCH_INPUTS];
+
+/**
+ * @brief Deterministic pseudo-random float in [lo, hi), matching the host suite's inputs.
+ */
+static float uniform(uint32_t &state, float lo, float hi) {
+  state = state * 1664525u + 1013904223u;
+  return lo + (hi - lo) * (float)(state >> 8) / (float)(1u << 24);
+}
+
+static void fillInputs() {
+  uint32_t seed = 1;
+  for (int i = 0; i < BENCH_INPUTS; i++) {
+    inputs[i].position = (int)uniform(seed, 0.0f, 40000.0f);
+    inputs[i].setpoint = i % 8 == 0 ? inputs[i].position : (int)uniform(seed, 0.0f, 40000.0f);
+    inputs[i].velocity = uniform(seed, -80000.0f, 80000.0f);
+    inputs[i].rpm = uniform(seed, 1000.0f, 4000.0f);
+    int delta = (int)uniform(seed, 0.0f, 40.0f);
+    inputs[i].lastCount = i % 8 == 0 ? INT16_MAX - delta / 2 : (int16_t)uniform(seed, INT16_MIN, INT16_MAX - 40);
+    inputs[i].count = (int16_t)(inputs[i].lastCount + delta);
+    inputs[i].elapsedUs = (int64_t)uniform(seed, 5000.0f, 20000.0f);
+    inputs[i].speedHz = (int)uniform(seed, 1000.0f, 80000.0f);
+  }
+  for (int i = 0; i < CAL_PARAM_COUNT; i++) {
+    cal.values[i] = calParams[i].defaultValue;
+  }
+}
+
+static void runEmpty(void *arg, uint32_t call) {
+}
+
+static void runMotorPlan(void *arg, uint32_t call) {
+  const auto &input = inputs[call & (BENCH_INPUTS - 1)];
+  Motor::MotionCommand command = Motor::plan(input.setpoint, input.position, input.velocity,
+                                             MOTOR_TIMER_RATE / 1000.0f, MOTOR_MAX_ACCELERATION_POS);
+  benchSink = command.steps;
+}
+
+static void runSetpointLaw(void *arg, uint32_t call) {
+  static float lastError = 0.0f;
+  const auto &input = inputs[call & (BENCH_INPUTS - 1)];
+  benchSink = Controller::setpointLaw(cal, input.rpm, cal[CAL_ENGINE_IDEAL_RPM_POWER], lastError,
+                                      input.position, call % 16 == 0);
+}
+
+static void runLowPassFilter(void *arg, uint32_t call) {
+  benchSink = (int32_t)filter.filter(inputs[call & (BENCH_INPUTS - 1)].rpm);
+}
+
+static void runCountsToRPM(void *arg, uint32_t call) {
+  const auto &input = inputs[call & (BENCH_INPUTS - 1)];
+  benchSink = (int32_t)PulseCounter::countsToRPM(input.count, input.lastCount, input.elapsedUs,
+                                                 PRIMARY_MAGNET_COUNT * EDGES_PER_MAGNET);
+}
+
+static void runSpiRead(void *arg, uint32_t call) {
+  benchSink = driver.readFault();
+}
+
+static void runMoveSteps(void *arg, uint32_t call) {
+  int steps = *static_cast<int *>(arg);
+  driver.moveSteps(call & 1 ? steps : -steps, inputs[call & (BENCH_INPUTS - 1)].speedHz);
+}
+
+static void runCanPack(void *arg, uint32_t call) {
+  float values[STATUS_SIGNAL_COUNT];
+  for (int i = 0; i < STATUS_SIGNAL_COUNT; i++) {
+    values[i] = (call + i) & 7;
+  }
+  uint8_t data[8];
+  canPackFrame(ECVT_STATUS_FRAME, values, data);
+  benchSink = data[0];
+}
+
+static const BenchCase benchCases[] = {
+  {"motor_plan", runMotorPlan, nullptr},
+  {"setpoint_law", runSetpointLaw, nullptr},
+  {"low_pass_filter", runLowPassFilter, nullptr},
+  {"counts_to_rpm", runCountsToRPM, nullptr},
+  {"spi_read_register", runSpiRead, nullptr},
+  {"move_steps/1", runMoveSteps, &moveStepCounts[0]},
+  {"move_steps/100", runMoveSteps, &moveStepCounts[1]},
+  {"move_steps/800", runMoveSteps, &moveStepCounts[2]},
+  {"move_steps/2000", runMoveSteps, &moveStepCounts[3]},
+  {"can_pack_status", runCanPack, nullptr},
+};
+
+/**
+ * @brief Read every cache line of evictBuffer so the next call starts with a cold flash cache.
+ */
+static void evictCache() {
+  int32_t sum = 0;
+  for (int i = 0; i < BENCH_EVICT_BYTES; i += BENCH_CACHE_LINE) {
+    sum += ((const volatile uint8_t *)evictBuffer)[i];
+  }
+  benchSink = sum;
+}
+
+/**
+ * @brief Time calls one at a time into samples[], minus the measured overhead.
+ */
+static void timeCalls(const BenchCase &bench, uint32_t calls, bool cold) {
+  for (uint32_t i = 0; i < calls; i++) {
+    if (cold) {
+      evictCache();
+    }
+    uint32_t start = ESP.getCycleCount();
+    bench.run(bench.arg, i);
+    uint32_t cycles = ESP.getCycleCount() - start;
+    samples[i] = cycles > overheadCycles ? cycles - overheadCycles : 0;
+  }
+}
+
+static int compareCycles(const void *a, const void *b) {
+  uint32_t x = *static_cast<const uint32_t *>(a);
+  uint32_t y = *static_cast<const uint32_t *>(b);
+  return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, const char *cache, uint32_t calls) {
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < calls; i++) {
+    total += samples[i];
+  }
+  qsort(samples, calls, sizeof(samples[0]), compareCycles);
+  Serial.printf("bench,%s,cache=%s,calls=%u,min_cycles=%u,median_cycles=%u,mean_cycles=%.1f,max_cycles=%u,cpu_mhz=%u\n",
+                name, cache, calls, samples[0], samples[calls / 2], (double)total / calls, samples[calls - 1],
+                ESP.getCpuFreqMHz());
+  results++;
+}
+
+static void runBenchmarks() {
+  results = 0;
+
+  // Timer overhead: the cheapest of many empty calls.
+  BenchCase empty = {"empty", runEmpty, nullptr};
+  overheadCycles = 0;
+  timeCalls(empty, BENCH_WARM_CALLS, false);
+  qsort(samples, BENCH_WARM_CALLS, sizeof(samples[0]), compareCycles);
+  overheadCycles = samples[0];
+  Serial.printf("bench_overhead,cycles=%u\n", overheadCycles);
+
+  for (const BenchCase &bench : benchCases) {
+    for (int i = 0; i < BENCH_WARMUP_CALLS; i++) {
+      bench.run(bench.arg, i);
+    }
+    timeCalls(bench, BENCH_WARM_CALLS, false);
+    report(bench.name, "warm", BENCH_WARM_CALLS);
+    timeCalls(bench, BENCH_COLD_CALLS, true);
+    report(bench.name, "cold", BENCH_COLD_CALLS);
+  }
+  driver.stop();
+  Serial.printf("bench_done,results=%d\n", results);
+}
+
+/**
+ * @brief Arduino setup entry point: bring up the driver with its outputs off and run once.
+ */
+void setup() {
+  Serial.begin(TELEMETRY_BAUD);
+  driver.begin();
+  fillInputs();
+  Serial.printf("bench_start,board=%s,cpu_mhz=%u\n", ARDUINO_BOARD, ESP.getCpuFreqMHz());
+  runBenchmarks();
+}
+
+/**
+ * @brief Repeat the run when the host sends "run".
+ */
+void loop() {
+  static char line[16];
+  static size_t length = 0;
+  while (Serial.available()) {
+    char c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      line[length] = '\0';
+      length = 0;
+      if (strcmp(line, "run") == 0) {
+        runBenchmarks();
+      }
+    } else if (length < sizeof(line) - 1) {
+      line[length++] = c;
+    }
+  }
+  delay(10);
+}
@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include <SPI.h>
+#include "freertos/semphr.h"
 #include "driver/rmt.h"
 #include "soc/rmt_reg.h"
 
@@ -9,6 +10,16 @@
 #define RMT_CHANNEL RMT_CHANNEL_0
 #define MAX_PULSES 2000 // maximum number of pulses to send in one batch
 
+/**
+ * @brief Decay settings selected by step rate, slowest first.
+ */
+enum DecayBand : uint8_t
+{
+    DECAY_BAND_QUIET,  // silentstep, holding and slow trims
+    DECAY_BAND_CRUISE, // ripple control
+    DECAY_BAND_TORQUE, // dynamic decay near top speed
+};
+
 /**
  * @brief DRV8462 stepper driver wrapper with SPI + RMT support.
  */
@@ -29,6 +40,23 @@ public:
     void enable();
     void disable();
 
+    /**
+     * @brief Set the run and hold current limits (CTRL11 / CTRL10 codes).
+     */
+    void setCurrent(uint8_t runCurrent, uint8_t holdCurrent);
+
+    /**
+     * @brief Write the CTRL1 decay mode and silentstep enable for a band.
+     */
+    void setDecayBand(DecayBand band);
+
+    /**
+     * @brief Check DIAG3 for a silentstep error and, if one is set, fall back to DECAY_QUIET
+     * without silentstep for the rest of the power cycle.
+     * @return True if silentstep is still in use.
+     */
+    bool checkSilentstep();
+
     /**
      * @brief Move a fixed number of steps at a constant speed.
      * @param steps Step count (sign indicates direction).
@@ -67,9 +95,14 @@ private:
     bool atqLearningComplete;
     unsigned long atqLearningMotionStartMs;
     unsigned long atqLearningStartMs;
+    bool silentstepFaulted;
+    SemaphoreHandle_t registerLock; // held across each read-modify-write; the motor timer and control task share CTRL1
+    StaticSemaphore_t registerLockBuffer;
     void setupAutoTorque();
+    void setupDecay();
     void serviceAutoTorqueLearning(bool motorIsStepping);
     void spiWriteRegister(uint8_t address, uint16_t data);
     uint16_t spiReadRegister(uint8_t address);
+    uint16_t modifyRegister(uint8_t address, uint16_t clearMask, uint16_t setBits);
     void setupRMT();
 };
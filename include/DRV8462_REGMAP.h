@@ -162,6 +162,16 @@
 #define SR_MASK               (0x40)        // Output driver rise and fall time selection
 #define EN_OUT_MASK           (0x80)        // Hi-Z outputs bit OR-ed with DRVOFF
 
+// CTRL1 DECAY settings (increasing / decreasing current steps)
+#define DECAY_SLOW_SLOW       (0x00)        // Slow / slow
+#define DECAY_SLOW_MIXED30    (0x01)        // Slow / mixed 30%
+#define DECAY_SLOW_MIXED60    (0x02)        // Slow / mixed 60%
+#define DECAY_SLOW_FAST       (0x03)        // Slow / fast
+#define DECAY_MIXED30         (0x04)        // Mixed 30% / mixed 30%
+#define DECAY_MIXED60         (0x05)        // Mixed 60% / mixed 60%
+#define DECAY_SMART_DYNAMIC   (0x06)        // Smart tune dynamic decay
+#define DECAY_SMART_RIPPLE    (0x07)        // Smart tune ripple control
+
 // Register 0x05 : CTRL2 Register
 #define MICROSTEP_MODE_MASK   (0x0F)        // Microstep setting
 #define SPI_STEP_MASK         (0x10)        // Enable SPI step control mode
@@ -208,6 +218,9 @@
 // Register 0x10 : CTRL13 Register
 #define VREF_MASK             (0x02)        // Voltage Reference Setting
 
+// Register 0x31 : SILENTSTEP_CTRL1 Register
+#define EN_SS_MASK            (0x80)        // Enable silentstep decay mode
+
 // Register 0x28 : ATQ_CTRL10 Register
 #define ATQ_EN_MASK           (0x80)        // Auto torque enable
 #define LRN_START_MASK        (0x40)        // Auto torque learning start
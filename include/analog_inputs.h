@@ -0,0 +1,110 @@
+#ifndef ANALOG_INPUTS_H
+#define ANALOG_INPUTS_H
+
+#include <Arduino.h>
+#include "filter.h"
+#include "snapshot.h"
+
+
+/**
+ * @brief Analog channels owned by the input service.
+ */
+enum AnalogChannel {
+    MANUAL_MODE_INPUT,
+    LIMIT_SWITCH_INPUT,
+    BRAKE_INPUT,
+    ANALOG_INPUT_COUNT
+};
+
+/**
+ * @brief Debounced position of the manual mode selector, lowest voltage first.
+ */
+enum ModeSelectorPosition {
+    SELECTOR_POWER,
+    SELECTOR_TORQUE,
+    SELECTOR_ACCELERATION,
+    SELECTOR_BRAKE_CHECK,
+    SELECTOR_HOMING
+};
+
+/**
+ * @brief Consistent view of every analog input, published once per DMA frame.
+ */
+struct AnalogInputState {
+    uint16_t raw[ANALOG_INPUT_COUNT];   // oversampled channel averages in ADC counts
+    float filtered[ANALOG_INPUT_COUNT]; // low-pass filtered channel values in ADC counts
+    ModeSelectorPosition modeSelector;  // debounced selector position
+    bool brakePressed;                  // debounced brake state with hysteresis
+    bool limitSwitch;                   // limit switch state (active high)
+    uint32_t timestampMs;               // time the frame was published
+};
+
+/**
+ * @brief Continuous ADC input service.
+ *
+ * Runs the ADC1 DMA engine over the selector and limit switch channels, oversamples
+ * the brake input, and publishes filtered, debounced values as a lock-free snapshot
+ * so control code never blocks on a conversion.
+ */
+class AnalogInputs {
+public:
+    AnalogInputs();
+
+    /**
+     * @brief Configure the ADC and start the sampling task.
+     */
+    void begin();
+
+    /**
+     * @brief Return the latest published input state.
+     */
+    AnalogInputState read() const {
+        return state.read();
+    }
+
+    /**
+     * @brief Number of frames published so far.
+     */
+    uint32_t sequence() const {
+        return state.sequence();
+    }
+
+    /**
+     * @brief Register a callback invoked from the input task whenever the debounced brake state changes.
+     * @param callback Function receiving the new brake state.
+     * @param arg Argument passed to the callback.
+     */
+    void setBrakeCallback(void (*callback)(bool pressed, void *arg), void *arg) {
+        brakeCallbackArg = arg;
+        brakeCallback = callback;
+    }
+
+    /**
+     * @brief Filter, debounce, and publish one oversampled frame.
+     * @param raw Averaged ADC counts for each channel.
+     * @param nowMs Frame timestamp in milliseconds.
+     */
+    void processFrame(const uint16_t raw[ANALOG_INPUT_COUNT], uint32_t nowMs);
+
+private:
+    static void taskEntry(void *arg);
+    void run();
+    ModeSelectorPosition classifySelector(float value) const;
+    void updateSelector(float value, uint32_t nowMs);
+    void updateBrake(uint16_t raw, uint32_t nowMs);
+
+    Snapshot<AnalogInputState> state;
+    LowPassFilter filters[ANALOG_INPUT_COUNT];
+    uint16_t lastRaw[ANALOG_INPUT_COUNT];
+
+    ModeSelectorPosition selector = SELECTOR_POWER;
+    ModeSelectorPosition pendingSelector = SELECTOR_POWER;
+    uint32_t pendingSelectorSinceMs = 0;
+
+    bool brakePressed = false;
+    uint32_t brakeLowSinceMs = 0;
+    void (*brakeCallback)(bool pressed, void *arg) = nullptr;
+    void *brakeCallbackArg = nullptr;
+};
+
+#endif // ANALOG_INPUTS_H
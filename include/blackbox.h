@@ -0,0 +1,210 @@
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "freertos/semphr.h"
+#include "telemetry.h"
+#include "config.h"
+
+/**
+ * @file blackbox.h
+ * @brief On-board flight recorder writing full-rate control samples to a raw flash partition.
+ *
+ * The "blackbox" partition (partitions.csv) is a circular log of fixed-size pages. Each page
+ * holds a header and a run of samples, each delta-encoded against the previous sample in
+ * the same page as zigzag varints, so any page decodes on its own once older pages are
+ * overwritten. tools/blackbox.py downloads the partition over the serial port and mirrors
+ * this layout; bump BLACKBOX_VERSION when it changes.
+ */
+
+#define BLACKBOX_MAGIC 0x31584242 // "BBX1"
+#define BLACKBOX_VERSION 1
+
+/**
+ * @brief Recorded sample fields, in encoding order. At most eight, one change-mask bit each.
+ */
+enum BlackboxField {
+    BLACKBOX_ENGINE_RPM,
+    BLACKBOX_SETPOINT,      // steps
+    BLACKBOX_POSITION,      // steps
+    BLACKBOX_VELOCITY,      // steps/s
+    BLACKBOX_BRAKE_RAW,     // ADC counts
+    BLACKBOX_CONTROL_MODE,  // ControlMode
+    BLACKBOX_FLAGS,         // TelemetryFlag bits
+    BLACKBOX_DRIVER_FAULT,
+    BLACKBOX_FIELD_COUNT
+};
+
+/**
+ * @brief Events that mark a page and, in triggered mode, keep the history around it.
+ */
+enum BlackboxTrigger : uint8_t {
+    BLACKBOX_TRIGGER_FAULT = 1 << 0,      // motor driver fault raised
+    BLACKBOX_TRIGGER_BRAKE_SLAM = 1 << 1, // brake input rose faster than BLACKBOX_BRAKE_SLAM_RATE
+    BLACKBOX_TRIGGER_MANUAL = 1 << 2,     // requested over the serial port
+    BLACKBOX_TRIGGER_SLIP = 1 << 3,       // belt slip event started
+};
+
+/**
+ * @brief One control-tick sample.
+ */
+struct BlackboxSample {
+    uint64_t timestampUs;
+    int32_t fields[BLACKBOX_FIELD_COUNT];
+};
+
+/**
+ * @brief Page header, little-endian, no padding.
+ */
+struct __attribute__((packed)) BlackboxPageHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t triggers;     // BlackboxTrigger bits raised while the page was filled
+    uint16_t length;      // payload bytes used
+    uint32_t sequence;    // page number, continues across boots
+    uint16_t session;     // incremented on each boot
+    uint16_t sampleCount;
+    uint64_t startUs;     // time of the first sample, since boot
+    uint16_t crc;         // CRC-16 of the header up to this field and the used payload
+};
+
+/**
+ * @brief One flash page. Unused payload bytes are left erased (0xFF).
+ */
+struct BlackboxPage {
+    BlackboxPageHeader header;
+    uint8_t payload[BLACKBOX_PAGE_SIZE - sizeof(BlackboxPageHeader)];
+};
+
+/**
+ * @brief Worst-case encoded sample: change mask, time delta, and every field as a 5-byte varint.
+ */
+#define BLACKBOX_SAMPLE_MAX (1 + 5 * (1 + BLACKBOX_FIELD_COUNT))
+
+/**
+ * @brief Recorder counters for diagnostics.
+ */
+struct BlackboxStats {
+    uint32_t pagesWritten;
+    uint32_t pagesDropped;   // completed pages lost because no erased flash was ready
+    uint32_t overruns;       // samples lost because every RAM page was waiting for flash
+    uint32_t triggeredPages; // pages that carried a trigger
+    uint32_t erasedPages;    // erased pages ready ahead of the write position
+    uint32_t sequence;       // next page sequence number
+    uint16_t session;
+};
+
+/**
+ * @brief Black-box recorder.
+ *
+ * The control task encodes each sample into the current RAM page. Completed pages go to a
+ * writer task on core 0 through a small ring, so the control tick never waits on flash.
+ * Flash erase and program stall both cores while the cache is disabled, so the writer only
+ * erases sectors ahead of the write position while allowErase() says the car is stopped,
+ * and programs pages in BLACKBOX_WRITE_CHUNK pieces. Pages that find no erased flash are
+ * dropped rather than erasing mid-run.
+ */
+class Blackbox {
+public:
+    Blackbox();
+
+    /**
+     * @brief Find the partition, resume after the newest page, and start the writer task.
+     */
+    void begin();
+
+    /**
+     * @brief Append one sample. Only the control task may call this.
+     * @param sample Sample to record.
+     */
+    void record(const BlackboxSample &sample);
+
+    /**
+     * @brief Raise a trigger from any task. It is attached to the page being filled.
+     * @param triggers BlackboxTrigger bits.
+     */
+    void trigger(uint8_t triggers) {
+        pendingTriggers.fetch_or(triggers, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Tell the writer whether erasing flash (a long stall) is acceptable now.
+     */
+    void allowErase(bool allowed) {
+        eraseAllowed.store(allowed, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Start streaming every recorded page, oldest first, as COBS frames on the serial port.
+     *
+     * Each frame carries BLACKBOX_FRAME_TAG and one page; a frame with the tag alone ends
+     * the dump. The pages are sent by serviceDump() and erasing is paused until the end
+     * frame. Call from the Arduino loop.
+     */
+    void dump();
+
+    /**
+     * @brief Send the next BLACKBOX_DUMP_PAGES_PER_PASS pages of a dump in progress.
+     * Call on every Arduino loop pass.
+     */
+    void serviceDump();
+
+    /**
+     * @brief Return recorder counters.
+     */
+    BlackboxStats getStats() const;
+
+private:
+    static size_t encodeVarint(uint32_t value, uint8_t *out);
+    static uint16_t pageCrc(const BlackboxPage &page);
+
+    bool startPage(uint64_t nowUs);
+    void finishPage();
+    uint8_t detectTriggers(const BlackboxSample &sample);
+
+    void run();
+    void scan();
+    bool isErased(uint32_t offset, uint32_t length);
+    void commit(BlackboxPage &page);
+    void eraseAhead();
+
+    const esp_partition_t *partition = nullptr;
+    uint32_t pageCount = 0;
+    TaskHandle_t task = nullptr;
+
+    BlackboxPage pages[BLACKBOX_RAM_PAGES];
+    std::atomic<uint32_t> filled;   // pages completed by the control task
+    std::atomic<uint32_t> consumed; // pages written or discarded by the writer
+    std::atomic<uint8_t> pendingTriggers;
+    std::atomic<bool> eraseAllowed;
+    std::atomic<bool> dumping;
+
+    // Control task state.
+    BlackboxPage *current = nullptr;
+    int32_t last[BLACKBOX_FIELD_COUNT]; // previous sample in the current page
+    uint64_t lastUs = 0;
+    BlackboxSample previous = {};       // previous sample overall, for trigger detection
+    bool hasPrevious = false;
+    uint8_t heldTriggers = 0;           // triggers raised while no page was free
+
+    // Writer task state. The flash position is changed and read under flashLock.
+    SemaphoreHandle_t flashLock; // held while the writer moves writeIndex or erases, and while a dump snapshots them
+    StaticSemaphore_t flashLockBuffer;
+    uint32_t writeIndex = 0;  // next flash page to program
+    uint32_t erasedPages = 0; // erased pages starting at writeIndex, ending on a sector boundary
+    uint32_t nextSequence = 0;
+    uint16_t session = 0;
+    uint32_t scanned = 0;     // completed pages already checked for triggers
+    uint64_t keepUntilUs = 0; // triggered mode keeps pages starting before this
+    BlackboxStats stats = {};
+
+    // Dump state, used from the Arduino loop.
+    TaggedFrameWriter<BLACKBOX_PAGE_SIZE> writer;
+    uint32_t dumpNext = 0;      // next flash page to send
+    uint32_t dumpRemaining = 0; // pages left, counted when the dump started
+};
+
+#endif // BLACKBOX_H
@@ -0,0 +1,173 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "can_scheduler.h"
+#include "snapshot.h"
+
+
+/**
+ * @brief Calibration protocol CAN IDs. Every frame carries one BajaCan float.
+ *
+ * Commands are sent to CAL_COMMAND_ID as (command << 8) | param. Writes are sent to
+ * CAL_WRITE_BASE_ID + param with the new value. Every request is answered on
+ * CAL_RESPONSE_ID with (command << 20) | (status << 16) | payload, where payload is the
+ * parameter index or the checksum. READ also returns the value on CAL_VALUE_BASE_ID + param.
+ */
+#define CAL_COMMAND_ID 0x620
+#define CAL_RESPONSE_ID 0x621
+#define CAL_WRITE_BASE_ID 0x640
+#define CAL_VALUE_BASE_ID 0x680
+
+/** @brief NVS namespace holding the committed set. */
+#define CAL_NVS_NAMESPACE "calibration"
+
+/**
+ * @brief Tunable parameters. Append new entries at the end: a stored set with fewer entries
+ * still loads, and the appended ones take their defaults.
+ */
+enum CalParam {
+    CAL_RPM_KP,
+    CAL_RPM_KD,
+    CAL_ENGINE_ENGAGE_RPM,
+    CAL_ENGINE_IDEAL_RPM_POWER,
+    CAL_ENGINE_IDEAL_RPM_TORQUE,
+    CAL_ENGINE_MAX_RPM,
+    CAL_IDLE_MOTOR_SETPOINT,
+    CAL_LOW_MAX_SETPOINT,
+    CAL_MAX_MOTOR_SETPOINT,
+    CAL_MAX_MOTOR_SETPOINT_BRAKE_MODE,
+    CAL_RUN_MOTOR_CURRENT,
+    CAL_HOLD_MOTOR_CURRENT,
+    CAL_MAX_ACCELERATION_POS,
+    CAL_MAX_ACCELERATION_NEG,
+    CAL_AMBIENT_TEMP,
+    CAL_PARAM_COUNT
+};
+
+/**
+ * @brief Calibration protocol commands.
+ */
+enum CalCommand {
+    CAL_CMD_READ = 1,     // return the staged value of a parameter
+    CAL_CMD_WRITE = 2,    // stage a new value (sent on CAL_WRITE_BASE_ID + param)
+    CAL_CMD_APPLY = 3,    // make the staged set active at the next control tick
+    CAL_CMD_COMMIT = 4,   // store the active set in NVS
+    CAL_CMD_CHECKSUM = 5, // return the checksum of the active set
+    CAL_CMD_REVERT = 6,   // discard staged writes
+    CAL_CMD_DEFAULTS = 7  // stage the compiled-in defaults
+};
+
+/**
+ * @brief Calibration protocol response status.
+ */
+enum CalStatus {
+    CAL_OK,
+    CAL_ERR_PARAM,   // parameter index out of range
+    CAL_ERR_RANGE,   // value outside the parameter's limits
+    CAL_ERR_COMMAND, // unknown command
+    CAL_ERR_NVS,     // NVS write failed
+    CAL_ERR_CONFLICT // set breaks an ordering between two parameters; payload is the first of them
+};
+
+/**
+ * @brief Registry entry for one parameter.
+ */
+struct CalParamDef {
+    const char *name;
+    float defaultValue; // compiled-in value from config.h
+    float min;
+    float max;
+};
+
+extern const CalParamDef calParams[CAL_PARAM_COUNT];
+
+/**
+ * @brief One complete parameter set.
+ */
+struct CalibrationValues {
+    float values[CAL_PARAM_COUNT];
+
+    float operator[](CalParam param) const {
+        return values[param];
+    }
+};
+
+/**
+ * @brief CRC-16/CCITT-FALSE over the little-endian bytes of every value.
+ */
+uint16_t calChecksum(const CalibrationValues &cal);
+
+/**
+ * @brief Check the orderings between parameters that each range check alone cannot,
+ * e.g. engine_engage_rpm below engine_max_rpm, which setpointLaw divides by.
+ * @return The lower parameter of the first violated pair, or CAL_PARAM_COUNT if the set is consistent.
+ */
+int calConflict(const CalibrationValues &cal);
+
+/**
+ * @brief Double-buffered parameter registry with a CAN calibration protocol and NVS storage.
+ *
+ * Protocol writes go to a staged set owned by the CAN receive task. APPLY publishes the
+ * staged set as a snapshot that the control loop copies once at the start of each tick,
+ * so a batch of writes takes effect together. Writes are checked one parameter at a time,
+ * and APPLY checks the set as a whole with calConflict(). COMMIT is deferred to service() because
+ * flash writes would stall the receive task.
+ */
+class Calibration {
+public:
+    /**
+     * @brief Construct a registry that answers over the given CAN transport.
+     * @param canTx Scheduler that sends the responses at the lowest priority.
+     */
+    Calibration(CanScheduler &canTx);
+
+    /**
+     * @brief Load the committed set from NVS, falling back to defaults if it is missing or corrupt.
+     */
+    void begin();
+
+    /**
+     * @brief Return the active parameter set.
+     */
+    CalibrationValues read() const {
+        return active.read();
+    }
+
+    /**
+     * @brief Number of times a parameter set has been applied, used to detect changes.
+     */
+    uint32_t sequence() const {
+        return active.sequence();
+    }
+
+    /**
+     * @brief Handle a frame on CAL_COMMAND_ID. Called from the CAN receive task.
+     * @param encoded (command << 8) | param.
+     */
+    void handleCommand(float encoded);
+
+    /**
+     * @brief Handle a frame on CAL_WRITE_BASE_ID + param. Called from the CAN receive task.
+     * @param param Parameter index.
+     * @param value New value.
+     */
+    void handleWrite(uint32_t param, float value);
+
+    /**
+     * @brief Run deferred NVS commits. Call from a low-priority task.
+     */
+    void service();
+
+private:
+    void respond(CalCommand command, CalStatus status, uint16_t payload);
+    static CalibrationValues defaults();
+
+    CanScheduler &canTx;
+    CalibrationValues staged;
+    Snapshot<CalibrationValues> active;
+    std::atomic<bool> commitRequested{false};
+};
+
+#endif // CALIBRATION_H
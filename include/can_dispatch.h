@@ -0,0 +1,93 @@
+#ifndef CAN_DISPATCH_H
+#define CAN_DISPATCH_H
+
+#include <Arduino.h>
+#include "BajaCan.h"
+#include "driver/twai.h"
+#include "config.h"
+
+
+/**
+ * @brief One row of the receive table.
+ */
+struct CanRxEntry {
+    uint32_t id;    // first ID handled
+    uint8_t count;  // number of consecutive IDs handled, starting at id
+    uint8_t filter; // hardware acceptance filter (0 or 1) that passes these IDs
+    void (*handler)(void *context, CanMessage &message);
+};
+
+/**
+ * @brief Receive counters.
+ */
+struct CanRxStats {
+    uint32_t received;  // frames dispatched to a handler
+    uint32_t unhandled; // frames that passed the hardware filters but have no handler
+    uint32_t overruns;  // RX queue full alerts (frames lost)
+    uint32_t busOff;    // bus-off events, each followed by automatic recovery
+};
+
+/**
+ * @brief Alert-driven CAN receive dispatcher.
+ *
+ * Supplies the dual-mode hardware acceptance filter BajaCan starts the bus with, one filter
+ * per group of related table rows, then blocks its task on the driver's RX alert so frames
+ * are handled as soon as they arrive. Handlers are found through a small open-addressed
+ * index built once from the static table, so lookup cost does not grow with the number of
+ * IDs handled.
+ */
+class CanDispatcher {
+public:
+    /**
+     * @brief Construct a dispatcher over a static receive table.
+     * @param can CAN transport used to decode frames.
+     * @param entries Table rows, covering fewer than CAN_RX_SLOTS IDs in total.
+     * @param entryCount Number of rows.
+     * @param context Passed to every handler.
+     */
+    CanDispatcher(BajaCan &can, const CanRxEntry *entries, uint8_t entryCount, void *context);
+
+    /**
+     * @brief Acceptance filter passing the table IDs, for BajaCan::begin().
+     *
+     * Each of the two filters spans only the rows assigned to it, so the vehicle inputs and
+     * the calibration block do not widen each other. Standard IDs only; a table that cannot be
+     * filtered gets an accept-all filter and relies on the lookup.
+     */
+    twai_filter_config_t acceptanceFilter() const;
+
+    /**
+     * @brief Enable the receive alerts and start the receive task. Call after the CAN bus is started.
+     */
+    void begin();
+
+    /**
+     * @brief Run the handler registered for a frame's ID, if any.
+     * @param message Received frame.
+     */
+    void dispatch(CanMessage &message);
+
+    /**
+     * @brief Return receive counters.
+     */
+    CanRxStats getStats() const {
+        return stats;
+    }
+
+private:
+    void run();
+    void buildIndex();
+
+    static uint32_t slotFor(uint32_t id) {
+        return (id ^ (id >> 4)) & (CAN_RX_SLOTS - 1);
+    }
+
+    BajaCan &can;
+    const CanRxEntry *entries;
+    uint8_t entryCount;
+    void *context;
+    int8_t index[CAN_RX_SLOTS]; // entry number per slot, -1 when empty
+    CanRxStats stats = {};
+};
+
+#endif // CAN_DISPATCH_H
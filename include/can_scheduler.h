@@ -0,0 +1,132 @@
+#ifndef CAN_SCHEDULER_H
+#define CAN_SCHEDULER_H
+
+#include <Arduino.h>
+#include "driver/twai.h"
+#include "freertos/semphr.h"
+#include "BajaCan.h"
+#include "can_signals.h"
+#include "config.h"
+
+
+/**
+ * @brief Transmit priority classes, highest first.
+ */
+enum CanPriority {
+    CAN_PRIORITY_CRITICAL, // faults and state changes, may fill the TWAI queue
+    CAN_PRIORITY_NORMAL,   // control telemetry
+    CAN_PRIORITY_BULK,     // diagnostics that can wait
+    CAN_PRIORITY_COUNT
+};
+
+/**
+ * @brief One row of the transmit table.
+ */
+struct CanTxEntry {
+    const CanFrameDef *frame;
+    uint16_t periodMs;   // periodic rate, 0 for on-change only
+    CanPriority priority;
+    uint32_t changeMask; // signals (bit i = signal i) whose raw value triggers an immediate send when it changes
+    void (*fill)(void *context, float *values); // samples one value per signal, in table order
+};
+
+/**
+ * @brief Transmit counters.
+ */
+struct CanTxStats {
+    uint32_t sent;
+    uint32_t retried;                      // attempts deferred because the TWAI queue was full
+    uint32_t failed;                       // frames rejected by the driver (bus off, not started)
+    uint32_t coalesced;                    // queued frames replaced by a newer sample of the same frame
+    uint32_t dropped[CAN_PRIORITY_COUNT];  // oldest frames discarded because a priority queue was full
+    uint32_t droppedMessages;              // oldest one-off messages discarded because their queue was full
+};
+
+/**
+ * @brief Table-driven CAN transmit scheduler.
+ *
+ * A dedicated task samples each table entry at its own period or when one of its
+ * change-triggering signals moves, queues the packed frame in a bounded per-priority
+ * queue with drop-oldest semantics, and feeds the TWAI driver highest priority first.
+ * Non-critical frames are held back while the TWAI queue already has
+ * CAN_TX_INFLIGHT_LIMIT frames pending, so a busy bus cannot starve critical frames.
+ * One-off BajaCan messages such as protocol replies wait in their own queue and go out
+ * after the bulk table frames.
+ */
+class CanScheduler {
+public:
+    /**
+     * @brief Construct a scheduler over a static transmit table.
+     * @param can CAN transport used to send one-off messages.
+     * @param entries Table rows (at most CAN_TX_MAX_ENTRIES).
+     * @param entryCount Number of rows.
+     * @param context Passed to every fill function.
+     */
+    CanScheduler(BajaCan &can, const CanTxEntry *entries, uint8_t entryCount, void *context);
+
+    /**
+     * @brief Start the scheduler task. Call after the TWAI driver is running.
+     */
+    void begin();
+
+    /**
+     * @brief Return transmit counters.
+     */
+    CanTxStats getStats() const {
+        return stats;
+    }
+
+    /**
+     * @brief Queue a one-off message at the lowest priority. Safe from any task; the oldest
+     * queued message is dropped when the queue is full.
+     * @param message Message to send.
+     */
+    void sendMessage(const CanMessage &message);
+
+    /**
+     * @brief Free slots in the one-off message queue, so a burst can wait instead of being dropped.
+     */
+    uint8_t messageSpace();
+
+    /**
+     * @brief One scheduler pass: sample due entries, then drain the queues.
+     * @param nowMs Current time in milliseconds.
+     */
+    void service(uint32_t nowMs);
+
+private:
+    struct QueuedFrame {
+        const CanFrameDef *frame;
+        uint8_t data[8];
+    };
+
+    struct PriorityQueue {
+        QueuedFrame frames[CAN_TX_QUEUE_DEPTH];
+        uint8_t head;  // oldest frame
+        uint8_t count;
+    };
+
+    void run();
+    bool signalsChanged(uint8_t index, const uint8_t data[8]) const;
+    void enqueue(CanPriority priority, const CanFrameDef *frame, const uint8_t data[8]);
+    void drain();
+    void drainMessages(uint32_t pending);
+
+    BajaCan &can;
+    const CanTxEntry *entries;
+    uint8_t entryCount;
+    void *context;
+
+    uint32_t lastSentMs[CAN_TX_MAX_ENTRIES];
+    uint8_t lastData[CAN_TX_MAX_ENTRIES][8]; // payload of the last queued frame, for change detection
+    bool hasSent[CAN_TX_MAX_ENTRIES];
+    PriorityQueue queues[CAN_PRIORITY_COUNT];
+    CanMessage messages[CAN_TX_MESSAGE_DEPTH];
+    uint8_t messageHead = 0;  // oldest message
+    uint8_t messageCount = 0;
+    SemaphoreHandle_t messageLock; // guards the message queue and droppedMessages
+    StaticSemaphore_t messageLockBuffer;
+    CanTxStats stats = {};
+};
+
+#endif // CAN_SCHEDULER_H
@@ -0,0 +1,109 @@
+#ifndef CAN_SIGNALS_H
+#define CAN_SIGNALS_H
+
+#include <stdint.h>
+
+/**
+ * @file can_signals.h
+ * @brief Table-driven packing of scaled fixed-width signals into 8-byte CAN frames.
+ *
+ * Signals use DBC conventions: Intel (little-endian) bit numbering, raw = (value - offset) / scale.
+ * This header has no Arduino dependencies so logging tools can share the decoder.
+ */
+
+/**
+ * @brief One signal inside a frame.
+ */
+struct CanSignal {
+    const char *name;
+    uint8_t startBit; // bit position of the LSB, Intel byte order
+    uint8_t length;   // width in bits, 1..32
+    bool isSigned;
+    float scale;      // physical value = raw * scale + offset
+    float offset;
+};
+
+/**
+ * @brief A frame and the signals packed into it.
+ */
+struct CanFrameDef {
+    const char *name;
+    uint32_t id;
+    uint8_t dlc;
+    const CanSignal *signals;
+    uint8_t signalCount;
+};
+
+/**
+ * @brief ECVT telemetry frame IDs.
+ */
+#define ECVT_SPEED_FRAME_ID 0x610
+#define ECVT_MOTOR_FRAME_ID 0x611
+#define ECVT_STATUS_FRAME_ID 0x612
+
+/**
+ * @brief Signal order in ECVT_SPEED_FRAME.
+ */
+enum EcvtSpeedSignal {
+    SPEED_ENGINE_RPM,
+    SPEED_TARGET_RPM,
+    SPEED_VEHICLE_SPEED,
+    SPEED_SIGNAL_COUNT
+};
+
+/**
+ * @brief Signal order in ECVT_MOTOR_FRAME.
+ */
+enum EcvtMotorSignal {
+    MOTOR_SETPOINT,
+    MOTOR_POSITION,
+    MOTOR_VELOCITY,
+    MOTOR_SIGNAL_COUNT
+};
+
+/**
+ * @brief Signal order in ECVT_STATUS_FRAME.
+ */
+enum EcvtStatusSignal {
+    STATUS_CONTROL_MODE,
+    STATUS_BRAKE,
+    STATUS_LIMIT_SWITCH,
+    STATUS_BRAKE_PROFILE,
+    STATUS_LAUNCH_STATE,
+    STATUS_DRIVER_FAULT,
+    STATUS_DEADLINE_MISSES,
+    STATUS_CONTROL_LATENCY,
+    STATUS_SIGNAL_COUNT
+};
+
+extern const CanFrameDef ECVT_SPEED_FRAME;
+extern const CanFrameDef ECVT_MOTOR_FRAME;
+extern const CanFrameDef ECVT_STATUS_FRAME;
+
+/**
+ * @brief Pack one physical value, saturating to the signal's raw range.
+ */
+void canPackSignal(uint8_t data[8], const CanSignal &signal, float value);
+
+/**
+ * @brief Unpack one signal to its physical value.
+ */
+float canUnpackSignal(const uint8_t data[8], const CanSignal &signal);
+
+/**
+ * @brief Pack values[i] into signal i of the frame. Unused bytes are zeroed.
+ */
+void canPackFrame(const CanFrameDef &frame, const float *values, uint8_t data[8]);
+
+/**
+ * @brief Unpack every signal of the frame into values[i].
+ */
+void canUnpackFrame(const CanFrameDef &frame, const uint8_t data[8], float *values);
+
+/**
+ * @brief Look up an ECVT frame definition by CAN ID.
+ * @return Definition, or nullptr if the ID is not an ECVT frame.
+ */
+const CanFrameDef *canFindFrame(uint32_t id);
+
+#endif // CAN_SIGNALS_H
@@ -39,6 +39,7 @@
  */
 #define LIMIT_SWITCH_PIN GPIO_NUM_39
 #define LIMIT_SWITCH_POS -7500 // in units of steps, location of sheave when limit switch is triggered
+#define LIMIT_SWITCH_THRESHOLD 2000 // raw ADC counts, limit switch is active high
 
 /**
  * @brief Manual mode selector thresholds.
@@ -48,6 +49,26 @@
 #define TORQUE_MODE_THRESHOLD 1500
 #define ACCELERATION_MODE_THRESHOLD 2500
 #define BRAKE_CHECK_MODE_THRESHOLD 3500
+#define MODE_SELECTOR_HYSTERESIS 100 // counts the filtered selector must move past a threshold before the mode changes
+#define MODE_SELECTOR_DEBOUNCE_MS 30 // selector position must be stable this long before it is accepted
+
+/**
+ * @brief Analog input service configuration.
+ *
+ * The mode selector and limit switch are sampled by the ADC1 DMA engine. The brake
+ * input sits on an ADC2 pin, which the ESP32 cannot scan with DMA, so the input task
+ * samples it with one-shot reads between DMA frames instead of the control tick.
+ */
+#define MANUAL_MODE_ADC_CHANNEL ADC1_CHANNEL_0  // GPIO36
+#define LIMIT_SWITCH_ADC_CHANNEL ADC1_CHANNEL_3 // GPIO39
+#define BRAKE_ADC_CHANNEL ADC2_CHANNEL_7        // GPIO27
+
+#define ANALOG_SAMPLE_RATE_HZ 20000 // total ADC1 conversion rate across all scanned channels
+#define ANALOG_FRAME_SAMPLES 64     // conversions per DMA frame, averaged per channel (~3.2 ms per frame)
+#define ANALOG_BRAKE_OVERSAMPLE 4   // one-shot brake conversions averaged per DMA frame
+#define ANALOG_FILTER_ALPHA 0.3f    // low-pass smoothing applied to each oversampled channel
+#define ANALOG_TASK_PRIORITY 2
+#define ANALOG_TASK_CORE 0
 
 
 
@@ -58,6 +79,21 @@
 #define CONTROLLER_TIMER_RATE 50 // Control timer rate in milliseconds
 #define MOTOR_TIMER_RATE 10       // Motor timer rate in milliseconds
 
+/**
+ * @brief Control tick scheduling.
+ *
+ * In event-driven mode the control law runs when a sensor reports fresh data (engine
+ * RPM estimate, brake change, encoder movement), capped at CONTROLLER_MIN_PERIOD_MS.
+ * CONTROLLER_TIMER_RATE remains the fallback period when nothing changes.
+ */
+#define CONTROLLER_EVENT_DRIVEN 1    // 1 = event-driven control task, 0 = fixed-rate FreeRTOS timer
+#define CONTROLLER_MIN_PERIOD_MS 5   // rate cap for event-driven ticks
+#define CONTROLLER_DEADLINE_US 2000  // allowed time from the first pending event, or the rate cap's release if later, to the end of the tick
+#define CONTROLLER_TASK_PRIORITY 3
+#define CONTROLLER_TASK_CORE 1
+#define RPM_SAMPLE_PERIOD_MS 20      // engine RPM sample window, independent of the control tick
+#define RPM_FILTER_ALPHA 0.2f        // low-pass weight of each new RPM sample
+
 /**
  * @brief DRV8462 motor driver configuration.
  */
@@ -77,8 +113,67 @@
 // value from 0-255 to set the motor current
 #define RUN_MOTOR_CURRENT 120 
 #define HOLD_MOTOR_CURRENT 80 
+#define MOTOR_MAX_ACCELERATION_POS 30000  // steps/s^2 while moving toward the engine (closing the sheave)
+#define MOTOR_MAX_ACCELERATION_NEG 120000 // steps/s^2 otherwise, also used by the brake profile
 #define STEPS_PER_REVOLUTION 200 * 16 // 1.8 degree step angle = 200 steps per revolution, 16x microstepping = 3200 steps per revolution
 
+/**
+ * @brief Lumped thermal model of the stepper coils and the DRV8462, and the derating it drives.
+ *
+ * Each node heats with I^2 R at the commanded current (run current while stepping, hold
+ * current otherwise) and cools toward the ambient_temp_c calibration parameter. Current and
+ * closing acceleration are derated on the temperature predicted THERMAL_LOOKAHEAD_S ahead,
+ * reaching THERMAL_MIN_DERATE at the coil limit or the driver OTW threshold.
+ */
+#define THERMAL_MODEL_ENABLED 1
+#define THERMAL_AMBIENT_C 40.0f             // default ambient, under the engine cover
+#define MOTOR_FULL_SCALE_CURRENT_A 8.0f     // peak phase current at current code 255, set by VREF
+#define MOTOR_PHASE_RESISTANCE_OHM 0.6f     // per phase at 25 C
+#define MOTOR_COIL_RTH_C_PER_W 3.0f         // coil to ambient
+#define MOTOR_COIL_TAU_S 900.0f
+#define MOTOR_COIL_DERATE_C 110.0f          // derating starts with the predicted coil above this
+#define MOTOR_COIL_LIMIT_C 130.0f           // class B insulation
+#define DRIVER_RDS_ON_OHM 0.1f              // high side plus low side of one bridge, hot
+#define DRIVER_QUIESCENT_W 0.15f
+#define DRIVER_RTH_C_PER_W 22.0f            // junction to ambient on the board
+#define DRIVER_TAU_S 30.0f
+#define DRIVER_DERATE_C 120.0f              // derating starts with the predicted junction above this
+#define DRIVER_OTW_C 140.0f                 // DRV8462 overtemperature warning, typical; shutdown is at 165 C
+#define THERMAL_LOOKAHEAD_S 20.0f
+#define THERMAL_MIN_DERATE 0.6f             // lowest fraction of current and closing acceleration
+#define THERMAL_DERATE_STEP 0.05f           // smallest derate change that rewrites the current registers
+#define THERMAL_MAX_RTH_SCALE 2.0f          // most an OTW may raise the driver thermal resistance
+
+/**
+ * @brief Decay mode and silentstep selection by commanded step rate.
+ *
+ * The motor tick sorts the planner's step rate into three bands: quiet (silentstep over
+ * ripple control) for holding and slow trims, cruise, and torque near the top speed where
+ * dynamic decay keeps the current following the step table. A band is entered past its
+ * threshold and left DECAY_HYSTERESIS below it. Shifts to a faster band are written on the
+ * tick that needs them; shifts to a slower one wait DECAY_DOWNSHIFT_MS. Nothing is written
+ * during a brake profile.
+ */
+#define DECAY_SCHEDULING_ENABLED 1
+#define DECAY_QUIET_MAX_HZ 3200             // one revolution per second
+#define DECAY_TORQUE_MIN_HZ 40000           // half the planner's top speed
+#define DECAY_HYSTERESIS 0.2f               // fraction below a threshold before leaving its band
+#define DECAY_DOWNSHIFT_MS 100
+#define DECAY_QUIET DECAY_SMART_RIPPLE      // CTRL1 DECAY under silentstep, used if silentstep faults
+#define DECAY_CRUISE DECAY_SMART_RIPPLE
+#define DECAY_TORQUE DECAY_SMART_DYNAMIC
+#define SILENTSTEP_ENABLE 1                 // silentstep in the quiet band
+
+/**
+ * @brief Use silentstep loop parameters from the TI tuning tool instead of the device defaults.
+ */
+#define SILENTSTEP_USE_TUNED_PARAMS 0
+#define SILENTSTEP_TUNED_CTRL1 0x00         // without EN_SS, which the decay scheduler owns
+#define SILENTSTEP_TUNED_CTRL2 0x00
+#define SILENTSTEP_TUNED_CTRL3 0x00
+#define SILENTSTEP_TUNED_CTRL4 0x00
+#define SILENTSTEP_TUNED_CTRL5 0x00
+
 /**
  * @brief Auto torque (ATQ) configuration.
  */
@@ -135,12 +230,43 @@
  */
 #define BRAKE_THRESHOLD 0.5f // threshold for brake pedal position to switch to brake
 #define BRAKE_PIN GPIO_NUM_27
+#define BRAKE_ON_THRESHOLD 1000   // raw ADC counts above which the brake reads as pressed
+#define BRAKE_OFF_THRESHOLD 800   // raw ADC counts below which the brake reads as released
+#define BRAKE_RELEASE_DEBOUNCE_MS 20 // presses are accepted immediately, releases must hold this long
+// #define BRAKE_SWITCH_PIN GPIO_NUM_32 // optional digital brake-light switch, active high, for edge-triggered braking
+
+/**
+ * @brief CAN telemetry configuration. Frame layouts live in can_signals.h, the transmit table in controller.cpp.
+ */
+#define CAN_SPEED_PERIOD_MS 10   // engine rpm frame, 100 Hz
+#define CAN_MOTOR_PERIOD_MS 20   // setpoint and position frame, 50 Hz
+#define CAN_STATUS_PERIOD_MS 100 // status heartbeat; mode, brake, and fault changes are sent immediately
+
+/**
+ * @brief CAN transmit scheduler configuration.
+ */
+#define CAN_TX_TASK_PRIORITY 3
+#define CAN_TX_TASK_CORE 0
+#define CAN_TX_TICK_MS 2         // scheduler pass period
+#define CAN_TX_MAX_ENTRIES 8     // transmit table rows
+#define CAN_TX_QUEUE_DEPTH 8     // frames per priority queue, oldest dropped when full
+#define CAN_TX_MESSAGE_DEPTH 8   // one-off messages (calibration and profiler replies), oldest dropped when full
+#define CAN_TX_INFLIGHT_LIMIT 2  // non-critical frames wait while this many frames are queued in the TWAI driver
+
+/**
+ * @brief CAN receive dispatcher configuration.
+ */
+#define CAN_RX_TASK_PRIORITY 4
+#define CAN_RX_TASK_CORE 0
+#define CAN_RX_SLOTS 32           // handler lookup slots, power of two larger than the number of handled IDs
+#define CAN_BRAKE_TIMEOUT_MS 250  // a CAN brake press is released when BRAKE_POT frames stop this long
+#define CAN_SPEED_TIMEOUT_MS 250  // vehicle speed reads as zero when LINEAR_SPEED frames stop this long
 
 
 /**
  * @brief Secondary RPM thresholds for gear shifting.
  */
-#define SLIP_SPEED ENGINE_ENGAGE_RPM / LOW_GEAR 
+#define SLIP_SPEED (ENGINE_ENGAGE_RPM / LOW_GEAR) // below this the engaging belt is expected to slip
 #define CRUISE_LOW ENGINE_IDEAL_RPM / LOW_GEAR
 #define CRUISE_HIGH ENGINE_IDEAL_RPM / HIGH_GEAR
 
@@ -160,19 +286,162 @@
 #define RPM_Kd 0
 
 
+/**
+ * @brief Launch (acceleration mode) controller tuning.
+ *
+ * Vehicle speeds use the units of the LINEAR_SPEED CAN signal.
+ */
+#define LAUNCH_STAGE_SETPOINT 8000       // sheave position held while staged, just short of belt clamp
+#define LAUNCH_STATIONARY_SPEED 0.5f     // below this the vehicle counts as held stationary
+#define LAUNCH_HANDOFF_SPEED 5.0f        // secondary/wheel speed at which the rpm controller takes over
+#define LAUNCH_RPM_RISE_TRIGGER 3000.0f  // rpm/s engine acceleration that marks a release
+#define LAUNCH_LOOKAHEAD_S 0.15f         // how far ahead the rpm rise is extrapolated when sizing the clamp
+#define LAUNCH_RPM_MARGIN 100            // clamp fully once predicted rpm is within this of the ideal rpm
+#define LAUNCH_MAX_MS 1500               // hand off to the rpm controller after this long regardless
+#define LAUNCH_RPM_RATE_ALPHA 0.3f       // smoothing for the rpm rise-rate estimate
+
+
+/**
+ * @brief Shadow-mode candidate evaluation.
+ *
+ * Candidate setpoint laws run on the same inputs as rpmToSetpoint every tick but never
+ * actuate. Their outputs are compared through a simple plant gain estimate.
+ */
+#define SHADOW_MODE_ENABLED 1
+#define SHADOW_RING_SIZE 256               // compact records kept for download, power of two
+#define SHADOW_DRAIN_PERIOD_MS 50          // records leave the ring at most one frame per period
+#define SHADOW_RECORDS_PER_FRAME 32        // ring records per SHADOW_FRAME_TAG frame or text batch
+#define SHADOW_BUDGET_CYCLES 24000         // per-candidate execution budget (100 us at 240 MHz)
+#define SHADOW_RPM_PER_STEP 0.05f          // estimated engine rpm change per step of sheave travel
+#define SHADOW_PD_KD 0.5f                  // derivative gain tried by the "pd" candidate
+
+
+/**
+ * @brief Online sheave position to ratio calibration.
+ *
+ * While driving, the measured ratio (engine rpm over secondary rpm) is fit against sheave
+ * position by recursive least squares on a piecewise-linear basis, and the fit is stored in
+ * NVS once the car is parked. The secondary speed comes from SECONDARY_HALL_PIN when it is
+ * defined, otherwise from the LINEAR_SPEED CAN signal.
+ */
+#define RATIO_LEARNING_ENABLED 1
+#define RATIO_KNOT_COUNT 9                     // knots spaced evenly from 0 to MAX_MOTOR_SETPOINT
+#define RATIO_SECONDARY_RPM_PER_SPEED 273.97f  // secondary rpm per LINEAR_SPEED unit (m/s, 0.29 m wheel, 8.32:1 gearbox)
+#define RATIO_SPEED_MAX_AGE_MS 200             // older LINEAR_SPEED frames are not used
+#define RATIO_MIN_SECONDARY_RPM 150.0f         // slower than this the speed signal is too coarse
+#define RATIO_MAX_STEP_RATE 2000.0f            // steps/s of sheave motion above which the belt has not settled
+#define RATIO_GATE_SIGMAS 4.0f                 // samples more than this many innovation SDs from the fit are slip or noise
+#define RATIO_FORGETTING 0.9995f               // RLS forgetting factor per accepted sample
+#define RATIO_MEASUREMENT_VARIANCE 0.01f       // ratio^2
+#define RATIO_INITIAL_VARIANCE 0.25f           // ratio^2 of a knot before any sample, and its ceiling
+#define RATIO_SAVE_SAMPLES 500                 // accepted samples before the fit is stored again
+
+
+/**
+ * @brief Belt slip detection and response.
+ *
+ * Slip is the measured ratio above the ratio the learned fit expects at the sheave position,
+ * as a fraction of the expected ratio. It is only judged above SLIP_SPEED and where the fit
+ * is certain, so it needs RATIO_LEARNING_ENABLED.
+ */
+#define SLIP_DETECTION_ENABLED 1
+#define SLIP_ENTER_FRACTION 0.08f  // slip above this for SLIP_ENTER_MS starts an event
+#define SLIP_EXIT_FRACTION 0.04f   // slip at or below this for SLIP_EXIT_MS ends it
+#define SLIP_ENTER_MS 60
+#define SLIP_EXIT_MS 200
+#define SLIP_MAX_FIT_SD 0.1f       // knots less certain than this do not judge slip
+
+#define SLIP_RESPONSE_NONE 0       // detect and log only
+#define SLIP_RESPONSE_CLAMP 1      // raise a clamp floor above the position where slip started
+#define SLIP_RESPONSE_HOLD 2       // limit how far each setpoint may move from the position
+#define SLIP_RESPONSE SLIP_RESPONSE_CLAMP
+#define SLIP_CLAMP_RATE 20000      // steps/s the clamp floor rises while slipping
+#define SLIP_CLAMP_MAX_STEPS 3000  // highest the floor rises above the start position
+#define SLIP_HOLD_STEPS 200        // largest setpoint move from the position while slipping
+
+
+
+/**
+ * @brief Serial telemetry stream. Binary frames are decoded on the host with tools/telemetry_decode.py;
+ * set TELEMETRY_BINARY to 0 for plain Teleplot lines readable in a serial monitor.
+ */
+#define TELEMETRY_BINARY 1
+#define TELEMETRY_BAUD 921600
+#define TELEMETRY_PERIOD_MS 5
+#define TELEMETRY_TX_BUFFER_SIZE 1024 // UART transmit buffer so frames are queued instead of blocking loop()
+
+/**
+ * @brief Deferred logging (DLOG). Messages are queued by the caller and printed by a drain task.
+ */
+#define LOG_RING_SIZE 64        // queued messages, power of two
+#define LOG_MAX_ARGS 8          // 32-bit arguments per message
+#define LOG_RATE_LIMIT_MS 100   // each message format is emitted at most once per period
+#define LOG_RATE_SLOTS 32       // formats tracked by the rate limiter
+#define LOG_LINE_MAX 160        // formatted line buffer in text mode
+#define LOG_DRAIN_PERIOD_MS 10
+#define LOG_TASK_PRIORITY 1
+#define LOG_TASK_CORE 0         // opposite the control task
+
+/**
+ * @brief Execution-time profiling (profiler.h). Set PROFILING_ENABLED to 0 to compile it out.
+ *
+ * Budgets are per run; longer runs count as deadline misses. Results are printed with the
+ * "prof" serial command or sent over CAN on request (PROFILE_REQUEST_ID).
+ */
+#define PROFILING_ENABLED 1
+#define PROFILE_LATE_PERCENT 150          // a period longer than this share of nominal counts as late
+#define PROFILE_BUDGET_MOTOR_US 500
+#define PROFILE_BUDGET_CONTROL_US 1000
+#define PROFILE_BUDGET_CAN_TX_US 500
+#define PROFILE_BUDGET_CAN_RX_US 200
+#define PROFILE_BUDGET_RPM_SAMPLE_US 100
+#define PROFILE_BUDGET_ANALOG_US 500
+#define PROFILE_BUDGET_SPI_US 50
+#define PROFILE_BUDGET_TELEMETRY_US 1000
+
+/**
+ * @brief Sensor-to-step latency trace (latency_trace.h), downloaded with the "trace dump" serial command.
+ *
+ * Each rpm sample records about five events, so the ring holds the last few seconds at RPM_SAMPLE_PERIOD_MS.
+ */
+#define LATENCY_TRACE_ENABLED 1
+#define TRACE_RING_SIZE 1024 // events, power of two, 13 bytes each plus a slot word
+
+/**
+ * @brief Step pulse-train capture (step_capture.h), downloaded with the "steps dump" serial command.
+ *
+ * Every moveSteps call records what the planner asked for, what was written to the RMT, and the
+ * pulses counted so far on STEP_LOOPBACK_PIN, which must be jumpered to STEP_PIN on the board.
+ * The simulator wires the loopback itself. Off by default because it takes a PCNT unit and a pin.
+ */
+#define STEP_CAPTURE_ENABLED 0
+#define STEP_CAPTURE_RING_SIZE 1024        // moveSteps calls, power of two; about 10 s of motor ticks
+#define STEP_LOOPBACK_PIN GPIO_NUM_18      // spare input jumpered to STEP_PIN
+#define STEP_LOOPBACK_COUNTER_ID PCNT_UNIT_0
 
 /**
- * @brief Rate-limited debug print macro.
+ * @brief Black-box recorder in the "blackbox" flash partition (partitions.csv), sampled every control tick.
+ *
+ * Flash erase and program stall both cores, so sectors are erased ahead of the write position only
+ * while the engine is below engagement and the car is stopped. The erased runway bounds how long the
+ * car can run without stopping before pages are dropped (roughly 1 KB/s at 100 ticks/s); erasing ahead
+ * also discards the oldest pages, so the rest of the partition is the history kept for download.
  */
-#define DEBUG_RATE_LIMIT_MS 100
-#define debugPrintf(...) do {\
-    static uint32_t lastPrintTime = 0; \
-    uint32_t currentTime = millis(); \
-    if (currentTime - lastPrintTime >= DEBUG_RATE_LIMIT_MS) { \
-        Serial.printf(__VA_ARGS__); \
-        lastPrintTime = currentTime; \
-    } \
-} while(0)
+#define BLACKBOX_ENABLED 1
+#define BLACKBOX_CONTINUOUS 1             // 1 = keep every page (endurance), 0 = keep only windows around triggers
+#define BLACKBOX_PARTITION_SUBTYPE 0x40   // custom data subtype of the blackbox partition
+#define BLACKBOX_PAGE_SIZE 1024           // bytes per page, divides the 4 KB flash sector
+#define BLACKBOX_RAM_PAGES 8              // page buffers between the control task and the writer
+#define BLACKBOX_PRETRIGGER_PAGES 6       // completed pages held as history in triggered mode
+#define BLACKBOX_POST_TRIGGER_MS 5000     // triggered mode keeps recording this long after a trigger
+#define BLACKBOX_ERASE_AHEAD_SECTORS 256  // sectors kept erased ahead of the write position (1 MB)
+#define BLACKBOX_ERASE_WHILE_DRIVING 0    // 1 = erase mid-run when the runway runs out, stalling the control core ~50 ms per sector
+#define BLACKBOX_WRITE_CHUNK 256          // bytes per flash program call, bounds each stall
+#define BLACKBOX_BRAKE_SLAM_RATE 20000    // brake ADC counts/s rise that counts as a brake slam
+#define BLACKBOX_IDLE_POLL_MS 50          // writer wake period for erasing ahead while stopped
+#define BLACKBOX_DUMP_PAGES_PER_PASS 1    // pages sent per loop pass during "bbx dump" (~11 ms of serial each)
+#define BLACKBOX_TASK_PRIORITY 1
+#define BLACKBOX_TASK_CORE 0
 
 
 
@@ -4,8 +4,24 @@
 
 #include "motor.h"
 #include "pulse_counter.h"
+#include "analog_inputs.h"
+#include "launch.h"
+#include "shadow.h"
+#include "can_signals.h"
+#include "can_scheduler.h"
+#include "can_dispatch.h"
+#include "calibration.h"
+#include "telemetry.h"
+#include "blackbox.h"
+#include "profiler.h"
+#include "latency_trace.h"
+#include "snapshot.h"
+#include "ratio_estimator.h"
+#include "slip_detector.h"
+#include "thermal_model.h"
 #include "BajaCan.h"
 #include <string>
+#include <atomic>
 #include "filter.h"
 #include "config.h"
 
@@ -81,6 +97,38 @@ inline std::string controlModeToString(ControlMode mode) {
 }
 
 
+/**
+ * @brief Sources that can wake the event-driven control task.
+ */
+enum ControlEvent : uint32_t {
+    CONTROL_EVENT_RPM = 1 << 0,     // new engine speed estimate
+    CONTROL_EVENT_BRAKE = 1 << 1,   // brake state changed (analog input or CAN frame)
+    CONTROL_EVENT_ENCODER = 1 << 2, // motor encoder moved
+};
+
+/**
+ * @brief Control tick timing statistics, in microseconds.
+ */
+struct ControlTiming {
+    uint32_t ticks;          // control ticks run
+    uint32_t fallbackTicks;  // ticks run by the fallback period with no new data
+    uint32_t deadlineMisses; // ticks that finished later than CONTROLLER_DEADLINE_US after their first event
+    uint32_t lastLatencyUs;  // first pending event, or the rate cap's release if later, to end of tick
+    uint32_t maxLatencyUs;
+    uint32_t lastExecUs;     // time spent in the tick itself
+    uint32_t maxExecUs;
+};
+
+/**
+ * @brief Vehicle-level inputs received over CAN, published by the receive task.
+ */
+struct VehicleInputs {
+    float brakePosition;   // brake pot reading from BRAKE_POT
+    float linearSpeed;     // vehicle speed from LINEAR_SPEED
+    uint32_t brakeTimeMs;  // arrival time of the last BRAKE_POT frame, 0 before the first
+    uint32_t speedTimeMs;  // arrival time of the last LINEAR_SPEED frame, 0 before the first
+};
+
 /**
  * @brief Coordinates CVT control, motor motion, and telemetry.
  */
@@ -97,28 +145,238 @@ class Controller {
         void init();
 
         /**
-         * @brief FreeRTOS timer handle used by main health checks.
+         * @brief FreeRTOS timer handle used by main health checks (fixed-rate mode only).
+         */
+        TimerHandle_t controller_timer = nullptr;
+
+        /**
+         * @brief Control task handle (event-driven mode only).
+         */
+        TaskHandle_t controller_task = nullptr;
+
+        /**
+         * @brief Wake the control task because fresh data is available.
+         * @param events Bitmask of ControlEvent values.
+         */
+        void notify(uint32_t events);
+
+        /**
+         * @brief Send the next batch of shadow-mode records, rate limited.
+         */
+        void drainShadowRecords() {
+            shadow.drainRecords(millis());
+        }
+
+        /**
+         * @brief Print shadow-mode candidate statistics.
+         */
+        void printShadowStats() {
+            shadow.printStats();
+        }
+
+        /**
+         * @brief Return control tick timing statistics.
+         */
+        ControlTiming getTiming() const {
+            return timing;
+        }
+
+        /**
+         * @brief Fill a binary telemetry record with the current controller state.
+         * @param record Record to fill; version and sequence are left to the encoder.
+         */
+        void sampleTelemetry(TelemetryRecord &record);
+
+        /**
+         * @brief Frames dropped by the CAN transmit scheduler across all priorities, one-off messages included.
+         */
+        uint32_t canTxDropped() const {
+            CanTxStats stats = canTx.getStats();
+            uint32_t dropped = stats.droppedMessages;
+            for (int p = 0; p < CAN_PRIORITY_COUNT; p++) {
+                dropped += stats.dropped[p];
+            }
+            return dropped;
+        }
+
+        /**
+         * @brief Return the latest analog input snapshot.
+         */
+        AnalogInputState getAnalogInputs() const {
+            return analogInputs.read();
+        }
+
+        /**
+         * @brief Run deferred calibration work (NVS commits). Call from the Arduino loop.
+         */
+        void serviceCalibration() {
+            calibration.service();
+#if RATIO_LEARNING_ENABLED
+            ratioEstimator.service();
+#endif
+        }
+
+#if RATIO_LEARNING_ENABLED
+        /**
+         * @brief Hold a CVT ratio from the learned fit instead of an engine rpm in the driving modes.
+         * @param ratio Engine rpm over secondary rpm; 0 returns to rpm control.
+         */
+        void commandRatio(float ratio) {
+            targetRatio = ratio;
+        }
+
+        /**
+         * @brief Ratio commanded with commandRatio, 0 under rpm control.
+         */
+        float getTargetRatio() const {
+            return targetRatio;
+        }
+
+        /**
+         * @brief Return the learned ratio against sheave position fit.
+         */
+        RatioFit getRatioFit() const {
+            return ratioEstimator.read();
+        }
+
+        /**
+         * @brief Discard the learned fit and start again from the LOW_GEAR/HIGH_GEAR prior.
+         */
+        void resetRatioFit() {
+            ratioEstimator.reset();
+        }
+#endif
+
+#if THERMAL_MODEL_ENABLED
+        /**
+         * @brief Return the coil and driver thermal model state.
          */
-        TimerHandle_t controller_timer;
+        ThermalState getThermalState() const {
+            return thermal.read();
+        }
+#endif
 
+#if DECAY_SCHEDULING_ENABLED
         /**
-         * @brief Build a human-readable telemetry snapshot.
-         * @return Multi-line log string.
+         * @brief Return the driver decay band, band changes since boot, and whether silentstep is in use.
          */
-        std::string log() {
-            return motor.log() +
-                   "\n>Engine_RPM:" + std::to_string(enginePulseCounter.getFilteredRPM()) +
-                   "\n>brake_state:" + std::to_string(analogRead(BRAKE_PIN) > 1000 ? 1 : 0) +
-                   "\n>manual_mode:" + std::to_string(this->brake_pressed ? 1 : 0) +
-                   "\n>control_mode:" + controlModeToString(this->controlMode) + "|t";
+        DecayBand getDecayBand() const {
+            return motor.getDecayBand();
+        }
+        uint32_t getDecaySwitches() const {
+            return motor.getDecaySwitches();
+        }
+        bool isSilentstepActive() const {
+            return motor.isSilentstepActive();
         }
+#endif
+
+#if SLIP_DETECTION_ENABLED
+        /**
+         * @brief Return belt slip totals and the last slip event.
+         */
+        SlipStats getSlipStats() const {
+            return slip.getStats();
+        }
+#endif
+
+        /**
+         * @brief Return the latest vehicle inputs received over CAN.
+         */
+        VehicleInputs getVehicleInputs() const {
+            return vehicleInputs.read();
+        }
+
+        /**
+         * @brief Start streaming the black-box recording over the serial port. Call from the Arduino loop.
+         */
+        void dumpBlackbox() {
+            blackbox.dump();
+        }
+
+        /**
+         * @brief Send the next pages of a black-box dump in progress. Call on every Arduino loop pass.
+         */
+        void serviceBlackboxDump() {
+            blackbox.serviceDump();
+        }
+
+        /**
+         * @brief Mark the page being recorded and, in triggered mode, keep the history around it.
+         */
+        void triggerBlackbox() {
+            blackbox.trigger(BLACKBOX_TRIGGER_MANUAL);
+        }
+
+        /**
+         * @brief Return black-box recorder counters.
+         */
+        BlackboxStats getBlackboxStats() const {
+            return blackbox.getStats();
+        }
+
+#if PROFILING_ENABLED
+        /**
+         * @brief Send one section of a requested profile export over CAN. Call from the Arduino loop.
+         */
+        void serviceProfiler();
+#endif
+
+        /**
+         * @brief Setpoint law behind rpmToSetpoint: PD on the rpm error, bounded below by an rpm-scheduled floor.
+         * @param cal Parameter set for this tick.
+         * @param rpm Current engine speed.
+         * @param targetRPM Engine speed the mode aims to hold.
+         * @param lastError Previous rpm error, updated in place.
+         * @param position Current motor position in steps.
+         * @param brakeCheck Use the brake-check setpoint ceiling.
+         * @return Motor setpoint in steps.
+         */
+        static int setpointLaw(const CalibrationValues &cal, float rpm, float targetRPM, float &lastError, int position,
+                               bool brakeCheck);
 
     private:
         /**
-         * @brief Periodic control tick executed by the controller timer.
+         * @brief Control tick executed by the control task or the controller timer.
          */
         void timerCallback();
 
+        /**
+         * @brief Event-driven control task body: wait for fresh data, rate-cap, and run the tick.
+         */
+        void taskLoop();
+
+        /**
+         * @brief Update timing statistics after a tick.
+         * @param startUs Time the tick started.
+         * @param eventUs Time latency is measured from, or 0 for a fallback tick.
+         */
+        void recordTiming(uint32_t startUs, uint32_t eventUs);
+
+        /**
+         * @brief Adopt a newly applied calibration set. Only called at the start of a tick.
+         */
+        void applyCalibration();
+
+        /**
+         * @brief Write the calibrated motor current and acceleration limits, scaled by the thermal derate.
+         * @param current Also rewrite the driver current registers.
+         */
+        void applyMotorLimits(bool current);
+
+#if THERMAL_MODEL_ENABLED
+        /**
+         * @brief Advance the thermal model with the planner's duty and adjust the derate.
+         * @param fault FAULT register read this tick.
+         */
+        void updateThermal(uint16_t fault);
+#endif
+
+        /**
+         * @brief Engine rpm the current mode aims to hold.
+         */
+        float targetRPM() const;
+
         /**
          * @brief Translate engine RPM into a sheave position setpoint.
          * @param engineRPM Current engine speed.
@@ -126,6 +384,30 @@ class Controller {
          */
         int rpmToSetpoint(float engineRPM);
 
+        /**
+         * @brief Sheave position for the commanded ratio, if one is commanded.
+         * @param engineRPM Current engine speed; below engagement the idle setpoint is held.
+         * @param setpoint Output motor setpoint, written when a ratio is commanded.
+         * @return True if setpoint was written, false to fall back to the launch and rpm controllers.
+         */
+        bool ratioSetpoint(float engineRPM, int32_t &setpoint);
+
+#if RATIO_LEARNING_ENABLED
+        /**
+         * @brief Secondary speed from SECONDARY_HALL_PIN, or from a fresh LINEAR_SPEED frame.
+         * @param rpm Output secondary rpm.
+         * @return False if there is no fresh measurement.
+         */
+        bool secondaryRPM(float &rpm);
+
+        /**
+         * @brief Judge belt slip and feed the ratio fit from the current ratio, or let the fit
+         * save while parked.
+         * @param engineRPM Engine speed from a fresh sample.
+         */
+        void observeBelt(float engineRPM);
+#endif
+
         /**
          * @brief Perform the limit-switch homing sequence.
          * @return Motor setpoint for the current homing step.
@@ -138,30 +420,146 @@ class Controller {
         void resetHomingRoutine();
 
         /**
-         * @brief Publish telemetry over CAN.
+         * @brief CAN transmit table fill functions, called from the transmit task.
+         * @param controller Controller instance.
+         * @param values One physical value per signal, in frame order.
+         */
+        static void fillSpeedFrame(void *controller, float *values);
+        static void fillMotorFrame(void *controller, float *values);
+        static void fillStatusFrame(void *controller, float *values);
+
+        static const CanTxEntry canTxTable[];
+        static const uint8_t canTxTableSize;
+
+        /**
+         * @brief CAN receive table handlers, called from the receive task.
+         * @param controller Controller instance.
+         * @param message Received frame.
+         */
+        static void onBrakePot(void *controller, CanMessage &message);
+        static void onLinearSpeed(void *controller, CanMessage &message);
+        static void onCalibrationCommand(void *controller, CanMessage &message);
+        static void onCalibrationWrite(void *controller, CanMessage &message);
+#if PROFILING_ENABLED
+        static void onProfileRequest(void *controller, CanMessage &message);
+#endif
+
+        static const CanRxEntry canRxTable[];
+        static const uint8_t canRxTableSize;
+
+        /**
+         * @brief Brake fast path: retract the sheave immediately on press, release on let-off.
+         *
+         * Called from the input task, the CAN receive task, the control task, or the brake switch ISR.
          */
-        void sendCan();
+        void brakeChanged();
+
+#ifdef BRAKE_SWITCH_PIN
+        /**
+         * @brief Brake switch interrupt: latch the switch and retract at once in a driving mode.
+         * In IRAM so it still runs while a flash write has the cache disabled.
+         * @param controller Controller instance.
+         */
+        static void IRAM_ATTR onBrakeSwitch(void *controller);
+#endif
+
+        /**
+         * @brief Drop CAN inputs whose frames have stopped: release a CAN brake press after
+         * CAN_BRAKE_TIMEOUT_MS and report zero speed after CAN_SPEED_TIMEOUT_MS.
+         * Called at the start of each tick.
+         */
+        void expireCanInputs();
+
+        /**
+         * @brief True in modes where the rpm controller drives the sheave and braking applies.
+         */
+        bool isDrivingMode() const {
+            return controlMode == POWER || controlMode == TORQUE ||
+                   controlMode == BRAKE_CHECK || controlMode == ACCELERATION;
+        }
+
+        /**
+         * @brief Sheave position to retreat to while braking: the launch staging point when a launch is staged.
+         */
+        int brakeSetpoint() const {
+            return (controlMode == ACCELERATION && launch.isStaged()) ? LAUNCH_STAGE_SETPOINT : HOME_POSITION;
+        }
+
+        /**
+         * @brief Brake, limit switch, and brake profile state as TelemetryFlag bits.
+         * @param inputs Latest analog input snapshot.
+         */
+        uint8_t statusFlags(const AnalogInputState &inputs) const {
+            uint8_t flags = (this->brake_pressed ? TELEMETRY_FLAG_BRAKE : 0) |
+                            (inputs.limitSwitch ? TELEMETRY_FLAG_LIMIT_SWITCH : 0) |
+                            (motor.isBraking() ? TELEMETRY_FLAG_BRAKE_PROFILE : 0);
+#if SLIP_DETECTION_ENABLED
+            flags |= slip.isSlipping() ? TELEMETRY_FLAG_SLIP : 0;
+#endif
+            flags |= this->thermalDerate < 1.0f ? TELEMETRY_FLAG_DERATE : 0;
+            return flags;
+        }
 
         /**
-         * @brief Consume CAN commands for mode and brake state.
+         * @brief Record the finished tick in the black box.
+         * @param engineRPM Engine speed the tick used.
+         * @param inputs Analog input snapshot the tick used.
          */
-        void readCan();
+        void recordBlackbox(float engineRPM, const AnalogInputState &inputs);
 
         /**
-         * @brief Update control mode based on manual mode input.
+         * @brief Update control mode based on the debounced mode selector.
+         * @param inputs Latest analog input snapshot.
          */
-        void setMode();
+        void setMode(const AnalogInputState &inputs);
 
         float last_Error;
-        float brake_pos = 0.0f;
+        float linear_speed = 0.0f;
         bool brake_pressed = false;
+        uint16_t last_fault = 0;
+        std::atomic<bool> analog_brake_pressed{false};
+        std::atomic<bool> can_brake_pressed{false};
+        std::atomic<bool> switch_brake_pressed{false};
         bool homingFirstTrigger = false;
         unsigned long homingTriggerTime = 0;
         Motor motor;
+        LaunchController launch;
+        ShadowEvaluator shadow;
         PulseCounter enginePulseCounter;
+#ifdef SECONDARY_HALL_PIN
+        PulseCounter secondaryPulseCounter;
+#endif
+        AnalogInputs analogInputs;
         BajaCan can;
+        CanScheduler canTx;
+        CanDispatcher canRx;
+        Snapshot<VehicleInputs> vehicleInputs;
+        VehicleInputs canRxState = {}; // receive task's working copy of vehicleInputs
+        Calibration calibration;
+        Blackbox blackbox;
+        CalibrationValues cal;       // parameter set used by the current tick
+        uint32_t calSequence = 0;    // calibration sequence cal was taken from
         ControlMode controlMode = HOMING;
         float last_speed = 0.0f;
+#if RATIO_LEARNING_ENABLED
+        RatioEstimator ratioEstimator;
+        std::atomic<float> targetRatio{0.0f}; // commanded ratio, 0 under rpm control
+#endif
+#if SLIP_DETECTION_ENABLED
+        SlipDetector slip;
+#endif
+#if THERMAL_MODEL_ENABLED
+        ThermalModel thermal;
+        uint32_t thermalLastUs = 0;
+        uint32_t thermalLastSteppingUs = 0;
+#endif
+        std::atomic<float> thermalDerate{1.0f}; // applied fraction of current and closing acceleration
+        std::atomic<uint32_t> pendingSinceUs{0}; // time of the first event since the last tick, 0 when none
+        ControlTiming timing = {};
+        uint32_t tracedSample = 0; // last rpm sample traced through the control tick
+#if PROFILING_ENABLED
+        std::atomic<int> profileExport{PROFILE_SECTION_COUNT}; // next section to export over CAN, PROFILE_SECTION_COUNT when idle
+#endif
 };
 
 
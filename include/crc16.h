@@ -0,0 +1,24 @@
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Update a CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) with a block of bytes.
+ * @param crc Running CRC, 0xFFFF for a new message.
+ * @param data Bytes to add.
+ * @param length Number of bytes.
+ * @return Updated CRC.
+ */
+inline uint16_t crc16Update(uint16_t crc, const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+#endif // CRC16_H
@@ -0,0 +1,120 @@
+#ifndef DEFERRED_LOG_H
+#define DEFERRED_LOG_H
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include "config.h"
+
+
+/**
+ * @brief Queue a printf-style message without formatting or touching the UART.
+ *
+ * The format must be a string literal: its address is the message ID, and the host
+ * decoder recovers the text from the firmware ELF. Arguments are stored as raw 32-bit
+ * words (integers, floats, or pointers to static strings). Safe from any task or ISR.
+ */
+#define DLOG(format, ...) do { \
+    static const char dlogFormat[] = format; \
+    deferredLog.write(dlogFormat, ##__VA_ARGS__); \
+} while (0)
+
+/**
+ * @brief One queued message.
+ */
+struct LogEntry {
+    const char *format;
+    uint32_t timestampUs;
+    uint8_t argCount;
+    uint32_t args[LOG_MAX_ARGS];
+};
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint32_t>::type
+logWord(T value) {
+    return static_cast<uint32_t>(value);
+}
+
+inline uint32_t logWord(double value) {
+    float narrowed = value;
+    uint32_t word;
+    memcpy(&word, &narrowed, sizeof(word));
+    return word;
+}
+
+inline uint32_t logWord(const void *pointer) {
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(pointer));
+}
+
+/**
+ * @brief Lock-free multi-producer, single-consumer log ring drained by a low-priority task.
+ *
+ * Producers claim a slot with one compare-and-swap and publish it with a per-slot sequence
+ * number, so they never wait on the consumer or on each other's copies; a full ring drops
+ * the message and counts it. The drain task formats messages (or forwards them as binary
+ * frames when TELEMETRY_BINARY is set) and applies the per-message rate limit.
+ */
+class DeferredLog {
+public:
+    DeferredLog();
+
+    /**
+     * @brief Start the drain task.
+     */
+    void begin();
+
+    template <typename... Args>
+    void write(const char *format, Args... args) {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many DLOG arguments");
+        const uint32_t words[] = {0, logWord(args)...}; // leading 0 keeps the array non-empty
+        push(format, words + 1, sizeof...(Args));
+    }
+
+    /**
+     * @brief Pop one message. Only the drain task may call this.
+     * @return False if the ring is empty.
+     */
+    bool pop(LogEntry &entry);
+
+    /**
+     * @brief Format a message as the firmware would have printed it.
+     * @return Length written, excluding the terminator.
+     */
+    static size_t format(const LogEntry &entry, char *out, size_t size);
+
+    /**
+     * @brief Messages dropped because the ring was full.
+     */
+    uint32_t getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> sequence;
+        LogEntry entry;
+    };
+
+    struct RateLimit {
+        const char *format;
+        uint32_t lastMs;
+        uint16_t suppressed;
+    };
+
+    void push(const char *format, const uint32_t *args, uint8_t argCount);
+    void run();
+    bool allow(const char *format, uint32_t nowMs, uint16_t &suppressed);
+    void emit(const LogEntry &entry, uint16_t suppressed);
+
+    Slot slots[LOG_RING_SIZE];
+    std::atomic<uint32_t> head;  // next position producers claim
+    uint32_t tail = 0;           // next position the consumer reads
+    std::atomic<uint32_t> dropped;
+    uint32_t reportedDropped = 0;
+    RateLimit rateLimits[LOG_RATE_SLOTS];
+};
+
+extern DeferredLog deferredLog;
+
+#endif // DEFERRED_LOG_H
@@ -0,0 +1,86 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "telemetry.h"
+#include "config.h"
+
+/**
+ * @file latency_trace.h
+ * @brief Sensor-to-step latency tracing.
+ *
+ * Each stage of the rpm-to-STEP pipeline records an esp_timer timestamp tagged with the
+ * engine rpm sample ID (PulseCounter::getSampleCount) it is acting on, so the host can line
+ * the stages up per sample. TRACE_EVENT compiles to nothing with LATENCY_TRACE_ENABLED 0.
+ * tools/latency_trace.py downloads the ring ("trace dump") and writes Chrome trace JSON.
+ */
+
+#define TRACE_EVENTS_PER_FRAME 32
+
+/**
+ * @brief Pipeline stages, in the order a sample passes through them.
+ */
+enum TraceStage : uint8_t {
+    TRACE_RPM_SAMPLE,   // PulseCounter::getRPM produced the sample; value = sample window in us
+    TRACE_CONTROL_TICK, // control tick picked up the sample
+    TRACE_SETPOINT,     // rpmToSetpoint result handed to Motor::setSetpoint; value = setpoint steps
+    TRACE_MOTOR_TICK,   // motor tick planned toward the new setpoint; value = setpoint steps
+    TRACE_STEP,         // first moveSteps call with pulses for the setpoint; value = steps
+    TRACE_STAGE_COUNT
+};
+
+/**
+ * @brief One trace event as sent to the host, little-endian, no padding.
+ */
+struct __attribute__((packed)) TraceEvent {
+    uint32_t timestampUs; // esp_timer, wraps after about 71 minutes
+    uint32_t sampleId;
+    int32_t value;
+    uint8_t stage;        // TraceStage
+};
+
+#if LATENCY_TRACE_ENABLED
+
+#define TRACE_EVENT(stage, sampleId, value) latencyTrace.record(stage, sampleId, value)
+
+/**
+ * @brief Fixed-size ring of the most recent trace events.
+ *
+ * Any task or timer may record. Writers claim a position with one atomic increment and
+ * overwrite the oldest event, so recording never blocks or fails. Each slot carries the
+ * position it holds, and the dump skips slots that are overwritten while it reads them.
+ */
+class LatencyTrace {
+public:
+    LatencyTrace();
+
+    /**
+     * @brief Record a stage for a sample. Sample ID 0 means "no sample" and is ignored.
+     * @param stage Pipeline stage.
+     * @param sampleId Engine rpm sample the stage is acting on.
+     * @param value Stage-specific value.
+     */
+    void record(TraceStage stage, uint32_t sampleId, int32_t value);
+
+    /**
+     * @brief Send the ring oldest first as TRACE_FRAME_TAG frames, then an empty end frame.
+     */
+    void dump();
+
+private:
+    RingSlot<TraceEvent> slots[TRACE_RING_SIZE];
+    std::atomic<uint32_t> head; // next position to claim
+    TaggedFrameWriter<TRACE_EVENTS_PER_FRAME * sizeof(TraceEvent)> writer;
+};
+
+extern LatencyTrace latencyTrace;
+
+#else
+
+#define TRACE_EVENT(stage, sampleId, value) do { (void)sizeof(stage); (void)sizeof(sampleId); (void)sizeof(value); } while (0)
+
+#endif // LATENCY_TRACE_ENABLED
+
+#endif // LATENCY_TRACE_H
@@ -0,0 +1,102 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "filter.h"
+#include "calibration.h"
+
+
+/**
+ * @brief Launch state machine phases.
+ */
+enum LaunchState {
+    LAUNCH_IDLE,   // not in acceleration mode
+    LAUNCH_STAGED, // vehicle held stationary, sheave pre-positioned at engagement
+    LAUNCH_ACTIVE, // released, clamping toward low gear
+    LAUNCH_DONE    // handed off to the rpm controller
+};
+
+/**
+ * @brief Timing of one launch, measured from the release in milliseconds (0 = milestone not reached).
+ */
+struct LaunchReport {
+    uint32_t launchCount;   // launches completed since boot
+    uint32_t releaseMs;     // millis() at release
+    uint32_t toEngageMs;    // engine above the engagement rpm
+    uint32_t toIdealRpmMs;  // engine within LAUNCH_RPM_MARGIN of the ideal rpm
+    uint32_t toFullClampMs; // sheave reached the low-gear clamp position
+    uint32_t toHandoffMs;   // rpm controller took over
+    float peakRpm;
+    float handoffSpeed;     // vehicle speed at handoff
+    bool aborted;           // brake applied during the launch
+};
+
+/**
+ * @brief Acceleration-mode launch controller.
+ *
+ * Holds the sheave at LAUNCH_STAGE_SETPOINT while the car is stationary, detects the
+ * release from engine rpm rise rate, brake let-off, or vehicle motion, then commands a
+ * monotonic clamp toward the calibrated low_max_setpoint sized from the extrapolated engine
+ * rpm. The motor planner's acceleration limits turn the step target into a time-optimal move.
+ * Control returns to the rpm controller once the secondary side is moving.
+ */
+class LaunchController {
+public:
+    LaunchController();
+
+    /**
+     * @brief Advance the state machine for one control tick.
+     * @param cal Parameter set of the tick (engagement and ideal rpm, low-gear clamp position).
+     * @param rpm Filtered engine rpm.
+     * @param rpmSample Engine rpm sample ID (PulseCounter's sample count). The rise rate is only
+     * updated when it changes, over the RPM_SAMPLE_PERIOD_MS windows since the last one.
+     * @param speed Measured secondary/vehicle speed.
+     * @param braking True while the brake is applied.
+     * @param position Current sheave position in steps.
+     * @param nowMs Current time in milliseconds.
+     * @param setpoint Output motor setpoint, written when the launch controller owns the sheave.
+     * @return True if setpoint was written, false to fall back to the rpm controller.
+     */
+    bool update(const CalibrationValues &cal, float rpm, uint32_t rpmSample, float speed, bool braking, int position,
+                uint32_t nowMs, int32_t &setpoint);
+
+    /**
+     * @brief Return to idle, e.g. when leaving acceleration mode.
+     */
+    void reset();
+
+    /**
+     * @brief True while the sheave is being held at the staging position.
+     */
+    bool isStaged() const {
+        return state == LAUNCH_STAGED;
+    }
+
+    LaunchState getState() const {
+        return state;
+    }
+
+    /**
+     * @brief Timing of the most recently completed launch.
+     */
+    LaunchReport getLastReport() const {
+        return lastReport;
+    }
+
+private:
+    void start(uint32_t nowMs);
+    void finish(uint32_t nowMs, float speed, bool aborted);
+
+    std::atomic<LaunchState> state{LAUNCH_IDLE};
+    LowPassFilter rateFilter;
+    float rpmRate = 0.0f; // filtered engine acceleration in rpm/s
+    float lastRpm = 0.0f;     // rpm of the previous sample
+    uint32_t lastSample = 0;  // ID of the previous sample
+    bool hasLastSample = false;
+    int32_t clampTarget = 0;
+    LaunchReport report = {};
+    LaunchReport lastReport = {};
+};
+
+#endif // LAUNCH_H
@@ -1,7 +1,7 @@
 #include <Arduino.h>
 #include "DRV8462.h"
 #include "encoder.h"
-#include <string>
+#include <atomic>
 
 
 /**
@@ -24,30 +24,133 @@ class Motor {
 
         /**
          * @brief Read or set motor state in step units.
+         *
+         * setSetpoint optionally tags the setpoint with the engine rpm sample it came from,
+         * so the motor tick and first step pulses for it appear in the latency trace.
          */
         int getPosition();
         int getSetpoint();
+        float getVelocity();
         void setPosition(int position);
-        void setSetpoint(int position);
+        void setSetpoint(int position, uint32_t traceSample = 0);
 
         /**
-         * @brief Create a log snapshot for serial telemetry.
+         * @brief Read the driver fault register.
          */
-        std::string log();
+        uint16_t getFault();
 
         /**
-         * @brief Read the driver fault register.
+         * @brief Read the driver DIAG2 register (overtemperature, stall, standstill).
          */
-        uint16_t getFault();
+        uint16_t getDiagnostics();
+
+        /**
+         * @brief Running total of time the planner has spent stepping, in microseconds. Wraps.
+         *
+         * The driver runs at the run current while stepping and drops to the hold current at
+         * standstill, so the difference between two reads over the interval is the run-current duty.
+         */
+        uint32_t getSteppingUs() const {
+            return steppingUs;
+        }
+
+        /**
+         * @brief Decay band last written to the driver, and how many times it has changed. Safe from any task.
+         */
+        DecayBand getDecayBand() const {
+            return decayBand;
+        }
+        uint32_t getDecaySwitches() const {
+            return decaySwitches;
+        }
+
+        /**
+         * @brief True unless the driver reported a silentstep error and the quiet band fell back.
+         */
+        bool isSilentstepActive() const {
+            return silentstepActive;
+        }
+
+        /**
+         * @brief Band for a commanded step rate, leaving the current band only past its hysteresis.
+         * @param band Current band.
+         * @param speedHz Commanded step rate, either sign.
+         */
+        static DecayBand decayBandFor(DecayBand band, int speedHz);
+
+        /**
+         * @brief Change the driver run and hold current limits.
+         */
+        void setCurrent(uint8_t runCurrent, uint8_t holdCurrent);
+
+        /**
+         * @brief Change the planner acceleration limits in steps/s^2. The brake profile uses the negative limit.
+         */
+        void setAccelerationLimits(int positive, int negative);
+
+        /**
+         * @brief Step count and rate for one planner tick.
+         */
+        struct MotionCommand {
+            int steps;   // signed steps to emit this tick
+            int speedHz; // signed step rate
+        };
+
+        /**
+         * @brief Limit acceleration and velocity toward the setpoint and decelerate to stop on it.
+         * @param setpoint Target position in steps.
+         * @param position Measured position in steps.
+         * @param velocity Measured velocity in steps/s.
+         * @param timeStep Tick period in seconds.
+         * @param maxAcceleration Acceleration limit in steps/s^2.
+         */
+        static MotionCommand plan(int setpoint, int position, float velocity, float timeStep, int maxAcceleration);
 
         /**
          * @brief Reset the home position to the provided step offset.
          */
         void setHome(int homePosition);
+
+        /**
+         * @brief Preempt the current trajectory with a maximum-deceleration move to the target.
+         *
+         * Safe to call from any task. The move is planned immediately on the timer daemon
+         * and later setpoints are ignored until releaseBrake() is called.
+         * @param target Step position to retreat to.
+         */
+        void brake(int target);
+
+        /**
+         * @brief ISR-safe variant of brake().
+         * @param target Step position to retreat to.
+         * @param higherPriorityTaskWoken Set if a context switch should be requested.
+         */
+        void brakeFromISR(int target, BaseType_t *higherPriorityTaskWoken);
+
+        /**
+         * @brief End the brake profile and accept setpoints again.
+         */
+        void releaseBrake();
+
+        /**
+         * @brief True while a brake profile is overriding the setpoint.
+         */
+        bool isBraking() const {
+            return brakeActive;
+        }
+
+        /**
+         * @brief Register a callback invoked from the motor timer when the encoder position changes.
+         * @param callback Function to call.
+         * @param arg Argument passed to the callback.
+         */
+        void setPositionCallback(void (*callback)(void *), void *arg);
         
     private:
         void startTimer();
         void timerCallback();
+        static void applyBrake(void *motor, uint32_t);
+        void scheduleDecay(int speedHz, int64_t nowUs);
 
         DRV8462 driver;
         Encoder encoder;
@@ -56,8 +159,22 @@ class Motor {
         int lastPosition; // in units of steps, used to calculate velocity
         float currentVelocity; // in units of steps/s
         float stepAccumulator; // accumulates fractional steps for sub-step precision
-        static const int maxAcceleration_pos = 30000; // max acceleration in steps/s^2
-        static const int maxAcceleration_neg = 120000; // max acceleration in steps/s^2
+        std::atomic<int> maxAcceleration_pos; // max acceleration in steps/s^2
+        std::atomic<int> maxAcceleration_neg; // max acceleration in steps/s^2, also the brake profile's deceleration
         static const int maxVelocity = 80000; // max velocity in steps/s
         int setpointPosition; // in units of steps
+        int64_t lastTickUs = 0; // time of the previous planner tick, used for the velocity estimate
+        std::atomic<bool> brakeActive{false};
+        std::atomic<int> brakeTarget{0};
+        std::atomic<uint32_t> setpointSample{0}; // rpm sample behind setpointPosition, 0 if untraced
+        uint32_t tracedSample = 0;               // last sample the motor tick traced
+        uint32_t stepPendingSample = 0;          // traced sample still waiting for its first step pulses
+        std::atomic<uint32_t> steppingUs{0};     // time covered by emitted step batches
+        std::atomic<DecayBand> decayBand{DECAY_BAND_QUIET};
+        std::atomic<uint32_t> decaySwitches{0};
+        std::atomic<bool> silentstepActive{true};
+        int64_t downshiftSinceUs = 0;            // first tick the planner asked for a slower band, 0 if not
+        int64_t silentstepCheckUs = 0;           // when to look for a silentstep error, 0 if not due
+        void (*positionCallback)(void *) = nullptr;
+        void *positionCallbackArg = nullptr;
 };
@@ -0,0 +1,153 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * @file profiler.h
+ * @brief Cycle-count profiling of the periodic callbacks, built on the Xtensa CCOUNT register.
+ *
+ * PROFILE_SCOPE(section) at the top of a function times it until it returns. With
+ * PROFILING_ENABLED set to 0 the macro expands to nothing and no profiler code is built.
+ */
+
+#define PROFILE_REQUEST_ID 0x622    // host to controller: 0 = export over CAN, 1 = reset
+#define PROFILE_VALUE_BASE_ID 0x6A0 // controller to host: PROFILE_VALUES_PER_SECTION frames per section
+
+/**
+ * @brief Values exported over CAN for each section, in ID order.
+ */
+enum ProfileValue {
+    PROFILE_VALUE_MEAN_US,
+    PROFILE_VALUE_MAX_US,
+    PROFILE_VALUE_DEADLINE_MISSES,
+    PROFILE_VALUE_JITTER_US, // longest minus shortest entry-to-entry period
+    PROFILE_VALUES_PER_SECTION
+};
+
+/**
+ * @brief Profiled code sections.
+ */
+enum ProfileSection {
+    PROFILE_MOTOR_TICK,    // Motor::timerCallback from the motor timer
+    PROFILE_CONTROL_TICK,  // Controller::timerCallback
+    PROFILE_CAN_TX,        // CanScheduler::service
+    PROFILE_CAN_RX,        // CanDispatcher::dispatch, one received frame
+    PROFILE_RPM_SAMPLE,    // engine rpm sample timer callback
+    PROFILE_ANALOG_FRAME,  // AnalogInputs::processFrame
+    PROFILE_SPI,           // one DRV8462 register transfer
+    PROFILE_TELEMETRY,     // Arduino loop body
+    PROFILE_SECTION_COUNT
+};
+
+#define PROFILE_HISTOGRAM_BINS 32 // bin n counts runs of 2^n to 2^(n+1)-1 cycles
+
+/**
+ * @brief Nominal timing of a section. A period of 0 marks an event-driven section.
+ */
+struct ProfileSectionInfo {
+    const char *name;
+    uint32_t periodUs;
+    uint32_t budgetUs; // runs longer than this count as deadline misses
+};
+
+extern const ProfileSectionInfo profileSections[PROFILE_SECTION_COUNT];
+
+/**
+ * @brief Execution time and period statistics for one section, in CPU cycles.
+ */
+struct ProfileStats {
+    uint32_t count;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t deadlineMisses;  // runs longer than the section budget
+    uint32_t periods;         // entry-to-entry intervals measured
+    uint32_t minPeriodCycles;
+    uint32_t maxPeriodCycles;
+    uint64_t totalPeriodCycles;
+    uint32_t latePeriods;     // intervals more than PROFILE_LATE_PERCENT of the nominal period
+    uint32_t migrated;        // runs discarded because they ended on the other core
+    uint32_t histogram[PROFILE_HISTOGRAM_BINS];
+};
+
+#if PROFILING_ENABLED
+
+/**
+ * @brief Per-section statistics shared by every task and timer.
+ *
+ * CCOUNT is per core, so each run remembers the core it started on and is discarded if it
+ * ends on the other one. Updates take a short spinlock because some sections (SPI) run from
+ * several tasks.
+ */
+class Profiler {
+public:
+    Profiler();
+
+    /**
+     * @brief Record a section entry and its period since the previous entry.
+     * @return Cycle count at entry.
+     */
+    uint32_t begin(ProfileSection section, int core);
+
+    /**
+     * @brief Record a section exit.
+     * @param start Value returned by begin().
+     * @param core Core the section started on.
+     */
+    void end(ProfileSection section, uint32_t start, int core);
+
+    /**
+     * @brief Copy one section's statistics.
+     */
+    ProfileStats getStats(ProfileSection section);
+
+    /**
+     * @brief Clear every section's statistics.
+     */
+    void reset();
+
+    /**
+     * @brief Print one line per section that has run, in microseconds, with its nonzero histogram bins.
+     */
+    void printReport();
+
+private:
+    static void clear(ProfileStats &stats);
+
+    ProfileStats stats[PROFILE_SECTION_COUNT];
+    uint32_t lastStart[PROFILE_SECTION_COUNT];
+    int8_t lastCore[PROFILE_SECTION_COUNT]; // -1 before the first entry
+    portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+};
+
+extern Profiler profiler;
+
+/**
+ * @brief Times the enclosing scope.
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileSection section)
+        : section(section), core(xPortGetCoreID()), start(profiler.begin(section, core)) {}
+
+    ~ProfileScope() {
+        profiler.end(section, start, core);
+    }
+
+private:
+    ProfileSection section;
+    int core;
+    uint32_t start;
+};
+
+#define PROFILE_SCOPE(section) ProfileScope profileScope(section)
+
+#else
+
+#define PROFILE_SCOPE(section) do { } while (0)
+
+#endif // PROFILING_ENABLED
+
+#endif // PROFILER_H
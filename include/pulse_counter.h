@@ -1,6 +1,8 @@
 #include "driver/pcnt.h"
+#include "esp_timer.h"
 #include <Arduino.h>
 #include "filter.h"
+#include "config.h"
 
 /**
  * @brief Hall-effect pulse counter with RPM calculation and filtering.
@@ -25,6 +27,15 @@ public:
      */
     float getRPM();
 
+    /**
+     * @brief Unfiltered RPM from two counter readings, correcting for one int16 wrap between them.
+     * @param currentCount Counter value now.
+     * @param lastCount Counter value at the previous sample.
+     * @param elapsedUs Time between the readings, greater than zero.
+     * @param pulsesPerRevolution Counted edges per revolution.
+     */
+    static float countsToRPM(int16_t currentCount, int16_t lastCount, int64_t elapsedUs, float pulsesPerRevolution);
+
     /**
      * @brief Reset the PCNT unit and RPM state.
      */
@@ -37,12 +48,31 @@ public:
         return filteredRPM;
     }
 
+    /**
+     * @brief Sample RPM on a fixed-period esp_timer instead of from the control tick.
+     * @param periodMs Sample period in milliseconds.
+     * @param callback Called after each new estimate (may be null).
+     * @param arg Argument passed to the callback.
+     */
+    void startSampling(uint32_t periodMs, void (*callback)(void *), void *arg);
+
+    /**
+     * @brief Number of RPM estimates produced since boot.
+     */
+    uint32_t getSampleCount() const {
+        return sampleCount;
+    }
+
 private:
     pcnt_unit_t counterId;
     int magnetCount; // number of magnets on the wheel, used for RPM calculation
     int16_t lastCount = 0;
-    uint32_t lastSampleTimeMs = 0;
+    int64_t lastSampleTimeUs = 0;
     bool hasLastSample = false;
-    LowPassFilter rpmFilter = LowPassFilter(0.2);
+    esp_timer_handle_t sampleTimer = nullptr;
+    void (*sampleCallback)(void *) = nullptr;
+    void *sampleCallbackArg = nullptr;
+    volatile uint32_t sampleCount = 0;
+    LowPassFilter rpmFilter = LowPassFilter(RPM_FILTER_ALPHA);
     float filteredRPM = 0.0f;
 };
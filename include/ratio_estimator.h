@@ -0,0 +1,135 @@
+#ifndef RATIO_ESTIMATOR_H
+#define RATIO_ESTIMATOR_H
+
+#include <atomic>
+#include <stdint.h>
+#include "snapshot.h"
+#include "config.h"
+
+/**
+ * @file ratio_estimator.h
+ * @brief Online fit of CVT ratio against sheave position.
+ *
+ * The ratio is modelled as piecewise linear in sheave steps, with one value per knot and
+ * knots spaced evenly from 0 to MAX_MOTOR_SETPOINT. Each accepted sample touches the two
+ * knots around the sheave position, and recursive least squares with a forgetting factor
+ * tracks belt wear and stretch. The fit starts from LOW_GEAR up to the calibrated low-speed
+ * max setpoint and a straight line to HIGH_GEAR at the calibrated max setpoint. The knot grid
+ * stays on the compiled-in MAX_MOTOR_SETPOINT so a stored fit keeps its meaning when the
+ * setpoint limits are retuned.
+ */
+
+/**
+ * @brief Published fit: ratio and variance at each knot.
+ */
+struct RatioFit {
+    float ratio[RATIO_KNOT_COUNT];
+    float variance[RATIO_KNOT_COUNT]; // ratio^2
+    uint32_t samples;                 // samples accepted since the fit was reset
+};
+
+/**
+ * @brief Recursive least squares ratio estimator.
+ *
+ * update() runs in the control task; ratioAt(), setpointForRatio(), and read() may be called
+ * from any task. NVS writes happen in service(), called from the Arduino loop.
+ */
+class RatioEstimator {
+public:
+    RatioEstimator();
+
+    /**
+     * @brief Load the stored fit, or start from the prior if there is none or it is corrupt.
+     */
+    void begin();
+
+    /**
+     * @brief Fold one measurement into the fit.
+     * @param ratio Measured engine rpm over secondary rpm.
+     * @param position Sheave position in steps.
+     * @return False if the sample is out of range or more than RATIO_GATE_SIGMAS innovation
+     * standard deviations from the fit.
+     */
+    bool update(float ratio, int position);
+
+    /**
+     * @brief Ask service() to store the fit if enough samples arrived since the last save.
+     * Called from the control task while the car is parked.
+     */
+    void requestSave();
+
+    /**
+     * @brief Shape the prior used when no stored fit is found and after reset(). Call from
+     * the control task.
+     * @param lowMaxSetpoint Sheave position where the prior leaves LOW_GEAR.
+     * @param maxSetpoint Sheave position where the prior reaches HIGH_GEAR.
+     */
+    void setPrior(float lowMaxSetpoint, float maxSetpoint) {
+        priorLowMax = lowMaxSetpoint;
+        priorMax = maxSetpoint;
+    }
+
+    /**
+     * @brief Go back to the prior at the next update or save. Safe from any task.
+     */
+    void reset() {
+        resetRequested = true;
+    }
+
+    /**
+     * @brief Store the fit in NVS if a save was requested. Call from the Arduino loop.
+     */
+    void service();
+
+    /**
+     * @brief Fitted ratio at a sheave position.
+     * @param position Sheave position in steps, clamped to the knot span.
+     */
+    float ratioAt(int position) const;
+
+    /**
+     * @brief Variance of the fitted ratio at a sheave position, interpolated between knots.
+     * @param position Sheave position in steps, clamped to the knot span.
+     */
+    float varianceAt(int position) const;
+
+    /**
+     * @brief Most clamped sheave position whose fitted ratio is still at least ratio.
+     *
+     * The fit is made non-increasing first, so noise at one knot cannot fold the curve back.
+     * @param ratio Target ratio.
+     * @return Sheave position in steps, between 0 and MAX_MOTOR_SETPOINT.
+     */
+    int setpointForRatio(float ratio) const;
+
+    /**
+     * @brief Return the latest published fit.
+     */
+    RatioFit read() const {
+        return fit.read();
+    }
+
+    /**
+     * @brief Sheave position of a knot in steps.
+     */
+    static int knotPosition(int knot) {
+        return (int)((int64_t)MAX_MOTOR_SETPOINT * knot / (RATIO_KNOT_COUNT - 1));
+    }
+
+private:
+    RatioFit prior() const;
+    void start(const RatioFit &initial);
+    void publish();
+
+    float theta[RATIO_KNOT_COUNT];                      // ratio at each knot
+    float covariance[RATIO_KNOT_COUNT][RATIO_KNOT_COUNT]; // ratio^2
+    uint32_t samples = 0;
+    uint32_t savedSamples = 0;
+    float priorLowMax = LOW_MAX_SETPOINT;
+    float priorMax = MAX_MOTOR_SETPOINT;
+    Snapshot<RatioFit> fit;
+    std::atomic<bool> saveRequested{false};
+    std::atomic<bool> resetRequested{false};
+};
+
+#endif // RATIO_ESTIMATOR_H
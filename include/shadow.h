@@ -0,0 +1,131 @@
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "calibration.h"
+#include "config.h"
+#include "telemetry.h"
+
+
+/**
+ * @brief Inputs shared by the active controller and every shadow candidate in one tick.
+ */
+struct ShadowInputs {
+    float engineRPM;
+    float targetRPM;
+    float vehicleSpeed;
+    int32_t position;       // sheave position in steps
+    int32_t activeSetpoint; // setpoint produced by rpmToSetpoint this tick
+    uint8_t mode;           // ControlMode
+    uint32_t nowMs;
+    CalibrationValues cal;  // parameter set the active law used this tick
+};
+
+/**
+ * @brief Candidate setpoint law. Must be pure apart from its private state block.
+ * @param inputs Tick inputs.
+ * @param state Per-candidate scratch state, zeroed at boot.
+ * @return Proposed motor setpoint in steps.
+ */
+typedef int32_t (*ShadowLaw)(const ShadowInputs &inputs, float *state);
+
+#define SHADOW_STATE_SIZE 4
+#define SHADOW_MAX_CANDIDATES 4
+
+/**
+ * @brief Entry in the candidate table.
+ */
+struct ShadowCandidate {
+    const char *name;
+    ShadowLaw law;
+};
+
+/**
+ * @brief Compact record of one candidate evaluation (12 bytes), sent little-endian as is.
+ */
+struct __attribute__((packed)) ShadowRecord {
+    uint32_t timeMs;
+    uint8_t candidate;
+    uint8_t mode;
+    int16_t setpointDelta;      // candidate minus active setpoint, saturated
+    int16_t predictedRpmError;  // target rpm minus predicted rpm under the candidate
+    int16_t activeRpmError;     // target rpm minus current rpm under the active law
+};
+
+/**
+ * @brief Per-candidate execution time and error accounting.
+ */
+struct ShadowStats {
+    uint32_t runs;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t overBudget;         // runs longer than SHADOW_BUDGET_CYCLES
+    double sumSquaredRpmError;   // predicted, for RMS comparison against the active law
+    double sumSquaredActiveError;
+};
+
+/**
+ * @brief Runs candidate control laws alongside the active one without actuating them.
+ */
+class ShadowEvaluator {
+public:
+    ShadowEvaluator();
+
+    /**
+     * @brief Run every candidate on this tick's inputs and record the results.
+     */
+    void evaluate(const ShadowInputs &inputs);
+
+    /**
+     * @brief Pop the oldest record from the ring.
+     * @return False if the ring is empty.
+     */
+    bool readRecord(ShadowRecord &record);
+
+    int getCandidateCount() const;
+    const char *getCandidateName(int index) const;
+    ShadowStats getStats(int index) const;
+
+    /**
+     * @brief True if the candidate has run and never exceeded its cycle budget.
+     */
+    bool fitsBudget(int index) const;
+
+    /**
+     * @brief Records lost because the ring was full.
+     */
+    uint32_t getDroppedRecords() const {
+        return droppedRecords;
+    }
+
+    /**
+     * @brief Send up to SHADOW_RECORDS_PER_FRAME records from the ring, at most once per
+     * SHADOW_DRAIN_PERIOD_MS. Binary telemetry sends one SHADOW_FRAME_TAG frame, text
+     * telemetry prints "shadow,..." CSV lines.
+     * @param nowMs Current time.
+     */
+    void drainRecords(uint32_t nowMs);
+
+    /**
+     * @brief Print per-candidate statistics.
+     */
+    void printStats();
+
+private:
+    void pushRecord(const ShadowRecord &record);
+
+    ShadowStats stats[SHADOW_MAX_CANDIDATES];
+    float state[SHADOW_MAX_CANDIDATES][SHADOW_STATE_SIZE];
+    ShadowRecord ring[SHADOW_RING_SIZE];
+    std::atomic<uint32_t> head{0}; // written by the control task
+    std::atomic<uint32_t> tail{0}; // written by the reader
+    uint32_t droppedRecords = 0;
+    uint32_t lastDrainMs = 0;
+#if TELEMETRY_BINARY
+    TaggedFrameWriter<SHADOW_RECORDS_PER_FRAME * sizeof(ShadowRecord)> writer{SHADOW_FRAME_TAG};
+#endif
+};
+
+#endif // SHADOW_H
@@ -0,0 +1,121 @@
+#ifndef SLIP_DETECTOR_H
+#define SLIP_DETECTOR_H
+
+#include <atomic>
+#include <stdint.h>
+#include "snapshot.h"
+#include "config.h"
+
+/**
+ * @file slip_detector.h
+ * @brief Belt slip detection with hysteresis, a clamp or hold response, and event statistics.
+ */
+
+#if SLIP_DETECTION_ENABLED && !RATIO_LEARNING_ENABLED
+#error "SLIP_DETECTION_ENABLED needs RATIO_LEARNING_ENABLED for the expected ratio"
+#endif
+
+/**
+ * @brief One slip event, from the first sample above SLIP_ENTER_FRACTION to the first sample
+ * of the SLIP_EXIT_MS spell at or below SLIP_EXIT_FRACTION.
+ */
+struct SlipEvent {
+    uint32_t startMs;
+    uint32_t durationMs;
+    float peakSlip;       // fraction of the expected ratio
+    float meanSlip;
+    float expectedRatio;  // at the start
+    float secondaryRPM;   // at the start
+    int32_t startPosition; // steps
+    int32_t clampSteps;   // highest the response raised the clamp floor above startPosition
+};
+
+/**
+ * @brief Slip totals since boot.
+ */
+struct SlipStats {
+    uint32_t events;
+    uint32_t totalMs;
+    uint32_t longestMs;
+    float peakSlip;
+    SlipEvent last;       // most recently finished event
+};
+
+/**
+ * @brief Slip state machine, run by the control task on each fresh rpm sample.
+ */
+class SlipDetector {
+public:
+    /**
+     * @brief Judge one sample.
+     * @param measuredRatio Engine rpm over secondary rpm.
+     * @param expectedRatio Ratio the fit expects at the sheave position.
+     * @param secondaryRPM Secondary speed the ratio was measured with.
+     * @param position Sheave position in steps.
+     * @param nowMs Current time in milliseconds.
+     */
+    void update(float measuredRatio, float expectedRatio, float secondaryRPM, int position, uint32_t nowMs);
+
+    /**
+     * @brief No usable sample this tick (braking, parked, slow, or uncertain fit). Ends an event.
+     * @param nowMs Current time in milliseconds.
+     */
+    void idle(uint32_t nowMs);
+
+    /**
+     * @brief Apply the SLIP_RESPONSE policy to a setpoint while an event is open.
+     * @param setpoint Setpoint from the active controller.
+     * @param position Current sheave position in steps.
+     * @param nowMs Current time in milliseconds.
+     * @param maxSetpoint Highest setpoint the response may command.
+     * @return Setpoint to command.
+     */
+    int32_t respond(int32_t setpoint, int position, uint32_t nowMs, int32_t maxSetpoint);
+
+    /**
+     * @brief True while a slip event is open. Safe from any task.
+     */
+    bool isSlipping() const {
+        return slipping;
+    }
+
+    /**
+     * @brief True from the first sample above SLIP_ENTER_FRACTION until the event closes,
+     * including while the event is still waiting out SLIP_ENTER_MS. Control task only.
+     */
+    bool isSuspect() const {
+        return entering || slipping;
+    }
+
+    /**
+     * @brief Most recent slip fraction, 0 without a usable sample.
+     */
+    float getSlip() const {
+        return slip;
+    }
+
+    /**
+     * @brief Return the slip totals. Safe from any task.
+     */
+    SlipStats getStats() const {
+        return published.read();
+    }
+
+private:
+    void finish(uint32_t endMs);
+
+    std::atomic<bool> slipping{false};
+    std::atomic<float> slip{0.0f};
+    bool entering = false;     // above SLIP_ENTER_FRACTION, waiting out SLIP_ENTER_MS
+    bool recovering = false;   // at or below SLIP_EXIT_FRACTION, waiting out SLIP_EXIT_MS
+    uint32_t enterMs = 0;      // first sample above SLIP_ENTER_FRACTION
+    uint32_t confirmMs = 0;    // event confirmed, where the clamp floor starts rising
+    uint32_t recoverMs = 0;    // first sample of the current recovery
+    float slipSum = 0.0f;
+    uint32_t slipSamples = 0;
+    SlipEvent event = {};
+    SlipStats stats = {};
+    Snapshot<SlipStats> published;
+};
+
+#endif // SLIP_DETECTOR_H
@@ -0,0 +1,60 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Single-writer, multi-reader lock-free snapshot of a small struct.
+ *
+ * The writer fills the next slot of a small ring and then publishes its
+ * sequence number. Readers copy the most recently published slot and retry
+ * only if the writer lapped the ring during the copy, so a preempted writer
+ * can never stall a reader.
+ */
+template <typename T, size_t SLOTS = 4>
+class Snapshot {
+public:
+    static_assert(SLOTS >= 3, "Snapshot needs at least three slots");
+
+    Snapshot() : published(0), slots() {}
+
+    /**
+     * @brief Publish a new value. Must only be called from one writer.
+     * @param value Value to publish.
+     */
+    void write(const T& value) {
+        uint32_t next = published.load(std::memory_order_relaxed) + 1;
+        slots[next % SLOTS] = value;
+        published.store(next, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy out the most recently published value.
+     * @return Latest value (default-constructed until the first write).
+     */
+    T read() const {
+        for (;;) {
+            uint32_t seq = published.load(std::memory_order_acquire);
+            T value = slots[seq % SLOTS];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (published.load(std::memory_order_relaxed) - seq < SLOTS - 1) {
+                return value;
+            }
+        }
+    }
+
+    /**
+     * @brief Number of values published so far, used to detect fresh data.
+     */
+    uint32_t sequence() const {
+        return published.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<uint32_t> published;
+    T slots[SLOTS];
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,84 @@
+#ifndef STEP_CAPTURE_H
+#define STEP_CAPTURE_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include "telemetry.h"
+#include "config.h"
+
+/**
+ * @file step_capture.h
+ * @brief Capture of the step pulse trains DRV8462::moveSteps emits.
+ *
+ * Each call records the planner's request next to what was written to the RMT, along with
+ * the running count of pulses seen on a PCNT loopback of the STEP pin, so the host can tell
+ * what actually came out of each batch before the next call stopped it.
+ * STEP_CAPTURE compiles to nothing with STEP_CAPTURE_ENABLED 0. tools/step_verify.py
+ * downloads the ring ("steps dump") and checks it against the planned profile.
+ */
+
+#define STEP_RECORDS_PER_FRAME 12
+
+/**
+ * @brief One moveSteps call as sent to the host, little-endian, no padding.
+ */
+struct __attribute__((packed)) StepCaptureRecord {
+    uint32_t timestampUs;    // esp_timer just before the RMT write, wraps after about 71 minutes
+    int32_t steps;           // requested by the planner, signed by direction
+    int32_t speedHz;         // requested step rate
+    uint32_t loopbackPulses; // pulses counted on the loopback up to this call, wraps at 2^32
+    uint16_t items;          // pulses written to the RMT, 0 if the call wrote nothing
+    uint16_t halfPeriodUs;   // high and low time of each written pulse
+};
+
+#if STEP_CAPTURE_ENABLED
+
+#define STEP_CAPTURE(steps, speedHz, items, halfPeriodUs) stepCapture.record(steps, speedHz, items, halfPeriodUs)
+
+/**
+ * @brief Fixed-size ring of the most recent moveSteps calls, with the same slot protocol as
+ * LatencyTrace so a dump never blocks the motor tick.
+ */
+class StepCapture {
+public:
+    StepCapture();
+
+    /**
+     * @brief Start counting rising edges on STEP_LOOPBACK_PIN. Call once the RMT is set up.
+     */
+    void begin();
+
+    /**
+     * @brief Record one moveSteps call. Called only from the timer daemon task.
+     * @param steps Steps requested, signed.
+     * @param speedHz Step rate requested.
+     * @param items Pulses written to the RMT.
+     * @param halfPeriodUs High and low time of each written pulse.
+     */
+    void record(int32_t steps, int32_t speedHz, uint16_t items, uint16_t halfPeriodUs);
+
+    /**
+     * @brief Send the ring oldest first as STEP_FRAME_TAG frames, then an empty end frame.
+     */
+    void dump();
+
+private:
+    uint32_t readLoopback();
+
+    RingSlot<StepCaptureRecord> slots[STEP_CAPTURE_RING_SIZE];
+    std::atomic<uint32_t> head; // next position to write
+    int16_t lastLoopbackCount = 0;
+    uint32_t loopbackPulses = 0;
+    TaggedFrameWriter<STEP_RECORDS_PER_FRAME * sizeof(StepCaptureRecord)> writer;
+};
+
+extern StepCapture stepCapture;
+
+#else
+
+#define STEP_CAPTURE(steps, speedHz, items, halfPeriodUs) do { (void)sizeof(steps); (void)sizeof(speedHz); (void)sizeof(items); (void)sizeof(halfPeriodUs); } while (0)
+
+#endif // STEP_CAPTURE_ENABLED
+
+#endif // STEP_CAPTURE_H
@@ -0,0 +1,206 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @file telemetry.h
+ * @brief Fixed-layout binary telemetry record with COBS framing for the serial link.
+ *
+ * Each frame is COBS(record || CRC-16 little-endian) followed by a 0x00 delimiter, so a
+ * receiver resynchronizes at the next zero byte after noise or interleaved debug text.
+ * tools/telemetry_decode.py mirrors this layout; bump TELEMETRY_RECORD_VERSION when it changes.
+ */
+
+#define TELEMETRY_RECORD_VERSION 1
+#define LOG_FRAME_TAG 0x80 // first byte of a deferred log frame; telemetry records start with their version
+#define BLACKBOX_FRAME_TAG 0x81 // first byte of a black-box dump frame
+#define TRACE_FRAME_TAG 0x82 // first byte of a latency trace dump frame
+#define STEP_FRAME_TAG 0x83 // first byte of a step capture dump frame
+#define SHADOW_FRAME_TAG 0x84 // first byte of a shadow-mode record frame
+
+/**
+ * @brief Bits of TelemetryRecord::flags.
+ */
+enum TelemetryFlag : uint8_t {
+    TELEMETRY_FLAG_BRAKE = 1 << 0,         // brake pressed (any source)
+    TELEMETRY_FLAG_LIMIT_SWITCH = 1 << 1,  // limit switch active
+    TELEMETRY_FLAG_BRAKE_PROFILE = 1 << 2, // motor brake profile overriding the setpoint
+    TELEMETRY_FLAG_SLIP = 1 << 3,          // belt slip event open
+    TELEMETRY_FLAG_DERATE = 1 << 4,        // thermal derating below full current
+};
+
+/**
+ * @brief One telemetry sample, little-endian, no padding.
+ */
+struct __attribute__((packed)) TelemetryRecord {
+    uint8_t version;
+    uint16_t sequence;       // stamped by the encoder, wraps
+    uint32_t timestampMs;
+    float engineRpm;
+    float targetRpm;
+    float vehicleSpeed;
+    int32_t motorPosition;   // steps
+    int32_t motorSetpoint;   // steps
+    float motorVelocity;     // steps/s
+    uint8_t controlMode;     // ControlMode
+    uint8_t flags;           // TelemetryFlag bits
+    uint8_t launchState;     // LaunchState
+    uint16_t driverFault;
+    uint16_t manualModeRaw;  // ADC counts
+    uint16_t limitSwitchRaw; // ADC counts
+    uint16_t brakeRaw;       // ADC counts
+    uint32_t ctrlLatencyUs;
+    uint32_t deadlineMisses;
+    uint32_t canTxDropped;
+};
+
+/**
+ * @brief Worst-case COBS output size for an input of n bytes, excluding the delimiter.
+ */
+#define COBS_MAX_ENCODED(n) ((n) + (n) / 254 + 1)
+
+#define TELEMETRY_FRAME_MAX (COBS_MAX_ENCODED(sizeof(TelemetryRecord) + 2) + 1)
+
+/**
+ * @brief COBS-encode a block. The output contains no zero bytes and no delimiter.
+ * @param input Bytes to encode.
+ * @param length Number of input bytes.
+ * @param output Buffer of at least COBS_MAX_ENCODED(length) bytes.
+ * @return Number of bytes written.
+ */
+size_t cobsEncode(const uint8_t *input, size_t length, uint8_t *output);
+
+/**
+ * @brief Append the CRC to a tagged body, COBS-encode it, and write the frame to Serial.
+ * @param body Tag byte and payload, with two spare bytes after them for the CRC.
+ * @param length Tag and payload bytes.
+ * @param frame Buffer of at least COBS_MAX_ENCODED(length + 2) + 1 bytes.
+ */
+void sendTaggedFrame(uint8_t *body, size_t length, uint8_t *frame);
+
+/**
+ * @brief Preallocated buffers for tagged frames of up to Capacity payload bytes.
+ */
+template <size_t Capacity>
+class TaggedFrameWriter {
+public:
+    explicit TaggedFrameWriter(uint8_t tag) {
+        body[0] = tag;
+    }
+
+    /**
+     * @brief Payload area, Capacity bytes after the tag.
+     */
+    uint8_t *payload() {
+        return &body[1];
+    }
+
+    /**
+     * @brief Send a frame with the first length payload bytes. Zero sends the tag alone.
+     */
+    void send(size_t length) {
+        sendTaggedFrame(body, 1 + length, frame);
+    }
+
+private:
+    uint8_t body[1 + Capacity + 2]; // tag, payload, CRC
+    uint8_t frame[COBS_MAX_ENCODED(1 + Capacity + 2) + 1];
+};
+
+/**
+ * @brief Ring slot that a dump can copy while the owning task keeps writing.
+ */
+template <typename T>
+struct RingSlot {
+    std::atomic<uint32_t> position; // ring position + 1 once written, 0 while empty or being written
+    T value;
+
+    /**
+     * @brief Overwrite the slot for ring position pos. The slot reads as empty while the value
+     * is copied in, so a concurrent dump sees the old value, the new one, or skips it.
+     */
+    void store(uint32_t pos, const T &newValue) {
+        position.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        value = newValue;
+        position.store(pos + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copy the value written at ring position pos.
+     * @return False if the slot was overwritten or is being written.
+     */
+    bool load(uint32_t pos, T &out) const {
+        uint32_t before = position.load(std::memory_order_acquire);
+        memcpy(&out, &value, sizeof(out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return before == pos + 1 && position.load(std::memory_order_relaxed) == before;
+    }
+};
+
+/**
+ * @brief Send the ring oldest first, PerFrame values to a frame, then an empty end frame.
+ * Slots overwritten during the dump are skipped, so writers are never blocked.
+ * @param slots Ring of Size slots, Size a power of two.
+ * @param end One past the newest position.
+ * @param writer Frame buffers tagged for this ring.
+ */
+template <size_t PerFrame, typename T, size_t Size>
+void dumpRing(const RingSlot<T> (&slots)[Size], uint32_t end, TaggedFrameWriter<PerFrame * sizeof(T)> &writer)
+{
+    static_assert((Size & (Size - 1)) == 0, "ring size must be a power of two");
+    uint32_t start = end > Size ? end - Size : 0;
+    size_t count = 0;
+
+    for (uint32_t pos = start; pos != end; pos++)
+    {
+        T value;
+        if (!slots[pos & (Size - 1)].load(pos, value))
+        {
+            continue; // overwritten or still being written
+        }
+        memcpy(writer.payload() + count * sizeof(T), &value, sizeof(T));
+        if (++count == PerFrame)
+        {
+            writer.send(count * sizeof(T));
+            count = 0;
+        }
+    }
+
+    if (count > 0)
+    {
+        writer.send(count * sizeof(T));
+    }
+    writer.send(0);
+}
+
+/**
+ * @brief Serializes telemetry records into a preallocated frame buffer.
+ */
+class TelemetryEncoder {
+public:
+    /**
+     * @brief Stamp version and sequence, append the CRC, and frame the record.
+     * @param record Record to encode; version and sequence are overwritten.
+     * @return Frame length in bytes, including the trailing delimiter.
+     */
+    size_t encode(TelemetryRecord &record);
+
+    /**
+     * @brief Frame produced by the last encode() call.
+     */
+    const uint8_t *frame() const {
+        return buffer;
+    }
+
+private:
+    uint8_t payload[sizeof(TelemetryRecord) + 2];
+    uint8_t buffer[TELEMETRY_FRAME_MAX];
+    uint16_t sequence = 0;
+};
+
+#endif // TELEMETRY_H
@@ -0,0 +1,86 @@
+#ifndef THERMAL_MODEL_H
+#define THERMAL_MODEL_H
+
+#include <stdint.h>
+#include "snapshot.h"
+#include "config.h"
+
+/**
+ * @file thermal_model.h
+ * @brief Real-time lumped thermal model of the stepper coils and the DRV8462.
+ *
+ * Two first-order nodes, coil and driver junction, each heated by I^2 R at the commanded
+ * current and cooled through a thermal resistance to ambient. With microstepping both phases
+ * together dissipate the peak phase current squared times one phase resistance, and the same
+ * holds for the bridge on-resistance. Auto torque only lowers the real current, so the model
+ * errs hot. An OTW below the modelled warning temperature raises the driver's thermal
+ * resistance so later predictions reach the threshold when the driver does.
+ */
+
+/**
+ * @brief Published model state.
+ */
+struct ThermalState {
+    float coilC;
+    float driverC;
+    float coilPredictedC;   // THERMAL_LOOKAHEAD_S ahead at the present power
+    float driverPredictedC;
+    float coilW;
+    float driverW;
+    float derate;           // fraction of current and closing acceleration, 1 when cool
+    float driverRthScale;   // learned from OTW, 1 until the first warning
+    uint32_t warnings;      // OTW rising edges seen
+    uint32_t shutdowns;     // OTSD rising edges seen
+};
+
+class ThermalModel {
+public:
+    ThermalModel();
+
+    /**
+     * @brief Start both nodes at ambient.
+     * @param ambientC Ambient temperature.
+     */
+    void begin(float ambientC);
+
+    /**
+     * @brief Advance the model.
+     * @param runCurrentA Peak phase current while stepping.
+     * @param holdCurrentA Peak phase current at standstill.
+     * @param duty Fraction of the interval spent stepping, from the motion planner.
+     * @param ambientC Ambient temperature.
+     * @param dtS Interval in seconds.
+     * @return Derate factor, THERMAL_MIN_DERATE to 1.
+     */
+    float update(float runCurrentA, float holdCurrentA, float duty, float ambientC, float dtS);
+
+    /**
+     * @brief Report the driver's overtemperature flags, read from DIAG2 when the FAULT OT bit is set.
+     * @param warning OTW is set.
+     * @param shutdown OTSD is set.
+     * @param ambientC Ambient temperature.
+     */
+    void reportOverTemperature(bool warning, bool shutdown, float ambientC);
+
+    /**
+     * @brief Return the latest state. Safe from any task.
+     */
+    ThermalState read() const {
+        return published.read();
+    }
+
+    /**
+     * @brief Peak phase current of a DRV8462 current code.
+     */
+    static float codeToAmps(float code) {
+        return (code + 1.0f) / 256.0f * MOTOR_FULL_SCALE_CURRENT_A;
+    }
+
+private:
+    ThermalState state = {};
+    bool lastWarning = false;
+    bool lastShutdown = false;
+    Snapshot<ThermalState> published;
+};
+
+#endif // THERMAL_MODEL_H
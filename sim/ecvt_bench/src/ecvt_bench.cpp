@@ -0,0 +1,228 @@
+#include <Arduino.h>
+#include <benchmark/benchmark.h>
+#include "driver/rmt.h"
+#include "sim.h"
+#include "controller.h" // also brings in motor.h, pulse_counter.h, and DRV8462.h, which have no include guards
+#include "config.h"
+
+/**
+ * @file ecvt_bench.cpp
+ * @brief Host microbenchmarks for the code that runs on every control or motor tick.
+ *
+ * Each benchmark cycles through a small table of inputs so the compiler cannot fold the
+ * call away and the branch predictor sees the same mix of cases as a real run.
+ * Results are only comparable between runs on the same host; use --benchmark_out with
+ * --benchmark_out_format=json and tools/bench_compare.py to check a change.
+ */
+
+#define BENCH_INPUTS 64 // entries in each input table, a power of two
+
+namespace {
+
+/**
+ * @brief Deterministic pseudo-random float in [lo, hi) so every run sees the same inputs.
+ */
+float uniform(uint32_t &state, float lo, float hi)
+{
+    state = state * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(state >> 8) / (float)(1u << 24);
+}
+
+CalibrationValues defaultCalibration()
+{
+    CalibrationValues cal;
+    for (int i = 0; i < CAL_PARAM_COUNT; i++)
+    {
+        cal.values[i] = calParams[i].defaultValue;
+    }
+    return cal;
+}
+
+/**
+ * @brief Motor::plan over tracking, accelerating, braking, and settled states.
+ */
+void BM_MotorPlan(benchmark::State &state)
+{
+    struct Input {
+        int setpoint;
+        int position;
+        float velocity;
+    };
+    Input inputs[BENCH_INPUTS];
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_INPUTS; i++)
+    {
+        inputs[i].position = (int)uniform(seed, 0.0f, 40000.0f);
+        inputs[i].setpoint = i % 8 == 0 ? inputs[i].position : (int)uniform(seed, 0.0f, 40000.0f);
+        inputs[i].velocity = uniform(seed, -80000.0f, 80000.0f);
+    }
+    const float timeStep = MOTOR_TIMER_RATE / 1000.0f;
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        const Input &input = inputs[i++ & (BENCH_INPUTS - 1)];
+        Motor::MotionCommand command = Motor::plan(input.setpoint, input.position, input.velocity, timeStep,
+                                                   MOTOR_MAX_ACCELERATION_POS);
+        benchmark::DoNotOptimize(command);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MotorPlan);
+
+/**
+ * @brief Controller::setpointLaw across idle, engaged, and brake-check inputs.
+ */
+void BM_SetpointLaw(benchmark::State &state)
+{
+    CalibrationValues cal = defaultCalibration();
+    struct Input {
+        float rpm;
+        int position;
+        bool brakeCheck;
+    };
+    Input inputs[BENCH_INPUTS];
+    uint32_t seed = 2;
+    for (int i = 0; i < BENCH_INPUTS; i++)
+    {
+        inputs[i].rpm = uniform(seed, 1000.0f, 4000.0f);
+        inputs[i].position = (int)uniform(seed, 0.0f, cal[CAL_MAX_MOTOR_SETPOINT]);
+        inputs[i].brakeCheck = i % 16 == 0;
+    }
+    float targetRPM = cal[CAL_ENGINE_IDEAL_RPM_POWER];
+    float lastError = 0.0f;
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        const Input &input = inputs[i++ & (BENCH_INPUTS - 1)];
+        int setpoint = Controller::setpointLaw(cal, input.rpm, targetRPM, lastError, input.position, input.brakeCheck);
+        benchmark::DoNotOptimize(setpoint);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SetpointLaw);
+
+/**
+ * @brief One LowPassFilter::filter step on a noisy signal.
+ */
+void BM_LowPassFilter(benchmark::State &state)
+{
+    float inputs[BENCH_INPUTS];
+    uint32_t seed = 3;
+    for (int i = 0; i < BENCH_INPUTS; i++)
+    {
+        inputs[i] = uniform(seed, 0.0f, 4095.0f);
+    }
+    LowPassFilter filter(ANALOG_FILTER_ALPHA);
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        float value = filter.filter(inputs[i++ & (BENCH_INPUTS - 1)]);
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LowPassFilter);
+
+/**
+ * @brief PulseCounter::countsToRPM, with one sample in eight wrapping the int16 counter.
+ */
+void BM_CountsToRPM(benchmark::State &state)
+{
+    struct Input {
+        int16_t current;
+        int16_t last;
+        int64_t elapsedUs;
+    };
+    Input inputs[BENCH_INPUTS];
+    uint32_t seed = 4;
+    for (int i = 0; i < BENCH_INPUTS; i++)
+    {
+        int delta = (int)uniform(seed, 0.0f, 40.0f);
+        inputs[i].last = i % 8 == 0 ? INT16_MAX - delta / 2 : (int16_t)uniform(seed, INT16_MIN, INT16_MAX - 40);
+        inputs[i].current = (int16_t)(inputs[i].last + delta);
+        inputs[i].elapsedUs = (int64_t)uniform(seed, 5000.0f, 20000.0f);
+    }
+    const float pulsesPerRevolution = PRIMARY_MAGNET_COUNT * EDGES_PER_MAGNET;
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        const Input &input = inputs[i++ & (BENCH_INPUTS - 1)];
+        float rpm = PulseCounter::countsToRPM(input.current, input.last, input.elapsedUs, pulsesPerRevolution);
+        benchmark::DoNotOptimize(rpm);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CountsToRPM);
+
+/**
+ * @brief Driver brought up once on the simulated board; the clock never advances, so every
+ * moveSteps call finds the previous train busy and stops it, as a retargeted tick does.
+ */
+DRV8462 &benchDriver()
+{
+    static DRV8462 *driver = nullptr;
+    if (!driver)
+    {
+        sim::setSerialOutput(nullptr);
+        driver = new DRV8462();
+        driver->begin();
+    }
+    return *driver;
+}
+
+/**
+ * @brief DRV8462::moveSteps for a batch of Arg(0) steps: status check, stop, pulse fill, and write.
+ */
+void BM_MoveSteps(benchmark::State &state)
+{
+    DRV8462 &driver = benchDriver();
+    int steps = state.range(0);
+    int speedHz[BENCH_INPUTS];
+    uint32_t seed = 5;
+    for (int i = 0; i < BENCH_INPUTS; i++)
+    {
+        speedHz[i] = (int)uniform(seed, 1000.0f, 80000.0f);
+    }
+
+    int i = 0;
+    for (auto _ : state)
+    {
+        driver.moveSteps(i & 1 ? steps : -steps, speedHz[i & (BENCH_INPUTS - 1)]);
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations() * steps);
+}
+BENCHMARK(BM_MoveSteps)->Arg(1)->Arg(100)->Arg(800)->Arg(MAX_PULSES);
+
+/**
+ * @brief The simulated RMT write and stop on their own, so the firmware's share of
+ * BM_MoveSteps is the difference between the two at the same step count.
+ */
+void BM_RmtWriteBaseline(benchmark::State &state)
+{
+    benchDriver();
+    int steps = state.range(0);
+    static rmt_item32_t items[MAX_PULSES];
+    for (int i = 0; i < steps; i++)
+    {
+        items[i] = {{{100, 1, 100, 0}}};
+    }
+
+    for (auto _ : state)
+    {
+        rmt_channel_status_result_t status;
+        rmt_get_channel_status(&status);
+        rmt_tx_stop(RMT_CHANNEL);
+        rmt_write_items(RMT_CHANNEL, items, steps, false);
+    }
+    state.SetItemsProcessed(state.iterations() * steps);
+}
+BENCHMARK(BM_RmtWriteBaseline)->Arg(1)->Arg(100)->Arg(800)->Arg(MAX_PULSES);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,43 @@
+#ifndef BENCH_PLANT_H
+#define BENCH_PLANT_H
+
+#include <stdint.h>
+#include "sim.h"
+
+/**
+ * @brief Bench setup with no vehicle: the engine holds a fixed speed and the stepper is
+ * ideal, so the sheave sits exactly where the step pulses put it.
+ *
+ * Drives the primary Hall counter, the stepper encoder, the limit switch, the mode
+ * selector, and the brake input.
+ */
+class BenchPlant : public sim::Plant {
+public:
+    struct Config {
+        float engineRpm = 0.0f;
+        uint16_t selectorRaw = 250;    // mode selector ADC counts, POWER band by default
+        uint16_t brakeRaw = 0;         // brake ADC counts
+        int32_t startPosition = 0;     // sheave position at power-up, in steps
+    };
+
+    explicit BenchPlant(const Config &config);
+
+    void update(uint64_t nowUs) override;
+
+    /**
+     * @brief Physical sheave position in steps; the limit switch sits at LIMIT_SWITCH_POS.
+     */
+    int32_t getPosition() const { return this->position; }
+
+    void setEngineRpm(float rpm) { this->config.engineRpm = rpm; }
+    void setBrakeRaw(uint16_t raw) { this->config.brakeRaw = raw; }
+
+private:
+    Config config;
+    uint64_t lastUs = 0;
+    double engineRevolutions = 0.0;
+    int32_t position;
+    int64_t lastSteps = 0;
+};
+
+#endif // BENCH_PLANT_H
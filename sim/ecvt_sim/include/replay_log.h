@@ -0,0 +1,128 @@
+#ifndef REPLAY_LOG_H
+#define REPLAY_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "sim.h"
+
+/**
+ * @brief Read-only memory map of a whole file, so multi-hour logs stream without being loaded.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    /**
+     * @brief Map a file; prints an error and returns false if it cannot be opened.
+     */
+    bool open(const char *path);
+
+    const uint8_t *data() const { return this->bytes; }
+    size_t size() const { return this->length; }
+
+private:
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * @brief One telemetry sample, recorded or produced by the firmware under replay.
+ *
+ * Raw ADC fields are -1 when the source does not carry them (Teleplot lines have no brake counts).
+ */
+struct ReplaySample {
+    uint64_t timeUs;
+    float engineRpm;
+    float vehicleSpeed;
+    int32_t motorPosition;
+    int32_t motorSetpoint;
+    uint8_t controlMode;
+    bool brake;
+    int32_t manualModeRaw;
+    int32_t limitSwitchRaw;
+    int32_t brakeRaw;
+};
+
+/**
+ * @brief Incremental decoder for the serial stream loop() writes: COBS telemetry frames when
+ * TELEMETRY_BINARY is set, Teleplot lines otherwise.
+ *
+ * Binary frames with a bad CRC are counted and dropped, and debug text between frames is
+ * skipped. Teleplot samples have no timestamp, so they are spaced TELEMETRY_PERIOD_MS apart.
+ */
+class TelemetryDecoder {
+public:
+    explicit TelemetryDecoder(bool binary) : binary(binary) {}
+
+    /**
+     * @brief Consume bytes up to and including the end of the next sample.
+     * @param ready Set when sample holds a complete sample.
+     * @return Bytes consumed; call again with the rest.
+     */
+    size_t feed(const uint8_t *data, size_t length, ReplaySample &sample, bool &ready);
+
+    /**
+     * @brief Number of binary frames dropped for a bad length or CRC.
+     */
+    uint64_t getBadFrames() const { return this->badFrames; }
+
+    /**
+     * @brief Guess the format of a capture from its first bytes: true if it holds a valid telemetry frame.
+     */
+    static bool looksBinary(const uint8_t *data, size_t length);
+
+private:
+    bool decodeFrame(const uint8_t *frame, size_t length, ReplaySample &sample);
+    bool decodeLine(const char *line, size_t length, ReplaySample &sample);
+
+    bool binary;
+    std::vector<uint8_t> pending;
+    uint64_t badFrames = 0;
+    uint64_t textSamples = 0;
+    ReplaySample partial = {};
+    bool partialStarted = false;
+};
+
+/**
+ * @brief Streams samples from a recorded serial capture through a memory map.
+ */
+class TelemetryLogReader {
+public:
+    bool open(const char *path);
+
+    /**
+     * @brief Next sample in the log, or false at the end.
+     */
+    bool next(ReplaySample &sample);
+
+    uint64_t getBadFrames() const { return this->decoder.getBadFrames(); }
+
+private:
+    MappedFile file;
+    TelemetryDecoder decoder{true};
+    size_t offset = 0;
+};
+
+/**
+ * @brief Streams frames from a CAN log in the simulator's --can-log CSV format
+ * (time_us,id,length,data as hex, header optional).
+ */
+class CanLogReader {
+public:
+    bool open(const char *path);
+
+    /**
+     * @brief Next frame in the log, or false at the end. Malformed lines are skipped.
+     */
+    bool next(sim::CanFrame &frame);
+
+private:
+    MappedFile file;
+    size_t offset = 0;
+};
+
+#endif // REPLAY_LOG_H
@@ -0,0 +1,120 @@
+#ifndef REPLAY_PLANT_H
+#define REPLAY_PLANT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sim.h"
+#include "replay_log.h"
+
+/**
+ * @brief Summary of how far the firmware under replay strays from the recording.
+ */
+struct ReplayDivergence {
+    uint64_t samples;          // firmware samples compared against the recording
+    float setpointRms;         // steps
+    int32_t setpointMaxError;  // steps, largest |new - recorded|
+    float maxErrorTimeS;       // log time of setpointMaxError
+    float firstDivergenceS;    // log time the error first exceeded the tolerance, negative if never
+    uint64_t overTolerance;    // samples past the tolerance
+    uint64_t modeMismatches;   // samples where the control modes differ
+};
+
+/**
+ * @brief Feeds a recorded run back through the firmware on the virtual clock.
+ *
+ * After the firmware homes against an ideal stepper, the sheave is moved so the firmware's
+ * position matches the first recorded one. From then on every recorded sample is applied at
+ * its own time offset: the recorded selector, limit switch, and brake counts drive the ADC
+ * inputs, while the sheave follows the firmware's own step pulses.
+ *
+ * The recorded engine rpm has already been through the Hall window and the low-pass filter,
+ * so it is not fed back as a speed. Playback keeps the recording's offset from boot modulo
+ * RPM_SAMPLE_PERIOD_MS, and the phase of the recording's rpm samples is found from where the
+ * filtered value changes. Each window's Hall edge count is then recovered by inverting the
+ * filter, and delivered in the middle of the window so the firmware counts exactly the edges
+ * the recording did. A self-replay of unchanged firmware then tracks the recording closely. The firmware's telemetry is decoded as it is written and each sample is compared
+ * with the recording. CAN frames from a log are injected at their recorded offsets.
+ */
+class ReplayPlant : public sim::Plant {
+public:
+    struct Config {
+        const char *logPath = nullptr;   // serial capture: telemetry frames or Teleplot lines
+        const char *canPath = nullptr;   // optional CAN log, times on the same clock as the capture
+        const char *diffPath = nullptr;  // optional per-sample comparison CSV
+        uint64_t startUs = 3000000;      // latest virtual time the recording starts, after homing; a log
+                                         // starting earlier plays at its own timestamps
+        uint64_t skipUs = 0;             // recorded time dropped from the start of the log, e.g. its own homing
+        int32_t tolerance = 200;         // setpoint error in steps that counts as diverged
+    };
+
+    ReplayPlant();
+
+    /**
+     * @brief Open the logs; prints an error and returns false on failure.
+     */
+    bool open(const Config &config);
+
+    void update(uint64_t nowUs) override;
+
+    /**
+     * @brief Feed bytes the firmware writes to its serial port.
+     */
+    void onSerial(const uint8_t *data, size_t length);
+
+    ReplayDivergence getDivergence() const;
+    void printSummary(FILE *out) const;
+
+    /**
+     * @brief Physical sheave position in steps.
+     */
+    int32_t getPosition() const { return (int32_t)this->position; }
+
+private:
+    void applySample(const ReplaySample &sample);
+    void compare(const ReplaySample &firmware);
+    void injectCan(uint64_t untilUs);
+    bool openLog(TelemetryLogReader &reader, ReplaySample &first);
+    uint64_t findRpmPhase();
+    float recordedRpmAt(uint64_t recordedUs);
+    void synthesizeEngine(uint64_t nowUs);
+
+    Config config;
+    TelemetryLogReader log;
+    CanLogReader can;
+    FILE *diff = nullptr;
+    TelemetryDecoder firmwareDecoder; // matches the firmware's TELEMETRY_BINARY
+
+    uint64_t lastUs = 0;
+    int64_t position = 0;
+    int64_t lastSteps = 0;
+
+    // Playback
+    bool started = false;
+    bool finished = false;
+    uint64_t logStartUs = 0;      // timestamp of the first recorded sample
+    uint64_t playStartUs = 0;     // virtual time it is applied
+    ReplaySample current = {};    // last applied sample
+    ReplaySample upcoming = {};
+    bool hasUpcoming = false;
+    uint64_t upcomingUs = 0;      // virtual time upcoming is applied
+    sim::CanFrame canFrame = {};
+    bool hasCanFrame = false;
+    ReplaySample firmware = {};   // latest firmware sample
+    bool hasFirmware = false;
+    uint64_t recordedSamples = 0;
+
+    // Engine Hall edges rebuilt from the filtered rpm, read ahead of playback
+    TelemetryLogReader rpmLog;
+    ReplaySample rpmNext = {};
+    bool hasRpmNext = false;
+    float rpmRecorded = 0.0f;     // filtered rpm of the last sample read from rpmLog
+    float rpmFiltered = 0.0f;     // filter state after the last rebuilt window
+    uint64_t rpmWindowUs = 0;     // recorded time of the next firmware rpm sample to rebuild
+    int64_t engineEdges = 0;      // cumulative Hall edges presented to the counter
+
+    // Divergence
+    double squares = 0.0;
+    ReplayDivergence divergence = {0, 0.0f, 0, 0.0f, -1.0f, 0, 0};
+};
+
+#endif // REPLAY_PLANT_H
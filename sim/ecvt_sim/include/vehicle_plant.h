@@ -0,0 +1,145 @@
+#ifndef VEHICLE_PLANT_H
+#define VEHICLE_PLANT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "sim.h"
+
+/**
+ * @brief Physical parameters of the car. Defaults are representative of a 10 hp Baja car;
+ * replace them with measured values before trusting absolute numbers.
+ */
+struct VehicleParams {
+    // Engine
+    float engineInertia = 0.05f;       // kg m^2, crank, flywheel, and primary sheave
+    float engineFriction = 0.8f;       // N m at 0 rpm
+    float engineFrictionPerRpm = 0.001f; // N m per rpm, friction and pumping
+    float governorRpm = 3800.0f;       // torque falls to zero here
+    float idleGain = 0.02f;            // N m per rpm below ENGINE_IDLE_RPM with the throttle closed
+
+    // CVT, positions in sheave steps with the limit switch at LIMIT_SWITCH_POS
+    float clampStart = 8500.0f;        // belt starts to carry torque just past LAUNCH_STAGE_SETPOINT
+    float lowFull = 20000.0f;          // fully clamped at LOW_GEAR (LOW_MAX_SETPOINT)
+    float highFull = 31000.0f;         // HIGH_GEAR at MAX_MOTOR_SETPOINT
+    float lowRatio = 3.6f;             // LOW_GEAR
+    float highRatio = 0.9f;            // HIGH_GEAR
+    float beltTorqueCapacity = 40.0f;  // N m at the primary when fully clamped
+    float beltStiffness = 200.0f;      // N m s/rad, slip damping of a clamped belt
+
+    // Driveline and vehicle
+    float gearboxRatio = 8.32f;        // fixed reduction after the CVT
+    float drivelineEfficiency = 0.9f;
+    float wheelRadius = 0.29f;         // m
+    float mass = 250.0f;               // kg with driver
+    float rollingResistance = 0.04f;   // Crr
+    float dragArea = 0.8f;             // Cd * A, m^2
+    float brakeForce = 3000.0f;        // N at the ground with the pedal down
+
+    // Sheave actuator: stepper on a leadscrew
+    float leadscrewLead = 0.005f;      // m per revolution
+    float leadscrewEfficiency = 0.35f;
+    float clampForce = 600.0f;         // N the sheave pushes against when fully clamped
+    float clampForcePerTorque = 15.0f; // N per N m carried by the belt
+    float stepperHoldTorque = 2.5f;    // N m
+    float stepperMaxRate = 128000.0f;  // steps/s where pull-out torque reaches zero
+    float travelMin = -8000.0f;        // hard stops, steps
+    float travelMax = 32000.0f;
+};
+
+/**
+ * @brief Driver inputs over time. Times are virtual seconds; negative disables an event.
+ */
+struct Scenario {
+    const char *name = "launch";
+    float throttleOnS = 3.0f;   // wide open throttle from here (after homing)
+    float throttleOffS = -1.0f;
+    float brakeOnS = -1.0f;     // pedal down from here, also sets the brake ADC input
+    float gradeStartS = -1.0f;
+    float grade = 0.0f;         // rise over run from gradeStartS
+
+    /**
+     * @brief Fill in a named preset: launch, hill, or brake.
+     * @return false for an unknown name.
+     */
+    static bool preset(const char *name, Scenario &scenario);
+};
+
+/**
+ * @brief Summary of a run, accumulated from throttle-on.
+ */
+struct VehicleMetrics {
+    float idealRpm;          // engine speed the metrics are measured against
+    float rpmErrorRms;       // while the belt is clamped, the throttle is open, and the brake is off
+    float timeToIdealS;      // from throttle-on until moving within VEHICLE_IDEAL_RPM_BAND of idealRpm; negative if never
+    float sheaveTravelSteps; // total actuator motion
+    float maxSpeed;          // m/s
+    float distance;          // m
+    int64_t lostSteps;       // step pulses the stepper could not follow
+};
+
+/**
+ * @brief Engine, belt CVT, driveline, vehicle, and sheave actuator.
+ *
+ * The engine and the CVT primary couple through a clamped belt that slips when the torque
+ * exceeds the clamp capacity, which rises from clampStart to lowFull; past lowFull the ratio
+ * moves from lowRatio to highRatio. The stepper follows the step pulses unless the leadscrew
+ * load exceeds its pull-out torque at the commanded rate, in which case the pulses are lost
+ * and only the encoder shows the real sheave position.
+ */
+class VehiclePlant : public sim::Plant {
+public:
+    VehiclePlant(const VehicleParams &params, const Scenario &scenario, uint16_t selectorRaw, float idealRpm);
+
+    void update(uint64_t nowUs) override;
+
+    /**
+     * @brief Write one CSV row per trace period to out (null disables the trace).
+     */
+    void setTrace(FILE *out, uint32_t periodUs);
+
+    /**
+     * @brief Physical sheave position in steps, including any lost steps.
+     */
+    int32_t getPosition() const { return (int32_t)this->sheave; }
+
+    VehicleMetrics getMetrics() const;
+    void printSummary(FILE *out) const;
+
+private:
+    void step(float t, float dt);
+    float engineTorque(float rpm, float throttle) const;
+    float ratio() const;
+    float clamp01(float x) const { return x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x); }
+
+    VehicleParams params;
+    Scenario scenario;
+    uint16_t selectorRaw;
+    float idealRpm;
+
+    uint64_t lastUs = 0;
+    FILE *trace = nullptr;
+    uint32_t tracePeriodUs = 10000;
+    uint64_t nextTraceUs = 0;
+
+    // State
+    float engineSpeed;          // rad/s
+    double engineAngle = 0.0;   // rad, for the Hall counter
+    float speed = 0.0f;         // m/s
+    double distance = 0.0;      // m
+    float sheave;               // actual actuator position, steps
+    int64_t lastCommand = 0;    // RMT step position last seen
+    float beltTorque = 0.0f;    // N m at the primary
+    float throttle = 0.0f;
+    bool braking = false;
+    float grade = 0.0f;
+
+    // Metrics
+    double rpmErrorSquares = 0.0;
+    uint64_t rpmErrorSamples = 0;
+    float timeToIdeal = -1.0f;
+    double travel = 0.0;
+    float maxSpeed = 0.0f;
+    int64_t lostSteps = 0;
+};
+
+#endif // VEHICLE_PLANT_H
@@ -0,0 +1,36 @@
+#include "bench_plant.h"
+#include <Arduino.h>
+#include "driver/adc.h"
+#include "driver/pcnt.h"
+#include "driver/rmt.h"
+#include "config.h"
+
+#define LIMIT_SWITCH_HIGH_RAW 4095
+#define LIMIT_SWITCH_LOW_RAW 0
+#define ENCODER_COUNTS_PER_REV 4096 // Encoder::COUNT_PER_REV
+
+BenchPlant::BenchPlant(const Config &config) : config(config), position(config.startPosition)
+{
+}
+
+void BenchPlant::update(uint64_t nowUs)
+{
+    double dt = (nowUs - this->lastUs) / 1e6;
+    this->lastUs = nowUs;
+
+    this->engineRevolutions += this->config.engineRpm / 60.0 * dt;
+    sim::setPcntInput(PRIMARY_COUNTER_ID, (int64_t)(this->engineRevolutions * PRIMARY_MAGNET_COUNT * EDGES_PER_MAGNET));
+
+    // The driver ignores STEP while disabled or asleep.
+    int64_t steps = sim::stepPosition(RMT_CHANNEL_0);
+    if (sim::gpioLevel(ENABLE_PIN) == HIGH && sim::gpioLevel(nSLEEP_PIN) == HIGH)
+    {
+        this->position += (int32_t)(steps - this->lastSteps);
+    }
+    this->lastSteps = steps;
+
+    sim::setPcntInput(ENCODER_COUNTER_ID, (int64_t)this->position * ENCODER_COUNTS_PER_REV / (STEPS_PER_REVOLUTION));
+    sim::setAdc1(LIMIT_SWITCH_ADC_CHANNEL, this->position <= LIMIT_SWITCH_POS ? LIMIT_SWITCH_HIGH_RAW : LIMIT_SWITCH_LOW_RAW);
+    sim::setAdc1(MANUAL_MODE_ADC_CHANNEL, this->config.selectorRaw);
+    sim::setAdc2(BRAKE_ADC_CHANNEL, this->config.brakeRaw);
+}
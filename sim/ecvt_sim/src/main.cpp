@@ -0,0 +1,435 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include <getopt.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "driver/pcnt.h"
+#include "driver/rmt.h"
+#include "esp_partition.h"
+#include "sim.h"
+#include "bench_plant.h"
+#include "vehicle_plant.h"
+#include "replay_plant.h"
+#include "calibration.h"
+#include "config.h"
+
+/**
+ * @file main.cpp
+ * @brief Host entry point: boots the unmodified firmware on the simulated board, runs it
+ * against a plant for a span of virtual time, and prints a one-line summary.
+ */
+
+#define SIM_PLANT_STEP_US 100          // plant integration step
+#define SIM_TRACE_PERIOD_US 10000      // vehicle trace row spacing
+#define SIM_CAL_NVS_NAMESPACE "calibration" // must match CAL_NVS_NAMESPACE in calibration.cpp
+#define SIM_BLACKBOX_PARTITION_SIZE 0x2B0000 // must match partitions.csv
+#define ARDUINO_LOOP_STACK 8192
+#define ARDUINO_LOOP_PRIORITY 1
+#define ARDUINO_LOOP_CORE 1
+
+namespace {
+
+struct Options {
+    double durationS = 30.0;
+    bool durationSet = false;
+    BenchPlant::Config bench;
+    bool vehicle = false;
+    bool replay = false;
+    ReplayPlant::Config replayConfig;
+    Scenario scenario;
+    float targetRpm = 0.0f;            // 0 picks the ideal speed of the selector mode
+    const char *tracePath = nullptr;
+    CalibrationValues cal;
+    bool calSet = false;               // seed NVS with cal before boot
+    const char *serialPath = nullptr;
+    const char *canLogPath = nullptr;
+    std::vector<std::pair<double, std::string>> commands;
+    bool help = false;
+};
+
+struct Selector {
+    const char *name;
+    uint16_t raw;
+};
+
+// One raw value inside each band of the mode selector thresholds in config.h.
+const Selector selectors[] = {
+    {"power", (POWER_MODE_THRESHOLD) / 2},
+    {"torque", (POWER_MODE_THRESHOLD + TORQUE_MODE_THRESHOLD) / 2},
+    {"acceleration", (TORQUE_MODE_THRESHOLD + ACCELERATION_MODE_THRESHOLD) / 2},
+    {"brake_check", (ACCELERATION_MODE_THRESHOLD + BRAKE_CHECK_MODE_THRESHOLD) / 2},
+    {"homing", (BRAKE_CHECK_MODE_THRESHOLD + 4095) / 2},
+};
+
+uint64_t canFrames = 0;
+
+void usage(const char *program, FILE *out)
+{
+    fprintf(out,
+            "usage: %s [options]\n"
+            "  --duration S        virtual seconds to run (default 30)\n"
+            "  --engine-rpm RPM    constant engine speed (default 0)\n"
+            "  --selector MODE     power|torque|acceleration|brake_check|homing (default power)\n"
+            "  --brake-adc RAW     brake input in ADC counts (default 0)\n"
+            "  --start-position S  sheave position at power-up in steps (default 0)\n"
+            "  --serial FILE       write the board's serial output to FILE, - for stdout\n"
+            "  --can-log FILE      write transmitted CAN frames to FILE as CSV\n"
+            "  --command S:TEXT    send TEXT as a serial line at virtual second S (repeatable)\n"
+            "  --plant NAME        bench (fixed engine speed, ideal stepper), vehicle, or replay (default bench)\n"
+            "  --scenario NAME     vehicle driver inputs: launch|hill|brake (default launch)\n"
+            "  --target-rpm RPM    engine speed the vehicle metrics measure against (default: selector mode)\n"
+            "  --trace FILE        write the vehicle state to FILE as CSV every 10 ms\n"
+            "  --cal NAME=VALUE    boot with a committed calibration parameter (repeatable)\n"
+            "  --replay FILE       recorded serial capture (telemetry frames or Teleplot lines) to play back;\n"
+            "                      runs to the end of the log unless --duration is given\n"
+            "  --replay-skip S     drop the first S seconds of the capture, e.g. its own homing\n"
+            "  --replay-can FILE   CAN log (--can-log format) to inject alongside the capture\n"
+            "  --replay-diff FILE  write recorded and new setpoints per sample to FILE as CSV\n"
+            "  --replay-tolerance STEPS  setpoint error counted as divergence (default 200)\n"
+            "  --help              print this message and exit\n",
+            program);
+}
+
+bool parseCal(const char *text, CalibrationValues &cal)
+{
+    const char *equals = strchr(text, '=');
+    if (!equals)
+    {
+        fprintf(stderr, "ERROR: --cal needs NAME=VALUE\n");
+        return false;
+    }
+    std::string name(text, equals - text);
+    for (int i = 0; i < CAL_PARAM_COUNT; i++)
+    {
+        if (name == calParams[i].name)
+        {
+            float value = atof(equals + 1);
+            if (!(value >= calParams[i].min && value <= calParams[i].max))
+            {
+                fprintf(stderr, "ERROR: %s must be within [%g, %g]\n", calParams[i].name, calParams[i].min,
+                        calParams[i].max);
+                return false;
+            }
+            cal.values[i] = value;
+            return true;
+        }
+    }
+    fprintf(stderr, "ERROR: unknown calibration parameter %s\n", name.c_str());
+    return false;
+}
+
+/**
+ * @brief Store a calibration set the way a COMMIT does, so Calibration::begin() loads it at boot.
+ */
+void seedCalibration(const CalibrationValues &cal)
+{
+    Preferences prefs;
+    prefs.begin(SIM_CAL_NVS_NAMESPACE, false);
+    prefs.putBytes("values", cal.values, sizeof(cal.values));
+    prefs.putUShort("crc", calChecksum(cal));
+    prefs.putUChar("count", CAL_PARAM_COUNT);
+    prefs.end();
+}
+
+bool parse(int argc, char **argv, Options &options)
+{
+    enum { DURATION = 1, ENGINE_RPM, SELECTOR, BRAKE_ADC, START_POSITION, SERIAL_OUT, CAN_LOG, COMMAND,
+           PLANT, SCENARIO, TARGET_RPM, TRACE, CAL, REPLAY, REPLAY_SKIP, REPLAY_CAN, REPLAY_DIFF, REPLAY_TOLERANCE, HELP };
+    static const option longOptions[] = {
+        {"duration", required_argument, nullptr, DURATION},
+        {"engine-rpm", required_argument, nullptr, ENGINE_RPM},
+        {"selector", required_argument, nullptr, SELECTOR},
+        {"brake-adc", required_argument, nullptr, BRAKE_ADC},
+        {"start-position", required_argument, nullptr, START_POSITION},
+        {"serial", required_argument, nullptr, SERIAL_OUT},
+        {"can-log", required_argument, nullptr, CAN_LOG},
+        {"command", required_argument, nullptr, COMMAND},
+        {"plant", required_argument, nullptr, PLANT},
+        {"scenario", required_argument, nullptr, SCENARIO},
+        {"target-rpm", required_argument, nullptr, TARGET_RPM},
+        {"trace", required_argument, nullptr, TRACE},
+        {"cal", required_argument, nullptr, CAL},
+        {"replay", required_argument, nullptr, REPLAY},
+        {"replay-skip", required_argument, nullptr, REPLAY_SKIP},
+        {"replay-can", required_argument, nullptr, REPLAY_CAN},
+        {"replay-diff", required_argument, nullptr, REPLAY_DIFF},
+        {"replay-tolerance", required_argument, nullptr, REPLAY_TOLERANCE},
+        {"help", no_argument, nullptr, HELP},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    for (int i = 0; i < CAL_PARAM_COUNT; i++)
+    {
+        options.cal.values[i] = calParams[i].defaultValue;
+    }
+
+    int option;
+    while ((option = getopt_long(argc, argv, "", longOptions, nullptr)) != -1)
+    {
+        switch (option)
+        {
+        case DURATION:
+            options.durationS = atof(optarg);
+            options.durationSet = true;
+            break;
+        case ENGINE_RPM:
+            options.bench.engineRpm = atof(optarg);
+            break;
+        case SELECTOR:
+        {
+            bool found = false;
+            for (const Selector &selector : selectors)
+            {
+                if (strcmp(optarg, selector.name) == 0)
+                {
+                    options.bench.selectorRaw = selector.raw;
+                    found = true;
+                }
+            }
+            if (!found)
+            {
+                fprintf(stderr, "ERROR: unknown selector mode %s\n", optarg);
+                return false;
+            }
+            break;
+        }
+        case BRAKE_ADC:
+            options.bench.brakeRaw = atoi(optarg);
+            break;
+        case START_POSITION:
+            options.bench.startPosition = atoi(optarg);
+            break;
+        case SERIAL_OUT:
+            options.serialPath = optarg;
+            break;
+        case CAN_LOG:
+            options.canLogPath = optarg;
+            break;
+        case COMMAND:
+        {
+            const char *colon = strchr(optarg, ':');
+            if (!colon)
+            {
+                fprintf(stderr, "ERROR: --command needs SECONDS:TEXT\n");
+                return false;
+            }
+            options.commands.emplace_back(atof(optarg), std::string(colon + 1) + "\n");
+            break;
+        }
+        case PLANT:
+            if (strcmp(optarg, "bench") != 0 && strcmp(optarg, "vehicle") != 0 && strcmp(optarg, "replay") != 0)
+            {
+                fprintf(stderr, "ERROR: unknown plant %s\n", optarg);
+                return false;
+            }
+            options.vehicle = strcmp(optarg, "vehicle") == 0;
+            options.replay = strcmp(optarg, "replay") == 0;
+            break;
+        case SCENARIO:
+            if (!Scenario::preset(optarg, options.scenario))
+            {
+                fprintf(stderr, "ERROR: unknown scenario %s\n", optarg);
+                return false;
+            }
+            break;
+        case TARGET_RPM:
+            options.targetRpm = atof(optarg);
+            break;
+        case TRACE:
+            options.tracePath = optarg;
+            break;
+        case REPLAY:
+            options.replayConfig.logPath = optarg;
+            break;
+        case REPLAY_SKIP:
+            options.replayConfig.skipUs = (uint64_t)(atof(optarg) * 1e6);
+            break;
+        case REPLAY_CAN:
+            options.replayConfig.canPath = optarg;
+            break;
+        case REPLAY_DIFF:
+            options.replayConfig.diffPath = optarg;
+            break;
+        case REPLAY_TOLERANCE:
+            options.replayConfig.tolerance = atoi(optarg);
+            break;
+        case CAL:
+            if (!parseCal(optarg, options.cal))
+            {
+                return false;
+            }
+            options.calSet = true;
+            break;
+        case HELP:
+            options.help = true;
+            return true;
+        default:
+            return false;
+        }
+    }
+    if (options.replay && !options.replayConfig.logPath)
+    {
+        fprintf(stderr, "ERROR: --plant replay needs --replay FILE\n");
+        return false;
+    }
+    return optind == argc && options.durationS > 0;
+}
+
+void sendCommand(void *arg)
+{
+    sim::serialInput(static_cast<std::string *>(arg)->c_str());
+}
+
+void replaySerial(const uint8_t *data, size_t length, void *arg)
+{
+    static_cast<ReplayPlant *>(arg)->onSerial(data, length);
+}
+
+void logCanFrame(const sim::CanFrame &frame, void *arg)
+{
+    canFrames++;
+    FILE *out = static_cast<FILE *>(arg);
+    if (!out)
+    {
+        return;
+    }
+    fprintf(out, "%llu,%lx,%u,", (unsigned long long)frame.timeUs, (unsigned long)frame.id, frame.length);
+    for (int i = 0; i < frame.length; i++)
+    {
+        fprintf(out, "%02x", frame.data[i]);
+    }
+    fputc('\n', out);
+}
+
+/**
+ * @brief Body of the Arduino core's loop task.
+ */
+void loopTask(void *arg)
+{
+    (void)arg;
+    setup();
+    for (;;)
+    {
+        loop();
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parse(argc, argv, options))
+    {
+        usage(argv[0], stderr);
+        return 1;
+    }
+    if (options.help)
+    {
+        usage(argv[0], stdout);
+        return 0;
+    }
+
+    FILE *serialOut = nullptr;
+    if (options.serialPath)
+    {
+        serialOut = strcmp(options.serialPath, "-") == 0 ? stdout : fopen(options.serialPath, "wb");
+        if (!serialOut)
+        {
+            fprintf(stderr, "ERROR: cannot open %s\n", options.serialPath);
+            return 1;
+        }
+    }
+    FILE *canLog = nullptr;
+    if (options.canLogPath)
+    {
+        canLog = fopen(options.canLogPath, "w");
+        if (!canLog)
+        {
+            fprintf(stderr, "ERROR: cannot open %s\n", options.canLogPath);
+            return 1;
+        }
+        fprintf(canLog, "time_us,id,length,data\n");
+    }
+
+    sim::setSerialOutput(serialOut);
+    sim::setCanTxListener(logCanFrame, canLog);
+    sim::addPartition("blackbox", ESP_PARTITION_TYPE_DATA, BLACKBOX_PARTITION_SUBTYPE, SIM_BLACKBOX_PARTITION_SIZE);
+    sim::setStepDirectionPin(RMT_CHANNEL_0, DIR_PIN, LOW);
+#if STEP_CAPTURE_ENABLED
+    sim::setPcntLoopback(STEP_LOOPBACK_COUNTER_ID, RMT_CHANNEL_0); // the STEP_LOOPBACK_PIN jumper
+#endif
+    for (auto &command : options.commands)
+    {
+        sim::at((uint64_t)(command.first * 1e6), sendCommand, &command.second);
+    }
+
+    FILE *trace = nullptr;
+    if (options.tracePath)
+    {
+        trace = fopen(options.tracePath, "w");
+        if (!trace)
+        {
+            fprintf(stderr, "ERROR: cannot open %s\n", options.tracePath);
+            return 1;
+        }
+    }
+
+    BenchPlant bench(options.bench);
+    if (options.calSet)
+    {
+        seedCalibration(options.cal);
+    }
+
+    float idealRpm = options.targetRpm > 0.0f ? options.targetRpm
+                     : options.bench.selectorRaw >= POWER_MODE_THRESHOLD && options.bench.selectorRaw < TORQUE_MODE_THRESHOLD
+                         ? options.cal[CAL_ENGINE_IDEAL_RPM_TORQUE]
+                         : options.cal[CAL_ENGINE_IDEAL_RPM_POWER];
+    VehiclePlant vehicle(VehicleParams(), options.scenario, options.bench.selectorRaw, idealRpm);
+    vehicle.setTrace(trace, SIM_TRACE_PERIOD_US);
+    ReplayPlant replay;
+    sim::Plant *plant = &bench;
+    if (options.vehicle)
+    {
+        plant = &vehicle;
+    }
+    else if (options.replay)
+    {
+        if (!replay.open(options.replayConfig))
+        {
+            return 1;
+        }
+        sim::setSerialListener(replaySerial, &replay);
+        plant = &replay;
+    }
+    sim::setPlant(plant, SIM_PLANT_STEP_US);
+
+    xTaskCreatePinnedToCore(loopTask, "loopTask", ARDUINO_LOOP_STACK, nullptr, ARDUINO_LOOP_PRIORITY, nullptr,
+                            ARDUINO_LOOP_CORE);
+
+    auto start = std::chrono::steady_clock::now();
+    sim::run(options.replay && !options.durationSet ? UINT64_MAX : (uint64_t)(options.durationS * 1e6));
+    uint64_t durationUs = sim::now();
+    double wallS = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    fprintf(stderr, "sim: %.3f s virtual in %.3f s wall (%.0fx), %llu task switches, %llu serial bytes, "
+                    "%llu CAN frames, sheave at %ld steps\n",
+            durationUs / 1e6, wallS, durationUs / 1e6 / (wallS > 0 ? wallS : 1e-9),
+            (unsigned long long)sim::switches(), (unsigned long long)sim::serialBytesWritten(),
+            (unsigned long long)canFrames, (long)(options.vehicle  ? vehicle.getPosition()
+                    : options.replay ? replay.getPosition()
+                                     : bench.getPosition()));
+    if (options.vehicle)
+    {
+        vehicle.printSummary(stderr);
+    }
+    if (options.replay)
+    {
+        replay.printSummary(stderr);
+    }
+
+    fflush(nullptr);
+    // Firmware tasks never return and their stacks hold live objects; skip global destructors.
+    _Exit(0);
+}
@@ -0,0 +1,356 @@
+#include "replay_log.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include "crc16.h"
+#include "telemetry.h"
+#include "config.h"
+
+#define REPLAY_DETECT_BYTES 65536 // capture prefix searched for a binary frame
+
+MappedFile::~MappedFile()
+{
+    if (this->bytes)
+    {
+        munmap(const_cast<uint8_t *>(this->bytes), this->length);
+    }
+}
+
+bool MappedFile::open(const char *path)
+{
+    int fd = ::open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        fprintf(stderr, "ERROR: cannot open %s\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return false;
+    }
+    this->length = info.st_size;
+    if (this->length > 0)
+    {
+        void *mapped = mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            fprintf(stderr, "ERROR: cannot map %s\n", path);
+            close(fd);
+            return false;
+        }
+        madvise(mapped, this->length, MADV_SEQUENTIAL);
+        this->bytes = static_cast<const uint8_t *>(mapped);
+    }
+    close(fd);
+    return true;
+}
+
+namespace {
+
+/**
+ * @brief Undo COBS; returns the decoded length, or 0 if the frame is malformed or too long.
+ */
+size_t cobsDecode(const uint8_t *input, size_t length, uint8_t *output, size_t capacity)
+{
+    size_t out = 0;
+    size_t i = 0;
+    while (i < length)
+    {
+        uint8_t code = input[i];
+        if (code == 0 || i + code > length || out + code - 1 > capacity)
+        {
+            return 0;
+        }
+        memcpy(output + out, input + i + 1, code - 1);
+        out += code - 1;
+        i += code;
+        if (code < 0xFF && i < length)
+        {
+            if (out >= capacity)
+            {
+                return 0;
+            }
+            output[out++] = 0;
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Result of decoding one candidate frame.
+ */
+enum FrameStatus {
+    FRAME_RECORD,  // valid telemetry record
+    FRAME_TAGGED,  // deferred log, black-box, or trace frame
+    FRAME_INVALID
+};
+
+FrameStatus decodeRecord(const uint8_t *frame, size_t length, TelemetryRecord &record)
+{
+    // The first decoded byte is the tag: a code byte of 1 encodes a leading zero.
+    if (length > 1 && frame[0] > 1 && frame[1] >= LOG_FRAME_TAG)
+    {
+        return FRAME_TAGGED;
+    }
+    uint8_t payload[sizeof(TelemetryRecord) + 2];
+    if (cobsDecode(frame, length, payload, sizeof(payload)) != sizeof(payload))
+    {
+        return FRAME_INVALID;
+    }
+    memcpy(&record, payload, sizeof(record));
+    uint16_t crc = payload[sizeof(record)] | (payload[sizeof(record) + 1] << 8);
+    if (record.version != TELEMETRY_RECORD_VERSION || crc16Update(0xFFFF, payload, sizeof(record)) != crc)
+    {
+        return FRAME_INVALID;
+    }
+    return FRAME_RECORD;
+}
+
+} // namespace
+
+bool TelemetryDecoder::decodeFrame(const uint8_t *frame, size_t length, ReplaySample &sample)
+{
+    TelemetryRecord record;
+    FrameStatus status = length ? decodeRecord(frame, length, record) : FRAME_INVALID;
+
+    // Debug text printed between frames has no delimiter of its own, so look for a valid
+    // frame after each newline before giving the bytes up as text.
+    const uint8_t *newline = frame + length;
+    bool text = false;
+    while (status == FRAME_INVALID)
+    {
+        newline = static_cast<const uint8_t *>(memrchr(frame, '\n', newline - frame));
+        if (!newline)
+        {
+            break;
+        }
+        text = true;
+        size_t rest = frame + length - (newline + 1);
+        status = rest ? decodeRecord(newline + 1, rest, record) : FRAME_INVALID;
+    }
+    if (status != FRAME_RECORD)
+    {
+        if (status == FRAME_INVALID && !text && length > 0)
+        {
+            this->badFrames++;
+        }
+        return false;
+    }
+
+    sample.timeUs = (uint64_t)record.timestampMs * 1000;
+    sample.engineRpm = record.engineRpm;
+    sample.vehicleSpeed = record.vehicleSpeed;
+    sample.motorPosition = record.motorPosition;
+    sample.motorSetpoint = record.motorSetpoint;
+    sample.controlMode = record.controlMode;
+    sample.brake = record.flags & TELEMETRY_FLAG_BRAKE;
+    sample.manualModeRaw = record.manualModeRaw;
+    sample.limitSwitchRaw = record.limitSwitchRaw;
+    sample.brakeRaw = record.brakeRaw;
+    return true;
+}
+
+/**
+ * @brief Fold one Teleplot line into the partial sample; true when it completes the sample.
+ */
+bool TelemetryDecoder::decodeLine(const char *line, size_t length, ReplaySample &sample)
+{
+    const char *colon = static_cast<const char *>(memchr(line, ':', length));
+    if (length < 2 || line[0] != '>' || !colon)
+    {
+        return false;
+    }
+    std::string name(line + 1, colon - line - 1);
+    std::string text(colon + 1, line + length - colon - 1);
+    double value = atof(text.c_str());
+
+    if (name == "Engine_RPM")
+    {
+        this->partial = {};
+        this->partial.manualModeRaw = -1;
+        this->partial.limitSwitchRaw = -1;
+        this->partial.brakeRaw = -1;
+        this->partial.engineRpm = value;
+        this->partialStarted = true;
+        return false;
+    }
+    if (!this->partialStarted)
+    {
+        return false;
+    }
+    if (name == "vehicle_speed")
+    {
+        this->partial.vehicleSpeed = value;
+    }
+    else if (name == "pos")
+    {
+        this->partial.motorPosition = (int32_t)value;
+    }
+    else if (name == "setpoint")
+    {
+        this->partial.motorSetpoint = (int32_t)value;
+    }
+    else if (name == "control_mode")
+    {
+        this->partial.controlMode = (uint8_t)value;
+    }
+    else if (name == "brake_state")
+    {
+        this->partial.brake = value != 0;
+    }
+    else if (name == "manual_mode")
+    {
+        this->partial.manualModeRaw = (int32_t)value;
+    }
+    else if (name == "limit")
+    {
+        this->partial.limitSwitchRaw = (int32_t)value;
+    }
+    else if (name == "can_tx_dropped")
+    {
+        // Last line printTeleplot() writes for a record.
+        this->partialStarted = false;
+        sample = this->partial;
+        sample.timeUs = this->textSamples++ * TELEMETRY_PERIOD_MS * 1000ULL;
+        return true;
+    }
+    return false;
+}
+
+size_t TelemetryDecoder::feed(const uint8_t *data, size_t length, ReplaySample &sample, bool &ready)
+{
+    ready = false;
+    uint8_t delimiter = this->binary ? 0 : '\n';
+    const uint8_t *end = static_cast<const uint8_t *>(memchr(data, delimiter, length));
+    if (!end)
+    {
+        this->pending.insert(this->pending.end(), data, data + length);
+        return length;
+    }
+
+    // Decode straight from the input unless part of the chunk arrived in an earlier call.
+    size_t consumed = end - data + 1;
+    const uint8_t *chunk = data;
+    size_t chunkLength = end - data;
+    if (!this->pending.empty())
+    {
+        this->pending.insert(this->pending.end(), data, end);
+        chunk = this->pending.data();
+        chunkLength = this->pending.size();
+    }
+
+    if (this->binary)
+    {
+        ready = this->decodeFrame(chunk, chunkLength, sample);
+    }
+    else
+    {
+        ready = this->decodeLine(reinterpret_cast<const char *>(chunk), chunkLength, sample);
+    }
+    this->pending.clear();
+    return consumed;
+}
+
+bool TelemetryDecoder::looksBinary(const uint8_t *data, size_t length)
+{
+    TelemetryDecoder probe(true);
+    size_t limit = length < REPLAY_DETECT_BYTES ? length : REPLAY_DETECT_BYTES;
+    size_t offset = 0;
+    while (offset < limit)
+    {
+        ReplaySample sample;
+        bool ready;
+        offset += probe.feed(data + offset, limit - offset, sample, ready);
+        if (ready)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TelemetryLogReader::open(const char *path)
+{
+    if (!this->file.open(path))
+    {
+        return false;
+    }
+    this->decoder = TelemetryDecoder(TelemetryDecoder::looksBinary(this->file.data(), this->file.size()));
+    this->offset = 0;
+    return true;
+}
+
+bool TelemetryLogReader::next(ReplaySample &sample)
+{
+    while (this->offset < this->file.size())
+    {
+        bool ready;
+        this->offset += this->decoder.feed(this->file.data() + this->offset, this->file.size() - this->offset, sample,
+                                           ready);
+        if (ready)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CanLogReader::open(const char *path)
+{
+    this->offset = 0;
+    return this->file.open(path);
+}
+
+bool CanLogReader::next(sim::CanFrame &frame)
+{
+    const char *data = reinterpret_cast<const char *>(this->file.data());
+    while (this->offset < this->file.size())
+    {
+        const char *line = data + this->offset;
+        size_t remaining = this->file.size() - this->offset;
+        const char *newline = static_cast<const char *>(memchr(line, '\n', remaining));
+        size_t length = newline ? newline - line : remaining;
+        this->offset += newline ? length + 1 : length;
+
+        // time_us,id,length,data
+        char text[96];
+        if (length == 0 || length >= sizeof(text) || line[0] < '0' || line[0] > '9')
+        {
+            continue;
+        }
+        memcpy(text, line, length);
+        text[length] = '\0';
+        char *field = text;
+        frame = {};
+        frame.timeUs = strtoull(field, &field, 10);
+        if (*field++ != ',')
+        {
+            continue;
+        }
+        frame.id = strtoul(field, &field, 16);
+        if (*field++ != ',')
+        {
+            continue;
+        }
+        unsigned long dlc = strtoul(field, &field, 10);
+        if (*field++ != ',' || dlc > 8 || strlen(field) < dlc * 2)
+        {
+            continue;
+        }
+        frame.length = dlc;
+        frame.extended = frame.id > 0x7FF;
+        for (unsigned i = 0; i < dlc; i++)
+        {
+            char byte[3] = {field[2 * i], field[2 * i + 1], '\0'};
+            frame.data[i] = strtoul(byte, nullptr, 16);
+        }
+        return true;
+    }
+    return false;
+}
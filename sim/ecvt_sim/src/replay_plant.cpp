@@ -0,0 +1,346 @@
+#include "replay_plant.h"
+#include <Arduino.h>
+#include <math.h>
+#include <stdlib.h>
+#include "driver/adc.h"
+#include "driver/pcnt.h"
+#include "driver/rmt.h"
+#include "config.h"
+
+#define ENCODER_COUNTS_PER_REV 4096 // Encoder::COUNT_PER_REV
+#define LIMIT_SWITCH_HIGH_RAW 4095
+#define LIMIT_SWITCH_LOW_RAW 0
+#define BRAKE_PRESSED_RAW 3000
+#define REPLAY_DEFAULT_SELECTOR_RAW 250 // POWER band, for logs without selector counts
+#define REPLAY_CAN_LOOKAHEAD_US 1000    // CAN frames are queued this far ahead of the clock
+#define REPLAY_PHASE_SCAN_US 30000000ULL // recorded time searched for the rpm sample phase
+#define RPM_PERIOD_US (RPM_SAMPLE_PERIOD_MS * 1000ULL)
+
+ReplayPlant::ReplayPlant() : firmwareDecoder(TELEMETRY_BINARY)
+{
+}
+
+bool ReplayPlant::openLog(TelemetryLogReader &reader, ReplaySample &first)
+{
+    if (!reader.open(this->config.logPath))
+    {
+        return false;
+    }
+    bool found = reader.next(first);
+    uint64_t firstUs = first.timeUs;
+    while (found && first.timeUs - firstUs < this->config.skipUs)
+    {
+        found = reader.next(first);
+    }
+    if (!found)
+    {
+        fprintf(stderr, "ERROR: no telemetry samples in %s\n", this->config.logPath);
+    }
+    return found;
+}
+
+bool ReplayPlant::open(const Config &config)
+{
+    this->config = config;
+    if (!this->openLog(this->log, this->upcoming) || !this->openLog(this->rpmLog, this->rpmNext))
+    {
+        return false;
+    }
+    this->hasUpcoming = true;
+    this->logStartUs = this->upcoming.timeUs;
+    this->current = this->upcoming;
+
+    // Keep the offset from boot modulo the rpm sample period, so the firmware's samples fall at
+    // the instants the recording's did.
+    this->playStartUs = this->logStartUs <= config.startUs
+                            ? this->logStartUs
+                            : this->logStartUs - (this->logStartUs - config.startUs) / RPM_PERIOD_US * RPM_PERIOD_US;
+    this->upcomingUs = this->playStartUs;
+
+    uint64_t phaseUs = this->findRpmPhase();
+    this->rpmWindowUs = this->logStartUs - this->logStartUs % RPM_PERIOD_US + phaseUs;
+    if (this->rpmWindowUs <= this->logStartUs)
+    {
+        this->rpmWindowUs += RPM_PERIOD_US;
+    }
+    this->hasRpmNext = true;
+    this->rpmRecorded = this->rpmNext.engineRpm;
+    this->rpmFiltered = this->rpmRecorded;
+
+    if (config.canPath)
+    {
+        if (!this->can.open(config.canPath))
+        {
+            return false;
+        }
+        this->hasCanFrame = this->can.next(this->canFrame);
+    }
+    if (config.diffPath)
+    {
+        this->diff = fopen(config.diffPath, "w");
+        if (!this->diff)
+        {
+            fprintf(stderr, "ERROR: cannot open %s\n", config.diffPath);
+            return false;
+        }
+        fprintf(this->diff, "log_time_s,engine_rpm,recorded_setpoint,new_setpoint,setpoint_error,recorded_position,"
+                            "new_position,recorded_mode,new_mode\n");
+    }
+    return true;
+}
+
+void ReplayPlant::update(uint64_t nowUs)
+{
+    this->lastUs = nowUs;
+
+    // The driver ignores STEP while disabled or asleep.
+    int64_t steps = sim::stepPosition(RMT_CHANNEL_0);
+    if (sim::gpioLevel(ENABLE_PIN) == HIGH && sim::gpioLevel(nSLEEP_PIN) == HIGH)
+    {
+        this->position += steps - this->lastSteps;
+    }
+    this->lastSteps = steps;
+
+    if (!this->started && nowUs >= this->playStartUs)
+    {
+        // Line the firmware's position up with the recording so the setpoints are comparable.
+        this->started = true;
+        if (this->hasFirmware)
+        {
+            this->position += this->upcoming.motorPosition - this->firmware.motorPosition;
+        }
+    }
+
+    if (this->started && !this->finished)
+    {
+        while (this->hasUpcoming && this->upcomingUs <= nowUs)
+        {
+            this->applySample(this->upcoming);
+            uint64_t previousUs = this->upcoming.timeUs;
+            this->hasUpcoming = this->log.next(this->upcoming);
+            // A timestamp that goes backwards is a reboot in the recording; keep playing at the telemetry rate.
+            this->upcomingUs += this->upcoming.timeUs > previousUs ? this->upcoming.timeUs - previousUs
+                                                                   : TELEMETRY_PERIOD_MS * 1000ULL;
+        }
+        if (!this->hasUpcoming)
+        {
+            this->finished = true;
+            sim::stop();
+        }
+        this->injectCan(nowUs + REPLAY_CAN_LOOKAHEAD_US);
+        this->synthesizeEngine(nowUs);
+    }
+
+    sim::setPcntInput(PRIMARY_COUNTER_ID, this->engineEdges);
+    sim::setPcntInput(ENCODER_COUNTER_ID, this->position * ENCODER_COUNTS_PER_REV / (STEPS_PER_REVOLUTION));
+
+    const ReplaySample &inputs = this->started && this->hasUpcoming ? this->upcoming : this->current;
+    bool limit = this->position <= LIMIT_SWITCH_POS;
+    sim::setAdc1(LIMIT_SWITCH_ADC_CHANNEL, this->started && inputs.limitSwitchRaw >= 0
+                                               ? inputs.limitSwitchRaw
+                                               : (limit ? LIMIT_SWITCH_HIGH_RAW : LIMIT_SWITCH_LOW_RAW));
+    sim::setAdc1(MANUAL_MODE_ADC_CHANNEL, inputs.manualModeRaw >= 0 ? inputs.manualModeRaw : REPLAY_DEFAULT_SELECTOR_RAW);
+    if (this->started)
+    {
+        sim::setAdc2(BRAKE_ADC_CHANNEL, inputs.brakeRaw >= 0 ? inputs.brakeRaw : (inputs.brake ? BRAKE_PRESSED_RAW : 0));
+    }
+}
+
+void ReplayPlant::applySample(const ReplaySample &sample)
+{
+    this->current = sample;
+    this->recordedSamples++;
+}
+
+/**
+ * @brief Phase of the recording's rpm samples within RPM_SAMPLE_PERIOD_MS.
+ *
+ * A change in the filtered rpm between two telemetry samples places an rpm sample between
+ * their timestamps. Each change votes for the millisecond phases it allows, and the middle of
+ * the best-supported run wins. A log whose rpm never changes has no phase to find, and 0 will do.
+ */
+uint64_t ReplayPlant::findRpmPhase()
+{
+    const int periodMs = RPM_SAMPLE_PERIOD_MS;
+    uint32_t votes[periodMs] = {};
+    TelemetryLogReader reader;
+    ReplaySample previous;
+    ReplaySample sample;
+    if (!this->openLog(reader, previous))
+    {
+        return 0;
+    }
+    while (reader.next(sample) && sample.timeUs > previous.timeUs && sample.timeUs - this->logStartUs < REPLAY_PHASE_SCAN_US)
+    {
+        if (sample.engineRpm != previous.engineRpm && sample.timeUs - previous.timeUs < RPM_PERIOD_US)
+        {
+            for (uint64_t ms = previous.timeUs / 1000; ms <= sample.timeUs / 1000; ms++)
+            {
+                votes[ms % periodMs]++;
+            }
+        }
+        previous = sample;
+    }
+
+    uint32_t best = 0;
+    for (int i = 0; i < periodMs; i++)
+    {
+        best = votes[i] > best ? votes[i] : best;
+    }
+    if (best == 0)
+    {
+        return 0;
+    }
+    // Longest circular run at the best count; start just after a phase below it if there is one.
+    int start = 0;
+    while (start < periodMs && votes[start] == best)
+    {
+        start++;
+    }
+    int runStart = 0;
+    int runLength = 0;
+    for (int i = 0, length = 0; i < periodMs; i++)
+    {
+        int phase = (start + i) % periodMs;
+        length = votes[phase] == best ? length + 1 : 0;
+        if (length > runLength)
+        {
+            runLength = length;
+            runStart = phase - length + 1;
+        }
+    }
+    return (uint64_t)((runStart + runLength / 2 + periodMs) % periodMs) * 1000;
+}
+
+/**
+ * @brief Latest recorded filtered rpm at a recorded time, reading ahead of playback.
+ */
+float ReplayPlant::recordedRpmAt(uint64_t recordedUs)
+{
+    while (this->hasRpmNext && this->rpmNext.timeUs <= recordedUs)
+    {
+        this->rpmRecorded = this->rpmNext.engineRpm;
+        uint64_t previousUs = this->rpmNext.timeUs;
+        this->hasRpmNext = this->rpmLog.next(this->rpmNext) && this->rpmNext.timeUs > previousUs;
+    }
+    return this->rpmRecorded;
+}
+
+/**
+ * @brief Deliver the Hall edges of each rpm window that has reached its midpoint.
+ *
+ * Sample k's filtered value is read half a period after it, clear of sample k+1, and
+ * raw = (filtered - (1 - alpha) * previous) / alpha gives the rpm over its window, which the
+ * firmware measured as a whole number of edges.
+ */
+void ReplayPlant::synthesizeEngine(uint64_t nowUs)
+{
+    const double edgesPerRpm = (double)PRIMARY_MAGNET_COUNT * EDGES_PER_MAGNET * RPM_PERIOD_US / 60e6;
+    while (this->playStartUs + (this->rpmWindowUs - this->logStartUs) - RPM_PERIOD_US / 2 <= nowUs)
+    {
+        float filtered = this->recordedRpmAt(this->rpmWindowUs + RPM_PERIOD_US / 2);
+        double raw = (filtered - (1.0 - RPM_FILTER_ALPHA) * this->rpmFiltered) / RPM_FILTER_ALPHA;
+        int64_t edges = llround(raw * edgesPerRpm);
+        this->engineEdges += edges > 0 ? edges : 0;
+        this->rpmFiltered = filtered;
+        this->rpmWindowUs += RPM_PERIOD_US;
+    }
+}
+
+void ReplayPlant::injectCan(uint64_t untilUs)
+{
+    while (this->hasCanFrame)
+    {
+        if (this->canFrame.timeUs >= this->logStartUs)
+        {
+            uint64_t atUs = this->playStartUs + (this->canFrame.timeUs - this->logStartUs);
+            if (atUs > untilUs)
+            {
+                return;
+            }
+            sim::CanFrame frame = this->canFrame;
+            frame.timeUs = atUs > this->lastUs ? atUs : this->lastUs;
+            sim::canInject(frame);
+        }
+        this->hasCanFrame = this->can.next(this->canFrame);
+    }
+}
+
+void ReplayPlant::onSerial(const uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        ReplaySample sample;
+        bool ready;
+        size_t used = this->firmwareDecoder.feed(data, length, sample, ready);
+        data += used;
+        length -= used;
+        if (!ready)
+        {
+            continue;
+        }
+        this->firmware = sample;
+        this->hasFirmware = true;
+        if (this->started && !this->finished)
+        {
+            this->compare(sample);
+        }
+    }
+}
+
+void ReplayPlant::compare(const ReplaySample &firmware)
+{
+    const ReplaySample &recorded = this->current;
+    int32_t error = firmware.motorSetpoint - recorded.motorSetpoint;
+    float logTimeS = (recorded.timeUs - this->logStartUs) / 1e6f;
+
+    ReplayDivergence &d = this->divergence;
+    d.samples++;
+    this->squares += (double)error * error;
+    if (abs(error) > d.setpointMaxError)
+    {
+        d.setpointMaxError = abs(error);
+        d.maxErrorTimeS = logTimeS;
+    }
+    if (abs(error) > this->config.tolerance)
+    {
+        d.overTolerance++;
+        if (d.firstDivergenceS < 0.0f)
+        {
+            d.firstDivergenceS = logTimeS;
+        }
+    }
+    if (firmware.controlMode != recorded.controlMode)
+    {
+        d.modeMismatches++;
+    }
+
+    if (this->diff)
+    {
+        fprintf(this->diff, "%.3f,%.1f,%ld,%ld,%ld,%ld,%ld,%u,%u\n", logTimeS, recorded.engineRpm,
+                (long)recorded.motorSetpoint, (long)firmware.motorSetpoint, (long)error, (long)recorded.motorPosition,
+                (long)firmware.motorPosition, recorded.controlMode, firmware.controlMode);
+    }
+}
+
+ReplayDivergence ReplayPlant::getDivergence() const
+{
+    ReplayDivergence d = this->divergence;
+    d.setpointRms = d.samples ? sqrt(this->squares / d.samples) : 0.0f;
+    return d;
+}
+
+void ReplayPlant::printSummary(FILE *out) const
+{
+    ReplayDivergence d = this->getDivergence();
+    if (this->diff)
+    {
+        fflush(this->diff);
+    }
+    fprintf(out, "replay: recorded=%llu compared=%llu%s setpoint_rms=%.1f max_error=%ld at_s=%.3f "
+                 "first_divergence_s=%.3f over_tolerance=%llu mode_mismatches=%llu bad_frames=%llu\n",
+            (unsigned long long)this->recordedSamples, (unsigned long long)d.samples,
+            this->finished ? "" : " (truncated)", d.setpointRms, (long)d.setpointMaxError, d.maxErrorTimeS,
+            d.firstDivergenceS, (unsigned long long)d.overTolerance, (unsigned long long)d.modeMismatches,
+            (unsigned long long)this->log.getBadFrames());
+}
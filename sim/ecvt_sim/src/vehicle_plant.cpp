@@ -0,0 +1,276 @@
+#include "vehicle_plant.h"
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+#include "driver/adc.h"
+#include "driver/pcnt.h"
+#include "driver/rmt.h"
+#include "config.h"
+
+#define VEHICLE_STEP_S 0.0001f          // integration step
+#define VEHICLE_IDEAL_RPM_BAND 100.0f   // rpm counted as reaching the ideal speed
+#define VEHICLE_STOPPED_SPEED 0.05f     // m/s below which static friction and brakes hold the car
+#define VEHICLE_AIR_DENSITY 1.2f
+#define VEHICLE_GRAVITY 9.81f
+#define ENCODER_COUNTS_PER_REV 4096     // Encoder::COUNT_PER_REV
+#define LIMIT_SWITCH_HIGH_RAW 4095
+#define BRAKE_PRESSED_RAW 3000
+#define RPM_PER_RAD_S (60.0f / (2.0f * (float)M_PI))
+
+/**
+ * @brief Full-throttle torque of a 10 hp single-cylinder engine, N m by rpm.
+ */
+static const float torqueCurve[][2] = {
+    {0, 10.0f}, {1200, 14.0f}, {1600, 17.5f}, {2000, 18.8f}, {2400, 19.3f},
+    {2800, 19.0f}, {3200, 17.8f}, {3600, 15.6f},
+};
+
+bool Scenario::preset(const char *name, Scenario &scenario)
+{
+    scenario = Scenario();
+    if (strcmp(name, "launch") == 0)
+    {
+        scenario.name = "launch";
+    }
+    else if (strcmp(name, "hill") == 0)
+    {
+        scenario.name = "hill";
+        scenario.gradeStartS = 10.0f;
+        scenario.grade = 0.3f;
+    }
+    else if (strcmp(name, "brake") == 0)
+    {
+        scenario.name = "brake";
+        scenario.throttleOffS = 12.0f;
+        scenario.brakeOnS = 12.0f;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+VehiclePlant::VehiclePlant(const VehicleParams &params, const Scenario &scenario, uint16_t selectorRaw, float idealRpm)
+    : params(params), scenario(scenario), selectorRaw(selectorRaw), idealRpm(idealRpm),
+      engineSpeed(ENGINE_IDLE_RPM / RPM_PER_RAD_S), sheave(0.0f)
+{
+}
+
+void VehiclePlant::setTrace(FILE *out, uint32_t periodUs)
+{
+    this->trace = out;
+    this->tracePeriodUs = periodUs;
+    if (out)
+    {
+        fprintf(out, "time_s,throttle,brake,grade,engine_rpm,primary_rpm,ratio,belt_torque_nm,speed_mps,"
+                     "sheave_steps,commanded_steps,lost_steps\n");
+    }
+}
+
+float VehiclePlant::engineTorque(float rpm, float throttle) const
+{
+    const int points = sizeof(torqueCurve) / sizeof(torqueCurve[0]);
+    float full = torqueCurve[points - 1][1];
+    for (int i = 1; i < points; i++)
+    {
+        if (rpm < torqueCurve[i][0])
+        {
+            float f = (rpm - torqueCurve[i - 1][0]) / (torqueCurve[i][0] - torqueCurve[i - 1][0]);
+            full = torqueCurve[i - 1][1] + f * (torqueCurve[i][1] - torqueCurve[i - 1][1]);
+            break;
+        }
+    }
+    // Governor: torque tapers to zero between ENGINE_MAX_RPM and governorRpm.
+    if (rpm > ENGINE_MAX_RPM)
+    {
+        full *= clamp01((this->params.governorRpm - rpm) / (this->params.governorRpm - ENGINE_MAX_RPM));
+    }
+
+    float friction = this->params.engineFriction + this->params.engineFrictionPerRpm * rpm;
+    float torque = throttle * full;
+    if (rpm < ENGINE_IDLE_RPM)
+    {
+        // Idle governor: cover friction and pull back up to ENGINE_IDLE_RPM.
+        float idle = friction + this->params.idleGain * (ENGINE_IDLE_RPM - rpm);
+        torque = torque > idle ? torque : (idle < full ? idle : full);
+    }
+    return torque - friction;
+}
+
+float VehiclePlant::ratio() const
+{
+    float f = clamp01((this->sheave - this->params.lowFull) / (this->params.highFull - this->params.lowFull));
+    return this->params.lowRatio + f * (this->params.highRatio - this->params.lowRatio);
+}
+
+void VehiclePlant::update(uint64_t nowUs)
+{
+    float t = this->lastUs / 1e6f;
+    float remaining = (nowUs - this->lastUs) / 1e6f;
+    this->lastUs = nowUs;
+
+    // Sheave actuator: follow new step pulses unless the stepper cannot push them.
+    int64_t command = sim::stepPosition(RMT_CHANNEL_0);
+    int64_t delta = command - this->lastCommand;
+    this->lastCommand = command;
+    bool powered = sim::gpioLevel(ENABLE_PIN) == HIGH && sim::gpioLevel(nSLEEP_PIN) == HIGH;
+    if (delta != 0 && powered)
+    {
+        // Closing the sheave works against the belt; opening is assisted and only sees friction.
+        float force = delta > 0 ? this->params.clampForce * clamp01((this->sheave - this->params.clampStart) /
+                                                                     (this->params.lowFull - this->params.clampStart)) +
+                                      this->params.clampForcePerTorque * fabsf(this->beltTorque)
+                                : 0.0f;
+        float required = force * this->params.leadscrewLead / (2.0f * (float)M_PI * this->params.leadscrewEfficiency);
+        float rate = remaining > 0.0f ? fabsf((float)delta) / remaining : 0.0f;
+        float available = this->params.stepperHoldTorque * (1.0f - rate / this->params.stepperMaxRate);
+        if (required > available)
+        {
+            this->lostSteps += delta > 0 ? delta : -delta;
+        }
+        else
+        {
+            float before = this->sheave;
+            float target = this->sheave + (float)delta;
+            this->sheave = target < this->params.travelMin ? this->params.travelMin
+                                                           : (target > this->params.travelMax ? this->params.travelMax : target);
+            this->lostSteps += (int64_t)fabsf(target - this->sheave);
+            this->travel += fabsf(this->sheave - before);
+        }
+    }
+    else if (delta != 0)
+    {
+        this->lostSteps += delta > 0 ? delta : -delta;
+    }
+
+    while (remaining > 1e-7f)
+    {
+        float dt = remaining < VEHICLE_STEP_S ? remaining : VEHICLE_STEP_S;
+        this->step(t, dt);
+        t += dt;
+        remaining -= dt;
+    }
+
+    sim::setPcntInput(PRIMARY_COUNTER_ID,
+                      (int64_t)(this->engineAngle / (2.0 * M_PI) * PRIMARY_MAGNET_COUNT * EDGES_PER_MAGNET));
+    sim::setPcntInput(ENCODER_COUNTER_ID, (int64_t)(this->sheave * ENCODER_COUNTS_PER_REV / (STEPS_PER_REVOLUTION)));
+    sim::setAdc1(LIMIT_SWITCH_ADC_CHANNEL, this->sheave <= LIMIT_SWITCH_POS ? LIMIT_SWITCH_HIGH_RAW : 0);
+    sim::setAdc1(MANUAL_MODE_ADC_CHANNEL, this->selectorRaw);
+    sim::setAdc2(BRAKE_ADC_CHANNEL, this->braking ? BRAKE_PRESSED_RAW : 0);
+
+    if (this->trace && nowUs >= this->nextTraceUs)
+    {
+        this->nextTraceUs = nowUs + this->tracePeriodUs;
+        float gearing = this->ratio() * this->params.gearboxRatio / this->params.wheelRadius;
+        fprintf(this->trace, "%.4f,%.2f,%d,%.3f,%.1f,%.1f,%.3f,%.2f,%.3f,%.0f,%lld,%lld\n",
+                nowUs / 1e6, this->throttle, this->braking ? 1 : 0, this->grade,
+                this->engineSpeed * RPM_PER_RAD_S, this->speed * gearing * RPM_PER_RAD_S, this->ratio(),
+                this->beltTorque, this->speed, this->sheave, (long long)command, (long long)this->lostSteps);
+    }
+}
+
+/**
+ * @brief Advance the engine, belt, and vehicle by dt.
+ *
+ * The belt torque is solved implicitly from the slip at the end of the step, so the stiff
+ * clamped coupling stays stable at any step size, then limited to the clamp capacity.
+ */
+void VehiclePlant::step(float t, float dt)
+{
+    const Scenario &s = this->scenario;
+    this->throttle = t >= s.throttleOnS && (s.throttleOffS < 0.0f || t < s.throttleOffS) ? 1.0f : 0.0f;
+    this->braking = s.brakeOnS >= 0.0f && t >= s.brakeOnS;
+    this->grade = s.gradeStartS >= 0.0f && t >= s.gradeStartS ? s.grade : 0.0f;
+
+    const VehicleParams &p = this->params;
+    float rpm = this->engineSpeed * RPM_PER_RAD_S;
+    float engine = this->engineTorque(rpm, this->throttle);
+
+    // Primary shaft speed and the vehicle inertia and load seen at the primary.
+    float k = this->ratio() * p.gearboxRatio / p.wheelRadius; // primary rad/s per m/s
+    float primary = this->speed * k;
+    float reflectedInertia = p.mass / (k * k);
+    float slope = atanf(this->grade);
+    float resist = p.mass * VEHICLE_GRAVITY * (sinf(slope) + (this->speed > 0.0f ? p.rollingResistance * cosf(slope) : 0.0f)) +
+                   0.5f * VEHICLE_AIR_DENSITY * p.dragArea * this->speed * this->speed +
+                   (this->braking && this->speed > 0.0f ? p.brakeForce : 0.0f);
+    float load = resist / k;
+
+    float capacity = p.beltTorqueCapacity * clamp01((this->sheave - p.clampStart) / (p.lowFull - p.clampStart));
+    float slip = this->engineSpeed - primary;
+    float slipFree = slip + dt * (engine / p.engineInertia + load / reflectedInertia);
+    float coupled = p.beltStiffness * slipFree /
+                    (1.0f + dt * p.beltStiffness * (1.0f / p.engineInertia + p.drivelineEfficiency / reflectedInertia));
+    this->beltTorque = coupled > capacity ? capacity : (coupled < -capacity ? -capacity : coupled);
+
+    this->engineSpeed += dt * (engine - this->beltTorque) / p.engineInertia;
+    if (this->engineSpeed < 0.0f)
+    {
+        this->engineSpeed = 0.0f;
+    }
+    this->engineAngle += this->engineSpeed * dt;
+
+    float drive = this->beltTorque * p.drivelineEfficiency * k;
+    float accel = (drive - resist) / p.mass;
+    if (this->speed <= VEHICLE_STOPPED_SPEED && accel < 0.0f && drive < resist)
+    {
+        // Static friction, brakes, or the grade hold the car; it does not roll back.
+        float holding = p.mass * VEHICLE_GRAVITY * p.rollingResistance + (this->braking ? p.brakeForce : 0.0f);
+        if (drive + holding >= p.mass * VEHICLE_GRAVITY * sinf(slope) || this->speed <= 0.0f)
+        {
+            this->speed = 0.0f;
+            accel = 0.0f;
+        }
+    }
+    this->speed += accel * dt;
+    if (this->speed < 0.0f)
+    {
+        this->speed = 0.0f;
+    }
+    this->distance += this->speed * dt;
+
+    // Metrics from throttle-on.
+    if (t < s.throttleOnS)
+    {
+        return;
+    }
+    if (this->speed > this->maxSpeed)
+    {
+        this->maxSpeed = this->speed;
+    }
+    float error = this->engineSpeed * RPM_PER_RAD_S - this->idealRpm;
+    bool driving = capacity > 0.0f && this->speed > VEHICLE_STOPPED_SPEED;
+    if (this->timeToIdeal < 0.0f && driving && fabsf(error) <= VEHICLE_IDEAL_RPM_BAND)
+    {
+        this->timeToIdeal = t - s.throttleOnS;
+    }
+    if (capacity > 0.0f && this->throttle > 0.0f && !this->braking)
+    {
+        this->rpmErrorSquares += (double)error * error;
+        this->rpmErrorSamples++;
+    }
+}
+
+VehicleMetrics VehiclePlant::getMetrics() const
+{
+    VehicleMetrics metrics;
+    metrics.idealRpm = this->idealRpm;
+    metrics.rpmErrorRms = this->rpmErrorSamples ? sqrt(this->rpmErrorSquares / this->rpmErrorSamples) : 0.0f;
+    metrics.timeToIdealS = this->timeToIdeal;
+    metrics.sheaveTravelSteps = this->travel;
+    metrics.maxSpeed = this->maxSpeed;
+    metrics.distance = this->distance;
+    metrics.lostSteps = this->lostSteps;
+    return metrics;
+}
+
+void VehiclePlant::printSummary(FILE *out) const
+{
+    VehicleMetrics m = this->getMetrics();
+    float stepsPerMm = (STEPS_PER_REVOLUTION) / (this->params.leadscrewLead * 1000.0f);
+    fprintf(out, "vehicle: scenario=%s ideal_rpm=%.0f rpm_error_rms=%.1f time_to_ideal_s=%.3f "
+                 "sheave_travel_mm=%.1f max_speed_kph=%.1f distance_m=%.1f final_speed_kph=%.1f lost_steps=%lld\n",
+            this->scenario.name, m.idealRpm, m.rpmErrorRms, m.timeToIdealS, m.sheaveTravelSteps / stepsPerMm,
+            m.maxSpeed * 3.6f, m.distance, this->speed * 3.6f, (long long)m.lostSteps);
+}
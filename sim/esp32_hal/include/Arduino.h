@@ -0,0 +1,102 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "driver/gpio.h"
+
+/**
+ * @file Arduino.h
+ * @brief Host stand-in for the arduino-esp32 core: timing on the virtual clock, GPIO and
+ * analogRead on the simulated pins, and a Serial port that writes to sim::setSerialOutput().
+ */
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+#define PULLDOWN 0x08
+#define INPUT_PULLDOWN 0x09
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define BIT(nr) (1UL << (nr))
+#define IRAM_ATTR
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+using std::max;
+using std::min;
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+/**
+ * @brief Serial port on the simulated UART. Output goes to the file set with sim::setSerialOutput().
+ */
+class HardwareSerial {
+public:
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+    void setTxBufferSize(size_t size) { (void)size; }
+    void setRxBufferSize(size_t size) { (void)size; }
+    int available();
+    int read();
+    int availableForWrite() { return 4096; }
+    void flush() {}
+    size_t write(uint8_t byte) { return write(&byte, 1); }
+    size_t write(const uint8_t *data, size_t length);
+    size_t print(const char *text) { return write(reinterpret_cast<const uint8_t *>(text), strlen(text)); }
+    size_t println(const char *text = "") { return print(text) + print("\r\n"); }
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HardwareSerial Serial;
+
+/**
+ * @brief Chip information. The cycle counter follows the virtual clock at the CPU frequency.
+ */
+class EspClass {
+public:
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getFreeHeap() { return 200000; }
+    void restart();
+};
+
+extern EspClass ESP;
+
+void setup();
+void loop();
+
+#endif // SIM_ARDUINO_H
@@ -0,0 +1,48 @@
+#ifndef SIM_PREFERENCES_H
+#define SIM_PREFERENCES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file Preferences.h
+ * @brief Host stand-in for the Arduino NVS wrapper, backed by an in-memory store that
+ * lasts for the simulated run.
+ */
+
+class Preferences {
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end();
+    bool clear();
+    bool remove(const char *key);
+    bool isKey(const char *key);
+
+    size_t putUChar(const char *key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putUShort(const char *key, uint16_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putUInt(const char *key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putInt(const char *key, int32_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putFloat(const char *key, float value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putBytes(const char *key, const void *value, size_t length);
+
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return get(key, defaultValue); }
+    uint16_t getUShort(const char *key, uint16_t defaultValue = 0) { return get(key, defaultValue); }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    int32_t getInt(const char *key, int32_t defaultValue = 0) { return get(key, defaultValue); }
+    float getFloat(const char *key, float defaultValue = 0.0f) { return get(key, defaultValue); }
+    size_t getBytesLength(const char *key);
+    size_t getBytes(const char *key, void *buffer, size_t length);
+
+private:
+    template <typename T>
+    T get(const char *key, T defaultValue) {
+        T value;
+        return getBytesLength(key) == sizeof(T) && getBytes(key, &value, sizeof(T)) == sizeof(T) ? value : defaultValue;
+    }
+
+    char name[16] = {0};
+    bool open = false;
+    bool readOnly = true;
+};
+
+#endif // SIM_PREFERENCES_H
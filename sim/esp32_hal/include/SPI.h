@@ -0,0 +1,55 @@
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+
+#include <stdint.h>
+
+/**
+ * @file SPI.h
+ * @brief Host stand-in for the Arduino SPI class. The device on the bus is a DRV8462
+ * register file (sim::driverRegister()): 16-bit frames carry R/W in bit 14, the address in
+ * bits 13..8, and data in bits 7..0, and every reply has the two status bits set.
+ */
+
+#define VSPI 3
+#define HSPI 2
+
+#define SPI_MODE0 0
+#define SPI_MODE1 1
+#define SPI_MODE2 2
+#define SPI_MODE3 3
+
+#ifndef MSBFIRST
+#define LSBFIRST 0
+#define MSBFIRST 1
+#endif
+
+class SPISettings {
+public:
+    SPISettings(uint32_t clock = 1000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0)
+        : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+
+    uint32_t clock;
+    uint8_t bitOrder;
+    uint8_t dataMode;
+};
+
+class SPIClass {
+public:
+    explicit SPIClass(uint8_t bus = HSPI) : bus(bus) {}
+
+    void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1);
+    void end() {}
+    void beginTransaction(SPISettings settings) { (void)settings; }
+    void endTransaction() {}
+    uint8_t transfer(uint8_t data);
+    uint16_t transfer16(uint16_t data);
+    int8_t pinSS() const { return ss; }
+
+private:
+    uint8_t bus;
+    int8_t ss = -1;
+};
+
+extern SPIClass SPI;
+
+#endif // SIM_SPI_H
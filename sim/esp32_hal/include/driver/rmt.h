@@ -0,0 +1,63 @@
+#ifndef SIM_RMT_H
+#define SIM_RMT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+/**
+ * @file rmt.h
+ * @brief Host stand-in for the RMT transmit driver. Written items play out on the virtual
+ * clock and each rising edge counts as one step (sim::stepPosition()).
+ */
+
+typedef enum { RMT_CHANNEL_0, RMT_CHANNEL_1, RMT_CHANNEL_2, RMT_CHANNEL_3, RMT_CHANNEL_4, RMT_CHANNEL_5, RMT_CHANNEL_6, RMT_CHANNEL_7, RMT_CHANNEL_MAX } rmt_channel_t;
+typedef enum { RMT_MODE_TX, RMT_MODE_RX } rmt_mode_t;
+typedef enum { RMT_IDLE_LEVEL_LOW, RMT_IDLE_LEVEL_HIGH } rmt_idle_level_t;
+typedef enum { RMT_CARRIER_LEVEL_LOW, RMT_CARRIER_LEVEL_HIGH } rmt_carrier_level_t;
+typedef enum { RMT_CHANNEL_UNINIT, RMT_CHANNEL_IDLE, RMT_CHANNEL_BUSY } rmt_channel_status_t;
+
+typedef struct {
+    union {
+        struct {
+            uint32_t duration0 : 15;
+            uint32_t level0 : 1;
+            uint32_t duration1 : 15;
+            uint32_t level1 : 1;
+        };
+        uint32_t val;
+    };
+} rmt_item32_t;
+
+typedef struct {
+    bool loop_en;
+    uint32_t carrier_freq_hz;
+    uint8_t carrier_duty_percent;
+    rmt_carrier_level_t carrier_level;
+    bool carrier_en;
+    rmt_idle_level_t idle_level;
+    bool idle_output_en;
+} rmt_tx_config_t;
+
+typedef struct {
+    rmt_mode_t rmt_mode;
+    rmt_channel_t channel;
+    gpio_num_t gpio_num;
+    uint8_t clk_div;
+    uint8_t mem_block_num;
+    uint32_t flags;
+    rmt_tx_config_t tx_config;
+} rmt_config_t;
+
+typedef struct {
+    rmt_channel_status_t status[RMT_CHANNEL_MAX];
+} rmt_channel_status_result_t;
+
+esp_err_t rmt_config(const rmt_config_t *config);
+esp_err_t rmt_driver_install(rmt_channel_t channel, size_t rxBufferSize, int intrFlags);
+esp_err_t rmt_write_items(rmt_channel_t channel, const rmt_item32_t *items, int count, bool waitDone);
+esp_err_t rmt_tx_stop(rmt_channel_t channel);
+esp_err_t rmt_get_channel_status(rmt_channel_status_result_t *status);
+
+#endif // SIM_RMT_H
@@ -0,0 +1,11 @@
+#ifndef SIM_ESP_SPI_FLASH_H
+#define SIM_ESP_SPI_FLASH_H
+
+/**
+ * @file esp_spi_flash.h
+ * @brief Host stand-in for the flash geometry constants.
+ */
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+#endif // SIM_ESP_SPI_FLASH_H
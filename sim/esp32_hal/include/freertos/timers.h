@@ -0,0 +1,25 @@
+#ifndef SIM_TIMERS_H
+#define SIM_TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+
+/**
+ * @file timers.h
+ * @brief Host stand-in for FreeRTOS software timers. Callbacks and pended functions run
+ * in scheduler context, as they would on the timer daemon.
+ */
+
+typedef struct tmrTimerControl *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+typedef void (*PendedFunction_t)(void *arg1, uint32_t arg2);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t autoReload, void *id,
+                           TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticksToWait);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticksToWait);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticksToWait);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+BaseType_t xTimerPendFunctionCall(PendedFunction_t function, void *arg1, uint32_t arg2, TickType_t ticksToWait);
+BaseType_t xTimerPendFunctionCallFromISR(PendedFunction_t function, void *arg1, uint32_t arg2, BaseType_t *woken);
+
+#endif // SIM_TIMERS_H
@@ -0,0 +1,162 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @file sim.h
+ * @brief Control surface of the host hardware abstraction behind the vendor headers.
+ *
+ * Firmware code keeps calling the Arduino, ESP-IDF, and FreeRTOS APIs; on the native
+ * build those resolve to this library. Everything runs on one host thread under a
+ * virtual microsecond clock. FreeRTOS tasks are coroutines that give up the CPU only
+ * when they block, and timers, esp_timers, interrupts, and peripheral events fire
+ * between task runs. Code takes no virtual time, so a run is deterministic and runs as
+ * fast as the host allows.
+ */
+
+namespace sim {
+
+/**
+ * @brief Virtual time in microseconds since boot.
+ */
+uint64_t now();
+
+/**
+ * @brief Run tasks and events until virtual time reaches untilUs or stop() is called.
+ */
+void run(uint64_t untilUs);
+
+/**
+ * @brief End run() after the current task or event returns.
+ */
+void stop();
+
+/**
+ * @brief Call fn(arg) from scheduler context at virtual time atUs.
+ */
+void at(uint64_t atUs, void (*fn)(void *), void *arg);
+
+/**
+ * @brief Number of task switches performed, for throughput reporting.
+ */
+uint64_t switches();
+
+/**
+ * @brief Physical world around the board. update() advances it to nowUs and refreshes
+ * the simulated sensor inputs (PCNT totals, ADC counts, GPIO levels).
+ */
+class Plant {
+public:
+    virtual ~Plant() {}
+    virtual void update(uint64_t nowUs) = 0;
+};
+
+/**
+ * @brief Install the plant. It is updated whenever time advances, at most maxStepUs apart.
+ */
+void setPlant(Plant *plant, uint32_t maxStepUs);
+
+/**
+ * @brief Output level last written to a pin, or the level driven onto an input.
+ */
+int gpioLevel(int pin);
+
+/**
+ * @brief Drive an input pin, firing any interrupt attached to the edge.
+ */
+void setGpioInput(int pin, int level);
+
+/**
+ * @brief Set the absolute number of counted edges seen at a PCNT unit input.
+ *
+ * The unit's counter reads the total minus the total when it was last cleared, with the
+ * hardware reset to zero at its limits.
+ */
+void setPcntInput(int unit, int64_t total);
+
+/**
+ * @brief Feed a PCNT unit from an RMT channel's step pulses, as if its input pin were jumpered
+ * to the channel's output. Exact at every read, unlike a plant calling setPcntInput.
+ */
+void setPcntLoopback(int unit, int rmtChannel);
+
+/**
+ * @brief Set the conversion result of an ADC1 or ADC2 channel in raw counts.
+ */
+void setAdc1(int channel, uint16_t raw);
+void setAdc2(int channel, uint16_t raw);
+
+/**
+ * @brief Tell the RMT model which GPIO sets the direction of a channel's step pulses.
+ * @param positiveLevel Direction level that counts steps as positive.
+ */
+void setStepDirectionPin(int channel, int pin, int positiveLevel);
+
+/**
+ * @brief Net step pulses (rising edges) an RMT channel has emitted up to now.
+ */
+int64_t stepPosition(int channel);
+
+/**
+ * @brief All step pulses an RMT channel has emitted up to now, regardless of direction.
+ */
+int64_t stepPulses(int channel);
+
+/**
+ * @brief DRV8462 register file behind the SPI bus. Writes inject faults or diagnostics.
+ */
+uint8_t driverRegister(uint8_t address);
+void setDriverRegister(uint8_t address, uint8_t value);
+
+/**
+ * @brief One CAN frame on the simulated bus.
+ */
+struct CanFrame {
+    uint64_t timeUs;
+    uint32_t id;
+    bool extended;
+    uint8_t length;
+    uint8_t data[8];
+};
+
+/**
+ * @brief Put a frame on the bus for the board to receive, subject to its acceptance filter.
+ */
+void canInject(const CanFrame &frame);
+
+/**
+ * @brief Called for every frame the board finishes transmitting.
+ */
+void setCanTxListener(void (*listener)(const CanFrame &frame, void *arg), void *arg);
+
+/**
+ * @brief Send the board's serial output to a file; null discards it.
+ */
+void setSerialOutput(FILE *out);
+
+/**
+ * @brief Called with every block the board writes to its serial port, in addition to the output file.
+ */
+void setSerialListener(void (*listener)(const uint8_t *data, size_t length, void *arg), void *arg);
+
+/**
+ * @brief Queue text for the board's serial input.
+ */
+void serialInput(const char *text);
+
+/**
+ * @brief Bytes the board has written to its serial port.
+ */
+uint64_t serialBytesWritten();
+
+/**
+ * @brief Add a flash partition, erased, for esp_partition_find_first().
+ */
+void addPartition(const char *label, int type, int subtype, size_t size);
+
+} // namespace sim
+
+#endif // SIM_H
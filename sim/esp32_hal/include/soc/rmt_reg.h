@@ -0,0 +1,9 @@
+#ifndef SIM_RMT_REG_H
+#define SIM_RMT_REG_H
+
+/**
+ * @file rmt_reg.h
+ * @brief Empty host stand-in; the firmware includes it but uses no registers directly.
+ */
+
+#endif // SIM_RMT_REG_H
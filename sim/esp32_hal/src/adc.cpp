@@ -0,0 +1,175 @@
+#include "driver/adc.h"
+#include <string.h>
+#include "internal.h"
+
+namespace {
+
+uint16_t adc1[ADC1_CHANNEL_MAX];
+uint16_t adc2[ADC2_CHANNEL_MAX];
+
+struct Dma {
+    bool initialized;
+    bool running;
+    uint32_t frameBytes;
+    uint32_t storeBytes;
+    uint32_t sampleRateHz;
+    uint32_t patternCount;
+    uint8_t pattern[16];  // ADC1 channels in scan order
+    uint64_t startUs;
+    uint64_t framesRead;  // frames consumed since start, including dropped ones
+    uint32_t nextPattern; // scan position of the next conversion
+};
+
+Dma dma;
+
+uint64_t frameDoneUs(uint64_t frame)
+{
+    uint64_t samples = frame * (dma.frameBytes / SOC_ADC_DIGI_RESULT_BYTES);
+    return dma.startUs + samples * 1000000 / dma.sampleRateHz;
+}
+
+} // namespace
+
+namespace sim {
+
+void setAdc1(int channel, uint16_t raw)
+{
+    if (channel >= 0 && channel < ADC1_CHANNEL_MAX)
+    {
+        adc1[channel] = raw & 0xFFF;
+    }
+}
+
+void setAdc2(int channel, uint16_t raw)
+{
+    if (channel >= 0 && channel < ADC2_CHANNEL_MAX)
+    {
+        adc2[channel] = raw & 0xFFF;
+    }
+}
+
+uint16_t adcRaw(int unit, int channel)
+{
+    if (unit == 1 && channel >= 0 && channel < ADC1_CHANNEL_MAX)
+    {
+        return adc1[channel];
+    }
+    if (unit == 2 && channel >= 0 && channel < ADC2_CHANNEL_MAX)
+    {
+        return adc2[channel];
+    }
+    return 0;
+}
+
+} // namespace sim
+
+esp_err_t adc_digi_initialize(const adc_digi_init_config_t *config)
+{
+    if (config->conv_num_each_intr == 0 || config->conv_num_each_intr % SOC_ADC_DIGI_RESULT_BYTES)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    dma.frameBytes = config->conv_num_each_intr;
+    dma.storeBytes = config->max_store_buf_size;
+    dma.initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_controller_configure(const adc_digi_configuration_t *config)
+{
+    if (!dma.initialized || config->pattern_num == 0 || config->pattern_num > sizeof(dma.pattern) ||
+        config->sample_freq_hz == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    dma.patternCount = config->pattern_num;
+    for (uint32_t i = 0; i < config->pattern_num; i++)
+    {
+        dma.pattern[i] = config->adc_pattern[i].channel;
+    }
+    dma.sampleRateHz = config->sample_freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_start()
+{
+    if (!dma.initialized || !dma.sampleRateHz)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    dma.running = true;
+    dma.startUs = sim::now();
+    dma.framesRead = 0;
+    dma.nextPattern = 0;
+    return ESP_OK;
+}
+
+esp_err_t adc_digi_stop()
+{
+    dma.running = false;
+    return ESP_OK;
+}
+
+/**
+ * @brief Return the next completed DMA frame, blocking until it completes. Conversions
+ * sample the channel values at the time the frame completes.
+ */
+esp_err_t adc_digi_read_bytes(uint8_t *buffer, uint32_t length, uint32_t *outLength, uint32_t timeoutMs)
+{
+    *outLength = 0;
+    if (!dma.running)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint64_t readyUs = frameDoneUs(dma.framesRead + 1);
+    if (sim::now() < readyUs)
+    {
+        uint64_t deadline = sim::now() + (uint64_t)timeoutMs * 1000;
+        sim::block(readyUs < deadline ? readyUs : deadline);
+        if (sim::now() < readyUs)
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+
+    // Frames the reader fell behind on beyond the store buffer are lost, as in the driver.
+    uint64_t completed = (sim::now() - dma.startUs) * dma.sampleRateHz / 1000000 / (dma.frameBytes / SOC_ADC_DIGI_RESULT_BYTES);
+    uint64_t stored = dma.storeBytes / dma.frameBytes;
+    if (stored && completed > dma.framesRead + stored)
+    {
+        dma.framesRead = completed - stored;
+    }
+
+    uint32_t bytes = length < dma.frameBytes ? length - length % SOC_ADC_DIGI_RESULT_BYTES : dma.frameBytes;
+    for (uint32_t i = 0; i < bytes; i += SOC_ADC_DIGI_RESULT_BYTES)
+    {
+        adc_digi_output_data_t sample;
+        sample.val = 0;
+        uint8_t channel = dma.pattern[dma.nextPattern];
+        sample.type1.channel = channel;
+        sample.type1.data = channel < ADC1_CHANNEL_MAX ? adc1[channel] : 0;
+        memcpy(&buffer[i], &sample, SOC_ADC_DIGI_RESULT_BYTES);
+        dma.nextPattern = (dma.nextPattern + 1) % dma.patternCount;
+    }
+    dma.framesRead++;
+    *outLength = bytes;
+    return ESP_OK;
+}
+
+esp_err_t adc2_config_channel_atten(adc2_channel_t channel, adc_atten_t atten)
+{
+    (void)atten;
+    return channel >= 0 && channel < ADC2_CHANNEL_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t adc2_get_raw(adc2_channel_t channel, adc_bits_width_t width, int *raw)
+{
+    (void)width;
+    if (channel < 0 || channel >= ADC2_CHANNEL_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *raw = adc2[channel];
+    return ESP_OK;
+}
@@ -0,0 +1,270 @@
+#include "Arduino.h"
+#include <string>
+#include "internal.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace {
+
+struct PinState {
+    uint8_t mode;
+    uint8_t level;
+    int interruptMode;
+    void (*handler)(void *);
+    void *arg;
+};
+
+PinState pins[GPIO_NUM_MAX];
+FILE *serialOut = nullptr;
+uint64_t serialWritten = 0;
+void (*serialListener)(const uint8_t *, size_t, void *) = nullptr;
+void *serialListenerArg = nullptr;
+
+std::string &serialIn()
+{
+    static std::string input;
+    return input;
+}
+
+// ADC channel behind each analog-capable pin: ADC1 as 0..7, ADC2 as 8..17, -1 for none.
+int adcChannel(uint8_t pin)
+{
+    static const int8_t adc1Pins[] = {36, 37, 38, 39, 32, 33, 34, 35};
+    static const int8_t adc2Pins[] = {4, 0, 2, 15, 13, 12, 14, 27, 25, 26};
+    for (int i = 0; i < 8; i++)
+    {
+        if (adc1Pins[i] == pin)
+        {
+            return i;
+        }
+    }
+    for (int i = 0; i < 10; i++)
+    {
+        if (adc2Pins[i] == pin)
+        {
+            return 8 + i;
+        }
+    }
+    return -1;
+}
+
+} // namespace
+
+namespace sim {
+
+int gpioLevel(int pin)
+{
+    return pin >= 0 && pin < GPIO_NUM_MAX ? pins[pin].level : 0;
+}
+
+void setGpioInput(int pin, int level)
+{
+    if (pin < 0 || pin >= GPIO_NUM_MAX)
+    {
+        return;
+    }
+    PinState &state = pins[pin];
+    uint8_t previous = state.level;
+    state.level = level ? HIGH : LOW;
+    if (!state.handler || previous == state.level)
+    {
+        return;
+    }
+    bool rising = state.level == HIGH;
+    if (state.interruptMode == CHANGE || (state.interruptMode == RISING && rising) ||
+        (state.interruptMode == FALLING && !rising))
+    {
+        state.handler(state.arg);
+    }
+}
+
+void setSerialOutput(FILE *out)
+{
+    serialOut = out;
+}
+
+void setSerialListener(void (*listener)(const uint8_t *data, size_t length, void *arg), void *arg)
+{
+    serialListener = listener;
+    serialListenerArg = arg;
+}
+
+void serialInput(const char *text)
+{
+    serialIn() += text;
+}
+
+uint64_t serialBytesWritten()
+{
+    return serialWritten;
+}
+
+} // namespace sim
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    if (inMax == inMin)
+    {
+        return outMin;
+    }
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(sim::now() / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)sim::now();
+}
+
+void delay(uint32_t ms)
+{
+    // Timer and interrupt context cannot block; code there takes no virtual time anyway.
+    if (sim::inTask())
+    {
+        sim::block(sim::now() + (uint64_t)ms * 1000);
+    }
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    if (sim::inTask())
+    {
+        sim::block(sim::now() + us);
+    }
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < GPIO_NUM_MAX)
+    {
+        pins[pin].mode = mode;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin < GPIO_NUM_MAX)
+    {
+        pins[pin].level = value ? HIGH : LOW;
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return sim::gpioLevel(pin);
+}
+
+uint16_t analogRead(uint8_t pin)
+{
+    int channel = adcChannel(pin);
+    if (channel < 0)
+    {
+        return 0;
+    }
+    return channel < 8 ? sim::adcRaw(1, channel) : sim::adcRaw(2, channel - 8);
+}
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void *), void *arg, int mode)
+{
+    if (pin < GPIO_NUM_MAX)
+    {
+        pins[pin].handler = handler;
+        pins[pin].arg = arg;
+        pins[pin].interruptMode = mode;
+    }
+}
+
+void detachInterrupt(uint8_t pin)
+{
+    if (pin < GPIO_NUM_MAX)
+    {
+        pins[pin].handler = nullptr;
+    }
+}
+
+int HardwareSerial::available()
+{
+    return (int)serialIn().size();
+}
+
+int HardwareSerial::read()
+{
+    std::string &input = serialIn();
+    if (input.empty())
+    {
+        return -1;
+    }
+    int byte = (uint8_t)input[0];
+    input.erase(0, 1);
+    return byte;
+}
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length)
+{
+    serialWritten += length;
+    if (serialOut)
+    {
+        fwrite(data, 1, length, serialOut);
+    }
+    if (serialListener)
+    {
+        serialListener(data, length, serialListenerArg);
+    }
+    return length;
+}
+
+size_t HardwareSerial::printf(const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return 0;
+    }
+    return write(reinterpret_cast<const uint8_t *>(buffer), std::min((size_t)length, sizeof(buffer) - 1));
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    return (uint32_t)(sim::now() * getCpuFreqMHz());
+}
+
+void EspClass::restart()
+{
+    fprintf(stderr, "sim: ESP.restart() at %.3f s\n", sim::now() / 1e6);
+    fflush(nullptr);
+    _Exit(2);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
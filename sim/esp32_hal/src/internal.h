@@ -0,0 +1,47 @@
+#ifndef SIM_INTERNAL_H
+#define SIM_INTERNAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/**
+ * @file internal.h
+ * @brief Hooks the peripheral models share: blocking tasks on the virtual clock and
+ * reading each other's state.
+ */
+
+namespace sim {
+
+/**
+ * @brief True while a task, not the scheduler (timers, events, interrupts), is running.
+ */
+bool inTask();
+
+/**
+ * @brief Block the running task until wake() or virtual time wakeUs (UINT64_MAX: no timeout).
+ * @return true if woken, false on timeout.
+ */
+bool block(uint64_t wakeUs);
+
+/**
+ * @brief Make a blocked task ready again; block() returns true.
+ */
+void wake(TaskHandle_t task);
+
+/**
+ * @brief Task running now, or null in scheduler context.
+ */
+TaskHandle_t currentTask();
+
+/**
+ * @brief Conversion result of an ADC channel; unit is 1 or 2.
+ */
+uint16_t adcRaw(int unit, int channel);
+
+} // namespace sim
+
+#endif // SIM_INTERNAL_H
@@ -0,0 +1,149 @@
+#include "driver/pcnt.h"
+#include "sim.h"
+
+namespace {
+
+struct Unit {
+    int64_t input;      // absolute edges seen at the input, from the plant
+    int64_t clearInput; // input at the last clear, adjusted for time spent paused
+    int64_t pauseInput; // input when paused
+    bool paused;
+    int16_t highLimit;
+    int16_t lowLimit;
+    int loopbackChannel = -1; // RMT channel feeding the input, or -1 for the plant
+};
+
+Unit units[PCNT_UNIT_MAX];
+
+/**
+ * @brief Bring a loopback unit's input up to date before it is read or latched.
+ */
+void refresh(Unit &unit)
+{
+    if (unit.loopbackChannel >= 0)
+    {
+        unit.input = sim::stepPulses(unit.loopbackChannel);
+    }
+}
+
+bool valid(pcnt_unit_t unit)
+{
+    return unit >= PCNT_UNIT_0 && unit < PCNT_UNIT_MAX;
+}
+
+} // namespace
+
+namespace sim {
+
+void setPcntInput(int unit, int64_t total)
+{
+    if (unit >= 0 && unit < PCNT_UNIT_MAX)
+    {
+        units[unit].input = total;
+    }
+}
+
+void setPcntLoopback(int unit, int rmtChannel)
+{
+    if (unit >= 0 && unit < PCNT_UNIT_MAX)
+    {
+        units[unit].loopbackChannel = rmtChannel;
+    }
+}
+
+} // namespace sim
+
+esp_err_t pcnt_unit_config(const pcnt_config_t *config)
+{
+    if (!valid(config->unit))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Unit &unit = units[config->unit];
+    unit.highLimit = config->counter_h_lim;
+    unit.lowLimit = config->counter_l_lim;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t id, int16_t *count)
+{
+    if (!valid(id))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Unit &unit = units[id];
+    refresh(unit);
+    int64_t counted = (unit.paused ? unit.pauseInput : unit.input) - unit.clearInput;
+
+    // The hardware counter resets to zero when it reaches either limit.
+    if (counted > 0 && unit.highLimit > 0)
+    {
+        counted %= unit.highLimit;
+    }
+    else if (counted < 0 && unit.lowLimit < 0)
+    {
+        counted = -(-counted % -unit.lowLimit);
+    }
+    *count = (int16_t)counted;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t id)
+{
+    if (!valid(id))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Unit &unit = units[id];
+    refresh(unit);
+    if (!unit.paused)
+    {
+        unit.paused = true;
+        unit.pauseInput = unit.input;
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t id)
+{
+    if (!valid(id))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Unit &unit = units[id];
+    refresh(unit);
+    if (unit.paused)
+    {
+        unit.paused = false;
+        unit.clearInput += unit.input - unit.pauseInput;
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t id)
+{
+    if (!valid(id))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Unit &unit = units[id];
+    refresh(unit);
+    unit.clearInput = unit.paused ? unit.pauseInput : unit.input;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_set_filter_value(pcnt_unit_t id, uint16_t value)
+{
+    (void)value;
+    return valid(id) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_filter_enable(pcnt_unit_t id)
+{
+    return valid(id) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_filter_disable(pcnt_unit_t id)
+{
+    return valid(id) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
@@ -0,0 +1,177 @@
+#include "driver/rmt.h"
+#include <algorithm>
+#include <vector>
+#include "internal.h"
+
+namespace {
+
+/**
+ * @brief One rmt_write_items() call: the virtual times of its rising edges and its direction.
+ */
+struct Train {
+    std::vector<uint64_t> risingUs;
+    uint64_t endUs;
+    int direction;
+};
+
+struct Channel {
+    bool installed;
+    int directionPin = -1;
+    int positiveLevel;
+    int64_t position;          // steps of trains already folded in
+    int64_t pulses;            // pulses of trains already folded in, either direction
+    std::vector<Train> trains; // queued or playing, oldest first
+};
+
+Channel &channel(int id)
+{
+    static Channel channels[RMT_CHANNEL_MAX];
+    return channels[id];
+}
+
+bool valid(rmt_channel_t id)
+{
+    return id >= RMT_CHANNEL_0 && id < RMT_CHANNEL_MAX;
+}
+
+int64_t edgesDone(const Train &train, uint64_t nowUs)
+{
+    return std::upper_bound(train.risingUs.begin(), train.risingUs.end(), nowUs) - train.risingUs.begin();
+}
+
+/**
+ * @brief Fold trains that have finished into the position count.
+ */
+void retire(Channel &ch, uint64_t nowUs)
+{
+    size_t done = 0;
+    while (done < ch.trains.size() && ch.trains[done].endUs <= nowUs)
+    {
+        ch.position += ch.trains[done].direction * (int64_t)ch.trains[done].risingUs.size();
+        ch.pulses += ch.trains[done].risingUs.size();
+        done++;
+    }
+    ch.trains.erase(ch.trains.begin(), ch.trains.begin() + done);
+}
+
+} // namespace
+
+namespace sim {
+
+void setStepDirectionPin(int id, int pin, int positiveLevel)
+{
+    channel(id).directionPin = pin;
+    channel(id).positiveLevel = positiveLevel;
+}
+
+int64_t stepPosition(int id)
+{
+    Channel &ch = channel(id);
+    retire(ch, now());
+    int64_t position = ch.position;
+    for (const Train &train : ch.trains)
+    {
+        position += train.direction * edgesDone(train, now());
+    }
+    return position;
+}
+
+int64_t stepPulses(int id)
+{
+    Channel &ch = channel(id);
+    retire(ch, now());
+    int64_t pulses = ch.pulses;
+    for (const Train &train : ch.trains)
+    {
+        pulses += edgesDone(train, now());
+    }
+    return pulses;
+}
+
+} // namespace sim
+
+esp_err_t rmt_config(const rmt_config_t *config)
+{
+    return valid(config->channel) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t rmt_driver_install(rmt_channel_t id, size_t rxBufferSize, int intrFlags)
+{
+    (void)rxBufferSize;
+    (void)intrFlags;
+    if (!valid(id))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    channel(id).installed = true;
+    return ESP_OK;
+}
+
+esp_err_t rmt_write_items(rmt_channel_t id, const rmt_item32_t *items, int count, bool waitDone)
+{
+    if (!valid(id) || !channel(id).installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    Channel &ch = channel(id);
+    uint64_t nowUs = sim::now();
+    retire(ch, nowUs);
+
+    // A write while busy starts after the train in flight, as the driver waits for it.
+    Train train;
+    train.direction = ch.directionPin < 0 || sim::gpioLevel(ch.directionPin) == ch.positiveLevel ? 1 : -1;
+    uint64_t t = ch.trains.empty() ? nowUs : ch.trains.back().endUs;
+    int level = 0; // idle low
+    for (int i = 0; i < count && items[i].duration0 > 0; i++) // a zero duration ends the transmission
+    {
+        if (items[i].level0 && !level)
+        {
+            train.risingUs.push_back(t);
+        }
+        t += items[i].duration0;
+        level = items[i].level0;
+        if (items[i].duration1 == 0)
+        {
+            break;
+        }
+        if (items[i].level1 && !level)
+        {
+            train.risingUs.push_back(t);
+        }
+        t += items[i].duration1;
+        level = items[i].level1;
+    }
+    train.endUs = t;
+    ch.trains.push_back(train);
+
+    if (waitDone && sim::inTask())
+    {
+        sim::block(train.endUs);
+    }
+    return ESP_OK;
+}
+
+esp_err_t rmt_tx_stop(rmt_channel_t id)
+{
+    if (!valid(id))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Channel &ch = channel(id);
+    ch.position = sim::stepPosition(id);
+    ch.pulses = sim::stepPulses(id);
+    ch.trains.clear();
+    return ESP_OK;
+}
+
+esp_err_t rmt_get_channel_status(rmt_channel_status_result_t *status)
+{
+    uint64_t nowUs = sim::now();
+    for (int id = 0; id < RMT_CHANNEL_MAX; id++)
+    {
+        Channel &ch = channel(id);
+        retire(ch, nowUs);
+        status->status[id] = !ch.installed ? RMT_CHANNEL_UNINIT : ch.trains.empty() ? RMT_CHANNEL_IDLE : RMT_CHANNEL_BUSY;
+    }
+    return ESP_OK;
+}
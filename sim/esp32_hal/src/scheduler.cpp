@@ -0,0 +1,627 @@
+#include "internal.h"
+#include <ucontext.h>
+#include <queue>
+#include <vector>
+#include "esp_timer.h"
+#include "freertos/timers.h"
+
+#define SIM_TASK_STACK_BYTES (256 * 1024) // host stacks are far larger than the firmware's 4 KB requests
+#define SIM_LIVELOCK_SWITCHES 10000000     // task switches without time advancing before the run aborts
+
+struct tskTaskControlBlock {
+    ucontext_t context;
+    std::vector<uint8_t> stack;
+    TaskFunction_t function;
+    void *arg;
+    const char *name;
+    UBaseType_t priority;
+    BaseType_t core;
+    uint64_t lastRun;       // switch count at the last resume, for round robin between equal priorities
+    bool blocked;
+    bool deleted;
+    bool timedOut;
+    uint64_t wakeUs;        // UINT64_MAX blocks until woken
+    uint32_t notifyValue;
+    bool notifyPending;
+    bool waitingNotify;
+};
+
+struct tmrTimerControl {
+    const char *name;
+    uint64_t periodUs;
+    bool autoReload;
+    void *id;
+    TimerCallbackFunction_t callback;
+    uint32_t generation; // bumped on start/stop so stale expiry events are ignored
+    bool active;
+};
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t periodUs;   // 0 for one-shot
+    uint32_t generation;
+    bool active;
+};
+
+namespace {
+
+struct Event {
+    uint64_t timeUs;
+    uint64_t order; // FIFO between events due at the same time
+    void (*fn)(void *);
+    void *arg;
+    uint32_t generation;
+    uint32_t *liveGeneration; // event is stale unless *liveGeneration == generation
+
+    bool operator>(const Event &other) const {
+        return timeUs != other.timeUs ? timeUs > other.timeUs : order > other.order;
+    }
+};
+
+struct PendedCall {
+    PendedFunction_t function;
+    void *arg1;
+    uint32_t arg2;
+};
+
+uint64_t nowUs = 0;
+uint64_t eventOrder = 0;
+uint64_t switchCount = 0;
+bool running = false;
+ucontext_t schedulerContext;
+TaskHandle_t current = nullptr;
+std::vector<TaskHandle_t> tasks;
+std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+std::vector<PendedCall> pendedCalls;
+
+sim::Plant *plant = nullptr;
+uint32_t plantStepUs = 1000;
+uint64_t plantTimeUs = 0;
+
+void taskEntry(unsigned int high, unsigned int low)
+{
+    TaskHandle_t task = reinterpret_cast<TaskHandle_t>(((uintptr_t)high << 32) | (uintptr_t)low);
+    task->function(task->arg);
+    // FreeRTOS tasks must not return; treat it as vTaskDelete(NULL).
+    vTaskDelete(nullptr);
+}
+
+void schedule(uint64_t timeUs, void (*fn)(void *), void *arg, uint32_t generation, uint32_t *liveGeneration)
+{
+    events.push(Event{timeUs, eventOrder++, fn, arg, generation, liveGeneration});
+}
+
+TaskHandle_t pickReady()
+{
+    TaskHandle_t best = nullptr;
+    for (TaskHandle_t task : tasks)
+    {
+        if (task->blocked || task->deleted)
+        {
+            continue;
+        }
+        if (!best || task->priority > best->priority ||
+            (task->priority == best->priority && task->lastRun < best->lastRun))
+        {
+            best = task;
+        }
+    }
+    return best;
+}
+
+void resume(TaskHandle_t task)
+{
+    current = task;
+    task->lastRun = ++switchCount;
+    swapcontext(&schedulerContext, &task->context);
+    current = nullptr;
+}
+
+uint64_t nextDue()
+{
+    uint64_t next = events.empty() ? UINT64_MAX : events.top().timeUs;
+    for (TaskHandle_t task : tasks)
+    {
+        if (task->blocked && !task->deleted && task->wakeUs < next)
+        {
+            next = task->wakeUs;
+        }
+    }
+    if (!pendedCalls.empty())
+    {
+        next = nowUs;
+    }
+    return next;
+}
+
+/**
+ * @brief Move the clock forward, letting the plant integrate in steps of at most plantStepUs.
+ */
+void advance(uint64_t toUs)
+{
+    while (plant && plantTimeUs + plantStepUs < toUs)
+    {
+        plantTimeUs += plantStepUs;
+        nowUs = plantTimeUs;
+        plant->update(nowUs);
+    }
+    nowUs = toUs;
+    if (plant && plantTimeUs < nowUs)
+    {
+        plantTimeUs = nowUs;
+        plant->update(nowUs);
+    }
+}
+
+/**
+ * @brief Wake timed-out tasks and run every event due now, in time then FIFO order.
+ */
+void fireDue()
+{
+    for (TaskHandle_t task : tasks)
+    {
+        if (task->blocked && !task->deleted && task->wakeUs <= nowUs)
+        {
+            task->blocked = false;
+            task->timedOut = true;
+        }
+    }
+
+    while (!events.empty() && events.top().timeUs <= nowUs)
+    {
+        Event event = events.top();
+        events.pop();
+        if (!event.liveGeneration || *event.liveGeneration == event.generation)
+        {
+            event.fn(event.arg);
+        }
+    }
+
+    // Pended calls run on the timer daemon; calls pended meanwhile run in the same pass.
+    for (size_t i = 0; i < pendedCalls.size(); i++)
+    {
+        PendedCall call = pendedCalls[i];
+        call.function(call.arg1, call.arg2);
+    }
+    pendedCalls.clear();
+}
+
+/**
+ * @brief Time a wait of ticks expires. As in the kernel, it ends on the ticks-th tick
+ * interrupt from now, so a one-tick wait lasts anywhere up to one tick.
+ */
+uint64_t timeoutUs(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? UINT64_MAX : (nowUs / 1000 + ticks) * 1000;
+}
+
+void timerExpired(void *arg)
+{
+    TimerHandle_t timer = static_cast<TimerHandle_t>(arg);
+    if (timer->autoReload)
+    {
+        schedule(nowUs + timer->periodUs, timerExpired, timer, timer->generation, &timer->generation);
+    }
+    else
+    {
+        timer->active = false;
+    }
+    timer->callback(timer);
+}
+
+void espTimerExpired(void *arg)
+{
+    esp_timer_handle_t timer = static_cast<esp_timer_handle_t>(arg);
+    if (timer->periodUs)
+    {
+        schedule(nowUs + timer->periodUs, espTimerExpired, timer, timer->generation, &timer->generation);
+    }
+    else
+    {
+        timer->active = false;
+    }
+    timer->callback(timer->arg);
+}
+
+} // namespace
+
+namespace sim {
+
+uint64_t now()
+{
+    return nowUs;
+}
+
+uint64_t switches()
+{
+    return switchCount;
+}
+
+void at(uint64_t atUs, void (*fn)(void *), void *arg)
+{
+    schedule(atUs < nowUs ? nowUs : atUs, fn, arg, 0, nullptr);
+}
+
+void setPlant(Plant *newPlant, uint32_t maxStepUs)
+{
+    plant = newPlant;
+    plantStepUs = maxStepUs ? maxStepUs : 1;
+    plantTimeUs = nowUs;
+    if (plant)
+    {
+        plant->update(nowUs);
+    }
+}
+
+void run(uint64_t untilUs)
+{
+    running = true;
+    uint64_t switchesAtTime = 0;
+    while (running)
+    {
+        TaskHandle_t task = pickReady();
+        if (task)
+        {
+            // Code takes no virtual time, so a task that never blocks would spin here forever.
+            if (++switchesAtTime > SIM_LIVELOCK_SWITCHES)
+            {
+                fprintf(stderr, "sim: task \"%s\" never blocks at %.6f s\n", task->name, nowUs / 1e6);
+                abort();
+            }
+            resume(task);
+            continue;
+        }
+        switchesAtTime = 0;
+
+        uint64_t next = nextDue();
+        if (next > untilUs)
+        {
+            advance(untilUs);
+            break;
+        }
+        advance(next);
+        fireDue();
+    }
+    running = false;
+}
+
+void stop()
+{
+    running = false;
+}
+
+bool inTask()
+{
+    return current != nullptr;
+}
+
+bool block(uint64_t wakeUs)
+{
+    if (!current)
+    {
+        fprintf(stderr, "sim: blocking call outside a task\n");
+        abort();
+    }
+    TaskHandle_t task = current;
+    task->blocked = true;
+    task->timedOut = false;
+    task->wakeUs = wakeUs;
+    swapcontext(&task->context, &schedulerContext);
+    return !task->timedOut;
+}
+
+void wake(TaskHandle_t task)
+{
+    if (task && task->blocked)
+    {
+        task->blocked = false;
+        task->timedOut = false;
+    }
+}
+
+TaskHandle_t currentTask()
+{
+    return current;
+}
+
+} // namespace sim
+
+BaseType_t xPortGetCoreID()
+{
+    return current && current->core != tskNO_AFFINITY ? current->core : 0;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    (void)stackDepth;
+    TaskHandle_t task = new tskTaskControlBlock();
+    task->function = function;
+    task->arg = arg;
+    task->name = name;
+    task->priority = priority;
+    task->core = core;
+    task->wakeUs = UINT64_MAX;
+    task->stack.resize(SIM_TASK_STACK_BYTES);
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack.data();
+    task->context.uc_stack.ss_size = task->stack.size();
+    task->context.uc_link = nullptr;
+    uintptr_t pointer = reinterpret_cast<uintptr_t>(task);
+    makecontext(&task->context, (void (*)())taskEntry, 2, (unsigned int)(pointer >> 32), (unsigned int)(pointer & 0xFFFFFFFF));
+
+    tasks.push_back(task);
+    if (handle)
+    {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stackDepth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(function, name, stackDepth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (!task)
+    {
+        task = current;
+    }
+    if (!task)
+    {
+        return;
+    }
+    task->deleted = true;
+    if (task == current)
+    {
+        // The stack stays allocated: this frame is still running on it.
+        swapcontext(&task->context, &schedulerContext);
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return current;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim::block(timeoutUs(ticks));
+}
+
+void vTaskDelayUntil(TickType_t *previousWake, TickType_t increment)
+{
+    *previousWake += increment;
+    uint64_t wakeUs = (uint64_t)*previousWake * 1000;
+    if (wakeUs > nowUs)
+    {
+        sim::block(wakeUs);
+    }
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return (TickType_t)(nowUs / 1000);
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    switch (action)
+    {
+    case eSetBits:
+        task->notifyValue |= value;
+        break;
+    case eIncrement:
+        task->notifyValue++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notifyValue = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->notifyPending)
+        {
+            return pdFAIL;
+        }
+        task->notifyValue = value;
+        break;
+    case eNoAction:
+        break;
+    }
+    task->notifyPending = true;
+    if (task->waitingNotify)
+    {
+        sim::wake(task);
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    if (woken)
+    {
+        *woken = pdTRUE;
+    }
+    return xTaskNotify(task, value, action);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    return xTaskNotify(task, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyFromISR(task, 0, eIncrement, woken);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t ticks)
+{
+    TaskHandle_t task = current;
+    if (!task->notifyPending)
+    {
+        task->notifyValue &= ~clearOnEntry;
+        if (ticks > 0)
+        {
+            task->waitingNotify = true;
+            sim::block(timeoutUs(ticks));
+            task->waitingNotify = false;
+        }
+    }
+
+    if (value)
+    {
+        *value = task->notifyValue;
+    }
+    if (!task->notifyPending)
+    {
+        return pdFALSE;
+    }
+    task->notifyValue &= ~clearOnExit;
+    task->notifyPending = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    TaskHandle_t task = current;
+    if (task->notifyValue == 0 && ticks > 0)
+    {
+        task->waitingNotify = true;
+        sim::block(timeoutUs(ticks));
+        task->waitingNotify = false;
+    }
+
+    uint32_t value = task->notifyValue;
+    if (value)
+    {
+        task->notifyValue = clearOnExit ? 0 : value - 1;
+    }
+    task->notifyPending = false;
+    return value;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t autoReload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    TimerHandle_t timer = new tmrTimerControl();
+    timer->name = name;
+    timer->periodUs = (uint64_t)period * 1000;
+    timer->autoReload = autoReload;
+    timer->id = id;
+    timer->callback = callback;
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticksToWait)
+{
+    (void)ticksToWait;
+    if (!timer)
+    {
+        return pdFAIL;
+    }
+    timer->generation++;
+    timer->active = true;
+    schedule(nowUs + timer->periodUs, timerExpired, timer, timer->generation, &timer->generation);
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticksToWait)
+{
+    (void)ticksToWait;
+    timer->generation++;
+    timer->active = false;
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticksToWait)
+{
+    timer->periodUs = (uint64_t)period * 1000;
+    return xTimerStart(timer, ticksToWait);
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+BaseType_t xTimerPendFunctionCall(PendedFunction_t function, void *arg1, uint32_t arg2, TickType_t ticksToWait)
+{
+    (void)ticksToWait;
+    pendedCalls.push_back(PendedCall{function, arg1, arg2});
+    return pdPASS;
+}
+
+BaseType_t xTimerPendFunctionCallFromISR(PendedFunction_t function, void *arg1, uint32_t arg2, BaseType_t *woken)
+{
+    if (woken)
+    {
+        *woken = pdTRUE;
+    }
+    return xTimerPendFunctionCall(function, arg1, arg2, 0);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    esp_timer_handle_t timer = new esp_timer();
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    *handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs)
+{
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->periodUs = periodUs;
+    timer->active = true;
+    timer->generation++;
+    schedule(nowUs + periodUs, espTimerExpired, timer, timer->generation, &timer->generation);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->periodUs = 0;
+    timer->active = true;
+    timer->generation++;
+    schedule(nowUs + timeoutUs, espTimerExpired, timer, timer->generation, &timer->generation);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    timer->generation++;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time()
+{
+    return (int64_t)nowUs;
+}
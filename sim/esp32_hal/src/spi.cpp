@@ -0,0 +1,58 @@
+#include "SPI.h"
+#include "sim.h"
+
+#define DRV_STATUS_BITS 0xC0 // reply MSB: both status bits set, no faults
+#define DRV_RW_BIT 0x4000
+#define DRV_ADDRESS_MASK 0x3F00
+#define DRV_DATA_MASK 0x00FF
+
+SPIClass SPI(VSPI);
+
+namespace {
+
+uint8_t registers[64];
+
+} // namespace
+
+namespace sim {
+
+uint8_t driverRegister(uint8_t address)
+{
+    return registers[address & 0x3F];
+}
+
+void setDriverRegister(uint8_t address, uint8_t value)
+{
+    registers[address & 0x3F] = value;
+}
+
+} // namespace sim
+
+void SPIClass::begin(int8_t sck, int8_t miso, int8_t mosi, int8_t ss)
+{
+    (void)sck;
+    (void)miso;
+    (void)mosi;
+    this->ss = ss;
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+    (void)data;
+    return 0xFF;
+}
+
+/**
+ * @brief One full-duplex DRV8462 frame. The reply carries the status byte and the register's
+ * value before a write, or its value for a read.
+ */
+uint16_t SPIClass::transfer16(uint16_t data)
+{
+    uint8_t address = (data & DRV_ADDRESS_MASK) >> 8;
+    uint8_t previous = registers[address];
+    if (!(data & DRV_RW_BIT))
+    {
+        registers[address] = data & DRV_DATA_MASK;
+    }
+    return (DRV_STATUS_BITS << 8) | previous;
+}
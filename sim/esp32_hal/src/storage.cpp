@@ -0,0 +1,201 @@
+#include <map>
+#include <string>
+#include <string.h>
+#include <vector>
+#include "Preferences.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "sim.h"
+
+namespace {
+
+struct Partition {
+    esp_partition_t info;
+    std::vector<uint8_t> data;
+};
+
+std::map<std::string, std::vector<uint8_t>> &nvs()
+{
+    static std::map<std::string, std::vector<uint8_t>> store;
+    return store;
+}
+
+std::vector<Partition *> &partitions()
+{
+    static std::vector<Partition *> table;
+    return table;
+}
+
+Partition *find(const esp_partition_t *info)
+{
+    for (Partition *partition : partitions())
+    {
+        if (&partition->info == info)
+        {
+            return partition;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace
+
+namespace sim {
+
+void addPartition(const char *label, int type, int subtype, size_t size)
+{
+    Partition *partition = new Partition();
+    partition->info.type = (esp_partition_type_t)type;
+    partition->info.subtype = subtype;
+    partition->info.size = (uint32_t)size;
+    strncpy(partition->info.label, label, sizeof(partition->info.label) - 1);
+    uint32_t address = 0x10000;
+    for (Partition *other : partitions())
+    {
+        address = other->info.address + other->info.size;
+    }
+    partition->info.address = address;
+    partition->data.assign(size, 0xFF);
+    partitions().push_back(partition);
+}
+
+} // namespace sim
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    for (Partition *partition : partitions())
+    {
+        if (partition->info.type == type &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || partition->info.subtype == subtype) &&
+            (!label || strcmp(label, partition->info.label) == 0))
+        {
+            return &partition->info;
+        }
+    }
+    return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *info, size_t offset, void *dst, size_t size)
+{
+    Partition *partition = find(info);
+    if (!partition || offset + size > partition->data.size())
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, &partition->data[offset], size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *info, size_t offset, const void *src, size_t size)
+{
+    Partition *partition = find(info);
+    if (!partition || offset + size > partition->data.size())
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(src);
+    for (size_t i = 0; i < size; i++)
+    {
+        partition->data[offset + i] &= bytes[i]; // NOR flash programming only clears bits
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *info, size_t offset, size_t size)
+{
+    Partition *partition = find(info);
+    if (!partition || offset + size > partition->data.size() || offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&partition->data[offset], 0xFF, size);
+    return ESP_OK;
+}
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+    if (strlen(name) >= sizeof(this->name))
+    {
+        return false;
+    }
+    strcpy(this->name, name);
+    this->readOnly = readOnly;
+    this->open = true;
+    return true;
+}
+
+void Preferences::end()
+{
+    this->open = false;
+}
+
+static std::string nvsKey(const char *name, const char *key)
+{
+    return std::string(name) + "/" + key;
+}
+
+bool Preferences::clear()
+{
+    if (!this->open || this->readOnly)
+    {
+        return false;
+    }
+    std::string prefix = std::string(this->name) + "/";
+    auto &store = nvs();
+    for (auto it = store.lower_bound(prefix); it != store.end() && it->first.compare(0, prefix.size(), prefix) == 0;)
+    {
+        it = store.erase(it);
+    }
+    return true;
+}
+
+bool Preferences::remove(const char *key)
+{
+    if (!this->open || this->readOnly)
+    {
+        return false;
+    }
+    return nvs().erase(nvsKey(this->name, key)) > 0;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    return this->open && nvs().count(nvsKey(this->name, key)) > 0;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    if (!this->open || this->readOnly || strlen(key) > 15)
+    {
+        return 0;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(value);
+    nvs()[nvsKey(this->name, key)].assign(bytes, bytes + length);
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    if (!this->open)
+    {
+        return 0;
+    }
+    auto it = nvs().find(nvsKey(this->name, key));
+    return it == nvs().end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t length)
+{
+    if (!this->open)
+    {
+        return 0;
+    }
+    auto it = nvs().find(nvsKey(this->name, key));
+    if (it == nvs().end() || it->second.size() > length)
+    {
+        return 0;
+    }
+    memcpy(buffer, it->second.data(), it->second.size());
+    return it->second.size();
+}
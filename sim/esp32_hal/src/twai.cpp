@@ -0,0 +1,406 @@
+#include "driver/twai.h"
+#include <deque>
+#include "internal.h"
+
+namespace {
+
+struct Bus {
+    bool installed;
+    twai_state_t state;
+    uint32_t bitRate;
+    uint32_t alertsEnabled;
+    uint32_t alertsPending;
+    twai_filter_config_t filter;
+    uint32_t txQueueLength;
+    uint32_t rxQueueLength;
+    uint32_t txGeneration; // bumped when the TX queue is flushed so completion events go stale
+    bool txBusy;
+    TaskHandle_t alertWaiter;
+    TaskHandle_t rxWaiter;
+    TaskHandle_t txWaiter;
+    twai_status_info_t counters;
+};
+
+Bus bus;
+void (*txListener)(const sim::CanFrame &, void *) = nullptr;
+void *txListenerArg = nullptr;
+
+std::deque<twai_message_t> &txQueue()
+{
+    static std::deque<twai_message_t> queue;
+    return queue;
+}
+
+std::deque<twai_message_t> &rxQueue()
+{
+    static std::deque<twai_message_t> queue;
+    return queue;
+}
+
+void raise(uint32_t alerts)
+{
+    bus.alertsPending |= alerts & bus.alertsEnabled;
+    if (bus.alertsPending && bus.alertWaiter)
+    {
+        sim::wake(bus.alertWaiter);
+    }
+}
+
+/**
+ * @brief Bits a frame occupies on the bus, ignoring bit stuffing.
+ */
+uint32_t frameBits(const twai_message_t &message)
+{
+    uint32_t dataBits = message.rtr ? 0 : 8 * (message.data_length_code > 8 ? 8 : message.data_length_code);
+    return (message.extd ? 67 : 47) + dataBits;
+}
+
+/**
+ * @brief The 32-bit value the single acceptance filter compares against.
+ */
+uint32_t filterBits(const twai_message_t &message)
+{
+    if (message.extd)
+    {
+        return (message.identifier << 3) | (message.rtr << 2);
+    }
+    uint32_t bits = (message.identifier << 21) | (message.rtr << 20);
+    if (!message.rtr && message.data_length_code > 0)
+    {
+        bits |= message.data[0] << 8;
+    }
+    if (!message.rtr && message.data_length_code > 1)
+    {
+        bits |= message.data[1];
+    }
+    return bits;
+}
+
+/**
+ * @brief Apply the acceptance filter. Dual mode checks two 16-bit filters and passes a frame
+ * that either accepts: the first sees a standard frame's ID, RTR, and first data byte (split
+ * across bits 19:16 and 3:0), the second its ID and RTR; for extended frames both see ID bits 28:13.
+ */
+bool accepted(const twai_message_t &message)
+{
+    const twai_filter_config_t &filter = bus.filter;
+    if (filter.single_filter)
+    {
+        return !((filterBits(message) ^ filter.acceptance_code) & ~filter.acceptance_mask);
+    }
+
+    uint32_t first;
+    uint32_t second;
+    uint32_t firstMask = 0xFFFF0000;
+    uint32_t secondMask = 0x0000FFFF;
+    if (message.extd)
+    {
+        first = (message.identifier >> 13) << 16;
+        second = message.identifier >> 13;
+    }
+    else
+    {
+        uint8_t data = (!message.rtr && message.data_length_code > 0) ? message.data[0] : 0;
+        first = (message.identifier << 21) | (message.rtr << 20) | ((data >> 4) << 16) | (data & 0xF);
+        second = (message.identifier << 5) | (message.rtr << 4);
+        firstMask |= 0x0000000F;
+        secondMask = 0x0000FFF0;
+    }
+    uint32_t care = ~filter.acceptance_mask;
+    return !((first ^ filter.acceptance_code) & care & firstMask) ||
+           !((second ^ filter.acceptance_code) & care & secondMask);
+}
+
+void startTransmit();
+
+void transmitDone(void *arg)
+{
+    if ((uint32_t)(uintptr_t)arg != bus.txGeneration || txQueue().empty())
+    {
+        return;
+    }
+    twai_message_t message = txQueue().front();
+    txQueue().pop_front();
+    bus.txBusy = false;
+
+    if (txListener)
+    {
+        sim::CanFrame frame = {};
+        frame.timeUs = sim::now();
+        frame.id = message.identifier;
+        frame.extended = message.extd;
+        frame.length = message.data_length_code > 8 ? 8 : message.data_length_code;
+        for (int i = 0; i < frame.length; i++)
+        {
+            frame.data[i] = message.data[i];
+        }
+        txListener(frame, txListenerArg);
+    }
+
+    raise(TWAI_ALERT_TX_SUCCESS | (txQueue().empty() ? TWAI_ALERT_TX_IDLE : 0));
+    if (bus.txWaiter)
+    {
+        sim::wake(bus.txWaiter);
+    }
+    startTransmit();
+}
+
+void startTransmit()
+{
+    if (bus.txBusy || txQueue().empty() || bus.state != TWAI_STATE_RUNNING)
+    {
+        return;
+    }
+    bus.txBusy = true;
+    uint64_t durationUs = ((uint64_t)frameBits(txQueue().front()) * 1000000 + bus.bitRate - 1) / bus.bitRate;
+    sim::at(sim::now() + durationUs, transmitDone, (void *)(uintptr_t)bus.txGeneration);
+}
+
+void flushTransmit()
+{
+    txQueue().clear();
+    bus.txBusy = false;
+    bus.txGeneration++;
+}
+
+void deliver(const twai_message_t &message)
+{
+    if (bus.state != TWAI_STATE_RUNNING)
+    {
+        return;
+    }
+    if (!accepted(message))
+    {
+        return;
+    }
+    if (rxQueue().size() >= bus.rxQueueLength)
+    {
+        bus.counters.rx_missed_count++;
+        raise(TWAI_ALERT_RX_QUEUE_FULL);
+        return;
+    }
+    rxQueue().push_back(message);
+    raise(TWAI_ALERT_RX_DATA);
+    if (bus.rxWaiter)
+    {
+        sim::wake(bus.rxWaiter);
+    }
+}
+
+void deliverLater(void *arg)
+{
+    twai_message_t *message = static_cast<twai_message_t *>(arg);
+    deliver(*message);
+    delete message;
+}
+
+/**
+ * @brief Block the running task until woken or the tick timeout expires.
+ */
+void waitTicks(TaskHandle_t *waiter, uint32_t ticks)
+{
+    *waiter = sim::currentTask();
+    sim::block(ticks == portMAX_DELAY ? UINT64_MAX : (sim::now() / 1000 + ticks) * 1000);
+    *waiter = nullptr;
+}
+
+} // namespace
+
+namespace sim {
+
+void canInject(const CanFrame &frame)
+{
+    twai_message_t *message = new twai_message_t();
+    message->extd = frame.extended;
+    message->identifier = frame.id;
+    message->data_length_code = frame.length > 8 ? 8 : frame.length;
+    for (int i = 0; i < message->data_length_code; i++)
+    {
+        message->data[i] = frame.data[i];
+    }
+    at(frame.timeUs, deliverLater, message);
+}
+
+void setCanTxListener(void (*listener)(const CanFrame &frame, void *arg), void *arg)
+{
+    txListener = listener;
+    txListenerArg = arg;
+}
+
+} // namespace sim
+
+esp_err_t twai_driver_install(const twai_general_config_t *general, const twai_timing_config_t *timing,
+                              const twai_filter_config_t *filter)
+{
+    if (bus.installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t quanta = 1 + timing->tseg_1 + timing->tseg_2;
+    if (timing->brp == 0 || quanta < 3)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    bus.installed = true;
+    bus.state = TWAI_STATE_STOPPED;
+    bus.bitRate = 80000000 / (timing->brp * quanta);
+    bus.alertsEnabled = general->alerts_enabled;
+    bus.alertsPending = 0;
+    bus.filter = *filter;
+    bus.txQueueLength = general->tx_queue_len;
+    bus.rxQueueLength = general->rx_queue_len;
+    bus.counters = {};
+    flushTransmit();
+    rxQueue().clear();
+    return ESP_OK;
+}
+
+esp_err_t twai_driver_uninstall()
+{
+    if (!bus.installed || bus.state == TWAI_STATE_RUNNING)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bus.installed = false;
+    flushTransmit();
+    rxQueue().clear();
+    return ESP_OK;
+}
+
+esp_err_t twai_start()
+{
+    if (!bus.installed || bus.state == TWAI_STATE_RUNNING)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bus.state = TWAI_STATE_RUNNING;
+    return ESP_OK;
+}
+
+esp_err_t twai_stop()
+{
+    if (!bus.installed || bus.state != TWAI_STATE_RUNNING)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bus.state = TWAI_STATE_STOPPED;
+    flushTransmit();
+    return ESP_OK;
+}
+
+esp_err_t twai_transmit(const twai_message_t *message, uint32_t ticksToWait)
+{
+    if (!bus.installed || bus.state != TWAI_STATE_RUNNING)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (message->data_length_code > 8)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (txQueue().size() >= bus.txQueueLength + 1 && ticksToWait > 0 && sim::inTask())
+    {
+        waitTicks(&bus.txWaiter, ticksToWait);
+    }
+    // The driver's queue holds tx_queue_len frames behind the one in the controller.
+    if (txQueue().size() >= bus.txQueueLength + 1)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    txQueue().push_back(*message);
+    startTransmit();
+    return ESP_OK;
+}
+
+esp_err_t twai_receive(twai_message_t *message, uint32_t ticksToWait)
+{
+    if (!bus.installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (rxQueue().empty() && ticksToWait > 0 && sim::inTask())
+    {
+        waitTicks(&bus.rxWaiter, ticksToWait);
+    }
+    if (rxQueue().empty())
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    *message = rxQueue().front();
+    rxQueue().pop_front();
+    return ESP_OK;
+}
+
+esp_err_t twai_read_alerts(uint32_t *alerts, uint32_t ticksToWait)
+{
+    if (!bus.installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!bus.alertsPending && ticksToWait > 0 && sim::inTask())
+    {
+        waitTicks(&bus.alertWaiter, ticksToWait);
+    }
+    *alerts = bus.alertsPending;
+    bus.alertsPending = 0;
+    return *alerts ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t twai_reconfigure_alerts(uint32_t alertsEnabled, uint32_t *currentAlerts)
+{
+    if (!bus.installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bus.alertsEnabled = alertsEnabled;
+    if (currentAlerts)
+    {
+        *currentAlerts = bus.alertsPending;
+    }
+    bus.alertsPending = 0;
+    return ESP_OK;
+}
+
+esp_err_t twai_get_status_info(twai_status_info_t *status)
+{
+    if (!bus.installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    *status = bus.counters;
+    status->state = bus.state;
+    status->msgs_to_tx = (uint32_t)txQueue().size();
+    status->msgs_to_rx = (uint32_t)rxQueue().size();
+    return ESP_OK;
+}
+
+esp_err_t twai_initiate_recovery()
+{
+    if (!bus.installed || bus.state != TWAI_STATE_BUS_OFF)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    bus.state = TWAI_STATE_STOPPED;
+    raise(TWAI_ALERT_BUS_RECOVERED);
+    return ESP_OK;
+}
+
+esp_err_t twai_clear_transmit_queue()
+{
+    if (!bus.installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    flushTransmit();
+    return ESP_OK;
+}
+
+esp_err_t twai_clear_receive_queue()
+{
+    if (!bus.installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    rxQueue().clear();
+    return ESP_OK;
+}
@@ -1,5 +1,8 @@
 #include "DRV8462.h"
 #include "config.h"
+#include "deferred_log.h"
+#include "profiler.h"
+#include "step_capture.h"
 
 DRV8462::DRV8462()
 {
@@ -9,6 +12,8 @@ DRV8462::DRV8462()
     this->atqLearningComplete = false;
     this->atqLearningMotionStartMs = 0;
     this->atqLearningStartMs = 0;
+    this->silentstepFaulted = false;
+    this->registerLock = xSemaphoreCreateMutexStatic(&this->registerLockBuffer);
 }
 
 DRV8462::~DRV8462()
@@ -59,10 +64,8 @@ void DRV8462::setupAutoTorque()
 
     Serial.printf("ATQ learned params loaded. CONST1=%u CONST2=%u\n", ATQ_LEARNED_CONST1, ATQ_LEARNED_CONST2);
 #else
-    uint16_t atq_ctrl4 = this->spiReadRegister(SPI_ATQ_CTRL4);
-    atq_ctrl4 = (atq_ctrl4 & ATQ_LRN_CONST2_MSB_MASK) |
-                (((ATQ_LRN_MIN_CURRENT_CODE & 0x1F) << 3) & ATQ_LRN_MIN_CURRENT_MASK);
-    this->spiWriteRegister(SPI_ATQ_CTRL4, atq_ctrl4);
+    this->modifyRegister(SPI_ATQ_CTRL4, (uint16_t)~ATQ_LRN_CONST2_MSB_MASK,
+                         ((ATQ_LRN_MIN_CURRENT_CODE & 0x1F) << 3) & ATQ_LRN_MIN_CURRENT_MASK);
 
     atq_ctrl15 = (((ATQ_ERROR_TRUNCATE_CODE & 0x0F) << 4) & ATQ_ERROR_TRUNCATE_MASK) |
                  (((ATQ_LRN_STEP_CODE & 0x03) << 2) & ATQ_LRN_STEP_FIELD_MASK) |
@@ -76,9 +79,7 @@ void DRV8462::setupAutoTorque()
         this->faultDetected();
     }
 
-    uint16_t atq_ctrl10 = this->spiReadRegister(SPI_ATQ_CTRL10);
-    atq_ctrl10 |= ATQ_EN_MASK;
-    this->spiWriteRegister(SPI_ATQ_CTRL10, atq_ctrl10);
+    this->modifyRegister(SPI_ATQ_CTRL10, 0, ATQ_EN_MASK);
 
     uint16_t atq_ctrl10_verify = this->spiReadRegister(SPI_ATQ_CTRL10);
     if ((atq_ctrl10_verify & ATQ_EN_MASK) == 0)
@@ -119,9 +120,7 @@ void DRV8462::serviceAutoTorqueLearning(bool motorIsStepping)
             return;
         }
 
-        uint16_t atq_ctrl10 = this->spiReadRegister(SPI_ATQ_CTRL10);
-        atq_ctrl10 |= LRN_START_MASK;
-        this->spiWriteRegister(SPI_ATQ_CTRL10, atq_ctrl10);
+        this->modifyRegister(SPI_ATQ_CTRL10, 0, LRN_START_MASK);
 
         uint16_t atq_ctrl10_verify = this->spiReadRegister(SPI_ATQ_CTRL10);
         if ((atq_ctrl10_verify & LRN_START_MASK) == 0)
@@ -173,11 +172,7 @@ void DRV8462::serviceAutoTorqueLearning(bool motorIsStepping)
 
     if ((millis() - this->atqLearningStartMs) > ATQ_LRN_TIMEOUT_MS)
     {
-        if ((atq_ctrl10 & LRN_START_MASK) != 0)
-        {
-            atq_ctrl10 &= ~LRN_START_MASK;
-            this->spiWriteRegister(SPI_ATQ_CTRL10, atq_ctrl10);
-        }
+        this->modifyRegister(SPI_ATQ_CTRL10, LRN_START_MASK, 0);
 
         this->atqLearningInProgress = false;
         this->atqLearningPending = true;
@@ -189,6 +184,71 @@ void DRV8462::serviceAutoTorqueLearning(bool motorIsStepping)
 #endif
 }
 
+void DRV8462::setupDecay()
+{
+    if (!DECAY_SCHEDULING_ENABLED)
+    {
+        return;
+    }
+
+#if SILENTSTEP_USE_TUNED_PARAMS
+    const uint8_t addresses[] = {SPI_SILENTSTEP_CTRL1, SPI_SILENTSTEP_CTRL2, SPI_SILENTSTEP_CTRL3,
+                                 SPI_SILENTSTEP_CTRL4, SPI_SILENTSTEP_CTRL5};
+    const uint16_t values[] = {SILENTSTEP_TUNED_CTRL1 & ~EN_SS_MASK, SILENTSTEP_TUNED_CTRL2, SILENTSTEP_TUNED_CTRL3,
+                               SILENTSTEP_TUNED_CTRL4, SILENTSTEP_TUNED_CTRL5};
+    for (int i = 0; i < 5; i++)
+    {
+        this->spiWriteRegister(addresses[i], values[i]);
+        if (this->spiReadRegister(addresses[i]) != values[i])
+        {
+            Serial.printf("Failed to set silentstep parameters in SILENTSTEP_CTRL%d\n", i + 1);
+            this->faultDetected();
+        }
+    }
+#endif
+
+    this->setDecayBand(DECAY_BAND_QUIET);
+    uint16_t ctrl1 = this->spiReadRegister(SPI_CTRL1);
+    if ((ctrl1 & DECAY_MASK) != DECAY_QUIET)
+    {
+        Serial.printf("Failed to set decay mode! CTRL1 Register: 0x%X\n", ctrl1);
+        this->faultDetected();
+    }
+}
+
+/**
+ * @brief Write the decay mode for a band. CTRL1 is modified in place because enable() and
+ * disable() share it.
+ */
+void DRV8462::setDecayBand(DecayBand band)
+{
+    uint16_t decay = band == DECAY_BAND_TORQUE ? DECAY_TORQUE : band == DECAY_BAND_CRUISE ? DECAY_CRUISE : DECAY_QUIET;
+    this->modifyRegister(SPI_CTRL1, DECAY_MASK, decay);
+
+    if (!SILENTSTEP_ENABLE || this->silentstepFaulted)
+    {
+        return;
+    }
+    this->modifyRegister(SPI_SILENTSTEP_CTRL1, EN_SS_MASK, band == DECAY_BAND_QUIET ? EN_SS_MASK : 0);
+}
+
+bool DRV8462::checkSilentstep()
+{
+    if (!SILENTSTEP_ENABLE || this->silentstepFaulted)
+    {
+        return false;
+    }
+    if ((this->spiReadRegister(SPI_DIAG3) & SILENTSTEP_ERROR_MASK) == 0)
+    {
+        return true;
+    }
+
+    this->silentstepFaulted = true;
+    this->modifyRegister(SPI_SILENTSTEP_CTRL1, EN_SS_MASK, 0);
+    DLOG("silentstep error, holding with decay 0x%X instead\n", DECAY_QUIET);
+    return false;
+}
+
 /**
  * @brief Initialize SPI, GPIO, RMT, and driver configuration registers.
  */
@@ -210,6 +270,9 @@ void DRV8462::begin()
     digitalWrite(ENABLE_PIN, LOW); // disable the driver
 
     this->setupRMT();
+#if STEP_CAPTURE_ENABLED
+    stepCapture.begin();
+#endif
 
     // Read fault register on startup.
     uint16_t faultReg = this->spiReadRegister(SPI_FAULT);
@@ -220,36 +283,41 @@ void DRV8462::begin()
     }
 
     // Enable open load detection.
-    uint16_t ctrl9 = this->spiReadRegister(SPI_CTRL9);
-    ctrl9 |= OLD_MASK; // set OLD bit
-    this->spiWriteRegister(SPI_CTRL9, ctrl9);
+    this->modifyRegister(SPI_CTRL9, 0, OLD_MASK); // set OLD bit
 
+    this->setCurrent(RUN_MOTOR_CURRENT, HOLD_MOTOR_CURRENT);
+
+    // Use internal Vref.
+    this->modifyRegister(SPI_CTRL13, 0, VREF_MASK); // set VREF bit
+
+    this->setupAutoTorque();
+    this->setupDecay();
+}
+
+/**
+ * @brief Set the run and hold current limits and verify them by read-back.
+ */
+void DRV8462::setCurrent(uint8_t runCurrent, uint8_t holdCurrent)
+{
     // Set idle current.
-    this->spiWriteRegister(SPI_CTRL10, HOLD_MOTOR_CURRENT); 
+    this->spiWriteRegister(SPI_CTRL10, holdCurrent);
     // Read back CTRL10 to verify idle current setting.
     uint16_t ctrl10Reg = this->spiReadRegister(SPI_CTRL10);
-    if (ctrl10Reg != HOLD_MOTOR_CURRENT)
+    if (ctrl10Reg != holdCurrent)
     {
         Serial.printf("Failed to set idle current! CTRL10 Register: 0x%X\n", ctrl10Reg);
         this->faultDetected();
     }
 
     // Set run current limit.
-    this->spiWriteRegister(SPI_CTRL11, RUN_MOTOR_CURRENT); 
+    this->spiWriteRegister(SPI_CTRL11, runCurrent);
     // Read back CTRL11 to verify run current setting.
     uint16_t ctrl11Reg = this->spiReadRegister(SPI_CTRL11);
-    if (ctrl11Reg != RUN_MOTOR_CURRENT)
+    if (ctrl11Reg != runCurrent)
     {
         Serial.printf("Failed to set torque! CTRL11 Register: 0x%X\n", ctrl11Reg);
         this->faultDetected();
     }
-
-    // Use internal Vref.
-    uint16_t ctrl13 = this->spiReadRegister(SPI_CTRL13);
-    ctrl13 |= VREF_MASK; // set VREF bit
-    this->spiWriteRegister(SPI_CTRL13, ctrl13);
-
-    this->setupAutoTorque();
 }
 
 /**
@@ -257,9 +325,7 @@ void DRV8462::begin()
  */
 void DRV8462::enable()
 {
-    uint16_t ctrl1Reg = this->spiReadRegister(SPI_CTRL1);
-    ctrl1Reg |= EN_OUT_MASK; // set EN_OUT bit
-    this->spiWriteRegister(SPI_CTRL1, ctrl1Reg);
+    this->modifyRegister(SPI_CTRL1, 0, EN_OUT_MASK); // set EN_OUT bit
 
     digitalWrite(ENABLE_PIN, HIGH); // enable the driver
 }
@@ -271,6 +337,7 @@ void DRV8462::enable()
  */
 void DRV8462::spiWriteRegister(uint8_t address, uint16_t data)
 {
+    PROFILE_SCOPE(PROFILE_SPI);
     uint16_t reg_value = 0;
 
     reg_value |= ((address << SPI_ADDRESS_POS) & SPI_ADDRESS_MASK); // Adding register address value
@@ -306,6 +373,7 @@ void DRV8462::spiWriteRegister(uint8_t address, uint16_t data)
  */
 uint16_t DRV8462::spiReadRegister(uint8_t address)
 {
+    PROFILE_SCOPE(PROFILE_SPI);
     uint16_t reg_value = 0;
 
     reg_value |= ((address << SPI_ADDRESS_POS) & SPI_ADDRESS_MASK); // Configure register address value
@@ -336,6 +404,27 @@ uint16_t DRV8462::spiReadRegister(uint8_t address)
     return (reg_value);
 }
 
+/**
+ * @brief Read a register, clear and set bits, and write it back if it changed, all under
+ * registerLock so a read-modify-write on another task cannot undo this one.
+ * @param address The 6-bit register address.
+ * @param clearMask Bits to clear.
+ * @param setBits Bits to set after clearing.
+ * @return The register value after the change.
+ */
+uint16_t DRV8462::modifyRegister(uint8_t address, uint16_t clearMask, uint16_t setBits)
+{
+    xSemaphoreTake(this->registerLock, portMAX_DELAY);
+    uint16_t value = this->spiReadRegister(address);
+    uint16_t wanted = (value & ~clearMask) | setBits;
+    if (wanted != value)
+    {
+        this->spiWriteRegister(address, wanted);
+    }
+    xSemaphoreGive(this->registerLock);
+    return wanted;
+}
+
 void DRV8462::faultDetected()
 {
     Serial.println("Fault detected!");
@@ -343,9 +432,7 @@ void DRV8462::faultDetected()
 
 void DRV8462::disable()
 {
-    uint16_t ctrl1Reg = this->spiReadRegister(SPI_CTRL1);
-    ctrl1Reg &= ~EN_OUT_MASK; // clear EN_OUT bit
-    this->spiWriteRegister(SPI_CTRL1, ctrl1Reg);
+    this->modifyRegister(SPI_CTRL1, EN_OUT_MASK, 0); // clear EN_OUT bit
 
     digitalWrite(ENABLE_PIN, LOW); // disable the driver
 }
@@ -425,6 +512,7 @@ void DRV8462::setupRMT()
  */
 void DRV8462::moveSteps(int steps, int speed_hz)
 {
+    int requestedSteps = steps;
     this->serviceAutoTorqueLearning((steps != 0) && (speed_hz > 0));
 
     // Stop any in-flight RMT command before sending a new one.
@@ -441,17 +529,21 @@ void DRV8462::moveSteps(int steps, int speed_hz)
     steps = abs(steps);
 
     if (steps == 0)
+    {
+        STEP_CAPTURE(requestedSteps, speed_hz, 0, 0);
         return;
+    }
     if (steps > MAX_PULSES)
     {
-        Serial.println("Warning: steps exceed MAX_PULSES, truncating to MAX_PULSES");
+        DLOG("Warning: steps exceed MAX_PULSES, truncating to MAX_PULSES\n");
         steps = MAX_PULSES;
     }
 
     // Validate speed to avoid division by zero and unreasonable values.
     if (speed_hz <= 0)
     {
-        Serial.println("Error: speed_hz must be greater than 0");
+        DLOG("Error: speed_hz must be greater than 0\n");
+        STEP_CAPTURE(requestedSteps, speed_hz, 0, 0);
         return;
     }
 
@@ -470,6 +562,8 @@ void DRV8462::moveSteps(int steps, int speed_hz)
         this->pulse_buf[i] = pulse;
     }
 
+    STEP_CAPTURE(requestedSteps, speed_hz, steps, duration_us);
+
     // Send the items (non-blocking).
     rmt_write_items(RMT_CHANNEL, this->pulse_buf, steps, false);
 }
@@ -0,0 +1,236 @@
+#include "analog_inputs.h"
+#include "driver/adc.h"
+#include "config.h"
+#include "profiler.h"
+
+#define ANALOG_READ_TIMEOUT_MS 20
+
+static const uint16_t selectorThresholds[] = {
+    POWER_MODE_THRESHOLD,
+    TORQUE_MODE_THRESHOLD,
+    ACCELERATION_MODE_THRESHOLD,
+    BRAKE_CHECK_MODE_THRESHOLD,
+};
+static const int selectorThresholdCount = sizeof(selectorThresholds) / sizeof(selectorThresholds[0]);
+
+AnalogInputs::AnalogInputs() : filters{LowPassFilter(ANALOG_FILTER_ALPHA),
+                                       LowPassFilter(ANALOG_FILTER_ALPHA),
+                                       LowPassFilter(ANALOG_FILTER_ALPHA)},
+                               lastRaw{0, 0, 0}
+{
+}
+
+/**
+ * @brief Configure ADC1 continuous mode and the brake channel, then start the input task.
+ */
+void AnalogInputs::begin()
+{
+    adc_digi_init_config_t initConfig = {};
+    initConfig.max_store_buf_size = ANALOG_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES * 4;
+    initConfig.conv_num_each_intr = ANALOG_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES;
+    initConfig.adc1_chan_mask = BIT(MANUAL_MODE_ADC_CHANNEL) | BIT(LIMIT_SWITCH_ADC_CHANNEL);
+    initConfig.adc2_chan_mask = 0;
+
+    if (adc_digi_initialize(&initConfig) != ESP_OK)
+    {
+        Serial.printf("ERROR: ADC DMA could not be initialized\n");
+        return;
+    }
+
+    // Scan order: mode selector, limit switch. Both use full-scale attenuation to match analogRead().
+    adc_digi_pattern_config_t pattern[2] = {};
+    pattern[0].atten = ADC_ATTEN_DB_11;
+    pattern[0].channel = MANUAL_MODE_ADC_CHANNEL;
+    pattern[0].unit = 0; // ADC1
+    pattern[0].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    pattern[1] = pattern[0];
+    pattern[1].channel = LIMIT_SWITCH_ADC_CHANNEL;
+
+    adc_digi_configuration_t digiConfig = {};
+    digiConfig.conv_limit_en = ADC_CONV_LIMIT_EN;
+    digiConfig.conv_limit_num = 250;
+    digiConfig.pattern_num = 2;
+    digiConfig.adc_pattern = pattern;
+    digiConfig.sample_freq_hz = ANALOG_SAMPLE_RATE_HZ;
+    digiConfig.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+    digiConfig.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+    if (adc_digi_controller_configure(&digiConfig) != ESP_OK)
+    {
+        Serial.printf("ERROR: ADC DMA could not be configured\n");
+        return;
+    }
+
+    adc2_config_channel_atten(BRAKE_ADC_CHANNEL, ADC_ATTEN_DB_11);
+
+    adc_digi_start();
+
+    if (xTaskCreatePinnedToCore(AnalogInputs::taskEntry, "analog_inputs", 4096, this,
+                                ANALOG_TASK_PRIORITY, nullptr, ANALOG_TASK_CORE) != pdPASS)
+    {
+        Serial.printf("ERROR: Analog input task could not be created\n");
+    }
+}
+
+void AnalogInputs::taskEntry(void *arg)
+{
+    static_cast<AnalogInputs *>(arg)->run();
+}
+
+/**
+ * @brief Input task body: average each DMA frame per channel and publish it.
+ */
+void AnalogInputs::run()
+{
+    uint8_t buffer[ANALOG_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES];
+
+    for (;;)
+    {
+        uint32_t length = 0;
+        if (adc_digi_read_bytes(buffer, sizeof(buffer), &length, ANALOG_READ_TIMEOUT_MS) != ESP_OK)
+        {
+            // Timeout or DMA overflow; the next read resynchronizes.
+            continue;
+        }
+
+        uint32_t sum[ANALOG_INPUT_COUNT] = {0};
+        uint32_t count[ANALOG_INPUT_COUNT] = {0};
+
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES)
+        {
+            adc_digi_output_data_t *sample = reinterpret_cast<adc_digi_output_data_t *>(&buffer[i]);
+            if (sample->type1.channel == MANUAL_MODE_ADC_CHANNEL)
+            {
+                sum[MANUAL_MODE_INPUT] += sample->type1.data;
+                count[MANUAL_MODE_INPUT]++;
+            }
+            else if (sample->type1.channel == LIMIT_SWITCH_ADC_CHANNEL)
+            {
+                sum[LIMIT_SWITCH_INPUT] += sample->type1.data;
+                count[LIMIT_SWITCH_INPUT]++;
+            }
+        }
+
+        // ADC2 cannot be scanned by DMA on the ESP32, so oversample the brake with one-shot reads.
+        for (int i = 0; i < ANALOG_BRAKE_OVERSAMPLE; i++)
+        {
+            int value = 0;
+            if (adc2_get_raw(BRAKE_ADC_CHANNEL, ADC_WIDTH_BIT_12, &value) == ESP_OK)
+            {
+                sum[BRAKE_INPUT] += value;
+                count[BRAKE_INPUT]++;
+            }
+        }
+
+        uint16_t raw[ANALOG_INPUT_COUNT];
+        for (int ch = 0; ch < ANALOG_INPUT_COUNT; ch++)
+        {
+            raw[ch] = count[ch] > 0 ? sum[ch] / count[ch] : this->lastRaw[ch];
+        }
+
+        this->processFrame(raw, millis());
+    }
+}
+
+void AnalogInputs::processFrame(const uint16_t raw[ANALOG_INPUT_COUNT], uint32_t nowMs)
+{
+    PROFILE_SCOPE(PROFILE_ANALOG_FRAME);
+    AnalogInputState next;
+
+    for (int ch = 0; ch < ANALOG_INPUT_COUNT; ch++)
+    {
+        this->lastRaw[ch] = raw[ch];
+        next.raw[ch] = raw[ch];
+        next.filtered[ch] = this->filters[ch].filter(raw[ch]);
+    }
+
+    bool wasBraking = this->brakePressed;
+    this->updateSelector(next.filtered[MANUAL_MODE_INPUT], nowMs);
+    this->updateBrake(raw[BRAKE_INPUT], nowMs);
+
+    next.modeSelector = this->selector;
+    next.brakePressed = this->brakePressed;
+    next.limitSwitch = raw[LIMIT_SWITCH_INPUT] > LIMIT_SWITCH_THRESHOLD;
+    next.timestampMs = nowMs;
+
+    this->state.write(next);
+
+    if (this->brakePressed != wasBraking && this->brakeCallback)
+    {
+        this->brakeCallback(this->brakePressed, this->brakeCallbackArg);
+    }
+}
+
+/**
+ * @brief Map a selector voltage to a position, holding the current one inside the hysteresis band.
+ */
+ModeSelectorPosition AnalogInputs::classifySelector(float value) const
+{
+    int candidate = 0;
+    while (candidate < selectorThresholdCount && value >= selectorThresholds[candidate])
+    {
+        candidate++;
+    }
+
+    int current = this->selector;
+    if (candidate > current && value < selectorThresholds[candidate - 1] + MODE_SELECTOR_HYSTERESIS)
+    {
+        candidate--;
+    }
+    else if (candidate < current && value > selectorThresholds[candidate] - MODE_SELECTOR_HYSTERESIS)
+    {
+        candidate++;
+    }
+
+    return static_cast<ModeSelectorPosition>(candidate);
+}
+
+void AnalogInputs::updateSelector(float value, uint32_t nowMs)
+{
+    ModeSelectorPosition candidate = this->classifySelector(value);
+
+    if (candidate == this->selector)
+    {
+        this->pendingSelector = candidate;
+        return;
+    }
+
+    if (candidate != this->pendingSelector)
+    {
+        this->pendingSelector = candidate;
+        this->pendingSelectorSinceMs = nowMs;
+        return;
+    }
+
+    if (nowMs - this->pendingSelectorSinceMs >= MODE_SELECTOR_DEBOUNCE_MS)
+    {
+        this->selector = candidate;
+    }
+}
+
+void AnalogInputs::updateBrake(uint16_t raw, uint32_t nowMs)
+{
+    if (raw > BRAKE_ON_THRESHOLD)
+    {
+        // Presses are latched immediately so braking is never delayed.
+        this->brakePressed = true;
+        this->brakeLowSinceMs = 0;
+        return;
+    }
+
+    if (!this->brakePressed || raw >= BRAKE_OFF_THRESHOLD)
+    {
+        this->brakeLowSinceMs = 0;
+        return;
+    }
+
+    if (this->brakeLowSinceMs == 0)
+    {
+        this->brakeLowSinceMs = nowMs == 0 ? 1 : nowMs;
+    }
+    else if (nowMs - this->brakeLowSinceMs >= BRAKE_RELEASE_DEBOUNCE_MS)
+    {
+        this->brakePressed = false;
+        this->brakeLowSinceMs = 0;
+    }
+}
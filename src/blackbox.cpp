@@ -0,0 +1,423 @@
+#include "blackbox.h"
+#include <stddef.h>
+#include "crc16.h"
+#include "deferred_log.h"
+
+#define BLACKBOX_PAGES_PER_SECTOR (SPI_FLASH_SEC_SIZE / BLACKBOX_PAGE_SIZE)
+
+static_assert(sizeof(BlackboxPage) == BLACKBOX_PAGE_SIZE, "BlackboxPage must fill one page exactly");
+static_assert(SPI_FLASH_SEC_SIZE % BLACKBOX_PAGE_SIZE == 0, "BLACKBOX_PAGE_SIZE must divide the flash sector");
+static_assert(BLACKBOX_PAGE_SIZE % BLACKBOX_WRITE_CHUNK == 0, "BLACKBOX_WRITE_CHUNK must divide the page");
+static_assert(BLACKBOX_FIELD_COUNT <= 8, "the change mask is one byte");
+static_assert(BLACKBOX_PRETRIGGER_PAGES < BLACKBOX_RAM_PAGES - 1, "the control task needs a free page while history is held");
+
+Blackbox::Blackbox() : filled(0), consumed(0), pendingTriggers(0), eraseAllowed(false), dumping(false), last(), writer(BLACKBOX_FRAME_TAG)
+{
+    this->flashLock = xSemaphoreCreateMutexStatic(&this->flashLockBuffer);
+}
+
+/**
+ * @brief Locate the partition, resume after the newest valid page, and start the writer on core 0.
+ */
+void Blackbox::begin()
+{
+    const esp_partition_t *partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)BLACKBOX_PARTITION_SUBTYPE, "blackbox");
+    if (!partition)
+    {
+        Serial.printf("ERROR: blackbox partition not found, recorder disabled\n");
+        return;
+    }
+
+    this->pageCount = partition->size / SPI_FLASH_SEC_SIZE * BLACKBOX_PAGES_PER_SECTOR;
+    this->partition = partition;
+    this->scan();
+
+    if (xTaskCreatePinnedToCore([](void *arg)
+                                { static_cast<Blackbox *>(arg)->run(); },
+                                "blackbox", 4096, this, BLACKBOX_TASK_PRIORITY, &this->task, BLACKBOX_TASK_CORE) != pdPASS)
+    {
+        Serial.printf("ERROR: Blackbox task could not be created\n");
+        this->partition = nullptr;
+    }
+}
+
+/**
+ * @brief Find the write position from the page with the highest sequence number.
+ *
+ * Pages are written in order into erased sectors, so the rest of the newest page's sector
+ * and any erased sectors after it form the runway. A sector that is not fully erased
+ * (power lost mid-write or mid-erase) is skipped.
+ */
+void Blackbox::scan()
+{
+    bool found = false;
+    uint32_t newest = 0;
+    BlackboxPageHeader best = {};
+
+    for (uint32_t i = 0; i < this->pageCount; i++)
+    {
+        BlackboxPageHeader header;
+        if (esp_partition_read(this->partition, i * BLACKBOX_PAGE_SIZE, &header, sizeof(header)) != ESP_OK ||
+            header.magic != BLACKBOX_MAGIC || header.version != BLACKBOX_VERSION)
+        {
+            continue;
+        }
+        if (!found || (int32_t)(header.sequence - best.sequence) > 0)
+        {
+            found = true;
+            newest = i;
+            best = header;
+        }
+    }
+
+    this->writeIndex = found ? (newest + 1) % this->pageCount : 0;
+    this->nextSequence = found ? best.sequence + 1 : 0;
+    this->session = found ? best.session + 1 : 0;
+
+    uint32_t sectorEnd = (this->writeIndex / BLACKBOX_PAGES_PER_SECTOR + 1) * BLACKBOX_PAGES_PER_SECTOR;
+    if (this->writeIndex % BLACKBOX_PAGES_PER_SECTOR != 0 &&
+        !this->isErased(this->writeIndex * BLACKBOX_PAGE_SIZE, (sectorEnd - this->writeIndex) * BLACKBOX_PAGE_SIZE))
+    {
+        this->writeIndex = sectorEnd % this->pageCount;
+    }
+    this->erasedPages = (BLACKBOX_PAGES_PER_SECTOR - this->writeIndex % BLACKBOX_PAGES_PER_SECTOR) % BLACKBOX_PAGES_PER_SECTOR;
+
+    uint32_t limit = this->pageCount - BLACKBOX_PAGES_PER_SECTOR;
+    while (this->erasedPages < limit &&
+           this->isErased(((this->writeIndex + this->erasedPages) % this->pageCount) * BLACKBOX_PAGE_SIZE, SPI_FLASH_SEC_SIZE))
+    {
+        this->erasedPages += BLACKBOX_PAGES_PER_SECTOR;
+    }
+}
+
+bool Blackbox::isErased(uint32_t offset, uint32_t length)
+{
+    uint32_t words[64];
+
+    for (uint32_t done = 0; done < length; done += sizeof(words))
+    {
+        uint32_t chunk = length - done < sizeof(words) ? length - done : sizeof(words);
+        if (esp_partition_read(this->partition, offset + done, words, chunk) != ESP_OK)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < chunk / sizeof(uint32_t); i++)
+        {
+            if (words[i] != 0xFFFFFFFF)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+size_t Blackbox::encodeVarint(uint32_t value, uint8_t *out)
+{
+    size_t length = 0;
+    while (value >= 0x80)
+    {
+        out[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[length++] = value;
+    return length;
+}
+
+/**
+ * @brief Encode a sample as [change mask][time delta][changed field deltas...].
+ *
+ * Every value is a varint; field deltas are zigzag-encoded so small negative steps stay short.
+ * Fields that did not change since the previous sample in the page cost nothing but their mask bit.
+ */
+void Blackbox::record(const BlackboxSample &sample)
+{
+    if (!this->partition)
+    {
+        return;
+    }
+
+    this->heldTriggers |= this->detectTriggers(sample);
+
+    if (this->current && this->current->header.length + (size_t)BLACKBOX_SAMPLE_MAX > sizeof(this->current->payload))
+    {
+        this->finishPage();
+    }
+    if (!this->current && !this->startPage(sample.timestampUs))
+    {
+        this->stats.overruns++;
+        return;
+    }
+
+    BlackboxPageHeader &header = this->current->header;
+    header.triggers |= this->heldTriggers | this->pendingTriggers.exchange(0, std::memory_order_relaxed);
+    this->heldTriggers = 0;
+
+    uint8_t *out = this->current->payload + header.length;
+    uint8_t *mask = out++;
+    *mask = 0;
+    out += encodeVarint((uint32_t)(sample.timestampUs - this->lastUs), out);
+
+    for (int i = 0; i < BLACKBOX_FIELD_COUNT; i++)
+    {
+        int32_t delta = (int32_t)((uint32_t)sample.fields[i] - (uint32_t)this->last[i]);
+        if (delta != 0)
+        {
+            *mask |= 1 << i;
+            out += encodeVarint(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31), out);
+            this->last[i] = sample.fields[i];
+        }
+    }
+
+    header.length = out - this->current->payload;
+    header.sampleCount++;
+    this->lastUs = sample.timestampUs;
+}
+
+uint8_t Blackbox::detectTriggers(const BlackboxSample &sample)
+{
+    uint8_t triggers = 0;
+
+    if (this->hasPrevious)
+    {
+        if (sample.fields[BLACKBOX_DRIVER_FAULT] != 0 && this->previous.fields[BLACKBOX_DRIVER_FAULT] == 0)
+        {
+            triggers |= BLACKBOX_TRIGGER_FAULT;
+        }
+
+        int32_t rise = sample.fields[BLACKBOX_BRAKE_RAW] - this->previous.fields[BLACKBOX_BRAKE_RAW];
+        uint64_t elapsedUs = sample.timestampUs - this->previous.timestampUs;
+        if (rise > 0 && sample.fields[BLACKBOX_BRAKE_RAW] > BRAKE_ON_THRESHOLD &&
+            (uint64_t)rise * 1000000 >= (uint64_t)BLACKBOX_BRAKE_SLAM_RATE * elapsedUs)
+        {
+            triggers |= BLACKBOX_TRIGGER_BRAKE_SLAM;
+        }
+
+        if ((sample.fields[BLACKBOX_FLAGS] & TELEMETRY_FLAG_SLIP) && !(this->previous.fields[BLACKBOX_FLAGS] & TELEMETRY_FLAG_SLIP))
+        {
+            triggers |= BLACKBOX_TRIGGER_SLIP;
+        }
+    }
+
+    this->previous = sample;
+    this->hasPrevious = true;
+    return triggers;
+}
+
+/**
+ * @brief Claim the next RAM page, or fail if every page is still waiting for the writer.
+ */
+bool Blackbox::startPage(uint64_t nowUs)
+{
+    uint32_t index = this->filled.load(std::memory_order_relaxed);
+    if (index - this->consumed.load(std::memory_order_acquire) >= BLACKBOX_RAM_PAGES)
+    {
+        return false;
+    }
+
+    this->current = &this->pages[index % BLACKBOX_RAM_PAGES];
+    memset(this->current, 0xFF, sizeof(BlackboxPage));
+
+    BlackboxPageHeader &header = this->current->header;
+    header.magic = BLACKBOX_MAGIC;
+    header.version = BLACKBOX_VERSION;
+    header.triggers = 0;
+    header.length = 0;
+    header.sampleCount = 0;
+    header.startUs = nowUs;
+
+    // The first sample in a page is a delta from zero, so each page decodes on its own.
+    memset(this->last, 0, sizeof(this->last));
+    this->lastUs = nowUs;
+    return true;
+}
+
+void Blackbox::finishPage()
+{
+    this->filled.fetch_add(1, std::memory_order_release);
+    this->current = nullptr;
+    xTaskNotifyGive(this->task);
+}
+
+/**
+ * @brief Writer task: commit completed pages, hold history in triggered mode, and erase ahead while stopped.
+ */
+void Blackbox::run()
+{
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(BLACKBOX_IDLE_POLL_MS));
+        uint32_t filled = this->filled.load(std::memory_order_acquire);
+
+        // Look ahead for triggers first so the pages held before them are kept as history.
+        for (; this->scanned != filled; this->scanned++)
+        {
+            const BlackboxPageHeader &header = this->pages[this->scanned % BLACKBOX_RAM_PAGES].header;
+            if (header.triggers)
+            {
+                this->stats.triggeredPages++;
+                this->keepUntilUs = header.startUs + (uint64_t)BLACKBOX_POST_TRIGGER_MS * 1000;
+            }
+        }
+
+        for (uint32_t index = this->consumed.load(std::memory_order_relaxed); index != filled; index++)
+        {
+            BlackboxPage &page = this->pages[index % BLACKBOX_RAM_PAGES];
+            bool keep = BLACKBOX_CONTINUOUS || page.header.startUs <= this->keepUntilUs;
+            if (!keep && filled - index <= BLACKBOX_PRETRIGGER_PAGES)
+            {
+                break;
+            }
+            if (keep)
+            {
+                this->commit(page);
+            }
+            this->consumed.store(index + 1, std::memory_order_release);
+        }
+
+        // A dump sets dumping under the lock, so no erase starts after it has taken its range.
+        xSemaphoreTake(this->flashLock, portMAX_DELAY);
+        if ((this->eraseAllowed.load(std::memory_order_relaxed) || (BLACKBOX_ERASE_WHILE_DRIVING && this->erasedPages == 0)) &&
+            !this->dumping.load(std::memory_order_relaxed))
+        {
+            this->eraseAhead();
+        }
+        xSemaphoreGive(this->flashLock);
+    }
+}
+
+uint16_t Blackbox::pageCrc(const BlackboxPage &page)
+{
+    uint16_t crc = crc16Update(0xFFFF, reinterpret_cast<const uint8_t *>(&page.header), offsetof(BlackboxPageHeader, crc));
+    return crc16Update(crc, page.payload, page.header.length);
+}
+
+/**
+ * @brief Program one page at the write position, skipping chunks that would only write erased bytes.
+ */
+void Blackbox::commit(BlackboxPage &page)
+{
+    if (this->erasedPages == 0)
+    {
+        this->stats.pagesDropped++;
+        return;
+    }
+
+    page.header.sequence = this->nextSequence++;
+    page.header.session = this->session;
+    page.header.crc = pageCrc(page);
+
+    uint32_t offset = this->writeIndex * BLACKBOX_PAGE_SIZE;
+    size_t used = sizeof(BlackboxPageHeader) + page.header.length;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&page);
+
+    for (size_t chunk = 0; chunk < used; chunk += BLACKBOX_WRITE_CHUNK)
+    {
+        if (esp_partition_write(this->partition, offset + chunk, bytes + chunk, BLACKBOX_WRITE_CHUNK) != ESP_OK)
+        {
+            // The page fails its CRC on download; keep going with the next one.
+            DLOG("Blackbox write failed at 0x%X\n", offset + chunk);
+            break;
+        }
+    }
+
+    xSemaphoreTake(this->flashLock, portMAX_DELAY);
+    this->writeIndex = (this->writeIndex + 1) % this->pageCount;
+    this->erasedPages--;
+    this->stats.pagesWritten++;
+    xSemaphoreGive(this->flashLock);
+}
+
+/**
+ * @brief Erase the next sector past the runway, one sector per call to bound each stall.
+ * Called with flashLock held.
+ */
+void Blackbox::eraseAhead()
+{
+    uint32_t target = BLACKBOX_ERASE_AHEAD_SECTORS * BLACKBOX_PAGES_PER_SECTOR;
+    uint32_t limit = this->pageCount - BLACKBOX_PAGES_PER_SECTOR; // never erase the sector holding the newest page
+    if (target > limit)
+    {
+        target = limit;
+    }
+    if (this->erasedPages >= target)
+    {
+        return;
+    }
+
+    uint32_t page = (this->writeIndex + this->erasedPages) % this->pageCount;
+    if (esp_partition_erase_range(this->partition, page * BLACKBOX_PAGE_SIZE, SPI_FLASH_SEC_SIZE) != ESP_OK)
+    {
+        DLOG("Blackbox erase failed at 0x%X\n", page * BLACKBOX_PAGE_SIZE);
+        return;
+    }
+    this->erasedPages += BLACKBOX_PAGES_PER_SECTOR;
+}
+
+/**
+ * @brief Take the range from the oldest page (just past the erased runway) to the newest.
+ *
+ * Pages the writer commits from here on land in the runway, outside the range, and nothing
+ * is erased until the end frame. A second request restarts the dump.
+ */
+void Blackbox::dump()
+{
+    if (!this->partition)
+    {
+        this->writer.send(0);
+        return;
+    }
+
+    xSemaphoreTake(this->flashLock, portMAX_DELAY);
+    this->dumping.store(true, std::memory_order_relaxed);
+    this->dumpNext = (this->writeIndex + this->erasedPages) % this->pageCount;
+    this->dumpRemaining = this->pageCount - this->erasedPages;
+    xSemaphoreGive(this->flashLock);
+}
+
+/**
+ * @brief Send the next valid pages of the dump, and the end frame after the last.
+ *
+ * Only sent pages count against BLACKBOX_DUMP_PAGES_PER_PASS; reading past invalid ones is cheap.
+ */
+void Blackbox::serviceDump()
+{
+    if (!this->dumping.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    for (int sent = 0; sent < BLACKBOX_DUMP_PAGES_PER_PASS && this->dumpRemaining > 0;)
+    {
+        uint32_t offset = this->dumpNext * BLACKBOX_PAGE_SIZE;
+        this->dumpNext = (this->dumpNext + 1) % this->pageCount;
+        this->dumpRemaining--;
+
+        const BlackboxPageHeader *header = reinterpret_cast<const BlackboxPageHeader *>(this->writer.payload());
+        if (esp_partition_read(this->partition, offset, this->writer.payload(), BLACKBOX_PAGE_SIZE) != ESP_OK ||
+            header->magic != BLACKBOX_MAGIC)
+        {
+            continue;
+        }
+        this->writer.send(BLACKBOX_PAGE_SIZE);
+        sent++;
+    }
+
+    if (this->dumpRemaining == 0)
+    {
+        this->dumping.store(false, std::memory_order_relaxed);
+        this->writer.send(0);
+    }
+}
+
+BlackboxStats Blackbox::getStats() const
+{
+    xSemaphoreTake(this->flashLock, portMAX_DELAY);
+    BlackboxStats stats = this->stats;
+    stats.erasedPages = this->erasedPages;
+    xSemaphoreGive(this->flashLock);
+    stats.sequence = this->nextSequence;
+    stats.session = this->session;
+    return stats;
+}
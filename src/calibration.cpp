@@ -0,0 +1,221 @@
+#include "calibration.h"
+#include <Preferences.h>
+#include "config.h"
+#include "crc16.h"
+
+const CalParamDef calParams[CAL_PARAM_COUNT] = {
+    {"rpm_kp", RPM_Kp, 0.0f, 50.0f},
+    {"rpm_kd", RPM_Kd, 0.0f, 50.0f},
+    {"engine_engage_rpm", ENGINE_ENGAGE_RPM, 1000.0f, 4000.0f},
+    {"engine_ideal_rpm_power", ENGINE_IDEAL_RPM_POWER, 1500.0f, 4000.0f},
+    {"engine_ideal_rpm_torque", ENGINE_IDEAL_RPM_TORQUE, 1500.0f, 4000.0f},
+    {"engine_max_rpm", ENGINE_MAX_RPM, 2000.0f, 4500.0f},
+    {"idle_motor_setpoint", IDLE_MOTOR_SETPOINT, 0.0f, MAX_MOTOR_SETPOINT},
+    {"low_max_setpoint", LOW_MAX_SETPOINT, 0.0f, MAX_MOTOR_SETPOINT},
+    {"max_motor_setpoint", MAX_MOTOR_SETPOINT, 0.0f, MAX_MOTOR_SETPOINT},
+    {"max_motor_setpoint_brake_mode", MAX_MOTOR_SETPOINT_BRAKE_MODE, 0.0f, MAX_MOTOR_SETPOINT},
+    {"run_motor_current", RUN_MOTOR_CURRENT, 0.0f, 255.0f},
+    {"hold_motor_current", HOLD_MOTOR_CURRENT, 0.0f, 255.0f},
+    {"max_acceleration_pos", MOTOR_MAX_ACCELERATION_POS, 1000.0f, 500000.0f},
+    {"max_acceleration_neg", MOTOR_MAX_ACCELERATION_NEG, 1000.0f, 500000.0f},
+    {"ambient_temp_c", THERMAL_AMBIENT_C, -20.0f, 80.0f},
+};
+
+/**
+ * @brief Pairs that must stay ordered, lower first.
+ */
+struct CalOrdering {
+    CalParam lower;
+    CalParam upper;
+    bool strict; // lower must be below upper, not just at or below it
+};
+
+static const CalOrdering calOrderings[] = {
+    {CAL_ENGINE_ENGAGE_RPM, CAL_ENGINE_MAX_RPM, true},         // setpointLaw divides by the difference
+    {CAL_ENGINE_ENGAGE_RPM, CAL_ENGINE_IDEAL_RPM_POWER, true}, // so does the launch clamp ramp
+    {CAL_IDLE_MOTOR_SETPOINT, CAL_LOW_MAX_SETPOINT, false},    // bounds of the low setpoint clamp
+    {CAL_LOW_MAX_SETPOINT, CAL_MAX_MOTOR_SETPOINT, false},
+    {CAL_LOW_MAX_SETPOINT, CAL_MAX_MOTOR_SETPOINT_BRAKE_MODE, false},
+};
+
+int calConflict(const CalibrationValues &cal)
+{
+    for (const CalOrdering &ordering : calOrderings)
+    {
+        float lower = cal[ordering.lower];
+        float upper = cal[ordering.upper];
+        if (ordering.strict ? !(lower < upper) : !(lower <= upper))
+        {
+            return ordering.lower;
+        }
+    }
+    return CAL_PARAM_COUNT;
+}
+
+uint16_t calChecksum(const CalibrationValues &cal)
+{
+    // The ESP32 is little-endian, so the value bytes are already in wire order.
+    return crc16Update(0xFFFF, reinterpret_cast<const uint8_t *>(cal.values), sizeof(cal.values));
+}
+
+Calibration::Calibration(CanScheduler &canTx) : canTx(canTx), staged(defaults())
+{
+}
+
+CalibrationValues Calibration::defaults()
+{
+    CalibrationValues cal;
+    for (int i = 0; i < CAL_PARAM_COUNT; i++)
+    {
+        cal.values[i] = calParams[i].defaultValue;
+    }
+    return cal;
+}
+
+/**
+ * @brief Load the committed set. The stored count and checksum must match or defaults are used.
+ */
+void Calibration::begin()
+{
+    // Parameters appended since the set was committed keep their defaults.
+    CalibrationValues stored = defaults();
+    Preferences prefs;
+
+    bool valid = false;
+    if (prefs.begin(CAL_NVS_NAMESPACE, true))
+    {
+        uint8_t count = prefs.getUChar("count", 0);
+        size_t size = count * sizeof(stored.values[0]);
+        valid = count > 0 && count <= CAL_PARAM_COUNT &&
+                prefs.getBytes("values", stored.values, sizeof(stored.values)) == size &&
+                prefs.getUShort("crc", 0) == crc16Update(0xFFFF, reinterpret_cast<const uint8_t *>(stored.values), size);
+        prefs.end();
+    }
+
+    for (int i = 0; valid && i < CAL_PARAM_COUNT; i++)
+    {
+        valid = stored.values[i] >= calParams[i].min && stored.values[i] <= calParams[i].max;
+    }
+    valid = valid && calConflict(stored) == CAL_PARAM_COUNT;
+
+    if (!valid)
+    {
+        Serial.printf("Calibration: no valid stored set, using defaults\n");
+        stored = defaults();
+    }
+
+    this->staged = stored;
+    this->active.write(stored);
+}
+
+void Calibration::handleWrite(uint32_t param, float value)
+{
+    if (param >= CAL_PARAM_COUNT)
+    {
+        this->respond(CAL_CMD_WRITE, CAL_ERR_PARAM, param);
+        return;
+    }
+
+    if (!(value >= calParams[param].min && value <= calParams[param].max))
+    {
+        this->respond(CAL_CMD_WRITE, CAL_ERR_RANGE, param);
+        return;
+    }
+
+    this->staged.values[param] = value;
+    this->respond(CAL_CMD_WRITE, CAL_OK, param);
+}
+
+void Calibration::handleCommand(float encoded)
+{
+    uint32_t code = (uint32_t)encoded;
+    CalCommand command = static_cast<CalCommand>(code >> 8);
+    uint32_t param = code & 0xFF;
+
+    switch (command)
+    {
+    case CAL_CMD_READ:
+        if (param >= CAL_PARAM_COUNT)
+        {
+            this->respond(command, CAL_ERR_PARAM, param);
+            return;
+        }
+        {
+            CanMessage value(CAL_VALUE_BASE_ID + param, this->staged.values[param]);
+            this->canTx.sendMessage(value);
+        }
+        this->respond(command, CAL_OK, param);
+        break;
+
+    case CAL_CMD_APPLY:
+    {
+        // The staged set is kept so the conflicting value can be rewritten and applied again.
+        int conflict = calConflict(this->staged);
+        if (conflict != CAL_PARAM_COUNT)
+        {
+            this->respond(command, CAL_ERR_CONFLICT, conflict);
+            return;
+        }
+        this->active.write(this->staged);
+        this->respond(command, CAL_OK, calChecksum(this->staged));
+        break;
+    }
+
+    case CAL_CMD_COMMIT:
+        this->commitRequested = true; // answered by service()
+        break;
+
+    case CAL_CMD_CHECKSUM:
+        this->respond(command, CAL_OK, calChecksum(this->active.read()));
+        break;
+
+    case CAL_CMD_REVERT:
+        this->staged = this->active.read();
+        this->respond(command, CAL_OK, 0);
+        break;
+
+    case CAL_CMD_DEFAULTS:
+        this->staged = defaults();
+        this->respond(command, CAL_OK, 0);
+        break;
+
+    default:
+        this->respond(command, CAL_ERR_COMMAND, param);
+        break;
+    }
+}
+
+/**
+ * @brief Store the active set in NVS if a commit was requested.
+ */
+void Calibration::service()
+{
+    if (!this->commitRequested.exchange(false))
+    {
+        return;
+    }
+
+    CalibrationValues cal = this->active.read();
+    uint16_t crc = calChecksum(cal);
+    Preferences prefs;
+
+    bool ok = prefs.begin(CAL_NVS_NAMESPACE, false) &&
+              prefs.putBytes("values", cal.values, sizeof(cal.values)) == sizeof(cal.values) &&
+              prefs.putUShort("crc", crc) == sizeof(crc) &&
+              prefs.putUChar("count", CAL_PARAM_COUNT) == 1;
+    prefs.end();
+
+    if (!ok)
+    {
+        Serial.printf("ERROR: Calibration could not be written to NVS\n");
+    }
+    this->respond(CAL_CMD_COMMIT, ok ? CAL_OK : CAL_ERR_NVS, crc);
+}
+
+void Calibration::respond(CalCommand command, CalStatus status, uint16_t payload)
+{
+    // 24 bits fit exactly in a float mantissa.
+    uint32_t code = ((uint32_t)(command & 0xF) << 20) | ((uint32_t)(status & 0xF) << 16) | payload;
+    CanMessage response(CAL_RESPONSE_ID, (float)code);
+    this->canTx.sendMessage(response);
+}
@@ -0,0 +1,184 @@
+#include "can_dispatch.h"
+#include "driver/twai.h"
+#include "profiler.h"
+
+#define CAN_STD_ID_MAX 0x7FF
+#define CAN_RX_FILTERS 2 // acceptance filters in dual filter mode
+
+static_assert((CAN_RX_SLOTS & (CAN_RX_SLOTS - 1)) == 0, "CAN_RX_SLOTS must be a power of two");
+
+CanDispatcher::CanDispatcher(BajaCan &can, const CanRxEntry *entries, uint8_t entryCount, void *context)
+    : can(can),
+      entries(entries),
+      entryCount(entryCount),
+      context(context)
+{
+}
+
+/**
+ * @brief Build the lookup index, enable the alerts the receive task sleeps on, and start it.
+ */
+void CanDispatcher::begin()
+{
+    this->buildIndex();
+
+    // BajaCan installed the driver; only the alerts are ours to set.
+    if (twai_reconfigure_alerts(TWAI_ALERT_RX_DATA | TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_BUS_OFF | TWAI_ALERT_BUS_RECOVERED,
+                                nullptr) != ESP_OK)
+    {
+        Serial.printf("ERROR: CAN receive alerts could not be enabled\n");
+    }
+
+    if (xTaskCreatePinnedToCore([](void *arg)
+                                { static_cast<CanDispatcher *>(arg)->run(); },
+                                "can_rx", 4096, this, CAN_RX_TASK_PRIORITY, nullptr, CAN_RX_TASK_CORE) != pdPASS)
+    {
+        Serial.printf("ERROR: CAN receive task could not be created\n");
+    }
+}
+
+void CanDispatcher::buildIndex()
+{
+    for (int slot = 0; slot < CAN_RX_SLOTS; slot++)
+    {
+        this->index[slot] = -1;
+    }
+
+    // Linear probing, one slot per handled ID. One slot is always left empty so every probe sequence terminates.
+    int used = 0;
+    for (uint8_t i = 0; i < this->entryCount; i++)
+    {
+        for (uint32_t id = this->entries[i].id; id < this->entries[i].id + this->entries[i].count; id++)
+        {
+            if (used == CAN_RX_SLOTS - 1)
+            {
+                Serial.printf("ERROR: CAN receive table has more IDs than CAN_RX_SLOTS\n");
+                return;
+            }
+
+            uint32_t slot = slotFor(id);
+            while (this->index[slot] >= 0)
+            {
+                slot = (slot + 1) & (CAN_RX_SLOTS - 1);
+            }
+            this->index[slot] = i;
+            used++;
+        }
+    }
+}
+
+/**
+ * @brief Dual-mode filter with one first-ID/differing-bits pair per filter.
+ *
+ * For standard frames the first filter compares the ID at bits 31:21, RTR at bit 20, and the
+ * first data byte at bits 19:16 and 3:0; the second compares the ID at bits 15:5 and RTR at
+ * bit 4. Bits that differ within a filter's rows are don't-care, so a filter may pass a few
+ * extra IDs; those are rejected by the lookup and counted as unhandled.
+ */
+twai_filter_config_t CanDispatcher::acceptanceFilter() const
+{
+    twai_filter_config_t acceptAll = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+    uint32_t first[CAN_RX_FILTERS] = {};
+    uint32_t differing[CAN_RX_FILTERS] = {};
+    bool used[CAN_RX_FILTERS] = {};
+
+    for (uint8_t i = 0; i < this->entryCount; i++)
+    {
+        const CanRxEntry &entry = this->entries[i];
+        if (entry.filter >= CAN_RX_FILTERS || entry.id + entry.count - 1 > CAN_STD_ID_MAX)
+        {
+            Serial.printf("ERROR: CAN receive table row %u cannot be filtered in hardware\n", (unsigned)i);
+            return acceptAll;
+        }
+
+        for (uint32_t id = entry.id; id < entry.id + entry.count; id++)
+        {
+            if (!used[entry.filter])
+            {
+                first[entry.filter] = id;
+                used[entry.filter] = true;
+            }
+            differing[entry.filter] |= id ^ first[entry.filter];
+        }
+    }
+
+    if (!used[0] && !used[1])
+    {
+        return acceptAll;
+    }
+
+    // An unused filter repeats the other so it passes nothing extra.
+    for (int f = 0; f < CAN_RX_FILTERS; f++)
+    {
+        if (!used[f])
+        {
+            first[f] = first[1 - f];
+            differing[f] = differing[1 - f];
+        }
+    }
+
+    twai_filter_config_t filter;
+    filter.single_filter = false;
+    filter.acceptance_code = (first[0] << 21) | (first[1] << 5);
+    filter.acceptance_mask = (differing[0] << 21) | 0x000F0000 | (differing[1] << 5) | 0x0000000F;
+    return filter;
+}
+
+/**
+ * @brief Receive task body: sleep until the driver raises an alert, then drain the RX queue.
+ */
+void CanDispatcher::run()
+{
+    CanMessage message;
+
+    for (;;)
+    {
+        uint32_t alerts = 0;
+        if (twai_read_alerts(&alerts, portMAX_DELAY) != ESP_OK)
+        {
+            continue;
+        }
+
+        if (alerts & TWAI_ALERT_RX_QUEUE_FULL)
+        {
+            this->stats.overruns++;
+        }
+
+        if (alerts & TWAI_ALERT_BUS_OFF)
+        {
+            this->stats.busOff++;
+            twai_initiate_recovery();
+        }
+
+        if (alerts & TWAI_ALERT_BUS_RECOVERED)
+        {
+            twai_start();
+        }
+
+        while (this->can.readMessage(message, 0) == ESP_OK)
+        {
+            this->dispatch(message);
+        }
+    }
+}
+
+void CanDispatcher::dispatch(CanMessage &message)
+{
+    PROFILE_SCOPE(PROFILE_CAN_RX);
+    uint32_t id = message.getId();
+    uint32_t slot = slotFor(id);
+
+    for (int probe = 0; probe < CAN_RX_SLOTS && this->index[slot] >= 0; probe++)
+    {
+        const CanRxEntry &entry = this->entries[this->index[slot]];
+        if (id - entry.id < entry.count)
+        {
+            this->stats.received++;
+            entry.handler(this->context, message);
+            return;
+        }
+        slot = (slot + 1) & (CAN_RX_SLOTS - 1);
+    }
+
+    this->stats.unhandled++;
+}
@@ -0,0 +1,250 @@
+#include "can_scheduler.h"
+#include "deferred_log.h"
+#include "profiler.h"
+
+CanScheduler::CanScheduler(BajaCan &can, const CanTxEntry *entries, uint8_t entryCount, void *context)
+    : can(can),
+      entries(entries),
+      entryCount(entryCount > CAN_TX_MAX_ENTRIES ? CAN_TX_MAX_ENTRIES : entryCount),
+      context(context),
+      lastSentMs(),
+      lastData(),
+      hasSent(),
+      queues()
+{
+    this->messageLock = xSemaphoreCreateMutexStatic(&this->messageLockBuffer);
+}
+
+/**
+ * @brief Start the transmit task.
+ */
+void CanScheduler::begin()
+{
+    if (xTaskCreatePinnedToCore([](void *arg)
+                                { static_cast<CanScheduler *>(arg)->run(); },
+                                "can_tx", 4096, this, CAN_TX_TASK_PRIORITY, nullptr, CAN_TX_TASK_CORE) != pdPASS)
+    {
+        Serial.printf("ERROR: CAN transmit task could not be created\n");
+    }
+}
+
+/**
+ * @brief Transmit task body: one pass every CAN_TX_TICK_MS.
+ */
+void CanScheduler::run()
+{
+    TickType_t lastWake = xTaskGetTickCount();
+    for (;;)
+    {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(CAN_TX_TICK_MS));
+        this->service(millis());
+    }
+}
+
+void CanScheduler::service(uint32_t nowMs)
+{
+    PROFILE_SCOPE(PROFILE_CAN_TX);
+
+    for (uint8_t i = 0; i < this->entryCount; i++)
+    {
+        const CanTxEntry &entry = this->entries[i];
+        bool due = !this->hasSent[i] ||
+                   (entry.periodMs > 0 && nowMs - this->lastSentMs[i] >= entry.periodMs);
+
+        // Entries without change triggers are only sampled when they are due.
+        if (!due && entry.changeMask == 0)
+        {
+            continue;
+        }
+
+        float values[32];
+        uint8_t data[8];
+        entry.fill(this->context, values);
+        canPackFrame(*entry.frame, values, data);
+
+        if (!due && !this->signalsChanged(i, data))
+        {
+            continue;
+        }
+
+        this->enqueue(entry.priority, entry.frame, data);
+        memcpy(this->lastData[i], data, sizeof(data));
+        this->lastSentMs[i] = nowMs;
+        this->hasSent[i] = true;
+    }
+
+    this->drain();
+
+    #ifdef CAN_DEBUG
+    twai_status_info_t canStatus;
+    if (twai_get_status_info(&canStatus) == ESP_OK && canStatus.msgs_to_tx > 0)
+    {
+        DLOG("CAN bus status - msgs_to_tx: %d, msgs_to_rx: %d, bus_state: %d\n", canStatus.msgs_to_tx, canStatus.msgs_to_rx, canStatus.state);
+    }
+    #endif
+}
+
+/**
+ * @brief Compare the change-triggering signals of a freshly packed frame with the last one queued.
+ */
+bool CanScheduler::signalsChanged(uint8_t index, const uint8_t data[8]) const
+{
+    const CanTxEntry &entry = this->entries[index];
+
+    for (uint8_t s = 0; s < entry.frame->signalCount; s++)
+    {
+        if ((entry.changeMask & (1u << s)) &&
+            canUnpackSignal(data, entry.frame->signals[s]) != canUnpackSignal(this->lastData[index], entry.frame->signals[s]))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void CanScheduler::enqueue(CanPriority priority, const CanFrameDef *frame, const uint8_t data[8])
+{
+    PriorityQueue &queue = this->queues[priority];
+
+    // A newer sample supersedes an unsent one, except for critical frames where every transition matters.
+    if (priority != CAN_PRIORITY_CRITICAL)
+    {
+        for (uint8_t n = 0; n < queue.count; n++)
+        {
+            QueuedFrame &queued = queue.frames[(queue.head + n) % CAN_TX_QUEUE_DEPTH];
+            if (queued.frame == frame)
+            {
+                memcpy(queued.data, data, 8);
+                this->stats.coalesced++;
+                return;
+            }
+        }
+    }
+
+    if (queue.count == CAN_TX_QUEUE_DEPTH)
+    {
+        queue.head = (queue.head + 1) % CAN_TX_QUEUE_DEPTH;
+        queue.count--;
+        this->stats.dropped[priority]++;
+    }
+
+    QueuedFrame &slot = queue.frames[(queue.head + queue.count) % CAN_TX_QUEUE_DEPTH];
+    slot.frame = frame;
+    memcpy(slot.data, data, 8);
+    queue.count++;
+}
+
+/**
+ * @brief Hand queued frames to the TWAI driver, highest priority first.
+ *
+ * The driver queue is FIFO, so non-critical frames are only submitted while it holds
+ * fewer than CAN_TX_INFLIGHT_LIMIT frames; a critical frame then waits behind at most
+ * that many frames no matter how busy the bus is.
+ */
+void CanScheduler::drain()
+{
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) != ESP_OK)
+    {
+        return;
+    }
+    uint32_t pending = status.msgs_to_tx;
+
+    for (int p = 0; p < CAN_PRIORITY_COUNT; p++)
+    {
+        PriorityQueue &queue = this->queues[p];
+
+        while (queue.count > 0)
+        {
+            if (p != CAN_PRIORITY_CRITICAL && pending >= CAN_TX_INFLIGHT_LIMIT)
+            {
+                return;
+            }
+
+            QueuedFrame &queued = queue.frames[queue.head];
+            twai_message_t message = {};
+            message.identifier = queued.frame->id;
+            message.data_length_code = queued.frame->dlc;
+            memcpy(message.data, queued.data, 8);
+
+            esp_err_t ret = twai_transmit(&message, 0);
+            if (ret == ESP_ERR_TIMEOUT)
+            {
+                // Driver queue full: leave the frame at the head and retry next pass.
+                this->stats.retried++;
+                return;
+            }
+
+            if (ret == ESP_OK)
+            {
+                this->stats.sent++;
+                pending++;
+            }
+            else
+            {
+                this->stats.failed++;
+                #ifdef CAN_DEBUG
+                DLOG("Failed to send %s message. Error code: %s\n", queued.frame->name, esp_err_to_name(ret));
+                #endif
+            }
+
+            queue.head = (queue.head + 1) % CAN_TX_QUEUE_DEPTH;
+            queue.count--;
+        }
+    }
+
+    this->drainMessages(pending);
+}
+
+void CanScheduler::sendMessage(const CanMessage &message)
+{
+    xSemaphoreTake(this->messageLock, portMAX_DELAY);
+    if (this->messageCount == CAN_TX_MESSAGE_DEPTH)
+    {
+        this->messageHead = (this->messageHead + 1) % CAN_TX_MESSAGE_DEPTH;
+        this->messageCount--;
+        this->stats.droppedMessages++;
+    }
+    this->messages[(this->messageHead + this->messageCount) % CAN_TX_MESSAGE_DEPTH] = message;
+    this->messageCount++;
+    xSemaphoreGive(this->messageLock);
+}
+
+uint8_t CanScheduler::messageSpace()
+{
+    xSemaphoreTake(this->messageLock, portMAX_DELAY);
+    uint8_t space = CAN_TX_MESSAGE_DEPTH - this->messageCount;
+    xSemaphoreGive(this->messageLock);
+    return space;
+}
+
+/**
+ * @brief Hand one-off messages to BajaCan once every table queue is empty, under the same
+ * in-flight limit as the other non-critical frames.
+ */
+void CanScheduler::drainMessages(uint32_t pending)
+{
+    xSemaphoreTake(this->messageLock, portMAX_DELAY);
+    while (this->messageCount > 0 && pending < CAN_TX_INFLIGHT_LIMIT)
+    {
+        esp_err_t ret = this->can.writeMessage(this->messages[this->messageHead], 0);
+        if (ret == ESP_ERR_TIMEOUT)
+        {
+            this->stats.retried++;
+            break;
+        }
+
+        if (ret == ESP_OK)
+        {
+            this->stats.sent++;
+            pending++;
+        }
+        else
+        {
+            this->stats.failed++;
+        }
+        this->messageHead = (this->messageHead + 1) % CAN_TX_MESSAGE_DEPTH;
+        this->messageCount--;
+    }
+    xSemaphoreGive(this->messageLock);
+}
@@ -0,0 +1,108 @@
+#include "can_signals.h"
+#include <math.h>
+#include <string.h>
+
+static const CanSignal speedSignals[SPEED_SIGNAL_COUNT] = {
+    // name            start len signed scale  offset
+    {"engine_rpm",      0,   16, false, 1.0f,  0.0f},
+    {"target_rpm",      16,  16, false, 1.0f,  0.0f},
+    {"vehicle_speed",   32,  16, true,  0.01f, 0.0f}, // LINEAR_SPEED units
+};
+
+static const CanSignal motorSignals[MOTOR_SIGNAL_COUNT] = {
+    {"motor_setpoint",  0,   16, true,  1.0f,  0.0f}, // steps
+    {"motor_position",  16,  16, true,  1.0f,  0.0f}, // steps
+    {"motor_velocity",  32,  16, true,  4.0f,  0.0f}, // steps/s
+};
+
+static const CanSignal statusSignals[STATUS_SIGNAL_COUNT] = {
+    {"control_mode",    0,   4,  false, 1.0f,  0.0f},
+    {"brake",           4,   1,  false, 1.0f,  0.0f},
+    {"limit_switch",    5,   1,  false, 1.0f,  0.0f},
+    {"brake_profile",   6,   1,  false, 1.0f,  0.0f},
+    {"launch_state",    8,   2,  false, 1.0f,  0.0f},
+    {"driver_fault",    16,  8,  false, 1.0f,  0.0f}, // DRV8462 FAULT register
+    {"deadline_misses", 32,  16, false, 1.0f,  0.0f},
+    {"ctrl_latency_us", 48,  16, false, 1.0f,  0.0f},
+};
+
+const CanFrameDef ECVT_SPEED_FRAME = {"ECVT_SPEED", ECVT_SPEED_FRAME_ID, 6, speedSignals, SPEED_SIGNAL_COUNT};
+const CanFrameDef ECVT_MOTOR_FRAME = {"ECVT_MOTOR", ECVT_MOTOR_FRAME_ID, 6, motorSignals, MOTOR_SIGNAL_COUNT};
+const CanFrameDef ECVT_STATUS_FRAME = {"ECVT_STATUS", ECVT_STATUS_FRAME_ID, 8, statusSignals, STATUS_SIGNAL_COUNT};
+
+static uint64_t loadLittleEndian(const uint8_t data[8])
+{
+    uint64_t word = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        word = (word << 8) | data[i];
+    }
+    return word;
+}
+
+static void storeLittleEndian(uint64_t word, uint8_t data[8])
+{
+    for (int i = 0; i < 8; i++)
+    {
+        data[i] = word & 0xFF;
+        word >>= 8;
+    }
+}
+
+void canPackSignal(uint8_t data[8], const CanSignal &signal, float value)
+{
+    int64_t minRaw = signal.isSigned ? -(int64_t(1) << (signal.length - 1)) : 0;
+    int64_t maxRaw = signal.isSigned ? (int64_t(1) << (signal.length - 1)) - 1 : (int64_t(1) << signal.length) - 1;
+
+    float scaled = roundf((value - signal.offset) / signal.scale);
+    int64_t raw = scaled <= (float)minRaw ? minRaw : scaled >= (float)maxRaw ? maxRaw : (int64_t)scaled;
+
+    uint64_t mask = ((uint64_t(1) << signal.length) - 1) << signal.startBit;
+    uint64_t word = loadLittleEndian(data);
+    word = (word & ~mask) | ((uint64_t(raw) << signal.startBit) & mask);
+    storeLittleEndian(word, data);
+}
+
+float canUnpackSignal(const uint8_t data[8], const CanSignal &signal)
+{
+    uint64_t raw = (loadLittleEndian(data) >> signal.startBit) & ((uint64_t(1) << signal.length) - 1);
+
+    int64_t value = (int64_t)raw;
+    if (signal.isSigned && (raw & (uint64_t(1) << (signal.length - 1))))
+    {
+        value -= int64_t(1) << signal.length; // sign-extend
+    }
+    return value * signal.scale + signal.offset;
+}
+
+void canPackFrame(const CanFrameDef &frame, const float *values, uint8_t data[8])
+{
+    memset(data, 0, 8);
+    for (uint8_t i = 0; i < frame.signalCount; i++)
+    {
+        canPackSignal(data, frame.signals[i], values[i]);
+    }
+}
+
+void canUnpackFrame(const CanFrameDef &frame, const uint8_t data[8], float *values)
+{
+    for (uint8_t i = 0; i < frame.signalCount; i++)
+    {
+        values[i] = canUnpackSignal(data, frame.signals[i]);
+    }
+}
+
+const CanFrameDef *canFindFrame(uint32_t id)
+{
+    switch (id)
+    {
+    case ECVT_SPEED_FRAME_ID:
+        return &ECVT_SPEED_FRAME;
+    case ECVT_MOTOR_FRAME_ID:
+        return &ECVT_MOTOR_FRAME;
+    case ECVT_STATUS_FRAME_ID:
+        return &ECVT_STATUS_FRAME;
+    default:
+        return nullptr;
+    }
+}
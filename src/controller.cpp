@@ -1,21 +1,54 @@
 #include "controller.h"
 #include <Arduino.h>
+#include "esp_timer.h"
 #include "config.h"
 #include "CanDatabase.h"
+#include "deferred_log.h"
+#include "profiler.h"
 
 Controller::Controller() : motor(),
                            enginePulseCounter(PRIMARY_HALL_PIN, PRIMARY_COUNTER_ID, PRIMARY_MAGNET_COUNT),
-                           can(CAN_TX_PIN, CAN_RX_PIN)
+#ifdef SECONDARY_HALL_PIN
+                           secondaryPulseCounter(SECONDARY_HALL_PIN, SECONDARY_COUNTER_ID, SECONDARY_MAGNET_COUNT),
+#endif
+                           can(CAN_TX_PIN, CAN_RX_PIN),
+                           canTx(can, canTxTable, canTxTableSize, this),
+                           canRx(can, canRxTable, canRxTableSize, this),
+                           calibration(canTx)
 {
 }
 
 /**
- * @brief Start control timers, initialize I/O, and bring up CAN.
+ * @brief Start control scheduling, initialize I/O, and bring up CAN.
  */
 void Controller::init()
 {
     this->last_Error = 0.0f;
     this->resetHomingRoutine();
+    calibration.begin(); // Load tuning parameters before the first tick
+    this->cal = calibration.read();
+    this->calSequence = calibration.sequence();
+#if THERMAL_MODEL_ENABLED
+    thermal.begin(this->cal[CAL_AMBIENT_TEMP]);
+    this->thermalLastUs = (uint32_t)esp_timer_get_time();
+#endif
+#if RATIO_LEARNING_ENABLED
+    ratioEstimator.setPrior(this->cal[CAL_LOW_MAX_SETPOINT], this->cal[CAL_MAX_MOTOR_SETPOINT]);
+    ratioEstimator.begin(); // Resume the learned ratio fit
+#endif
+#if BLACKBOX_ENABLED
+    blackbox.begin(); // Resume the flight recorder before the first tick
+#endif
+
+#if CONTROLLER_EVENT_DRIVEN
+    if (xTaskCreatePinnedToCore([](void *arg)
+                                { static_cast<Controller *>(arg)->taskLoop(); },
+                                "controller", 4096, this, CONTROLLER_TASK_PRIORITY,
+                                &controller_task, CONTROLLER_TASK_CORE) != pdPASS)
+    {
+        Serial.printf("ERROR: Controller task could not be created\n");
+    }
+#else
     controller_timer = xTimerCreate("controller_timer",
                                     pdMS_TO_TICKS(CONTROLLER_TIMER_RATE),
                                     pdTRUE,
@@ -25,7 +58,9 @@ void Controller::init()
                                         // Timer callback function lambda
                                         // retrieve the Controller instance from the timer ID and call the timerCallback method
                                         Controller *controller = static_cast<Controller *>(pvTimerGetTimerID(xTimer));
+                                        uint32_t startUs = (uint32_t)esp_timer_get_time();
                                         controller->timerCallback();
+                                        controller->recordTiming(startUs, 0);
                                     });
 
     if (!controller_timer)
@@ -37,25 +72,216 @@ void Controller::init()
     {
         Serial.printf("ERROR: Controller timer could not be started\n");
     }
-
-    pinMode(LIMIT_SWITCH_PIN, INPUT);
+#endif
+
+    // Fresh sensor data wakes the control task; in fixed-rate mode these notifications are ignored.
+    enginePulseCounter.startSampling(RPM_SAMPLE_PERIOD_MS, [](void *arg)
+                                     { static_cast<Controller *>(arg)->notify(CONTROL_EVENT_RPM); }, this);
+#ifdef SECONDARY_HALL_PIN
+    secondaryPulseCounter.startSampling(RPM_SAMPLE_PERIOD_MS, nullptr, nullptr);
+#endif
+    analogInputs.setBrakeCallback([](bool pressed, void *arg)
+                                  {
+                                      Controller *controller = static_cast<Controller *>(arg);
+                                      controller->analog_brake_pressed = pressed;
+                                      controller->brakeChanged(); }, this);
+    motor.setPositionCallback([](void *arg)
+                              { static_cast<Controller *>(arg)->notify(CONTROL_EVENT_ENCODER); }, this);
+
+    analogInputs.begin(); // Start continuous sampling of the mode, limit, and brake inputs
     motor.init();   // Start the motor timer as well
+    this->applyMotorLimits(true);
     motor.enable(); // Enable the motor driver
-    can.begin();    // Start the CAN bus
+    can.begin(canRx.acceptanceFilter()); // Start the CAN bus, passing only the IDs the receive table handles
+    canRx.begin();  // Start the receive task
+    canTx.begin();  // Start the telemetry scheduler
+
+#ifdef BRAKE_SWITCH_PIN
+    pinMode(BRAKE_SWITCH_PIN, INPUT);
+    attachInterruptArg(BRAKE_SWITCH_PIN, Controller::onBrakeSwitch, this, CHANGE);
+#endif
+}
+
+#ifdef BRAKE_SWITCH_PIN
+void IRAM_ATTR Controller::onBrakeSwitch(void *arg)
+{
+    Controller *controller = static_cast<Controller *>(arg);
+    bool pressed = digitalRead(BRAKE_SWITCH_PIN) == HIGH;
+    controller->switch_brake_pressed = pressed;
+    if (pressed && controller->isDrivingMode())
+    {
+        BaseType_t woken = pdFALSE;
+        controller->motor.brakeFromISR(controller->brakeSetpoint(), &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+#endif
+
+/**
+ * @brief Combine every brake source and preempt or release the motor without waiting for a tick.
+ */
+void Controller::brakeChanged()
+{
+    bool pressed = this->analog_brake_pressed || this->can_brake_pressed || this->switch_brake_pressed;
+
+    if (pressed && this->isDrivingMode())
+    {
+        this->motor.brake(this->brakeSetpoint());
+    }
+    else if (!pressed)
+    {
+        this->motor.releaseBrake();
+    }
+
+    this->notify(CONTROL_EVENT_BRAKE);
+}
+
+/**
+ * @brief Record the first pending event and wake the control task.
+ * @param events Bitmask of ControlEvent values.
+ */
+void Controller::notify(uint32_t events)
+{
+    uint32_t none = 0;
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+    nowUs = nowUs != 0 ? nowUs : 1; // never store the "no event" sentinel
+    this->pendingSinceUs.compare_exchange_strong(none, nowUs);
+
+    if (this->controller_task)
+    {
+        xTaskNotify(this->controller_task, events, eSetBits);
+    }
+}
+
+/**
+ * @brief Event-driven control task: run the tick on fresh data, at most every CONTROLLER_MIN_PERIOD_MS.
+ */
+void Controller::taskLoop()
+{
+    int64_t lastRunUs = -(int64_t)CONTROLLER_MIN_PERIOD_MS * 1000;
+
+    for (;;)
+    {
+        uint32_t events = 0;
+        // Fall back to the fixed rate when nothing reports new data (homing, mode changes).
+        xTaskNotifyWait(0, UINT32_MAX, &events, pdMS_TO_TICKS(CONTROLLER_TIMER_RATE));
+
+        // Rate cap, merging events that arrive meanwhile. Brake changes skip the wait.
+        int64_t releaseUs = lastRunUs + CONTROLLER_MIN_PERIOD_MS * 1000;
+        while (!(events & CONTROL_EVENT_BRAKE))
+        {
+            int64_t remainingUs = releaseUs - esp_timer_get_time();
+            if (remainingUs <= 0)
+            {
+                break;
+            }
+            uint32_t more = 0;
+            xTaskNotifyWait(0, UINT32_MAX, &more, pdMS_TO_TICKS(remainingUs / 1000) + 1);
+            events |= more;
+        }
+
+        lastRunUs = esp_timer_get_time();
+        uint32_t eventUs = this->pendingSinceUs.exchange(0);
+        // An event inside the rate cap waits for it by design, so the deadline counts from the
+        // later of the event and the cap's release.
+        if (eventUs != 0 && !(events & CONTROL_EVENT_BRAKE) && (int32_t)((uint32_t)releaseUs - eventUs) > 0)
+        {
+            eventUs = (uint32_t)releaseUs;
+        }
+        this->timerCallback();
+        this->recordTiming((uint32_t)lastRunUs, eventUs);
+    }
+}
+
+void Controller::recordTiming(uint32_t startUs, uint32_t eventUs)
+{
+    uint32_t endUs = (uint32_t)esp_timer_get_time();
+
+    this->timing.ticks++;
+    this->timing.lastExecUs = endUs - startUs;
+    if (this->timing.lastExecUs > this->timing.maxExecUs)
+    {
+        this->timing.maxExecUs = this->timing.lastExecUs;
+    }
+
+    if (eventUs == 0)
+    {
+        this->timing.fallbackTicks++;
+        return;
+    }
+
+    this->timing.lastLatencyUs = endUs - eventUs;
+    if (this->timing.lastLatencyUs > this->timing.maxLatencyUs)
+    {
+        this->timing.maxLatencyUs = this->timing.lastLatencyUs;
+    }
+    if (this->timing.lastLatencyUs > CONTROLLER_DEADLINE_US)
+    {
+        this->timing.deadlineMisses++;
+    }
 }
 
 /**
- * @brief Main control loop tick executed by the FreeRTOS timer.
+ * @brief A silent bus must not hold the brake on or the last speed forever. A press cleared here
+ * while a late frame arrives is asserted again by the next frame.
+ */
+void Controller::expireCanInputs()
+{
+    VehicleInputs vehicle = this->vehicleInputs.read();
+    uint32_t nowMs = millis();
+
+    if (this->can_brake_pressed && nowMs - vehicle.brakeTimeMs > CAN_BRAKE_TIMEOUT_MS)
+    {
+        this->can_brake_pressed = false;
+        DLOG("BRAKE_POT silent for %lu ms, releasing the CAN brake\n", (unsigned long)(nowMs - vehicle.brakeTimeMs));
+        this->brakeChanged();
+    }
+
+    bool speedFresh = vehicle.speedTimeMs != 0 && nowMs - vehicle.speedTimeMs <= CAN_SPEED_TIMEOUT_MS;
+    this->linear_speed = speedFresh ? vehicle.linearSpeed : 0.0f;
+}
+
+/**
+ * @brief Main control loop tick executed by the control task or FreeRTOS timer.
  */
 void Controller::timerCallback()
 {
+    PROFILE_SCOPE(PROFILE_CONTROL_TICK);
+
     // Determine motor setpoint based on mode
     int32_t motorSetpoint = 0;
 
-    float engineRPM = enginePulseCounter.getRPM();
-    this->brake_pressed = analogRead(BRAKE_PIN) > 1000;
+    // Calibration writes take effect here, between ticks, so a tick never sees a partial set.
+    if (calibration.sequence() != this->calSequence)
+    {
+        this->applyCalibration();
+    }
+
+    // RPM is sampled on its own fixed-period timer so its window does not drift with tick jitter.
+    // The sample ID is read first so the traced sample is never newer than the rpm used.
+    uint32_t rpmSample = enginePulseCounter.getSampleCount();
+    bool newSample = rpmSample != this->tracedSample;
+    if (newSample)
+    {
+        TRACE_EVENT(TRACE_CONTROL_TICK, rpmSample, 0);
+    }
+    float engineRPM = enginePulseCounter.getFilteredRPM();
+    AnalogInputState inputs = analogInputs.read();
+    this->expireCanInputs();
+    this->brake_pressed = inputs.brakePressed || this->can_brake_pressed || this->switch_brake_pressed;
+
+    this->setMode(inputs);
+
+#if RATIO_LEARNING_ENABLED
+    if (newSample)
+    {
+        this->observeBelt(engineRPM);
+    }
+#endif
 
-    this->setMode();
+    if (this->controlMode != ACCELERATION) {
+        this->launch.reset();
+    }
 
     switch (this->controlMode)
     {
@@ -63,9 +289,33 @@ void Controller::timerCallback()
     case TORQUE:
     case BRAKE_CHECK:
     case ACCELERATION:
-        motorSetpoint = this->rpmToSetpoint(engineRPM);
+        // A commanded ratio replaces both; otherwise the launch controller owns the sheave
+        // from staging until it hands off.
+        if (!this->ratioSetpoint(engineRPM, motorSetpoint) &&
+            (this->controlMode != ACCELERATION ||
+             !this->launch.update(this->cal, engineRPM, rpmSample, this->linear_speed, this->brake_pressed,
+                                  this->motor.getPosition(), millis(), motorSetpoint))) {
+            motorSetpoint = this->rpmToSetpoint(engineRPM);
+
+#if SHADOW_MODE_ENABLED
+            // Candidate laws see exactly the inputs the active law saw, and never actuate.
+            ShadowInputs shadowInputs;
+            shadowInputs.engineRPM = engineRPM;
+            shadowInputs.targetRPM = this->targetRPM();
+            shadowInputs.vehicleSpeed = this->linear_speed;
+            shadowInputs.position = this->motor.getPosition();
+            shadowInputs.activeSetpoint = motorSetpoint;
+            shadowInputs.mode = this->controlMode;
+            shadowInputs.nowMs = millis();
+            shadowInputs.cal = this->cal;
+            this->shadow.evaluate(shadowInputs);
+#endif
+        }
+#if SLIP_DETECTION_ENABLED
+        motorSetpoint = this->slip.respond(motorSetpoint, this->motor.getPosition(), millis(), this->cal[CAL_MAX_MOTOR_SETPOINT]);
+#endif
         if (this->brake_pressed) {
-            motorSetpoint = HOME_POSITION;
+            motorSetpoint = this->brakeSetpoint();
         }
         break;
 
@@ -84,56 +334,259 @@ void Controller::timerCallback()
     }
 
     // Apply setpoint to the motor controller.
-    motor.setSetpoint(motorSetpoint);
+    if (newSample)
+    {
+        TRACE_EVENT(TRACE_SETPOINT, rpmSample, motorSetpoint);
+        this->tracedSample = rpmSample;
+    }
+    motor.setSetpoint(motorSetpoint, rpmSample);
 
     // Check for motor faults reported by the driver.
     uint16_t fault = motor.getFault();
+    this->last_fault = fault;
     if (fault != 0)
     {
-        Serial.printf("Motor fault detected! Fault code: 0x%X\n", fault);
+        DLOG("Motor fault detected! Fault code: 0x%X\n", fault);
     }
+#if THERMAL_MODEL_ENABLED
+    this->updateThermal(fault);
+#endif
 
-    this->sendCan();
+    this->recordBlackbox(engineRPM, inputs);
 }
 
-int Controller::rpmToSetpoint(float rpm)
+#if THERMAL_MODEL_ENABLED
+void Controller::updateThermal(uint16_t fault)
+{
+    uint32_t nowUs = (uint32_t)esp_timer_get_time();
+    uint32_t steppingUs = this->motor.getSteppingUs();
+    uint32_t elapsedUs = nowUs - this->thermalLastUs;
+    if (elapsedUs == 0)
+    {
+        return;
+    }
+    float duty = (float)(steppingUs - this->thermalLastSteppingUs) / elapsedUs;
+    this->thermalLastUs = nowUs;
+    this->thermalLastSteppingUs = steppingUs;
+
+    // The FAULT register is already read every tick; DIAG2 is only read to tell OTW from OTSD.
+    float ambientC = this->cal[CAL_AMBIENT_TEMP];
+    uint16_t diag = (fault & OT_MASK) ? this->motor.getDiagnostics() : 0;
+    this->thermal.reportOverTemperature(diag & OTW_MASK, diag & OTS_MASK, ambientC);
+
+    float derate = this->thermalDerate;
+    float target = this->thermal.update(ThermalModel::codeToAmps(this->cal[CAL_RUN_MOTOR_CURRENT] * derate),
+                                        ThermalModel::codeToAmps(this->cal[CAL_HOLD_MOTOR_CURRENT] * derate),
+                                        duty, ambientC, elapsedUs / 1000000.0f);
+
+    // Rewrite the driver registers only for a worthwhile change, or to return to full current.
+    if (fabsf(target - derate) >= THERMAL_DERATE_STEP || (target == 1.0f && derate != 1.0f))
+    {
+        if (target < derate)
+        {
+            DLOG("thermal: derating to %.2f\n", target);
+        }
+        this->thermalDerate = target;
+        this->applyMotorLimits(true);
+    }
+}
+#endif
+
+void Controller::applyMotorLimits(bool current)
+{
+    // Only closing is derated: opening and the brake profile are assisted by the belt.
+    float derate = this->thermalDerate;
+    if (current)
+    {
+        this->motor.setCurrent(this->cal[CAL_RUN_MOTOR_CURRENT] * derate, this->cal[CAL_HOLD_MOTOR_CURRENT] * derate);
+    }
+    this->motor.setAccelerationLimits(this->cal[CAL_MAX_ACCELERATION_POS] * derate, this->cal[CAL_MAX_ACCELERATION_NEG]);
+}
+
+void Controller::recordBlackbox(float engineRPM, const AnalogInputState &inputs)
+{
+    BlackboxSample sample;
+    sample.timestampUs = esp_timer_get_time();
+    sample.fields[BLACKBOX_ENGINE_RPM] = engineRPM;
+    sample.fields[BLACKBOX_SETPOINT] = motor.getSetpoint();
+    sample.fields[BLACKBOX_POSITION] = motor.getPosition();
+    sample.fields[BLACKBOX_VELOCITY] = motor.getVelocity();
+    sample.fields[BLACKBOX_BRAKE_RAW] = inputs.raw[BRAKE_INPUT];
+    sample.fields[BLACKBOX_CONTROL_MODE] = this->controlMode;
+    sample.fields[BLACKBOX_FLAGS] = this->statusFlags(inputs);
+    sample.fields[BLACKBOX_DRIVER_FAULT] = this->last_fault;
+
+    // Erasing flash stalls this core for tens of milliseconds, so only allow it with the belt unloaded.
+    this->blackbox.allowErase(engineRPM < this->cal[CAL_ENGINE_ENGAGE_RPM] && this->linear_speed < LAUNCH_STATIONARY_SPEED);
+    this->blackbox.record(sample);
+}
+
+void Controller::applyCalibration()
+{
+    CalibrationValues previous = this->cal;
+    this->calSequence = calibration.sequence();
+    this->cal = calibration.read();
+
+    this->applyMotorLimits(this->cal[CAL_RUN_MOTOR_CURRENT] != previous[CAL_RUN_MOTOR_CURRENT] ||
+                           this->cal[CAL_HOLD_MOTOR_CURRENT] != previous[CAL_HOLD_MOTOR_CURRENT]);
+#if RATIO_LEARNING_ENABLED
+    this->ratioEstimator.setPrior(this->cal[CAL_LOW_MAX_SETPOINT], this->cal[CAL_MAX_MOTOR_SETPOINT]);
+#endif
+}
+
+/**
+ * @brief Snapshot controller, motor, and input state for the serial telemetry stream.
+ */
+void Controller::sampleTelemetry(TelemetryRecord &record)
+{
+    AnalogInputState inputs = analogInputs.read();
+
+    record.timestampMs = millis();
+    record.engineRpm = enginePulseCounter.getFilteredRPM();
+    record.targetRpm = this->targetRPM();
+    record.vehicleSpeed = this->linear_speed;
+    record.motorPosition = motor.getPosition();
+    record.motorSetpoint = motor.getSetpoint();
+    record.motorVelocity = motor.getVelocity();
+    record.controlMode = this->controlMode;
+    record.flags = this->statusFlags(inputs);
+    record.launchState = launch.getState();
+    record.driverFault = this->last_fault;
+    record.manualModeRaw = inputs.raw[MANUAL_MODE_INPUT];
+    record.limitSwitchRaw = inputs.raw[LIMIT_SWITCH_INPUT];
+    record.brakeRaw = inputs.raw[BRAKE_INPUT];
+    record.ctrlLatencyUs = this->timing.lastLatencyUs;
+    record.deadlineMisses = this->timing.deadlineMisses;
+    record.canTxDropped = this->canTxDropped();
+}
+
+float Controller::targetRPM() const
 {
-    float targetRPM = 0.0f;
     switch (this->controlMode)
     {
     case POWER:
-        targetRPM = ENGINE_IDEAL_RPM_POWER;
-        break;
+        return this->cal[CAL_ENGINE_IDEAL_RPM_POWER];
     case TORQUE:
-        targetRPM = ENGINE_IDEAL_RPM_TORQUE;
-        break;
+        return this->cal[CAL_ENGINE_IDEAL_RPM_TORQUE];
     default:
-        targetRPM = ENGINE_IDEAL_RPM_POWER;
-        break;
+        return this->cal[CAL_ENGINE_IDEAL_RPM_POWER];
+    }
+}
+
+bool Controller::ratioSetpoint(float engineRPM, int32_t &setpoint)
+{
+#if RATIO_LEARNING_ENABLED
+    float ratio = this->targetRatio;
+    if (ratio <= 0.0f)
+    {
+        return false;
     }
+    if (engineRPM < this->cal[CAL_ENGINE_ENGAGE_RPM])
+    {
+        setpoint = this->cal[CAL_IDLE_MOTOR_SETPOINT];
+        return true;
+    }
+    int position = this->ratioEstimator.setpointForRatio(ratio);
+    setpoint = clamp(position, (int)this->cal[CAL_IDLE_MOTOR_SETPOINT], (int)this->cal[CAL_MAX_MOTOR_SETPOINT]);
+    return true;
+#else
+    return false;
+#endif
+}
+
+#if RATIO_LEARNING_ENABLED
+bool Controller::secondaryRPM(float &rpm)
+{
+#ifdef SECONDARY_HALL_PIN
+    rpm = this->secondaryPulseCounter.getFilteredRPM();
+#else
+    VehicleInputs vehicle = this->vehicleInputs.read();
+    if (vehicle.speedTimeMs == 0 || millis() - vehicle.speedTimeMs > RATIO_SPEED_MAX_AGE_MS)
+    {
+        return false;
+    }
+    rpm = vehicle.linearSpeed * RATIO_SECONDARY_RPM_PER_SPEED;
+#endif
+    return rpm >= RATIO_MIN_SECONDARY_RPM;
+}
 
-    if (rpm < ENGINE_ENGAGE_RPM)
+void Controller::observeBelt(float engineRPM)
+{
+    // Store the fit while the belt is unloaded, like black-box erases.
+    if (engineRPM < this->cal[CAL_ENGINE_ENGAGE_RPM] && this->linear_speed < LAUNCH_STATIONARY_SPEED)
     {
-        return IDLE_MOTOR_SETPOINT;
+#if SLIP_DETECTION_ENABLED
+        this->slip.idle(millis());
+#endif
+        this->ratioEstimator.requestSave();
+        return;
+    }
+
+    // Only judge the belt while it is driving.
+    float secondary = 0.0f;
+    bool driving = this->isDrivingMode() && !this->brake_pressed && engineRPM >= this->cal[CAL_ENGINE_ENGAGE_RPM] &&
+                   this->secondaryRPM(secondary);
+    float ratio = driving ? engineRPM / secondary : 0.0f;
+    int position = this->motor.getPosition();
+
+#if SLIP_DETECTION_ENABLED
+    // Below SLIP_SPEED the belt is still engaging, and an uncertain fit cannot tell slip from error.
+    if (driving && secondary >= SLIP_SPEED && this->ratioEstimator.varianceAt(position) <= SLIP_MAX_FIT_SD * SLIP_MAX_FIT_SD)
+    {
+        this->slip.update(ratio, this->ratioEstimator.ratioAt(position), secondary, position, millis());
+    }
+    else
+    {
+        this->slip.idle(millis());
+    }
+    if (this->slip.isSuspect())
+    {
+        return; // slipping samples, confirmed or not, would bend the fit toward the slip
+    }
+#endif
+
+    // The fit only learns with the sheave settled.
+    if (driving && fabsf(this->motor.getVelocity()) <= RATIO_MAX_STEP_RATE)
+    {
+        this->ratioEstimator.update(ratio, position);
+    }
+}
+#endif
+
+int Controller::rpmToSetpoint(float rpm)
+{
+    return setpointLaw(this->cal, rpm, this->targetRPM(), this->last_Error, this->motor.getPosition(),
+                       this->controlMode == BRAKE_CHECK);
+}
+
+int Controller::setpointLaw(const CalibrationValues &cal, float rpm, float targetRPM, float &lastError, int position,
+                            bool brakeCheck)
+{
+    if (rpm < cal[CAL_ENGINE_ENGAGE_RPM])
+    {
+        return cal[CAL_IDLE_MOTOR_SETPOINT];
     }
     else
     {
 
         float rpmError = targetRPM - rpm; // positive error means the rpm is too low
 
-        float d_error = this->last_Error - rpmError; // Derivative error
+        float d_error = lastError - rpmError; // Derivative error
 
-        float d_setpoint = -rpmError * RPM_Kp + d_error * RPM_Kd; // negative because lower rpm means more negative sheve position position
+        float d_setpoint = -rpmError * cal[CAL_RPM_KP] + d_error * cal[CAL_RPM_KD]; // negative because lower rpm means more negative sheve position position
 
-        float low_setpoint = lerp(IDLE_MOTOR_SETPOINT, LOW_MAX_SETPOINT, (rpm - ENGINE_ENGAGE_RPM) / (ENGINE_MAX_RPM - ENGINE_ENGAGE_RPM));
+        float idleSetpoint = cal[CAL_IDLE_MOTOR_SETPOINT];
+        float lowMaxSetpoint = cal[CAL_LOW_MAX_SETPOINT];
+        float engageRPM = cal[CAL_ENGINE_ENGAGE_RPM];
+        float low_setpoint = lerp(idleSetpoint, lowMaxSetpoint, (rpm - engageRPM) / (cal[CAL_ENGINE_MAX_RPM] - engageRPM));
 
-        low_setpoint = clamp(low_setpoint, IDLE_MOTOR_SETPOINT, LOW_MAX_SETPOINT);
+        low_setpoint = clamp(low_setpoint, idleSetpoint, lowMaxSetpoint);
 
-        this->last_Error = rpmError;
-        if (this->controlMode == BRAKE_CHECK) {
-            return clamp(this->motor.getPosition() + d_setpoint, low_setpoint, MAX_MOTOR_SETPOINT_BRAKE_MODE);
+        lastError = rpmError;
+        if (brakeCheck) {
+            return clamp(position + d_setpoint, low_setpoint, cal[CAL_MAX_MOTOR_SETPOINT_BRAKE_MODE]);
         }
-        return clamp(this->motor.getPosition() + d_setpoint, low_setpoint, MAX_MOTOR_SETPOINT);
+        return clamp(position + d_setpoint, low_setpoint, cal[CAL_MAX_MOTOR_SETPOINT]);
     }
 }
 
@@ -150,7 +603,7 @@ int Controller::rpmToSetpoint(float rpm)
 int Controller::homingRoutine()
 {
     // Limit switch is active high.
-    bool limitSwitchState = analogRead(LIMIT_SWITCH_PIN) > 2000;
+    bool limitSwitchState = analogInputs.read().limitSwitch;
 
     if (!this->homingFirstTrigger)
     {
@@ -198,102 +651,168 @@ void Controller::resetHomingRoutine()
 
 
 /**
- * @brief Send telemetry frames to the CAN bus.
+ * @brief CAN transmit table: engine speed at 100 Hz, motor motion at 50 Hz, and a status
+ * heartbeat that is also sent the moment the mode, brake, limit switch, launch state, or fault changes.
  */
-void Controller::sendCan() {
-    CanMessage engineRpmMsg(CanDatabase::ENGINE_RPM.id, this->enginePulseCounter.getFilteredRPM());
-    esp_err_t ret = can.writeMessage(engineRpmMsg, 0);
-    
-    if (ret != ESP_OK)
-    {
-        #ifdef CAN_DEBUG
-        Serial.printf("Failed to send ENGINE_RPM message. Error code: %s\n", esp_err_to_name(ret));
-        #endif
-    }
+const CanTxEntry Controller::canTxTable[] = {
+    {&ECVT_STATUS_FRAME, CAN_STATUS_PERIOD_MS, CAN_PRIORITY_CRITICAL,
+     BIT(STATUS_CONTROL_MODE) | BIT(STATUS_BRAKE) | BIT(STATUS_LIMIT_SWITCH) | BIT(STATUS_BRAKE_PROFILE) |
+         BIT(STATUS_LAUNCH_STATE) | BIT(STATUS_DRIVER_FAULT),
+     Controller::fillStatusFrame},
+    {&ECVT_SPEED_FRAME, CAN_SPEED_PERIOD_MS, CAN_PRIORITY_NORMAL, 0, Controller::fillSpeedFrame},
+    {&ECVT_MOTOR_FRAME, CAN_MOTOR_PERIOD_MS, CAN_PRIORITY_BULK, 0, Controller::fillMotorFrame},
+};
+const uint8_t Controller::canTxTableSize = sizeof(Controller::canTxTable) / sizeof(Controller::canTxTable[0]);
+
+void Controller::fillSpeedFrame(void *arg, float *values) {
+    Controller *controller = static_cast<Controller *>(arg);
+    values[SPEED_ENGINE_RPM] = controller->enginePulseCounter.getFilteredRPM();
+    values[SPEED_TARGET_RPM] = controller->targetRPM();
+    values[SPEED_VEHICLE_SPEED] = controller->linear_speed;
+}
 
-    CanMessage motorSetpointMsg(CanDatabase::MOTOR_SETPOINT.id, this->motor.getSetpoint());
-    ret = can.writeMessage(motorSetpointMsg, 0);
-    if (ret != ESP_OK)
-    {
-        #ifdef CAN_DEBUG
-        Serial.printf("Failed to send MOTOR_SETPOINT message. Error code: %s\n", esp_err_to_name(ret));
-        #endif
+void Controller::fillMotorFrame(void *arg, float *values) {
+    Controller *controller = static_cast<Controller *>(arg);
+    values[MOTOR_SETPOINT] = controller->motor.getSetpoint();
+    values[MOTOR_POSITION] = controller->motor.getPosition();
+    values[MOTOR_VELOCITY] = controller->motor.getVelocity();
+}
+
+void Controller::fillStatusFrame(void *arg, float *values) {
+    Controller *controller = static_cast<Controller *>(arg);
+    values[STATUS_CONTROL_MODE] = controller->controlMode;
+    values[STATUS_BRAKE] = controller->brake_pressed ? 1 : 0;
+    values[STATUS_LIMIT_SWITCH] = controller->analogInputs.read().limitSwitch ? 1 : 0;
+    values[STATUS_BRAKE_PROFILE] = controller->motor.isBraking() ? 1 : 0;
+    values[STATUS_LAUNCH_STATE] = controller->launch.getState();
+    values[STATUS_DRIVER_FAULT] = controller->last_fault & 0xFF;
+    values[STATUS_DEADLINE_MISSES] = controller->timing.deadlineMisses;
+    values[STATUS_CONTROL_LATENCY] = controller->timing.lastLatencyUs;
+}
+
+/**
+ * @brief CAN receive table: vehicle inputs the controller consumes and the calibration protocol.
+ * The vehicle inputs use acceptance filter 0 and the calibration and profiler block filter 1.
+ */
+const CanRxEntry Controller::canRxTable[] = {
+    {CanDatabase::BRAKE_POT.id, 1, 0, Controller::onBrakePot},
+    {CanDatabase::LINEAR_SPEED.id, 1, 0, Controller::onLinearSpeed},
+    {CAL_COMMAND_ID, 1, 1, Controller::onCalibrationCommand},
+    {CAL_WRITE_BASE_ID, CAL_PARAM_COUNT, 1, Controller::onCalibrationWrite},
+#if PROFILING_ENABLED
+    {PROFILE_REQUEST_ID, 1, 1, Controller::onProfileRequest},
+#endif
+};
+const uint8_t Controller::canRxTableSize = sizeof(Controller::canRxTable) / sizeof(Controller::canRxTable[0]);
+
+void Controller::onBrakePot(void *arg, CanMessage &message) {
+    Controller *controller = static_cast<Controller *>(arg);
+    if (message.getDataType() != CanDatabase::BRAKE_POT.type) {
+        return;
     }
 
-    CanMessage motorPositionMsg(CanDatabase::MOTOR_POSITION.id, this->motor.getPosition());
-    ret = can.writeMessage(motorPositionMsg, 0);
-    if (ret != ESP_OK)    {
-        #ifdef CAN_DEBUG
-        Serial.printf("Failed to send MOTOR_POSITION message. Error code: %s\n", esp_err_to_name(ret));
-        #endif
+    controller->canRxState.brakePosition = message.getFloat();
+    controller->canRxState.brakeTimeMs = millis();
+    controller->vehicleInputs.write(controller->canRxState);
+    #ifdef CAN_DEBUG
+    DLOG(">BRAKE_POT:%.2f\n", controller->canRxState.brakePosition);
+    #endif
+
+    bool pressed = controller->canRxState.brakePosition > BRAKE_THRESHOLD;
+    if (pressed != controller->can_brake_pressed) {
+        controller->can_brake_pressed = pressed;
+        controller->brakeChanged();
     }
+}
 
-    CanMessage brakeStateMsg(CanDatabase::SECONDARY_RPM.id, (float)(this->brake_pressed ? 1 : 0));
-    ret = can.writeMessage(brakeStateMsg, 0);
-    if (ret != ESP_OK)    {
-        #ifdef CAN_DEBUG
-        Serial.printf("Failed to send BRAKE_STATE message. Error code: %s\n", esp_err_to_name(ret));
-        #endif
+void Controller::onLinearSpeed(void *arg, CanMessage &message) {
+    Controller *controller = static_cast<Controller *>(arg);
+    if (message.getDataType() != CanDatabase::LINEAR_SPEED.type) {
+        return;
     }
 
+    controller->canRxState.linearSpeed = message.getFloat();
+    controller->canRxState.speedTimeMs = millis();
+    controller->vehicleInputs.write(controller->canRxState);
     #ifdef CAN_DEBUG
-    twai_status_info_t status;
-    if (twai_get_status_info(&status) == ESP_OK) {
-        Serial.printf("CAN bus status - msgs_to_tx: %d, msgs_to_rx: %d, bus_state: %d\n", status.msgs_to_tx, status.msgs_to_rx, status.state);
-    }
+    DLOG(">LINEAR_SPEED:%.2f\n", controller->canRxState.linearSpeed);
     #endif
 }
 
-/**
- * @brief Read inbound CAN messages for brake and mode data.
- */
-void Controller::readCan() {
-    CanMessage message;
-    while (can.readMessage(message, 0) == ESP_OK) {
-        if (message.getId() == CanDatabase::BRAKE_POT.id && message.getDataType() == CanDatabase::BRAKE_POT.type) {
-            this->brake_pos = message.getFloat();
-            #ifdef CAN_DEBUG
-            Serial.printf(">BRAKE_POT:%.2f\n", this->brake_pos);
-            #endif
-
-            if (this->brake_pos > BRAKE_THRESHOLD) {
-                this->controlMode = BRAKE;
-            } else {
-                this->controlMode = POWER;  
-            }
-        } else if (message.getId() == CanDatabase::LINEAR_SPEED.id && message.getDataType() == CanDatabase::LINEAR_SPEED.type) {
-            float linearSpeed = message.getFloat();
-            #ifdef CAN_DEBUG
-            Serial.printf(">LINEAR_SPEED:%.2f\n", linearSpeed);
-            #endif
+void Controller::onCalibrationCommand(void *arg, CanMessage &message) {
+    static_cast<Controller *>(arg)->calibration.handleCommand(message.getFloat());
+}
 
-        }
+void Controller::onCalibrationWrite(void *arg, CanMessage &message) {
+    static_cast<Controller *>(arg)->calibration.handleWrite(message.getId() - CAL_WRITE_BASE_ID, message.getFloat());
+}
+
+#if PROFILING_ENABLED
+void Controller::onProfileRequest(void *arg, CanMessage &message) {
+    if (message.getFloat() == 1.0f) {
+        profiler.reset();
+    } else {
+        static_cast<Controller *>(arg)->profileExport = 0;
+    }
+}
 
+/**
+ * @brief Queue one section per call behind the scheduler's table frames, waiting while the
+ * message queue has no room for a whole section rather than dropping part of the export.
+ */
+void Controller::serviceProfiler() {
+    int section = this->profileExport;
+    if (section >= PROFILE_SECTION_COUNT || canTx.messageSpace() < PROFILE_VALUES_PER_SECTION) {
+        return;
+    }
+    this->profileExport = section + 1;
+
+    ProfileStats s = profiler.getStats(static_cast<ProfileSection>(section));
+    float mhz = ESP.getCpuFreqMHz();
+    float values[PROFILE_VALUES_PER_SECTION];
+    values[PROFILE_VALUE_MEAN_US] = s.count ? s.totalCycles / s.count / mhz : 0.0f;
+    values[PROFILE_VALUE_MAX_US] = s.maxCycles / mhz;
+    values[PROFILE_VALUE_DEADLINE_MISSES] = s.deadlineMisses;
+    values[PROFILE_VALUE_JITTER_US] = s.periods ? (s.maxPeriodCycles - s.minPeriodCycles) / mhz : 0.0f;
+
+    for (int i = 0; i < PROFILE_VALUES_PER_SECTION; i++) {
+        CanMessage message(PROFILE_VALUE_BASE_ID + section * PROFILE_VALUES_PER_SECTION + i, values[i]);
+        canTx.sendMessage(message);
     }
 }
+#endif
 
 
 /**
- * @brief Set control mode from the manual selector input.
+ * @brief Set control mode from the debounced manual selector position.
+ * @param inputs Latest analog input snapshot.
  */
-void Controller::setMode() {
+void Controller::setMode(const AnalogInputState &inputs) {
     static ControlMode lastMode = HOMING;
 
     if (this->controlMode == HOMING) {
         return;
     }
 
-    if (analogRead(MANUAL_MODE_PIN) < POWER_MODE_THRESHOLD) {
+    switch (inputs.modeSelector) {
+    case SELECTOR_POWER:
         this->controlMode = POWER;
-    } else if (analogRead(MANUAL_MODE_PIN) < TORQUE_MODE_THRESHOLD) {
+        break;
+    case SELECTOR_TORQUE:
         this->controlMode = TORQUE;
-    } else if (analogRead(MANUAL_MODE_PIN) < ACCELERATION_MODE_THRESHOLD) {
+        break;
+    case SELECTOR_ACCELERATION:
         this->controlMode = ACCELERATION;
-    } else if (analogRead(MANUAL_MODE_PIN) < BRAKE_CHECK_MODE_THRESHOLD) {
+        break;
+    case SELECTOR_BRAKE_CHECK:
         this->controlMode = BRAKE_CHECK;
-    } else if (lastMode != HOMING) {
-        this->resetHomingRoutine();
-        this->controlMode = HOMING;
+        break;
+    case SELECTOR_HOMING:
+        if (lastMode != HOMING) {
+            this->resetHomingRoutine();
+            this->controlMode = HOMING;
+        }
+        break;
     }
     lastMode = this->controlMode;
 }
@@ -0,0 +1,274 @@
+#include "deferred_log.h"
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "telemetry.h"
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+
+DeferredLog deferredLog;
+
+DeferredLog::DeferredLog() : head(0), dropped(0), rateLimits()
+{
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++)
+    {
+        this->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Start the drain task on the core that does not run the control loop.
+ */
+void DeferredLog::begin()
+{
+    if (xTaskCreatePinnedToCore([](void *arg)
+                                { static_cast<DeferredLog *>(arg)->run(); },
+                                "log_drain", 4096, this, LOG_TASK_PRIORITY, nullptr, LOG_TASK_CORE) != pdPASS)
+    {
+        Serial.printf("ERROR: Log drain task could not be created\n");
+    }
+}
+
+/**
+ * @brief Claim a slot, copy the message in, and publish it.
+ *
+ * A slot is free for position pos when its sequence equals pos, and holds a message
+ * for the consumer when it equals pos + 1.
+ */
+void DeferredLog::push(const char *format, const uint32_t *args, uint8_t argCount)
+{
+    uint32_t pos = this->head.load(std::memory_order_relaxed);
+    Slot *slot;
+
+    for (;;)
+    {
+        slot = &this->slots[pos & (LOG_RING_SIZE - 1)];
+        int32_t diff = (int32_t)(slot->sequence.load(std::memory_order_acquire) - pos);
+
+        if (diff == 0)
+        {
+            if (this->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            this->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = this->head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->entry.format = format;
+    slot->entry.timestampUs = (uint32_t)esp_timer_get_time();
+    slot->entry.argCount = argCount;
+    memcpy(slot->entry.args, args, argCount * sizeof(uint32_t));
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+bool DeferredLog::pop(LogEntry &entry)
+{
+    Slot &slot = this->slots[this->tail & (LOG_RING_SIZE - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != this->tail + 1)
+    {
+        return false;
+    }
+
+    entry = slot.entry;
+    slot.sequence.store(this->tail + LOG_RING_SIZE, std::memory_order_release);
+    this->tail++;
+    return true;
+}
+
+/**
+ * @brief Drain task body: empty the ring, then sleep for LOG_DRAIN_PERIOD_MS.
+ */
+void DeferredLog::run()
+{
+    LogEntry entry;
+
+    for (;;)
+    {
+        while (this->pop(entry))
+        {
+            uint16_t suppressed = 0;
+            if (this->allow(entry.format, entry.timestampUs / 1000, suppressed))
+            {
+                this->emit(entry, suppressed);
+            }
+        }
+
+        uint32_t droppedNow = this->getDropped();
+        if (droppedNow != this->reportedDropped)
+        {
+            DLOG("log ring full, %u messages dropped\n", droppedNow - this->reportedDropped);
+            this->reportedDropped = droppedNow;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_PERIOD_MS));
+    }
+}
+
+/**
+ * @brief Per-message rate limit: at most one message per format every LOG_RATE_LIMIT_MS.
+ * @param suppressed Set to the number of messages skipped since the last one emitted.
+ */
+bool DeferredLog::allow(const char *format, uint32_t nowMs, uint16_t &suppressed)
+{
+    RateLimit &limit = this->rateLimits[((uintptr_t)format >> 2) % LOG_RATE_SLOTS];
+
+    if (limit.format != format)
+    {
+        // Slot collision or first use: the newer format takes the slot over.
+        limit.format = format;
+        limit.lastMs = nowMs;
+        limit.suppressed = 0;
+        return true;
+    }
+
+    if (nowMs - limit.lastMs < LOG_RATE_LIMIT_MS)
+    {
+        if (limit.suppressed < UINT16_MAX)
+        {
+            limit.suppressed++;
+        }
+        return false;
+    }
+
+    suppressed = limit.suppressed;
+    limit.lastMs = nowMs;
+    limit.suppressed = 0;
+    return true;
+}
+
+/**
+ * @brief Print a message, or send it as a binary log frame on the telemetry link.
+ *
+ * Frame payload: LOG_FRAME_TAG, format address (u32), timestamp us (u32), suppressed
+ * count (u16), argument count (u8), arguments (u32 each), CRC-16; COBS-framed like
+ * telemetry records.
+ */
+void DeferredLog::emit(const LogEntry &entry, uint16_t suppressed)
+{
+#if TELEMETRY_BINARY
+    uint8_t payload[12 + 4 * LOG_MAX_ARGS + 2];
+    uint32_t address = logWord(entry.format);
+    size_t length = 0;
+
+    payload[length++] = LOG_FRAME_TAG;
+    memcpy(&payload[length], &address, 4);
+    length += 4;
+    memcpy(&payload[length], &entry.timestampUs, 4);
+    length += 4;
+    memcpy(&payload[length], &suppressed, 2);
+    length += 2;
+    payload[length++] = entry.argCount;
+    memcpy(&payload[length], entry.args, 4 * entry.argCount);
+    length += 4 * entry.argCount;
+
+    uint8_t frame[COBS_MAX_ENCODED(sizeof(payload)) + 1];
+    sendTaggedFrame(payload, length, frame);
+#else
+    (void)suppressed;
+    char text[LOG_LINE_MAX];
+    size_t length = format(entry, text, sizeof(text));
+    Serial.write(reinterpret_cast<const uint8_t *>(text), length);
+#endif
+}
+
+/**
+ * @brief Expand one conversion at a time so each argument is passed with its real type.
+ */
+size_t DeferredLog::format(const LogEntry &entry, char *out, size_t size)
+{
+    const char *p = entry.format;
+    size_t length = 0;
+    uint8_t arg = 0;
+
+    while (*p && length + 1 < size)
+    {
+        if (*p != '%')
+        {
+            out[length++] = *p++;
+            continue;
+        }
+
+        // Copy one conversion specification, e.g. "%-8.2f".
+        char spec[16];
+        size_t specLength = 0;
+        spec[specLength++] = *p++;
+        while (*p && strchr("-+ #0123456789.lhz", *p) && specLength < sizeof(spec) - 2)
+        {
+            spec[specLength++] = *p++;
+        }
+        char conversion = *p ? *p++ : '\0';
+        spec[specLength++] = conversion;
+        spec[specLength] = '\0';
+
+        int written;
+        uint32_t word = arg < entry.argCount ? entry.args[arg] : 0;
+        switch (conversion)
+        {
+        case '%':
+            written = snprintf(out + length, size - length, "%%");
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        {
+            float value;
+            memcpy(&value, &word, sizeof(value));
+            written = snprintf(out + length, size - length, spec, (double)value);
+            arg++;
+            break;
+        }
+        case 's':
+            written = snprintf(out + length, size - length, spec, (const char *)(uintptr_t)word);
+            arg++;
+            break;
+        case 'p':
+            written = snprintf(out + length, size - length, spec, (void *)(uintptr_t)word);
+            arg++;
+            break;
+        default:
+        {
+            // Integer conversions; drop length modifiers since every argument is 32 bits.
+            char intSpec[16];
+            size_t n = 0;
+            for (size_t i = 0; i < specLength; i++)
+            {
+                if (!strchr("lhz", spec[i]))
+                {
+                    intSpec[n++] = spec[i];
+                }
+            }
+            intSpec[n] = '\0';
+            if (conversion == 'd' || conversion == 'i')
+            {
+                written = snprintf(out + length, size - length, intSpec, (int)word);
+            }
+            else
+            {
+                written = snprintf(out + length, size - length, intSpec, (unsigned int)word);
+            }
+            arg++;
+            break;
+        }
+        }
+
+        if (written < 0)
+        {
+            break;
+        }
+        length += (size_t)written < size - length ? (size_t)written : size - length - 1;
+    }
+
+    out[length] = '\0';
+    return length;
+}
@@ -0,0 +1,46 @@
+#include "latency_trace.h"
+
+#if LATENCY_TRACE_ENABLED
+
+#include <Arduino.h>
+#include "esp_timer.h"
+
+LatencyTrace latencyTrace;
+
+LatencyTrace::LatencyTrace() : head(0), writer(TRACE_FRAME_TAG)
+{
+    for (uint32_t i = 0; i < TRACE_RING_SIZE; i++)
+    {
+        this->slots[i].position.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Claim the next position and overwrite its slot.
+ */
+void LatencyTrace::record(TraceStage stage, uint32_t sampleId, int32_t value)
+{
+    if (sampleId == 0)
+    {
+        return;
+    }
+
+    TraceEvent event;
+    event.timestampUs = (uint32_t)esp_timer_get_time();
+    event.sampleId = sampleId;
+    event.value = value;
+    event.stage = stage;
+
+    uint32_t pos = this->head.fetch_add(1, std::memory_order_relaxed);
+    this->slots[pos & (TRACE_RING_SIZE - 1)].store(pos, event);
+}
+
+/**
+ * @brief Send every event still in the ring, oldest first. Recording continues meanwhile.
+ */
+void LatencyTrace::dump()
+{
+    dumpRing<TRACE_EVENTS_PER_FRAME>(this->slots, this->head.load(std::memory_order_acquire), this->writer);
+}
+
+#endif // LATENCY_TRACE_ENABLED
@@ -0,0 +1,161 @@
+#include "launch.h"
+#include "config.h"
+#include "deferred_log.h"
+
+#define LAUNCH_CLAMP_TOLERANCE 200 // steps short of low_max_setpoint that count as fully clamped
+
+LaunchController::LaunchController() : rateFilter(LAUNCH_RPM_RATE_ALPHA)
+{
+}
+
+void LaunchController::reset()
+{
+    this->state = LAUNCH_IDLE;
+    this->rateFilter = LowPassFilter(LAUNCH_RPM_RATE_ALPHA);
+    this->rpmRate = 0.0f;
+    this->hasLastSample = false;
+}
+
+bool LaunchController::update(const CalibrationValues &cal, float rpm, uint32_t rpmSample, float speed, bool braking,
+                              int position, uint32_t nowMs, int32_t &setpoint)
+{
+    // Engine acceleration between rpm samples. Ticks are event-driven and several can see the
+    // same sample, so only the tick that brings a new one differences it, over the sample windows.
+    if (!this->hasLastSample || rpmSample != this->lastSample)
+    {
+        if (this->hasLastSample)
+        {
+            float rawRate = (rpm - this->lastRpm) * 1000.0f / (RPM_SAMPLE_PERIOD_MS * (rpmSample - this->lastSample));
+            this->rpmRate = this->rateFilter.filter(rawRate);
+        }
+        this->lastRpm = rpm;
+        this->lastSample = rpmSample;
+        this->hasLastSample = true;
+    }
+
+    float engageRpm = cal[CAL_ENGINE_ENGAGE_RPM];
+    float idealRpm = cal[CAL_ENGINE_IDEAL_RPM_POWER];
+    int32_t clampSetpoint = cal[CAL_LOW_MAX_SETPOINT];
+
+    switch (this->state)
+    {
+    case LAUNCH_IDLE:
+        // Only launches from a standstill are staged; entering the mode while rolling hands straight off.
+        this->state = speed < LAUNCH_STATIONARY_SPEED ? LAUNCH_STAGED : LAUNCH_DONE;
+        return this->update(cal, rpm, rpmSample, speed, braking, position, nowMs, setpoint);
+
+    case LAUNCH_STAGED:
+    {
+        bool released = !braking && (this->rpmRate > LAUNCH_RPM_RISE_TRIGGER ||
+                                     rpm > engageRpm ||
+                                     speed >= LAUNCH_STATIONARY_SPEED);
+        if (!released)
+        {
+            setpoint = LAUNCH_STAGE_SETPOINT;
+            return true;
+        }
+        this->start(nowMs);
+    }
+        // fall through
+
+    case LAUNCH_ACTIVE:
+    {
+        if (braking)
+        {
+            this->finish(nowMs, speed, true);
+            return false;
+        }
+
+        uint32_t elapsedMs = nowMs - this->report.releaseMs;
+
+        if (rpm > this->report.peakRpm)
+        {
+            this->report.peakRpm = rpm;
+        }
+        if (this->report.toEngageMs == 0 && rpm > engageRpm)
+        {
+            this->report.toEngageMs = elapsedMs == 0 ? 1 : elapsedMs;
+        }
+        if (this->report.toIdealRpmMs == 0 && rpm >= idealRpm - LAUNCH_RPM_MARGIN)
+        {
+            this->report.toIdealRpmMs = elapsedMs == 0 ? 1 : elapsedMs;
+        }
+        if (this->report.toFullClampMs == 0 && position >= clampSetpoint - LAUNCH_CLAMP_TOLERANCE)
+        {
+            this->report.toFullClampMs = elapsedMs == 0 ? 1 : elapsedMs;
+        }
+
+        if (speed >= LAUNCH_HANDOFF_SPEED || elapsedMs >= LAUNCH_MAX_MS)
+        {
+            this->finish(nowMs, speed, false);
+            return false;
+        }
+
+        // Size the clamp from where the engine will be shortly, so a fast rev clamps harder and sooner.
+        float predictedRpm = rpm + this->rpmRate * LAUNCH_LOOKAHEAD_S;
+        int32_t target;
+        if (predictedRpm >= idealRpm - LAUNCH_RPM_MARGIN)
+        {
+            target = clampSetpoint;
+        }
+        else
+        {
+            float k = (predictedRpm - engageRpm) / (idealRpm - engageRpm);
+            k = clamp(k, 0.0f, 1.0f);
+            target = lerp(LAUNCH_STAGE_SETPOINT, clampSetpoint, k);
+        }
+
+        // Never back the clamp off once the belt is gripping.
+        if (target > this->clampTarget)
+        {
+            this->clampTarget = target;
+        }
+        setpoint = this->clampTarget;
+        return true;
+    }
+
+    case LAUNCH_DONE:
+    default:
+        // Re-stage when the car comes back to rest with the engine idling.
+        if (speed < LAUNCH_STATIONARY_SPEED && rpm < engageRpm)
+        {
+            this->state = LAUNCH_STAGED;
+            setpoint = LAUNCH_STAGE_SETPOINT;
+            return true;
+        }
+        return false;
+    }
+}
+
+void LaunchController::start(uint32_t nowMs)
+{
+    uint32_t launchCount = this->report.launchCount;
+    this->report = {};
+    this->report.launchCount = launchCount;
+    this->report.releaseMs = nowMs;
+    this->clampTarget = LAUNCH_STAGE_SETPOINT;
+    this->state = LAUNCH_ACTIVE;
+}
+
+/**
+ * @brief Close out a launch and log its timing.
+ */
+void LaunchController::finish(uint32_t nowMs, float speed, bool aborted)
+{
+    this->report.launchCount++;
+    this->report.toHandoffMs = nowMs - this->report.releaseMs;
+    this->report.handoffSpeed = speed;
+    this->report.aborted = aborted;
+    this->lastReport = this->report;
+    this->state = LAUNCH_DONE;
+
+    DLOG(">launch:%u engage_ms=%u ideal_ms=%u clamp_ms=%u handoff_ms=%u peak_rpm=%.0f speed=%.2f%s\n",
+         this->report.launchCount,
+         this->report.toEngageMs,
+         this->report.toIdealRpmMs,
+         this->report.toFullClampMs,
+         this->report.toHandoffMs,
+         this->report.peakRpm,
+         this->report.handoffSpeed,
+         aborted ? " aborted" : "");
+}
@@ -1,5 +1,10 @@
 #include <Arduino.h>
 #include "controller.h"
+#include "telemetry.h"
+#include "deferred_log.h"
+#include "profiler.h"
+#include "latency_trace.h"
+#include "step_capture.h"
 #include "config.h"
 
 /**
@@ -7,20 +12,169 @@
  */
 Controller controller;
 
+/**
+ * @brief Telemetry record and frame buffers, allocated once.
+ */
+TelemetryRecord telemetryRecord;
+TelemetryEncoder telemetryEncoder;
+
 /**
  * @brief Arduino setup entry point.
  */
 void setup() {
-  Serial.begin(115200);
+  Serial.setTxBufferSize(TELEMETRY_TX_BUFFER_SIZE);
+  Serial.begin(TELEMETRY_BAUD);
+  deferredLog.begin();
   controller.init();
 }
 
+#if !TELEMETRY_BINARY
+/**
+ * @brief Print a record as Teleplot lines for a plain serial monitor.
+ */
+static void printTeleplot(const TelemetryRecord &record) {
+  Serial.printf(">Engine_RPM:%.1f\n>target_rpm:%.1f\n>vehicle_speed:%.2f\n",
+                record.engineRpm, record.targetRpm, record.vehicleSpeed);
+  Serial.printf(">pos:%ld\n>setpoint:%ld\n>vel:%.1f\n",
+                (long)record.motorPosition, (long)record.motorSetpoint, record.motorVelocity);
+  Serial.printf(">control_mode:%u\n>brake_state:%u\n>manual_mode:%u\n>limit:%u\n",
+                record.controlMode, record.flags & TELEMETRY_FLAG_BRAKE ? 1 : 0,
+                record.manualModeRaw, record.limitSwitchRaw);
+  Serial.printf(">ctrl_latency_us:%lu\n>ctrl_deadline_miss:%lu\n>can_tx_dropped:%lu\n",
+                (unsigned long)record.ctrlLatencyUs, (unsigned long)record.deadlineMisses,
+                (unsigned long)record.canTxDropped);
+}
+#endif
+
+#if RATIO_LEARNING_ENABLED
+/**
+ * @brief Print the learned ratio fit, one knot per line.
+ */
+static void printRatioFit() {
+  RatioFit fit = controller.getRatioFit();
+  Serial.printf("ratio_fit,samples=%lu,target=%.3f\n", (unsigned long)fit.samples, controller.getTargetRatio());
+  for (int i = 0; i < RATIO_KNOT_COUNT; i++) {
+    Serial.printf("ratio_knot,steps=%d,ratio=%.3f,sd=%.3f\n", RatioEstimator::knotPosition(i), fit.ratio[i],
+                  sqrtf(fit.variance[i]));
+  }
+}
+#endif
+
 /**
- * @brief Arduino loop for periodic telemetry.
+ * @brief Handle line commands from the host: "bbx dump", "bbx trigger", "bbx info", "prof", "prof reset", "trace dump", "steps dump",
+ * "shadow", "ratio", "ratio <target>", "ratio off", "ratio reset", "slip", "thermal", "decay".
+ */
+static void serviceSerialCommands() {
+  static char line[32];
+  static size_t length = 0;
+
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c != '\n' && c != '\r') {
+      if (length < sizeof(line) - 1) {
+        line[length++] = c;
+      }
+      continue;
+    }
+    line[length] = '\0';
+    length = 0;
+
+    if (strcmp(line, "bbx dump") == 0) {
+      controller.dumpBlackbox();
+    } else if (strcmp(line, "bbx trigger") == 0) {
+      controller.triggerBlackbox();
+    } else if (strcmp(line, "bbx info") == 0) {
+      BlackboxStats stats = controller.getBlackboxStats();
+      Serial.printf("blackbox: session %u sequence %lu written %lu dropped %lu overruns %lu triggered %lu erased %lu\n",
+                    stats.session, (unsigned long)stats.sequence, (unsigned long)stats.pagesWritten,
+                    (unsigned long)stats.pagesDropped, (unsigned long)stats.overruns,
+                    (unsigned long)stats.triggeredPages, (unsigned long)stats.erasedPages);
+#if PROFILING_ENABLED
+    } else if (strcmp(line, "prof") == 0) {
+      profiler.printReport();
+    } else if (strcmp(line, "prof reset") == 0) {
+      profiler.reset();
+#endif
+#if LATENCY_TRACE_ENABLED
+    } else if (strcmp(line, "trace dump") == 0) {
+      latencyTrace.dump();
+#endif
+#if STEP_CAPTURE_ENABLED
+    } else if (strcmp(line, "steps dump") == 0) {
+      stepCapture.dump();
+#endif
+#if SHADOW_MODE_ENABLED
+    } else if (strcmp(line, "shadow") == 0) {
+      controller.printShadowStats();
+#endif
+#if THERMAL_MODEL_ENABLED
+    } else if (strcmp(line, "thermal") == 0) {
+      ThermalState thermal = controller.getThermalState();
+      Serial.printf("thermal: coil %.1f C (%.1f W, predicted %.1f C) driver %.1f C (%.1f W, predicted %.1f C) derate %.2f\n",
+                    thermal.coilC, thermal.coilW, thermal.coilPredictedC, thermal.driverC, thermal.driverW,
+                    thermal.driverPredictedC, thermal.derate);
+      Serial.printf("thermal: otw %lu otsd %lu driver rth scale %.2f\n", (unsigned long)thermal.warnings,
+                    (unsigned long)thermal.shutdowns, thermal.driverRthScale);
+#endif
+#if DECAY_SCHEDULING_ENABLED
+    } else if (strcmp(line, "decay") == 0) {
+      static const char *const bands[] = {"quiet", "cruise", "torque"};
+      Serial.printf("decay: band %s switches %lu silentstep %s\n", bands[controller.getDecayBand()],
+                    (unsigned long)controller.getDecaySwitches(), controller.isSilentstepActive() ? "on" : "faulted");
+#endif
+#if SLIP_DETECTION_ENABLED
+    } else if (strcmp(line, "slip") == 0) {
+      SlipStats stats = controller.getSlipStats();
+      Serial.printf("slip: events %lu total %lu ms longest %lu ms peak %.3f\n", (unsigned long)stats.events,
+                    (unsigned long)stats.totalMs, (unsigned long)stats.longestMs, stats.peakSlip);
+      if (stats.events) {
+        Serial.printf("slip last: at %lu ms for %lu ms peak %.3f mean %.3f expected %.2f secondary %.0f rpm position %ld clamp +%ld\n",
+                      (unsigned long)stats.last.startMs, (unsigned long)stats.last.durationMs, stats.last.peakSlip,
+                      stats.last.meanSlip, stats.last.expectedRatio, stats.last.secondaryRPM,
+                      (long)stats.last.startPosition, (long)stats.last.clampSteps);
+      }
+#endif
+#if RATIO_LEARNING_ENABLED
+    } else if (strcmp(line, "ratio") == 0) {
+      printRatioFit();
+    } else if (strcmp(line, "ratio off") == 0) {
+      controller.commandRatio(0.0f);
+    } else if (strcmp(line, "ratio reset") == 0) {
+      controller.resetRatioFit();
+    } else if (strncmp(line, "ratio ", 6) == 0) {
+      float ratio = atof(line + 6);
+      if (ratio >= HIGH_GEAR && ratio <= LOW_GEAR) {
+        controller.commandRatio(ratio);
+      } else {
+        Serial.printf("ERROR: ratio must be between %.2f and %.2f\n", HIGH_GEAR, LOW_GEAR);
+      }
+#endif
+    }
+  }
+}
+
+/**
+ * @brief Arduino loop for periodic telemetry and host commands.
  */
 void loop() {
-  delay(50);
-  Serial.println(controller.log().c_str());
-  Serial.printf(">manual_mode:%d\n", analogRead(MANUAL_MODE_PIN));
-  Serial.printf(">limit:%d\n", analogRead(LIMIT_SWITCH_PIN));
+  static TickType_t lastWake = xTaskGetTickCount();
+  vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(TELEMETRY_PERIOD_MS));
+  PROFILE_SCOPE(PROFILE_TELEMETRY);
+
+  controller.serviceCalibration();
+#if PROFILING_ENABLED
+  controller.serviceProfiler();
+#endif
+  serviceSerialCommands();
+  controller.sampleTelemetry(telemetryRecord);
+#if TELEMETRY_BINARY
+  size_t length = telemetryEncoder.encode(telemetryRecord);
+  Serial.write(telemetryEncoder.frame(), length);
+#else
+  printTeleplot(telemetryRecord);
+#endif
+#if SHADOW_MODE_ENABLED
+  controller.drainShadowRecords();
+#endif
+  controller.serviceBlackboxDump();
 }
@@ -1,11 +1,19 @@
 #include "motor.h"
+#include "esp_timer.h"
 #include "config.h"
+#include "deferred_log.h"
+#include "profiler.h"
+#include "latency_trace.h"
 
-Motor::Motor() : currentPosition(0), setpointPosition(0), currentVelocity(0.0f), stepAccumulator(0.0f), driver(), encoder(ENCODER_A_PIN, ENCODER_B_PIN, ENCODER_COUNTER_ID) {}
+Motor::Motor() : driver(), encoder(ENCODER_A_PIN, ENCODER_B_PIN, ENCODER_COUNTER_ID), currentPosition(0), lastPosition(0), currentVelocity(0.0f), stepAccumulator(0.0f),
+                 maxAcceleration_pos(MOTOR_MAX_ACCELERATION_POS), maxAcceleration_neg(MOTOR_MAX_ACCELERATION_NEG), setpointPosition(0) {}
 
 void Motor::init()
 {
     this->driver.begin();
+#if DECAY_SCHEDULING_ENABLED
+    this->silentstepCheckUs = esp_timer_get_time() + DECAY_DOWNSHIFT_MS * 1000LL; // begin() left it in the quiet band
+#endif
     this->startTimer();
 }
 
@@ -24,6 +32,7 @@ void Motor::startTimer()
                                                  // Timer callback function lambda
                                                  // retrieve the Motor instance from the timer ID and call the timerCallback method
                                                  Motor *motor = static_cast<Motor *>(pvTimerGetTimerID(xTimer));
+                                                 PROFILE_SCOPE(PROFILE_MOTOR_TICK);
                                                  motor->timerCallback();
                                              });
 
@@ -42,9 +51,46 @@ void Motor::startTimer()
  * @brief Set the target motor position in step units.
  * @param position Target step position (0 = idle).
  */
-void Motor::setSetpoint(int position)
+void Motor::setSetpoint(int position, uint32_t traceSample)
 {
+    if (this->brakeActive)
+    {
+        return; // the brake profile owns the setpoint until released
+    }
     this->setpointPosition = position;
+    this->setpointSample = traceSample; // published after the position so the tick never pairs a new tag with an old setpoint
+}
+
+void Motor::brake(int target)
+{
+    this->brakeTarget = target;
+    this->brakeActive = true;
+    // Run the planner now on the timer daemon so it cannot interleave with the periodic tick.
+    xTimerPendFunctionCall(Motor::applyBrake, this, 0, 0);
+}
+
+void IRAM_ATTR Motor::brakeFromISR(int target, BaseType_t *higherPriorityTaskWoken)
+{
+    this->brakeTarget = target;
+    this->brakeActive = true;
+    xTimerPendFunctionCallFromISR(Motor::applyBrake, this, 0, higherPriorityTaskWoken);
+}
+
+void Motor::releaseBrake()
+{
+    this->brakeActive = false;
+}
+
+/**
+ * @brief Pended brake handler: replan toward the brake target without waiting for the next tick.
+ */
+void Motor::applyBrake(void *motor, uint32_t)
+{
+    Motor *self = static_cast<Motor *>(motor);
+    if (self->brakeActive)
+    {
+        self->timerCallback();
+    }
 }
 
 int Motor::getPosition()
@@ -57,6 +103,11 @@ int Motor::getSetpoint()
     return this->setpointPosition;
 }
 
+float Motor::getVelocity()
+{
+    return this->currentVelocity;
+}
+
 void Motor::setPosition(int position)
 {
     this->currentPosition = position;
@@ -74,32 +125,23 @@ void Motor::disable()
 }
 
 /**
- * @brief Motor control tick that applies acceleration/velocity limits.
+ * @brief Planner math of one motor tick, separate from the hardware so it can be measured on the host.
  */
-void Motor::timerCallback()
+Motor::MotionCommand Motor::plan(int setpoint, int position, float velocity, float timeStep, int maxAcceleration)
 {
-    float timeStep = (float)MOTOR_TIMER_RATE / 1000.0f - 0.00005; // subtract 50us to ensure steps finish before next tick
-    
-    // Update current position from encoder feedback.
-    this->currentPosition = this->encoder.getSteps();
-    this->currentVelocity = (this->currentPosition - this->lastPosition) / timeStep; // calculate velocity based on change in position over time step
-
     // Calculate the ideal steps and speed.
-    int stepsToMove = this->setpointPosition - this->currentPosition;
+    int stepsToMove = setpoint - position;
     int speed_hz = stepsToMove / timeStep; // speed proportional to the number of steps, with a maximum of maxVelocity
 
-    // Determine which acceleration limit to use based on motion direction.
-    int maxAcceleration = this->currentVelocity > 0 ? maxAcceleration_pos : maxAcceleration_neg;
-
     // Limit acceleration.
-    float acceleration = (speed_hz - this->currentVelocity) / timeStep;
+    float acceleration = (speed_hz - velocity) / timeStep;
     if (acceleration > maxAcceleration)
     {
-        speed_hz = this->currentVelocity + maxAcceleration * timeStep;
+        speed_hz = velocity + maxAcceleration * timeStep;
     }
     else if (acceleration < -maxAcceleration)
     {
-        speed_hz = this->currentVelocity - maxAcceleration * timeStep;
+        speed_hz = velocity - maxAcceleration * timeStep;
     }
 
     // Limit speed.
@@ -118,7 +160,7 @@ void Motor::timerCallback()
             stepsToMove = speed_hz * timeStep;
 
     // Decelerate if we would overshoot the setpoint.
-    float distanceToSetpoint = this->setpointPosition - this->currentPosition;
+    float distanceToSetpoint = setpoint - position;
 
     
 
@@ -134,25 +176,170 @@ void Motor::timerCallback()
     {        stepsToMove = distanceToSetpoint;
     }
 
-    debugPrintf(">stepsToMove:%d\n", stepsToMove);
+    return {stepsToMove, speed_hz};
+}
+
+/**
+ * @brief Motor control tick that applies acceleration/velocity limits.
+ */
+void Motor::timerCallback()
+{
+    float timeStep = (float)MOTOR_TIMER_RATE / 1000.0f - 0.00005; // subtract 50us to ensure steps finish before next tick
+    uint32_t sample = this->setpointSample;
+
+    if (this->brakeActive)
+    {
+        this->setpointPosition = this->brakeTarget;
+    }
+    else if (sample != this->tracedSample)
+    {
+        TRACE_EVENT(TRACE_MOTOR_TICK, sample, this->setpointPosition);
+        this->tracedSample = sample;
+        this->stepPendingSample = sample;
+    }
+
+    // Update current position from encoder feedback. Velocity uses the measured interval
+    // because brake preemption can run the planner between periodic ticks.
+    int64_t nowUs = esp_timer_get_time();
+    float elapsed = this->lastTickUs != 0 ? (nowUs - this->lastTickUs) / 1000000.0f : timeStep;
+    if (elapsed <= 0.0f)
+    {
+        elapsed = timeStep;
+    }
+    this->lastTickUs = nowUs;
+
+    this->currentPosition = this->encoder.getSteps();
+    this->currentVelocity = (this->currentPosition - this->lastPosition) / elapsed; // calculate velocity based on change in position over time step
+
+    if (this->currentPosition != this->lastPosition && this->positionCallback)
+    {
+        this->positionCallback(this->positionCallbackArg);
+    }
+
+    // Determine which acceleration limit to use based on motion direction.
+    int maxAcceleration = this->currentVelocity > 0 ? maxAcceleration_pos : maxAcceleration_neg;
+    if (this->brakeActive)
+    {
+        maxAcceleration = maxAcceleration_neg; // deceleration used by the brake profile in either direction
+    }
+
+    MotionCommand command = plan(this->setpointPosition, this->currentPosition, this->currentVelocity, timeStep, maxAcceleration);
+    int stepsToMove = command.steps;
+    int speed_hz = command.speedHz;
+
+    DLOG(">stepsToMove:%d\n", stepsToMove);
     this->driver.moveSteps(stepsToMove, abs(speed_hz));
+    if (stepsToMove != 0 && speed_hz != 0)
+    {
+        float batchUs = abs(stepsToMove) * 1000000.0f / abs(speed_hz);
+        this->steppingUs += (uint32_t)(batchUs < timeStep * 1000000.0f ? batchUs : timeStep * 1000000.0f);
+    }
+    if (this->stepPendingSample != 0 && stepsToMove != 0 && speed_hz != 0)
+    {
+        TRACE_EVENT(TRACE_STEP, this->stepPendingSample, stepsToMove);
+        this->stepPendingSample = 0;
+    }
+#if DECAY_SCHEDULING_ENABLED
+    // After the batch is queued, so the register writes never delay its first step.
+    this->scheduleDecay(speed_hz, nowUs);
+#endif
     this->lastPosition = this->currentPosition; // update last position for velocity calculation in the next timer callback
 
 }
 
 
-
-std::string Motor::log()
+DecayBand Motor::decayBandFor(DecayBand band, int speedHz)
 {
-    return "\n>pos:" + std::to_string(this->currentPosition) + "\n>vel:" + std::to_string(this->currentVelocity) + "\n>setpoint:" + std::to_string(this->setpointPosition);
+    int speed = abs(speedHz);
+    if (speed > DECAY_TORQUE_MIN_HZ)
+    {
+        return DECAY_BAND_TORQUE;
+    }
+    if (band == DECAY_BAND_TORQUE && speed >= DECAY_TORQUE_MIN_HZ * (1.0f - DECAY_HYSTERESIS))
+    {
+        return DECAY_BAND_TORQUE;
+    }
+    if (speed > DECAY_QUIET_MAX_HZ)
+    {
+        return DECAY_BAND_CRUISE;
+    }
+    if (band != DECAY_BAND_QUIET && speed >= DECAY_QUIET_MAX_HZ * (1.0f - DECAY_HYSTERESIS))
+    {
+        return DECAY_BAND_CRUISE;
+    }
+    return DECAY_BAND_QUIET;
 }
 
+/**
+ * @brief Move the driver to the band for the commanded step rate.
+ *
+ * A faster band is written at once since the torque is needed on this batch. A slower band
+ * waits DECAY_DOWNSHIFT_MS so reversals and brief slowdowns do not toggle the registers.
+ * The brake profile is left alone: its steps matter most and it ends in a few ticks.
+ */
+void Motor::scheduleDecay(int speedHz, int64_t nowUs)
+{
+    if (this->brakeActive)
+    {
+        return;
+    }
+
+    if (this->silentstepCheckUs != 0 && nowUs >= this->silentstepCheckUs)
+    {
+        this->silentstepCheckUs = 0;
+        this->silentstepActive = this->driver.checkSilentstep();
+    }
+
+    DecayBand band = this->decayBand;
+    DecayBand target = decayBandFor(band, speedHz);
+    if (target == band)
+    {
+        this->downshiftSinceUs = 0;
+        return;
+    }
+    if (target < band)
+    {
+        if (this->downshiftSinceUs == 0)
+        {
+            this->downshiftSinceUs = nowUs;
+        }
+        if (nowUs - this->downshiftSinceUs < DECAY_DOWNSHIFT_MS * 1000LL)
+        {
+            return;
+        }
+    }
+
+    this->driver.setDecayBand(target);
+    this->decayBand = target;
+    this->decaySwitches++;
+    this->downshiftSinceUs = 0;
+    if (target == DECAY_BAND_QUIET && this->silentstepActive)
+    {
+        this->silentstepCheckUs = nowUs + DECAY_DOWNSHIFT_MS * 1000LL;
+    }
+}
 
 uint16_t Motor::getFault()
 {
     return this->driver.readFault();
 }
 
+uint16_t Motor::getDiagnostics()
+{
+    return this->driver.readDiag2();
+}
+
+void Motor::setCurrent(uint8_t runCurrent, uint8_t holdCurrent)
+{
+    this->driver.setCurrent(runCurrent, holdCurrent);
+}
+
+void Motor::setAccelerationLimits(int positive, int negative)
+{
+    this->maxAcceleration_pos = positive;
+    this->maxAcceleration_neg = negative;
+}
+
 void Motor::setHome(int homePosition) {
     this->currentPosition = homePosition;
     // this->setpointPosition = homePosition;
@@ -160,3 +347,9 @@ void Motor::setHome(int homePosition) {
     this->stepAccumulator = 0.0f;
     this->encoder.setCount(homePosition);
 }
+
+void Motor::setPositionCallback(void (*callback)(void *), void *arg)
+{
+    this->positionCallbackArg = arg;
+    this->positionCallback = callback;
+}
@@ -0,0 +1,147 @@
+#include "profiler.h"
+
+#if PROFILING_ENABLED
+
+const ProfileSectionInfo profileSections[PROFILE_SECTION_COUNT] = {
+    {"motor_tick", MOTOR_TIMER_RATE * 1000, PROFILE_BUDGET_MOTOR_US},
+    {"control_tick", CONTROLLER_EVENT_DRIVEN ? 0 : CONTROLLER_TIMER_RATE * 1000, PROFILE_BUDGET_CONTROL_US},
+    {"can_tx", CAN_TX_TICK_MS * 1000, PROFILE_BUDGET_CAN_TX_US},
+    {"can_rx", 0, PROFILE_BUDGET_CAN_RX_US},
+    {"rpm_sample", RPM_SAMPLE_PERIOD_MS * 1000, PROFILE_BUDGET_RPM_SAMPLE_US},
+    {"analog_frame", (uint32_t)((uint64_t)ANALOG_FRAME_SAMPLES * 1000000 / ANALOG_SAMPLE_RATE_HZ), PROFILE_BUDGET_ANALOG_US},
+    {"spi", 0, PROFILE_BUDGET_SPI_US},
+    {"telemetry", TELEMETRY_PERIOD_MS * 1000, PROFILE_BUDGET_TELEMETRY_US},
+};
+
+Profiler profiler;
+
+Profiler::Profiler()
+{
+    this->reset();
+}
+
+void Profiler::clear(ProfileStats &stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.minCycles = UINT32_MAX;
+    stats.minPeriodCycles = UINT32_MAX;
+}
+
+void Profiler::reset()
+{
+    portENTER_CRITICAL_SAFE(&this->lock);
+    for (int i = 0; i < PROFILE_SECTION_COUNT; i++)
+    {
+        clear(this->stats[i]);
+        this->lastCore[i] = -1;
+    }
+    portEXIT_CRITICAL_SAFE(&this->lock);
+}
+
+uint32_t Profiler::begin(ProfileSection section, int core)
+{
+    uint32_t now = ESP.getCycleCount();
+
+    portENTER_CRITICAL_SAFE(&this->lock);
+    ProfileStats &s = this->stats[section];
+    if (this->lastCore[section] == core)
+    {
+        uint32_t period = now - this->lastStart[section];
+        s.periods++;
+        s.totalPeriodCycles += period;
+        if (period < s.minPeriodCycles)
+        {
+            s.minPeriodCycles = period;
+        }
+        if (period > s.maxPeriodCycles)
+        {
+            s.maxPeriodCycles = period;
+        }
+        uint32_t nominal = profileSections[section].periodUs;
+        if (nominal > 0 && (uint64_t)period * 100 > (uint64_t)nominal * ESP.getCpuFreqMHz() * PROFILE_LATE_PERCENT)
+        {
+            s.latePeriods++;
+        }
+    }
+    this->lastStart[section] = now;
+    this->lastCore[section] = core;
+    portEXIT_CRITICAL_SAFE(&this->lock);
+
+    return now;
+}
+
+void Profiler::end(ProfileSection section, uint32_t start, int core)
+{
+    uint32_t cycles = ESP.getCycleCount() - start;
+
+    portENTER_CRITICAL_SAFE(&this->lock);
+    ProfileStats &s = this->stats[section];
+    if (xPortGetCoreID() != core)
+    {
+        s.migrated++;
+    }
+    else
+    {
+        s.count++;
+        s.totalCycles += cycles;
+        if (cycles < s.minCycles)
+        {
+            s.minCycles = cycles;
+        }
+        if (cycles > s.maxCycles)
+        {
+            s.maxCycles = cycles;
+        }
+        if (cycles > profileSections[section].budgetUs * ESP.getCpuFreqMHz())
+        {
+            s.deadlineMisses++;
+        }
+        s.histogram[cycles ? 31 - __builtin_clz(cycles) : 0]++;
+    }
+    portEXIT_CRITICAL_SAFE(&this->lock);
+}
+
+ProfileStats Profiler::getStats(ProfileSection section)
+{
+    portENTER_CRITICAL_SAFE(&this->lock);
+    ProfileStats copy = this->stats[section];
+    portEXIT_CRITICAL_SAFE(&this->lock);
+    return copy;
+}
+
+void Profiler::printReport()
+{
+    float mhz = ESP.getCpuFreqMHz();
+
+    for (int i = 0; i < PROFILE_SECTION_COUNT; i++)
+    {
+        ProfileStats s = this->getStats(static_cast<ProfileSection>(i));
+        if (s.count == 0)
+        {
+            continue;
+        }
+
+        Serial.printf("profile,%s,count=%u,min_us=%.1f,mean_us=%.1f,max_us=%.1f,misses=%u,migrated=%u",
+                      profileSections[i].name, s.count, s.minCycles / mhz,
+                      s.totalCycles / s.count / mhz, s.maxCycles / mhz, s.deadlineMisses, s.migrated);
+        if (s.periods > 0)
+        {
+            Serial.printf(",period_min_us=%.1f,period_mean_us=%.1f,period_max_us=%.1f,jitter_us=%.1f,late=%u",
+                          s.minPeriodCycles / mhz, s.totalPeriodCycles / s.periods / mhz, s.maxPeriodCycles / mhz,
+                          (s.maxPeriodCycles - s.minPeriodCycles) / mhz, s.latePeriods);
+        }
+        Serial.printf(",hist=");
+        bool first = true;
+        for (int bin = 0; bin < PROFILE_HISTOGRAM_BINS; bin++)
+        {
+            if (s.histogram[bin])
+            {
+                Serial.printf("%s%d:%u", first ? "" : ";", bin, s.histogram[bin]);
+                first = false;
+            }
+        }
+        Serial.printf("\n");
+    }
+}
+
+#endif // PROFILING_ENABLED
@@ -1,6 +1,8 @@
 #include "pulse_counter.h"
 #include <limits.h>
 #include "config.h"
+#include "profiler.h"
+#include "latency_trace.h"
 
 
 /**
@@ -57,9 +59,58 @@ void PulseCounter::resetCount() {
     pcnt_counter_clear(counterId);
     hasLastSample = false;
     lastCount = 0;
-    lastSampleTimeMs = 0;
+    lastSampleTimeUs = 0;
 }
 
+/**
+ * @brief Start periodic RPM sampling so the sample window does not depend on the control tick.
+ * @param periodMs Sample period in milliseconds.
+ * @param callback Optional callback invoked after each new estimate.
+ * @param arg Argument passed to the callback.
+ */
+void PulseCounter::startSampling(uint32_t periodMs, void (*callback)(void *), void *arg) {
+    sampleCallback = callback;
+    sampleCallbackArg = arg;
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = [](void *arg) {
+        PulseCounter *counter = static_cast<PulseCounter *>(arg);
+        PROFILE_SCOPE(PROFILE_RPM_SAMPLE);
+        counter->getRPM();
+        if (counter->sampleCallback) {
+            counter->sampleCallback(counter->sampleCallbackArg);
+        }
+    };
+    timerArgs.arg = this;
+    timerArgs.dispatch_method = ESP_TIMER_TASK;
+    timerArgs.name = "rpm_sample";
+
+    if (esp_timer_create(&timerArgs, &sampleTimer) != ESP_OK) {
+        Serial.printf("ERROR: RPM sample timer could not be created\n");
+        return;
+    }
+
+    if (esp_timer_start_periodic(sampleTimer, static_cast<uint64_t>(periodMs) * 1000) != ESP_OK) {
+        Serial.printf("ERROR: RPM sample timer could not be started\n");
+    }
+}
+
+
+float PulseCounter::countsToRPM(int16_t currentCount, int16_t lastCount, int64_t elapsedUs, float pulsesPerRevolution) {
+    int32_t deltaCount = static_cast<int32_t>(currentCount) - static_cast<int32_t>(lastCount);
+
+    // Correct for int16 counter wrap between samples.
+    if (deltaCount < INT16_MIN) {
+        deltaCount += (INT16_MAX - INT16_MIN + 1);
+    } else if (deltaCount > INT16_MAX) {
+        deltaCount -= (INT16_MAX - INT16_MIN + 1);
+    }
+
+    if (deltaCount > 0 && pulsesPerRevolution > 0.0f) {
+        return (static_cast<float>(deltaCount) * 60000000.0f) / (pulsesPerRevolution * static_cast<float>(elapsedUs));
+    }
+    return 0.0f;
+}
 
 /**
  * @brief Calculate RPM from pulse delta and elapsed time.
@@ -73,42 +124,31 @@ float PulseCounter::getRPM() {
     int16_t currentCount;
     pcnt_get_counter_value(counterId, &currentCount);
 
-    uint32_t currentTimeMs = millis();
+    int64_t currentTimeUs = esp_timer_get_time();
 
     if (!hasLastSample) {
         lastCount = currentCount;
-        lastSampleTimeMs = currentTimeMs;
+        lastSampleTimeUs = currentTimeUs;
         hasLastSample = true;
         return 0.0f;
     }
 
-    uint32_t elapsedMs = currentTimeMs - lastSampleTimeMs;
-    if (elapsedMs == 0) {
+    int64_t elapsedUs = currentTimeUs - lastSampleTimeUs;
+    if (elapsedUs <= 0) {
         return 0.0f;
     }
 
-    int32_t deltaCount = static_cast<int32_t>(currentCount) - static_cast<int32_t>(lastCount);
-
-    // Correct for int16 counter wrap between samples.
-    if (deltaCount < INT16_MIN) {
-        deltaCount += (INT16_MAX - INT16_MIN + 1);
-    } else if (deltaCount > INT16_MAX) {
-        deltaCount -= (INT16_MAX - INT16_MIN + 1);
-    }
-
     float pulsesPerRevolution = static_cast<float>(magnetCount) * EDGES_PER_MAGNET;
-
-    float rpm = 0.0f;
-    if (deltaCount > 0 && pulsesPerRevolution > 0.0f) {
-        rpm = (static_cast<float>(deltaCount) * 60000.0f) / (pulsesPerRevolution * static_cast<float>(elapsedMs));
-    }
+    float rpm = countsToRPM(currentCount, lastCount, elapsedUs, pulsesPerRevolution);
 
     lastCount = currentCount;
-    lastSampleTimeMs = currentTimeMs;
+    lastSampleTimeUs = currentTimeUs;
 
     // Apply low-pass filter to smooth out RPM readings.
     rpm = rpmFilter.filter(rpm);
     filteredRPM = rpm;
+    sampleCount = sampleCount + 1;
+    TRACE_EVENT(TRACE_RPM_SAMPLE, sampleCount, static_cast<int32_t>(elapsedUs));
 
     return rpm;
 }
@@ -0,0 +1,269 @@
+#include "ratio_estimator.h"
+#include <Arduino.h>
+#include <Preferences.h>
+#include <math.h>
+#include "crc16.h"
+
+#if RATIO_LEARNING_ENABLED
+
+#define RATIO_NVS_NAMESPACE "ratio_fit"
+
+static_assert(RATIO_KNOT_COUNT >= 2, "RATIO_KNOT_COUNT needs at least two knots");
+
+static uint16_t fitChecksum(const RatioFit &fit)
+{
+    return crc16Update(0xFFFF, reinterpret_cast<const uint8_t *>(&fit), sizeof(fit));
+}
+
+/**
+ * @brief Knot segment and interpolation weight of a sheave position.
+ * @param position Sheave position in steps.
+ * @param weight Output weight of the upper knot; the lower knot gets 1 - weight.
+ * @return Index of the lower knot, at most RATIO_KNOT_COUNT - 2.
+ */
+static int segment(int position, float &weight)
+{
+    float x = (float)position * (RATIO_KNOT_COUNT - 1) / MAX_MOTOR_SETPOINT;
+    x = clamp(x, 0.0f, (float)(RATIO_KNOT_COUNT - 1));
+    int knot = (int)x;
+    if (knot > RATIO_KNOT_COUNT - 2)
+    {
+        knot = RATIO_KNOT_COUNT - 2;
+    }
+    weight = x - knot;
+    return knot;
+}
+
+RatioEstimator::RatioEstimator()
+{
+    this->start(this->prior());
+}
+
+RatioFit RatioEstimator::prior() const
+{
+    RatioFit fit = {};
+    // Calibration orders the two setpoints; keep the slope finite if they are set equal.
+    float span = fmaxf(this->priorMax - this->priorLowMax, 1.0f);
+    for (int i = 0; i < RATIO_KNOT_COUNT; i++)
+    {
+        float k = (knotPosition(i) - this->priorLowMax) / span;
+        fit.ratio[i] = lerp(LOW_GEAR, HIGH_GEAR, clamp(k, 0.0f, 1.0f));
+        fit.variance[i] = RATIO_INITIAL_VARIANCE;
+    }
+    return fit;
+}
+
+/**
+ * @brief Restart the recursion from a fit. Knots start uncorrelated with their stored variance.
+ */
+void RatioEstimator::start(const RatioFit &initial)
+{
+    for (int r = 0; r < RATIO_KNOT_COUNT; r++)
+    {
+        this->theta[r] = initial.ratio[r];
+        for (int c = 0; c < RATIO_KNOT_COUNT; c++)
+        {
+            this->covariance[r][c] = r == c ? initial.variance[r] : 0.0f;
+        }
+    }
+    this->samples = initial.samples;
+    this->savedSamples = initial.samples;
+    this->publish();
+}
+
+void RatioEstimator::publish()
+{
+    RatioFit out;
+    for (int i = 0; i < RATIO_KNOT_COUNT; i++)
+    {
+        out.ratio[i] = this->theta[i];
+        out.variance[i] = this->covariance[i][i];
+    }
+    out.samples = this->samples;
+    this->fit.write(out);
+}
+
+/**
+ * @brief Load the stored fit. The stored knot count and checksum must match or the prior is used.
+ */
+void RatioEstimator::begin()
+{
+    RatioFit stored;
+    Preferences prefs;
+
+    bool valid = false;
+    if (prefs.begin(RATIO_NVS_NAMESPACE, true))
+    {
+        valid = prefs.getUChar("count", 0) == RATIO_KNOT_COUNT &&
+                prefs.getBytes("fit", &stored, sizeof(stored)) == sizeof(stored) &&
+                prefs.getUShort("crc", 0) == fitChecksum(stored);
+        prefs.end();
+    }
+
+    for (int i = 0; valid && i < RATIO_KNOT_COUNT; i++)
+    {
+        valid = stored.ratio[i] > 0.0f && stored.variance[i] > 0.0f && stored.variance[i] <= RATIO_INITIAL_VARIANCE;
+    }
+
+    if (!valid)
+    {
+        Serial.printf("Ratio fit: no valid stored fit, using the LOW_GEAR/HIGH_GEAR prior\n");
+        stored = this->prior();
+    }
+    this->start(stored);
+}
+
+bool RatioEstimator::update(float ratio, int position)
+{
+    if (this->resetRequested.exchange(false))
+    {
+        this->start(this->prior());
+    }
+
+    if (position < 0 || position > MAX_MOTOR_SETPOINT || !(ratio > 0.0f))
+    {
+        return false;
+    }
+
+    // Only the two knots around the position have nonzero basis values.
+    float weight;
+    int lo = segment(position, weight);
+    int hi = lo + 1;
+    float w[2] = {1.0f - weight, weight};
+
+    float predicted = w[0] * this->theta[lo] + w[1] * this->theta[hi];
+    float error = ratio - predicted;
+
+    // Covariance times the basis vector, and the innovation variance.
+    float pphi[RATIO_KNOT_COUNT];
+    for (int r = 0; r < RATIO_KNOT_COUNT; r++)
+    {
+        pphi[r] = this->covariance[r][lo] * w[0] + this->covariance[r][hi] * w[1];
+    }
+    float innovation = RATIO_MEASUREMENT_VARIANCE + w[0] * pphi[lo] + w[1] * pphi[hi];
+
+    // Gate on the innovation: wide while the knots are uncertain, tight once they have learned.
+    if (error * error > RATIO_GATE_SIGMAS * RATIO_GATE_SIGMAS * innovation)
+    {
+        return false;
+    }
+
+    for (int r = 0; r < RATIO_KNOT_COUNT; r++)
+    {
+        this->theta[r] += pphi[r] / innovation * error;
+    }
+    for (int r = 0; r < RATIO_KNOT_COUNT; r++)
+    {
+        for (int c = 0; c < RATIO_KNOT_COUNT; c++)
+        {
+            this->covariance[r][c] = (this->covariance[r][c] - pphi[r] * pphi[c] / innovation) / RATIO_FORGETTING;
+        }
+    }
+
+    // Forgetting inflates knots that are never visited without bound; scale their row and
+    // column back so the variance stays at or below the prior and the matrix stays symmetric.
+    for (int r = 0; r < RATIO_KNOT_COUNT; r++)
+    {
+        if (this->covariance[r][r] > RATIO_INITIAL_VARIANCE)
+        {
+            float scale = sqrtf(RATIO_INITIAL_VARIANCE / this->covariance[r][r]);
+            for (int c = 0; c < RATIO_KNOT_COUNT; c++)
+            {
+                this->covariance[r][c] *= scale;
+                this->covariance[c][r] *= scale;
+            }
+        }
+    }
+
+    this->samples++;
+    this->publish();
+    return true;
+}
+
+void RatioEstimator::requestSave()
+{
+    if (this->resetRequested.exchange(false))
+    {
+        this->start(this->prior());
+        this->saveRequested = true; // store the reset fit too
+    }
+
+    if (this->samples - this->savedSamples >= RATIO_SAVE_SAMPLES)
+    {
+        this->savedSamples = this->samples;
+        this->saveRequested = true;
+    }
+}
+
+/**
+ * @brief Store the latest fit in NVS if a save was requested.
+ */
+void RatioEstimator::service()
+{
+    if (!this->saveRequested.exchange(false))
+    {
+        return;
+    }
+
+    RatioFit stored = this->fit.read();
+    uint16_t crc = fitChecksum(stored);
+    Preferences prefs;
+
+    bool ok = prefs.begin(RATIO_NVS_NAMESPACE, false) &&
+              prefs.putBytes("fit", &stored, sizeof(stored)) == sizeof(stored) &&
+              prefs.putUShort("crc", crc) == sizeof(crc) &&
+              prefs.putUChar("count", RATIO_KNOT_COUNT) == 1;
+    prefs.end();
+
+    if (!ok)
+    {
+        Serial.printf("ERROR: Ratio fit could not be written to NVS\n");
+    }
+}
+
+float RatioEstimator::ratioAt(int position) const
+{
+    RatioFit current = this->fit.read();
+    float weight;
+    int lo = segment(position, weight);
+    return lerp(current.ratio[lo], current.ratio[lo + 1], weight);
+}
+
+float RatioEstimator::varianceAt(int position) const
+{
+    RatioFit current = this->fit.read();
+    float weight;
+    int lo = segment(position, weight);
+    return lerp(current.variance[lo], current.variance[lo + 1], weight);
+}
+
+int RatioEstimator::setpointForRatio(float ratio) const
+{
+    RatioFit current = this->fit.read();
+
+    // Running maximum from the clamped end: the ratio can only fall as the sheave clamps, and
+    // the knots near the open end, which are seldom driven on, must not cap the rest.
+    float envelope[RATIO_KNOT_COUNT];
+    envelope[RATIO_KNOT_COUNT - 1] = current.ratio[RATIO_KNOT_COUNT - 1];
+    for (int i = RATIO_KNOT_COUNT - 2; i >= 0; i--)
+    {
+        envelope[i] = current.ratio[i] > envelope[i + 1] ? current.ratio[i] : envelope[i + 1];
+    }
+
+    if (ratio > envelope[0])
+    {
+        return knotPosition(0);
+    }
+    for (int i = 0; i < RATIO_KNOT_COUNT - 1; i++)
+    {
+        // Flat segments at the target are skipped so the most clamped position wins.
+        if (envelope[i + 1] < ratio)
+        {
+            float k = (envelope[i] - ratio) / (envelope[i] - envelope[i + 1]);
+            return (int)lerp((float)knotPosition(i), (float)knotPosition(i + 1), k);
+        }
+    }
+    return knotPosition(RATIO_KNOT_COUNT - 1);
+}
+
+#endif // RATIO_LEARNING_ENABLED
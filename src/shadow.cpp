@@ -0,0 +1,212 @@
+#include "shadow.h"
+#include "controller.h"
+
+/**
+ * @brief rpmToSetpoint with the derivative gain replaced by SHADOW_PD_KD. State: [0] last error.
+ */
+static int32_t pdLaw(const ShadowInputs &inputs, float *state)
+{
+    CalibrationValues cal = inputs.cal;
+    cal.values[CAL_RPM_KD] = SHADOW_PD_KD;
+    return Controller::setpointLaw(cal, inputs.engineRPM, inputs.targetRPM, state[0], inputs.position,
+                                   inputs.mode == BRAKE_CHECK);
+}
+
+/**
+ * @brief Feedforward from vehicle speed plus proportional rpm trim.
+ *
+ * Assumes sheave position scales roughly with vehicle speed at the ideal rpm; the speed-to-step
+ * slope is learned online as a running ratio. State: [0] learned steps per unit speed.
+ */
+static int32_t feedforwardLaw(const ShadowInputs &inputs, float *state)
+{
+    const CalibrationValues &cal = inputs.cal;
+    if (inputs.engineRPM < cal[CAL_ENGINE_ENGAGE_RPM])
+    {
+        return cal[CAL_IDLE_MOTOR_SETPOINT];
+    }
+
+    if (inputs.vehicleSpeed > 1.0f && fabsf(inputs.targetRPM - inputs.engineRPM) < 200.0f)
+    {
+        float observed = inputs.position / inputs.vehicleSpeed;
+        state[0] = state[0] == 0.0f ? observed : 0.98f * state[0] + 0.02f * observed;
+    }
+
+    float feedforward = state[0] * inputs.vehicleSpeed;
+    float trim = -(inputs.targetRPM - inputs.engineRPM) * cal[CAL_RPM_KP] * 0.5f;
+    return clamp(feedforward + trim, cal[CAL_IDLE_MOTOR_SETPOINT], cal[CAL_MAX_MOTOR_SETPOINT]);
+}
+
+/**
+ * @brief Candidate table. Add a law here to evaluate it in shadow mode.
+ */
+static const ShadowCandidate candidates[] = {
+    {"pd", pdLaw},
+    {"feedforward", feedforwardLaw},
+};
+static const int candidateCount = sizeof(candidates) / sizeof(candidates[0]);
+static_assert(sizeof(candidates) / sizeof(candidates[0]) <= SHADOW_MAX_CANDIDATES, "Too many shadow candidates");
+static_assert((SHADOW_RING_SIZE & (SHADOW_RING_SIZE - 1)) == 0, "SHADOW_RING_SIZE must be a power of two");
+static_assert(sizeof(ShadowRecord) == 12, "ShadowRecord is sent as is");
+
+static int16_t saturate16(float value)
+{
+    return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : (int16_t)value;
+}
+
+ShadowEvaluator::ShadowEvaluator() : stats(), state(), ring()
+{
+    for (int i = 0; i < SHADOW_MAX_CANDIDATES; i++)
+    {
+        this->stats[i].minCycles = UINT32_MAX;
+    }
+}
+
+void ShadowEvaluator::evaluate(const ShadowInputs &inputs)
+{
+    float activeError = inputs.targetRPM - inputs.engineRPM;
+
+    for (int i = 0; i < candidateCount; i++)
+    {
+        uint32_t start = ESP.getCycleCount();
+        int32_t setpoint = candidates[i].law(inputs, this->state[i]);
+        uint32_t cycles = ESP.getCycleCount() - start;
+
+        // Predict where the engine would sit if the candidate's setpoint had been commanded instead.
+        float predictedRpm = inputs.engineRPM - SHADOW_RPM_PER_STEP * (setpoint - inputs.activeSetpoint);
+        float predictedError = inputs.targetRPM - predictedRpm;
+
+        ShadowStats &s = this->stats[i];
+        s.runs++;
+        s.totalCycles += cycles;
+        if (cycles < s.minCycles)
+        {
+            s.minCycles = cycles;
+        }
+        if (cycles > s.maxCycles)
+        {
+            s.maxCycles = cycles;
+        }
+        if (cycles > SHADOW_BUDGET_CYCLES)
+        {
+            s.overBudget++;
+        }
+        s.sumSquaredRpmError += predictedError * predictedError;
+        s.sumSquaredActiveError += activeError * activeError;
+
+        ShadowRecord record;
+        record.timeMs = inputs.nowMs;
+        record.candidate = i;
+        record.mode = inputs.mode;
+        record.setpointDelta = saturate16(setpoint - inputs.activeSetpoint);
+        record.predictedRpmError = saturate16(predictedError);
+        record.activeRpmError = saturate16(activeError);
+        this->pushRecord(record);
+    }
+}
+
+void ShadowEvaluator::pushRecord(const ShadowRecord &record)
+{
+    uint32_t h = this->head.load(std::memory_order_relaxed);
+    if (h - this->tail.load(std::memory_order_acquire) >= SHADOW_RING_SIZE)
+    {
+        this->droppedRecords++;
+        return;
+    }
+    this->ring[h & (SHADOW_RING_SIZE - 1)] = record;
+    this->head.store(h + 1, std::memory_order_release);
+}
+
+bool ShadowEvaluator::readRecord(ShadowRecord &record)
+{
+    uint32_t t = this->tail.load(std::memory_order_relaxed);
+    if (t == this->head.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    record = this->ring[t & (SHADOW_RING_SIZE - 1)];
+    this->tail.store(t + 1, std::memory_order_release);
+    return true;
+}
+
+int ShadowEvaluator::getCandidateCount() const
+{
+    return candidateCount;
+}
+
+const char *ShadowEvaluator::getCandidateName(int index) const
+{
+    return (index >= 0 && index < candidateCount) ? candidates[index].name : "";
+}
+
+ShadowStats ShadowEvaluator::getStats(int index) const
+{
+    return this->stats[index];
+}
+
+bool ShadowEvaluator::fitsBudget(int index) const
+{
+    return this->stats[index].runs > 0 && this->stats[index].overBudget == 0;
+}
+
+/**
+ * @brief Records arrive every control tick, so the ring is sent in bounded batches rather than
+ * all at once; records that do not fit meanwhile are counted as dropped.
+ */
+void ShadowEvaluator::drainRecords(uint32_t nowMs)
+{
+    if (nowMs - this->lastDrainMs < SHADOW_DRAIN_PERIOD_MS)
+    {
+        return;
+    }
+    this->lastDrainMs = nowMs;
+
+    ShadowRecord record;
+#if TELEMETRY_BINARY
+    size_t count = 0;
+    while (count < SHADOW_RECORDS_PER_FRAME && this->readRecord(record))
+    {
+        memcpy(this->writer.payload() + count * sizeof(record), &record, sizeof(record));
+        count++;
+    }
+    if (count > 0)
+    {
+        this->writer.send(count * sizeof(record));
+    }
+#else
+    for (int i = 0; i < SHADOW_RECORDS_PER_FRAME && this->readRecord(record); i++)
+    {
+        Serial.printf("shadow,%u,%s,%u,%d,%d,%d\n",
+                      record.timeMs,
+                      this->getCandidateName(record.candidate),
+                      record.mode,
+                      record.setpointDelta,
+                      record.predictedRpmError,
+                      record.activeRpmError);
+    }
+#endif
+}
+
+void ShadowEvaluator::printStats()
+{
+    for (int i = 0; i < candidateCount; i++)
+    {
+        const ShadowStats &s = this->stats[i];
+        if (s.runs == 0)
+        {
+            continue;
+        }
+        Serial.printf("shadow_stats,%d,%s,runs=%u,cycles_min=%u,cycles_mean=%u,cycles_max=%u,over_budget=%u,rms_err=%.1f,active_rms_err=%.1f,fits=%d\n",
+                      i,
+                      candidates[i].name,
+                      s.runs,
+                      s.minCycles,
+                      (uint32_t)(s.totalCycles / s.runs),
+                      s.maxCycles,
+                      s.overBudget,
+                      sqrt(s.sumSquaredRpmError / s.runs),
+                      sqrt(s.sumSquaredActiveError / s.runs),
+                      this->fitsBudget(i) ? 1 : 0);
+    }
+    Serial.printf("shadow_dropped,%u\n", this->droppedRecords);
+}
@@ -0,0 +1,143 @@
+#include "slip_detector.h"
+#include "deferred_log.h"
+
+#if SLIP_DETECTION_ENABLED
+
+void SlipDetector::update(float measuredRatio, float expectedRatio, float secondaryRPM, int position, uint32_t nowMs)
+{
+    float current = (measuredRatio - expectedRatio) / expectedRatio;
+    this->slip = current;
+
+    if (!this->slipping)
+    {
+        if (current <= SLIP_ENTER_FRACTION)
+        {
+            this->entering = false;
+            return;
+        }
+        if (!this->entering)
+        {
+            // Remember the conditions at the first sample so the event reports where it began.
+            this->entering = true;
+            this->enterMs = nowMs;
+            this->event = {};
+            this->event.startMs = nowMs;
+            this->event.expectedRatio = expectedRatio;
+            this->event.secondaryRPM = secondaryRPM;
+            this->event.startPosition = position;
+            this->slipSum = 0.0f;
+            this->slipSamples = 0;
+        }
+        this->slipSum += current;
+        this->slipSamples++;
+        if (current > this->event.peakSlip)
+        {
+            this->event.peakSlip = current;
+        }
+        if (nowMs - this->enterMs >= SLIP_ENTER_MS)
+        {
+            this->entering = false;
+            this->recovering = false;
+            this->confirmMs = nowMs;
+            this->slipping = true;
+            DLOG("slip: started at %ld steps, slip %.3f, expected ratio %.2f\n",
+                 (long)this->event.startPosition, current, this->event.expectedRatio);
+        }
+        return;
+    }
+
+    this->slipSum += current;
+    this->slipSamples++;
+    if (current > this->event.peakSlip)
+    {
+        this->event.peakSlip = current;
+    }
+
+    if (current > SLIP_EXIT_FRACTION)
+    {
+        this->recovering = false;
+        return;
+    }
+    if (!this->recovering)
+    {
+        this->recovering = true;
+        this->recoverMs = nowMs;
+    }
+    if (nowMs - this->recoverMs >= SLIP_EXIT_MS)
+    {
+        this->finish(this->recoverMs);
+    }
+}
+
+void SlipDetector::idle(uint32_t nowMs)
+{
+    this->slip = 0.0f;
+    this->entering = false;
+    if (this->slipping)
+    {
+        this->finish(this->recovering ? this->recoverMs : nowMs);
+    }
+}
+
+int32_t SlipDetector::respond(int32_t setpoint, int position, uint32_t nowMs, int32_t maxSetpoint)
+{
+    if (!this->slipping)
+    {
+        return setpoint;
+    }
+
+#if SLIP_RESPONSE == SLIP_RESPONSE_CLAMP
+    (void)position; // the floor is measured from where the slip started
+    // Clamp harder the longer the belt keeps slipping, never below what the controller asked for.
+    int32_t boost = (int32_t)((uint64_t)(nowMs - this->confirmMs) * SLIP_CLAMP_RATE / 1000);
+    boost = boost < SLIP_CLAMP_MAX_STEPS ? boost : SLIP_CLAMP_MAX_STEPS;
+    int32_t floor = this->event.startPosition + boost;
+    floor = floor < maxSetpoint ? floor : maxSetpoint;
+    if (floor - this->event.startPosition > this->event.clampSteps)
+    {
+        this->event.clampSteps = floor - this->event.startPosition;
+    }
+    return setpoint > floor ? setpoint : floor;
+#elif SLIP_RESPONSE == SLIP_RESPONSE_HOLD
+    // Shift slowly so the belt can grip again before the ratio moves further.
+    (void)nowMs;
+    (void)maxSetpoint;
+    return clamp(setpoint, position - SLIP_HOLD_STEPS, position + SLIP_HOLD_STEPS);
+#else
+    (void)position;
+    (void)nowMs;
+    (void)maxSetpoint;
+    return setpoint;
+#endif
+}
+
+/**
+ * @brief Close the open event, fold it into the totals, and log it.
+ */
+void SlipDetector::finish(uint32_t endMs)
+{
+    this->slipping = false;
+    this->recovering = false;
+
+    this->event.durationMs = endMs - this->event.startMs;
+    this->event.meanSlip = this->slipSamples ? this->slipSum / this->slipSamples : 0.0f;
+
+    this->stats.events++;
+    this->stats.totalMs += this->event.durationMs;
+    if (this->event.durationMs > this->stats.longestMs)
+    {
+        this->stats.longestMs = this->event.durationMs;
+    }
+    if (this->event.peakSlip > this->stats.peakSlip)
+    {
+        this->stats.peakSlip = this->event.peakSlip;
+    }
+    this->stats.last = this->event;
+    this->published.write(this->stats);
+
+    DLOG("slip: %lu ms, peak %.3f, mean %.3f, secondary %.0f rpm, clamp +%ld steps\n",
+         (unsigned long)this->event.durationMs, this->event.peakSlip, this->event.meanSlip,
+         this->event.secondaryRPM, (long)this->event.clampSteps);
+}
+
+#endif // SLIP_DETECTION_ENABLED
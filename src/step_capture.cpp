@@ -0,0 +1,88 @@
+#include "step_capture.h"
+
+#if STEP_CAPTURE_ENABLED
+
+#include <Arduino.h>
+#include "driver/pcnt.h"
+#include "esp_timer.h"
+
+StepCapture stepCapture;
+
+StepCapture::StepCapture() : head(0), writer(STEP_FRAME_TAG)
+{
+    for (uint32_t i = 0; i < STEP_CAPTURE_RING_SIZE; i++)
+    {
+        this->slots[i].position.store(0, std::memory_order_relaxed);
+    }
+}
+
+void StepCapture::begin()
+{
+    pcnt_config_t config = {};
+
+    config.unit = STEP_LOOPBACK_COUNTER_ID;
+    config.channel = PCNT_CHANNEL_0;
+    config.pulse_gpio_num = STEP_LOOPBACK_PIN;
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+
+    // One count per step: the RMT item starts high, so count rising edges only.
+    // Direction is known from the request, so the count never goes down.
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DIS;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.counter_h_lim = INT16_MAX;
+    config.counter_l_lim = INT16_MIN;
+
+    pcnt_unit_config(&config);
+    pcnt_counter_clear(STEP_LOOPBACK_COUNTER_ID);
+    pcnt_counter_resume(STEP_LOOPBACK_COUNTER_ID);
+    this->lastLoopbackCount = 0;
+    this->loopbackPulses = 0;
+}
+
+/**
+ * @brief Extend the 16-bit counter to a running total. The counter resets to zero on reaching
+ * its high limit, and one motor tick emits far fewer pulses than that between reads.
+ */
+uint32_t StepCapture::readLoopback()
+{
+    int16_t count;
+    pcnt_get_counter_value(STEP_LOOPBACK_COUNTER_ID, &count);
+    int32_t delta = (int32_t)count - this->lastLoopbackCount;
+    if (delta < 0)
+    {
+        delta += INT16_MAX;
+    }
+    this->lastLoopbackCount = count;
+    this->loopbackPulses += delta;
+    return this->loopbackPulses;
+}
+
+/**
+ * @brief Overwrite the oldest slot.
+ */
+void StepCapture::record(int32_t steps, int32_t speedHz, uint16_t items, uint16_t halfPeriodUs)
+{
+    StepCaptureRecord record;
+    record.timestampUs = (uint32_t)esp_timer_get_time();
+    record.steps = steps;
+    record.speedHz = speedHz;
+    record.loopbackPulses = this->readLoopback();
+    record.items = items;
+    record.halfPeriodUs = halfPeriodUs;
+
+    uint32_t pos = this->head.load(std::memory_order_relaxed);
+    this->slots[pos & (STEP_CAPTURE_RING_SIZE - 1)].store(pos, record);
+    this->head.store(pos + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Send every record still in the ring, oldest first. Recording continues meanwhile.
+ */
+void StepCapture::dump()
+{
+    dumpRing<STEP_RECORDS_PER_FRAME>(this->slots, this->head.load(std::memory_order_acquire), this->writer);
+}
+
+#endif // STEP_CAPTURE_ENABLED
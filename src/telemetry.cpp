@@ -0,0 +1,56 @@
+#include "telemetry.h"
+#include <Arduino.h>
+#include <string.h>
+#include "crc16.h"
+
+size_t cobsEncode(const uint8_t *input, size_t length, uint8_t *output)
+{
+    size_t codeIndex = 0; // where the current block's length code goes
+    size_t out = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        if (input[i] != 0)
+        {
+            output[out++] = input[i];
+            code++;
+        }
+
+        if (input[i] == 0 || code == 0xFF)
+        {
+            output[codeIndex] = code;
+            codeIndex = out++;
+            code = 1;
+        }
+    }
+
+    output[codeIndex] = code;
+    return out;
+}
+
+void sendTaggedFrame(uint8_t *body, size_t length, uint8_t *frame)
+{
+    uint16_t crc = crc16Update(0xFFFF, body, length);
+    body[length] = crc & 0xFF;
+    body[length + 1] = crc >> 8;
+
+    size_t encoded = cobsEncode(body, length + 2, frame);
+    frame[encoded++] = 0x00;
+    Serial.write(frame, encoded);
+}
+
+size_t TelemetryEncoder::encode(TelemetryRecord &record)
+{
+    record.version = TELEMETRY_RECORD_VERSION;
+    record.sequence = this->sequence++;
+
+    memcpy(this->payload, &record, sizeof(record));
+    uint16_t crc = crc16Update(0xFFFF, this->payload, sizeof(record));
+    this->payload[sizeof(record)] = crc & 0xFF;
+    this->payload[sizeof(record) + 1] = crc >> 8;
+
+    size_t length = cobsEncode(this->payload, sizeof(this->payload), this->buffer);
+    this->buffer[length++] = 0x00;
+    return length;
+}
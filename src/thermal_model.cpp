@@ -0,0 +1,108 @@
+#include "thermal_model.h"
+#include <math.h>
+#include "deferred_log.h"
+
+#if THERMAL_MODEL_ENABLED
+
+#define COPPER_TEMPCO 0.00393f // per C above 25 C
+
+/**
+ * @brief Step one node exactly for a constant power over dt.
+ */
+static float settle(float temperature, float steadyC, float tauS, float dtS)
+{
+    return steadyC + (temperature - steadyC) * expf(-dtS / tauS);
+}
+
+/**
+ * @brief Linear derate from 1 at start to THERMAL_MIN_DERATE at limit, judged on the hotter of
+ * the present and predicted temperatures so a cooling node stays derated until it is cool.
+ */
+static float derateFor(float temperatureC, float predictedC, float startC, float limitC)
+{
+    float hottest = predictedC > temperatureC ? predictedC : temperatureC;
+    float k = clamp((hottest - startC) / (limitC - startC), 0.0f, 1.0f);
+    return lerp(1.0f, THERMAL_MIN_DERATE, k);
+}
+
+ThermalModel::ThermalModel()
+{
+    this->begin(THERMAL_AMBIENT_C);
+}
+
+void ThermalModel::begin(float ambientC)
+{
+    this->state.coilC = ambientC;
+    this->state.driverC = ambientC;
+    this->state.coilPredictedC = ambientC;
+    this->state.driverPredictedC = ambientC;
+    this->state.derate = 1.0f;
+    this->state.driverRthScale = 1.0f;
+    this->published.write(this->state);
+}
+
+float ThermalModel::update(float runCurrentA, float holdCurrentA, float duty, float ambientC, float dtS)
+{
+    duty = clamp(duty, 0.0f, 1.0f);
+    float currentSquared = duty * runCurrentA * runCurrentA + (1.0f - duty) * holdCurrentA * holdCurrentA;
+
+    float coilOhm = MOTOR_PHASE_RESISTANCE_OHM * (1.0f + COPPER_TEMPCO * (this->state.coilC - 25.0f));
+    this->state.coilW = currentSquared * coilOhm;
+    this->state.driverW = currentSquared * DRIVER_RDS_ON_OHM + DRIVER_QUIESCENT_W;
+
+    float coilSteadyC = ambientC + this->state.coilW * MOTOR_COIL_RTH_C_PER_W;
+    float driverRth = DRIVER_RTH_C_PER_W * this->state.driverRthScale;
+    float driverSteadyC = ambientC + this->state.driverW * driverRth;
+    float driverTauS = DRIVER_TAU_S * this->state.driverRthScale; // same heat capacity, higher resistance
+
+    this->state.coilC = settle(this->state.coilC, coilSteadyC, MOTOR_COIL_TAU_S, dtS);
+    this->state.driverC = settle(this->state.driverC, driverSteadyC, driverTauS, dtS);
+    this->state.coilPredictedC = settle(this->state.coilC, coilSteadyC, MOTOR_COIL_TAU_S, THERMAL_LOOKAHEAD_S);
+    this->state.driverPredictedC = settle(this->state.driverC, driverSteadyC, driverTauS, THERMAL_LOOKAHEAD_S);
+
+    float coilDerate = derateFor(this->state.coilC, this->state.coilPredictedC, MOTOR_COIL_DERATE_C, MOTOR_COIL_LIMIT_C);
+    float driverDerate = derateFor(this->state.driverC, this->state.driverPredictedC, DRIVER_DERATE_C, DRIVER_OTW_C);
+    this->state.derate = coilDerate < driverDerate ? coilDerate : driverDerate;
+
+    this->published.write(this->state);
+    return this->state.derate;
+}
+
+void ThermalModel::reportOverTemperature(bool warning, bool shutdown, float ambientC)
+{
+    if (warning == this->lastWarning && shutdown == this->lastShutdown)
+    {
+        return;
+    }
+
+    if (warning && !this->lastWarning)
+    {
+        this->state.warnings++;
+
+        // The junction is at the OTW threshold now. If the model is cooler, scale the driver's
+        // thermal resistance so the same power would have brought it there.
+        float modelRise = this->state.driverC - ambientC;
+        float actualRise = DRIVER_OTW_C - ambientC;
+        if (modelRise > 0.0f && actualRise > modelRise)
+        {
+            float scale = this->state.driverRthScale * actualRise / modelRise;
+            this->state.driverRthScale = scale < THERMAL_MAX_RTH_SCALE ? scale : THERMAL_MAX_RTH_SCALE;
+        }
+        DLOG("thermal: driver OTW with model at %.1f C, rth scale %.2f\n", this->state.driverC,
+             this->state.driverRthScale);
+        if (this->state.driverC < DRIVER_OTW_C)
+        {
+            this->state.driverC = DRIVER_OTW_C;
+        }
+    }
+    if (shutdown && !this->lastShutdown)
+    {
+        this->state.shutdowns++;
+        DLOG("thermal: driver OTSD with model at %.1f C\n", this->state.driverC);
+    }
+    this->lastWarning = warning;
+    this->lastShutdown = shutdown;
+    this->published.write(this->state);
+}
+
+#endif // THERMAL_MODEL_ENABLED
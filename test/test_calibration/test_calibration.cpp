@@ -0,0 +1,119 @@
+#include <unity.h>
+#include <Preferences.h>
+#include "calibration.h"
+#include "config.h"
+
+/**
+ * @file test_calibration.cpp
+ * @brief Orderings between calibration parameters, checked on APPLY and on load.
+ */
+
+static BajaCan can(CAN_TX_PIN, CAN_RX_PIN);
+static CanScheduler canTx(can, nullptr, 0, nullptr); // never started; responses stay queued
+
+static CalibrationValues defaultSet()
+{
+    CalibrationValues cal;
+    for (int i = 0; i < CAL_PARAM_COUNT; i++)
+    {
+        cal.values[i] = calParams[i].defaultValue;
+    }
+    return cal;
+}
+
+static void command(Calibration &calibration, CalCommand command)
+{
+    calibration.handleCommand((float)(command << 8));
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+    Preferences prefs;
+    prefs.begin(CAL_NVS_NAMESPACE, false);
+    prefs.clear();
+    prefs.end();
+}
+
+void test_defaults_are_consistent()
+{
+    TEST_ASSERT_EQUAL(CAL_PARAM_COUNT, calConflict(defaultSet()));
+}
+
+void test_each_ordering_is_checked()
+{
+    CalibrationValues cal = defaultSet();
+    cal.values[CAL_ENGINE_MAX_RPM] = cal[CAL_ENGINE_ENGAGE_RPM];
+    TEST_ASSERT_EQUAL(CAL_ENGINE_ENGAGE_RPM, calConflict(cal));
+
+    cal = defaultSet();
+    cal.values[CAL_ENGINE_IDEAL_RPM_POWER] = cal[CAL_ENGINE_ENGAGE_RPM] - 1.0f;
+    TEST_ASSERT_EQUAL(CAL_ENGINE_ENGAGE_RPM, calConflict(cal));
+
+    cal = defaultSet();
+    cal.values[CAL_IDLE_MOTOR_SETPOINT] = cal[CAL_LOW_MAX_SETPOINT] + 1.0f;
+    TEST_ASSERT_EQUAL(CAL_IDLE_MOTOR_SETPOINT, calConflict(cal));
+
+    cal = defaultSet();
+    cal.values[CAL_MAX_MOTOR_SETPOINT] = cal[CAL_LOW_MAX_SETPOINT] - 1.0f;
+    TEST_ASSERT_EQUAL(CAL_LOW_MAX_SETPOINT, calConflict(cal));
+
+    cal = defaultSet();
+    cal.values[CAL_MAX_MOTOR_SETPOINT_BRAKE_MODE] = cal[CAL_LOW_MAX_SETPOINT] - 1.0f;
+    TEST_ASSERT_EQUAL(CAL_LOW_MAX_SETPOINT, calConflict(cal));
+
+    // Equal setpoint bounds are a valid, if narrow, clamp.
+    cal = defaultSet();
+    cal.values[CAL_IDLE_MOTOR_SETPOINT] = cal[CAL_LOW_MAX_SETPOINT];
+    TEST_ASSERT_EQUAL(CAL_PARAM_COUNT, calConflict(cal));
+}
+
+void test_apply_rejects_a_conflicting_set_and_keeps_it_staged()
+{
+    Calibration calibration(canTx);
+    calibration.begin();
+    uint32_t sequence = calibration.sequence();
+
+    // Each value is in its own range, but max rpm now equals engagement.
+    calibration.handleWrite(CAL_ENGINE_MAX_RPM, ENGINE_ENGAGE_RPM);
+    command(calibration, CAL_CMD_APPLY);
+    TEST_ASSERT_EQUAL(sequence, calibration.sequence());
+    TEST_ASSERT_EQUAL_FLOAT(ENGINE_MAX_RPM, calibration.read()[CAL_ENGINE_MAX_RPM]);
+
+    // Fixing the other side of the pair lets the same staged set apply.
+    calibration.handleWrite(CAL_ENGINE_ENGAGE_RPM, ENGINE_ENGAGE_RPM - 500);
+    command(calibration, CAL_CMD_APPLY);
+    TEST_ASSERT_EQUAL(sequence + 1, calibration.sequence());
+    TEST_ASSERT_EQUAL_FLOAT(ENGINE_ENGAGE_RPM, calibration.read()[CAL_ENGINE_MAX_RPM]);
+    TEST_ASSERT_EQUAL_FLOAT(ENGINE_ENGAGE_RPM - 500, calibration.read()[CAL_ENGINE_ENGAGE_RPM]);
+}
+
+void test_conflicting_stored_set_loads_defaults()
+{
+    CalibrationValues stored = defaultSet();
+    stored.values[CAL_IDLE_MOTOR_SETPOINT] = stored[CAL_LOW_MAX_SETPOINT] + 1000.0f;
+
+    Preferences prefs;
+    prefs.begin(CAL_NVS_NAMESPACE, false);
+    prefs.putBytes("values", stored.values, sizeof(stored.values));
+    prefs.putUShort("crc", calChecksum(stored));
+    prefs.putUChar("count", CAL_PARAM_COUNT);
+    prefs.end();
+
+    Calibration calibration(canTx);
+    calibration.begin();
+    TEST_ASSERT_EQUAL_FLOAT(IDLE_MOTOR_SETPOINT, calibration.read()[CAL_IDLE_MOTOR_SETPOINT]);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_defaults_are_consistent);
+    RUN_TEST(test_each_ordering_is_checked);
+    RUN_TEST(test_apply_rejects_a_conflicting_set_and_keeps_it_staged);
+    RUN_TEST(test_conflicting_stored_set_loads_defaults);
+    return UNITY_END();
+}
@@ -0,0 +1,66 @@
+#include <unity.h>
+#include "motor.h"
+#include "config.h"
+
+/**
+ * @file test_decay_band.cpp
+ * @brief Band thresholds and hysteresis of Motor::decayBandFor.
+ */
+
+static const int TORQUE_EXIT_HZ = (int)(DECAY_TORQUE_MIN_HZ * (1.0f - DECAY_HYSTERESIS));
+static const int QUIET_ENTRY_HZ = (int)(DECAY_QUIET_MAX_HZ * (1.0f - DECAY_HYSTERESIS));
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_thresholds_from_quiet()
+{
+    TEST_ASSERT_EQUAL(DECAY_BAND_QUIET, Motor::decayBandFor(DECAY_BAND_QUIET, 0));
+    TEST_ASSERT_EQUAL(DECAY_BAND_QUIET, Motor::decayBandFor(DECAY_BAND_QUIET, DECAY_QUIET_MAX_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_CRUISE, Motor::decayBandFor(DECAY_BAND_QUIET, DECAY_QUIET_MAX_HZ + 1));
+    TEST_ASSERT_EQUAL(DECAY_BAND_CRUISE, Motor::decayBandFor(DECAY_BAND_QUIET, DECAY_TORQUE_MIN_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_TORQUE, Motor::decayBandFor(DECAY_BAND_QUIET, DECAY_TORQUE_MIN_HZ + 1));
+}
+
+void test_torque_holds_down_to_hysteresis()
+{
+    TEST_ASSERT_EQUAL(DECAY_BAND_TORQUE, Motor::decayBandFor(DECAY_BAND_TORQUE, DECAY_TORQUE_MIN_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_TORQUE, Motor::decayBandFor(DECAY_BAND_TORQUE, TORQUE_EXIT_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_CRUISE, Motor::decayBandFor(DECAY_BAND_TORQUE, TORQUE_EXIT_HZ - 1));
+    TEST_ASSERT_EQUAL(DECAY_BAND_CRUISE, Motor::decayBandFor(DECAY_BAND_CRUISE, TORQUE_EXIT_HZ));
+}
+
+void test_cruise_holds_down_to_hysteresis()
+{
+    TEST_ASSERT_EQUAL(DECAY_BAND_CRUISE, Motor::decayBandFor(DECAY_BAND_CRUISE, DECAY_QUIET_MAX_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_CRUISE, Motor::decayBandFor(DECAY_BAND_CRUISE, QUIET_ENTRY_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_QUIET, Motor::decayBandFor(DECAY_BAND_CRUISE, QUIET_ENTRY_HZ - 1));
+    TEST_ASSERT_EQUAL(DECAY_BAND_QUIET, Motor::decayBandFor(DECAY_BAND_QUIET, QUIET_ENTRY_HZ));
+
+    // A drop straight from torque to a trim lands in quiet.
+    TEST_ASSERT_EQUAL(DECAY_BAND_CRUISE, Motor::decayBandFor(DECAY_BAND_TORQUE, QUIET_ENTRY_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_QUIET, Motor::decayBandFor(DECAY_BAND_TORQUE, 0));
+}
+
+void test_direction_is_ignored()
+{
+    TEST_ASSERT_EQUAL(DECAY_BAND_TORQUE, Motor::decayBandFor(DECAY_BAND_QUIET, -(DECAY_TORQUE_MIN_HZ + 1)));
+    TEST_ASSERT_EQUAL(DECAY_BAND_TORQUE, Motor::decayBandFor(DECAY_BAND_TORQUE, -TORQUE_EXIT_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_CRUISE, Motor::decayBandFor(DECAY_BAND_CRUISE, -QUIET_ENTRY_HZ));
+    TEST_ASSERT_EQUAL(DECAY_BAND_QUIET, Motor::decayBandFor(DECAY_BAND_CRUISE, -(QUIET_ENTRY_HZ - 1)));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_thresholds_from_quiet);
+    RUN_TEST(test_torque_holds_down_to_hysteresis);
+    RUN_TEST(test_cruise_holds_down_to_hysteresis);
+    RUN_TEST(test_direction_is_ignored);
+    return UNITY_END();
+}
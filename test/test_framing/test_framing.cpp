@@ -0,0 +1,214 @@
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include "crc16.h"
+#include "telemetry.h"
+#include "sim.h"
+
+/**
+ * @file test_framing.cpp
+ * @brief COBS framing, CRC, and the tagged-frame writers shared by the dumps and the decoders in tools/.
+ */
+
+static const uint8_t TEST_FRAME_TAG = 0x80;
+
+static std::vector<uint8_t> serialBytes;
+
+static void captureSerial(const uint8_t *data, size_t length, void *)
+{
+    serialBytes.insert(serialBytes.end(), data, data + length);
+}
+
+/**
+ * @brief Reference COBS decoder, as tools/telemetry_decode.py does it.
+ */
+static std::vector<uint8_t> cobsDecode(const uint8_t *data, size_t length)
+{
+    std::vector<uint8_t> out;
+    size_t i = 0;
+    while (i < length)
+    {
+        uint8_t code = data[i++];
+        for (uint8_t k = 1; k < code && i < length; k++)
+        {
+            out.push_back(data[i++]);
+        }
+        if (code != 0xFF && i < length)
+        {
+            out.push_back(0);
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief Split the captured serial bytes into frame bodies with their CRCs stripped.
+ * @return False if a frame is too short or fails its CRC, or bytes follow the last delimiter.
+ */
+static bool splitFrames(const std::vector<uint8_t> &bytes, std::vector<std::vector<uint8_t>> &frames)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < bytes.size(); i++)
+    {
+        if (bytes[i] != 0)
+        {
+            continue;
+        }
+        std::vector<uint8_t> body = cobsDecode(&bytes[start], i - start);
+        start = i + 1;
+        if (body.size() < 3)
+        {
+            return false;
+        }
+        uint16_t crc = body[body.size() - 2] | (body[body.size() - 1] << 8);
+        body.resize(body.size() - 2);
+        if (crc16Update(0xFFFF, body.data(), body.size()) != crc)
+        {
+            return false;
+        }
+        frames.push_back(body);
+    }
+    return start == bytes.size();
+}
+
+void setUp()
+{
+    serialBytes.clear();
+    sim::setSerialListener(captureSerial, nullptr);
+}
+
+void tearDown()
+{
+    sim::setSerialListener(nullptr, nullptr);
+}
+
+void test_crc16_check_value()
+{
+    const char *check = "123456789";
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, crc16Update(0xFFFF, reinterpret_cast<const uint8_t *>(check), 9));
+}
+
+void test_cobs_known_vectors()
+{
+    uint8_t out[16];
+
+    const uint8_t zero[] = {0x00};
+    const uint8_t zeroEncoded[] = {0x01, 0x01};
+    TEST_ASSERT_EQUAL(sizeof(zeroEncoded), cobsEncode(zero, sizeof(zero), out));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(zeroEncoded, out, sizeof(zeroEncoded));
+
+    const uint8_t mixed[] = {0x11, 0x22, 0x00, 0x33};
+    const uint8_t mixedEncoded[] = {0x03, 0x11, 0x22, 0x02, 0x33};
+    TEST_ASSERT_EQUAL(sizeof(mixedEncoded), cobsEncode(mixed, sizeof(mixed), out));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(mixedEncoded, out, sizeof(mixedEncoded));
+}
+
+void test_cobs_long_runs_round_trip()
+{
+    // Runs of 253 to 256 non-zero bytes cross the 254-byte block limit.
+    for (size_t run = 253; run <= 256; run++)
+    {
+        std::vector<uint8_t> input(run + 3, 0x5A);
+        input[run] = 0x00;
+        uint8_t out[COBS_MAX_ENCODED(260)];
+        size_t length = cobsEncode(input.data(), input.size(), out);
+
+        TEST_ASSERT_LESS_OR_EQUAL(COBS_MAX_ENCODED(input.size()), length);
+        TEST_ASSERT_TRUE(memchr(out, 0, length) == nullptr);
+        std::vector<uint8_t> decoded = cobsDecode(out, length);
+        TEST_ASSERT_TRUE(decoded == input);
+    }
+}
+
+void test_tagged_frame_carries_payload_and_crc()
+{
+    TaggedFrameWriter<6> writer(TEST_FRAME_TAG);
+    const uint8_t payload[] = {0x00, 0x01, 0x00, 0xFF, 0x00, 0x80};
+    memcpy(writer.payload(), payload, sizeof(payload));
+    writer.send(sizeof(payload));
+    writer.send(0);
+
+    std::vector<std::vector<uint8_t>> frames;
+    TEST_ASSERT_TRUE(splitFrames(serialBytes, frames));
+    TEST_ASSERT_EQUAL(2, frames.size());
+    TEST_ASSERT_EQUAL(1 + sizeof(payload), frames[0].size());
+    TEST_ASSERT_EQUAL_HEX8(TEST_FRAME_TAG, frames[0][0]);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(payload, &frames[0][1], sizeof(payload));
+    TEST_ASSERT_EQUAL(1, frames[1].size()); // end frame: the tag alone
+}
+
+void test_telemetry_encoder_numbers_records()
+{
+    TelemetryEncoder encoder;
+    TelemetryRecord record = {};
+    record.engineRpm = 3100.0f;
+
+    std::vector<uint8_t> bytes;
+    for (int i = 0; i < 2; i++)
+    {
+        size_t length = encoder.encode(record);
+        bytes.insert(bytes.end(), encoder.frame(), encoder.frame() + length);
+    }
+
+    std::vector<std::vector<uint8_t>> frames;
+    TEST_ASSERT_TRUE(splitFrames(bytes, frames));
+    TEST_ASSERT_EQUAL(2, frames.size());
+    for (int i = 0; i < 2; i++)
+    {
+        TelemetryRecord decoded;
+        TEST_ASSERT_EQUAL(sizeof(decoded), frames[i].size());
+        memcpy(&decoded, frames[i].data(), sizeof(decoded));
+        TEST_ASSERT_EQUAL(TELEMETRY_RECORD_VERSION, decoded.version);
+        TEST_ASSERT_EQUAL(i, decoded.sequence);
+        TEST_ASSERT_EQUAL_FLOAT(3100.0f, decoded.engineRpm);
+    }
+}
+
+void test_ring_dump_sends_newest_ring_oldest_first()
+{
+    RingSlot<uint32_t> slots[8];
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        slots[i].position.store(0);
+    }
+    for (uint32_t pos = 0; pos < 11; pos++)
+    {
+        slots[pos & 7].store(pos, 100 + pos);
+    }
+    slots[5].position.store(0); // position 5 is being rewritten and must be skipped
+
+    TaggedFrameWriter<3 * sizeof(uint32_t)> writer(TRACE_FRAME_TAG);
+    dumpRing<3>(slots, 11, writer);
+
+    std::vector<std::vector<uint8_t>> frames;
+    TEST_ASSERT_TRUE(splitFrames(serialBytes, frames));
+    std::vector<uint32_t> values;
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+        TEST_ASSERT_EQUAL_HEX8(TRACE_FRAME_TAG, frames[f][0]);
+        TEST_ASSERT_LESS_OR_EQUAL(1 + 3 * sizeof(uint32_t), frames[f].size());
+        for (size_t at = 1; at + sizeof(uint32_t) <= frames[f].size(); at += sizeof(uint32_t))
+        {
+            uint32_t value;
+            memcpy(&value, &frames[f][at], sizeof(value));
+            values.push_back(value);
+        }
+    }
+
+    const uint32_t expected[] = {103, 104, 106, 107, 108, 109, 110};
+    TEST_ASSERT_EQUAL(sizeof(expected) / sizeof(expected[0]), values.size());
+    TEST_ASSERT_EQUAL_MEMORY(expected, values.data(), sizeof(expected));
+    TEST_ASSERT_EQUAL(1, frames.back().size());
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_crc16_check_value);
+    RUN_TEST(test_cobs_known_vectors);
+    RUN_TEST(test_cobs_long_runs_round_trip);
+    RUN_TEST(test_tagged_frame_carries_payload_and_crc);
+    RUN_TEST(test_telemetry_encoder_numbers_records);
+    RUN_TEST(test_ring_dump_sends_newest_ring_oldest_first);
+    return UNITY_END();
+}
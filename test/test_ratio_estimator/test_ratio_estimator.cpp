@@ -0,0 +1,143 @@
+#include <unity.h>
+#include <math.h>
+#include "ratio_estimator.h"
+
+/**
+ * @file test_ratio_estimator.cpp
+ * @brief Prior and its calibrated shape, convergence, innovation gate, and inversion of the ratio fit.
+ */
+
+static const int MID = (LOW_MAX_SETPOINT + MAX_MOTOR_SETPOINT) / 2;
+
+/**
+ * @brief A belt whose ratio is 0.5 above the prior everywhere.
+ */
+static float worn(const RatioEstimator &prior, int position)
+{
+    return prior.ratioAt(position) + 0.5f;
+}
+
+/**
+ * @brief Feed samples swept across the whole sheave travel.
+ */
+static void sweep(RatioEstimator &estimator, const RatioEstimator &prior, int samples)
+{
+    for (int i = 0; i < samples; i++)
+    {
+        int position = (int)((int64_t)MAX_MOTOR_SETPOINT * (i % 101) / 100);
+        estimator.update(worn(prior, position), position);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_prior_spans_low_to_high_gear()
+{
+    RatioEstimator estimator;
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, LOW_GEAR, estimator.ratioAt(0));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, LOW_GEAR, estimator.ratioAt(RatioEstimator::knotPosition(1)));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, HIGH_GEAR, estimator.ratioAt(MAX_MOTOR_SETPOINT));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, RATIO_INITIAL_VARIANCE, estimator.varianceAt(MID));
+    TEST_ASSERT_EQUAL(0, estimator.read().samples);
+}
+
+void test_fit_converges_and_variance_falls()
+{
+    RatioEstimator prior;
+    RatioEstimator estimator;
+    sweep(estimator, prior, 2000);
+
+    for (int knot = 0; knot < RATIO_KNOT_COUNT; knot++)
+    {
+        int position = RatioEstimator::knotPosition(knot);
+        TEST_ASSERT_FLOAT_WITHIN(0.02f, worn(prior, position), estimator.ratioAt(position));
+        TEST_ASSERT_LESS_THAN(RATIO_MEASUREMENT_VARIANCE, estimator.varianceAt(position));
+    }
+    TEST_ASSERT_EQUAL(2000, estimator.read().samples);
+}
+
+void test_gate_is_wide_on_untrained_knots()
+{
+    // A whole ratio off the prior is still within its uncertainty.
+    RatioEstimator estimator;
+    TEST_ASSERT_TRUE(estimator.update(estimator.ratioAt(MID) + 1.0f, MID));
+}
+
+void test_gate_tightens_as_knots_learn()
+{
+    RatioEstimator prior;
+    RatioEstimator estimator;
+    sweep(estimator, prior, 2000);
+
+    float fitted = estimator.ratioAt(MID);
+    float sd = sqrtf(estimator.varianceAt(MID) + RATIO_MEASUREMENT_VARIANCE);
+    TEST_ASSERT_FALSE(estimator.update(fitted + 0.5f, MID));
+    TEST_ASSERT_FALSE(estimator.update(fitted + (RATIO_GATE_SIGMAS + 1.0f) * sd, MID));
+    TEST_ASSERT_TRUE(estimator.update(fitted + 0.5f * sd, MID));
+}
+
+void test_out_of_range_samples_are_rejected()
+{
+    RatioEstimator estimator;
+    TEST_ASSERT_FALSE(estimator.update(2.0f, -1));
+    TEST_ASSERT_FALSE(estimator.update(2.0f, MAX_MOTOR_SETPOINT + 1));
+    TEST_ASSERT_FALSE(estimator.update(0.0f, MID));
+    TEST_ASSERT_FALSE(estimator.update(NAN, MID));
+    TEST_ASSERT_EQUAL(0, estimator.read().samples);
+}
+
+void test_setpoint_for_ratio_inverts_the_fit()
+{
+    RatioEstimator estimator;
+    float ratio = estimator.ratioAt(MID);
+    TEST_ASSERT_INT_WITHIN(10, MID, estimator.setpointForRatio(ratio));
+    TEST_ASSERT_EQUAL(0, estimator.setpointForRatio(LOW_GEAR + 1.0f));
+    TEST_ASSERT_EQUAL(MAX_MOTOR_SETPOINT, estimator.setpointForRatio(HIGH_GEAR - 0.1f));
+    // Flat at LOW_GEAR up to LOW_MAX_SETPOINT: the most clamped position of the flat wins.
+    TEST_ASSERT_INT_WITHIN(RatioEstimator::knotPosition(1), LOW_MAX_SETPOINT, estimator.setpointForRatio(LOW_GEAR));
+}
+
+void test_reset_returns_to_the_prior()
+{
+    RatioEstimator prior;
+    RatioEstimator estimator;
+    sweep(estimator, prior, 500);
+    estimator.reset();
+    estimator.requestSave();
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, prior.ratioAt(MID), estimator.ratioAt(MID));
+    TEST_ASSERT_EQUAL(0, estimator.read().samples);
+}
+
+void test_prior_follows_the_calibrated_setpoints()
+{
+    RatioEstimator estimator;
+    estimator.setPrior(RatioEstimator::knotPosition(3), RatioEstimator::knotPosition(7));
+    estimator.reset();
+    estimator.requestSave();
+
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, LOW_GEAR, estimator.ratioAt(RatioEstimator::knotPosition(3)));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, (LOW_GEAR + HIGH_GEAR) / 2, estimator.ratioAt(RatioEstimator::knotPosition(5)));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, HIGH_GEAR, estimator.ratioAt(RatioEstimator::knotPosition(7)));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, HIGH_GEAR, estimator.ratioAt(MAX_MOTOR_SETPOINT));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_prior_spans_low_to_high_gear);
+    RUN_TEST(test_fit_converges_and_variance_falls);
+    RUN_TEST(test_gate_is_wide_on_untrained_knots);
+    RUN_TEST(test_gate_tightens_as_knots_learn);
+    RUN_TEST(test_out_of_range_samples_are_rejected);
+    RUN_TEST(test_setpoint_for_ratio_inverts_the_fit);
+    RUN_TEST(test_reset_returns_to_the_prior);
+    RUN_TEST(test_prior_follows_the_calibrated_setpoints);
+    return UNITY_END();
+}
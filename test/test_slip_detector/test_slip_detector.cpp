@@ -0,0 +1,121 @@
+#include <unity.h>
+#include "slip_detector.h"
+
+/**
+ * @file test_slip_detector.cpp
+ * @brief Enter and exit hysteresis, event statistics, and the SLIP_RESPONSE policy.
+ */
+
+static const float EXPECTED = 2.0f;
+static const float SECONDARY = 1000.0f;
+static const int POSITION = 15000;
+static const uint32_t SAMPLE_MS = 20; // RPM_SAMPLE_PERIOD_MS
+
+/**
+ * @brief Feed samples at a slip fraction every SAMPLE_MS from startMs up to endMs.
+ * @return Time of the next sample.
+ */
+static uint32_t feed(SlipDetector &detector, float slip, uint32_t startMs, uint32_t endMs)
+{
+    uint32_t nowMs = startMs;
+    for (; nowMs < endMs; nowMs += SAMPLE_MS)
+    {
+        detector.update(EXPECTED * (1.0f + slip), EXPECTED, SECONDARY, POSITION, nowMs);
+    }
+    return nowMs;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_brief_slip_is_suspect_but_not_an_event()
+{
+    SlipDetector detector;
+    feed(detector, 0.0f, 0, 100);
+    TEST_ASSERT_FALSE(detector.isSuspect());
+
+    uint32_t nowMs = feed(detector, 0.2f, 100, 100 + SLIP_ENTER_MS);
+    TEST_ASSERT_TRUE(detector.isSuspect());
+    TEST_ASSERT_FALSE(detector.isSlipping());
+
+    feed(detector, 0.0f, nowMs, nowMs + SAMPLE_MS);
+    TEST_ASSERT_FALSE(detector.isSuspect());
+    TEST_ASSERT_EQUAL(0, detector.getStats().events);
+}
+
+void test_event_opens_after_enter_time_and_closes_after_exit_time()
+{
+    SlipDetector detector;
+    uint32_t nowMs = feed(detector, 0.2f, 1000, 1000 + SLIP_ENTER_MS + SAMPLE_MS);
+    TEST_ASSERT_TRUE(detector.isSlipping());
+
+    // Between the exit and enter fractions the event stays open.
+    nowMs = feed(detector, 0.06f, nowMs, nowMs + 2 * SLIP_EXIT_MS);
+    TEST_ASSERT_TRUE(detector.isSlipping());
+
+    uint32_t recoverMs = nowMs;
+    nowMs = feed(detector, 0.0f, nowMs, nowMs + SLIP_EXIT_MS);
+    TEST_ASSERT_TRUE(detector.isSlipping());
+    feed(detector, 0.0f, nowMs, nowMs + SAMPLE_MS);
+    TEST_ASSERT_FALSE(detector.isSlipping());
+    TEST_ASSERT_FALSE(detector.isSuspect());
+
+    SlipStats stats = detector.getStats();
+    TEST_ASSERT_EQUAL(1, stats.events);
+    TEST_ASSERT_EQUAL(1000, stats.last.startMs);
+    TEST_ASSERT_EQUAL(recoverMs - 1000, stats.last.durationMs);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.2f, stats.last.peakSlip);
+    TEST_ASSERT_EQUAL(POSITION, stats.last.startPosition);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, EXPECTED, stats.last.expectedRatio);
+}
+
+void test_idle_ends_an_open_event()
+{
+    SlipDetector detector;
+    uint32_t nowMs = feed(detector, 0.2f, 0, SLIP_ENTER_MS + SAMPLE_MS);
+    TEST_ASSERT_TRUE(detector.isSlipping());
+
+    detector.idle(nowMs);
+    TEST_ASSERT_FALSE(detector.isSlipping());
+    TEST_ASSERT_EQUAL(1, detector.getStats().events);
+    TEST_ASSERT_EQUAL(nowMs, detector.getStats().last.durationMs);
+}
+
+void test_response_only_acts_while_slipping()
+{
+    SlipDetector detector;
+    TEST_ASSERT_EQUAL(1000, detector.respond(1000, POSITION, 0, MAX_MOTOR_SETPOINT));
+
+    feed(detector, 0.2f, 0, SLIP_ENTER_MS + SAMPLE_MS);
+    TEST_ASSERT_TRUE(detector.isSlipping());
+    uint32_t confirmMs = SLIP_ENTER_MS; // the sample that waited out SLIP_ENTER_MS
+    int32_t setpoint = detector.respond(1000, POSITION, confirmMs + 1000, MAX_MOTOR_SETPOINT);
+
+#if SLIP_RESPONSE == SLIP_RESPONSE_CLAMP
+    // The floor rises at SLIP_CLAMP_RATE from the start position up to SLIP_CLAMP_MAX_STEPS above it,
+    // never past maxSetpoint, and never lowers what the controller asked for.
+    TEST_ASSERT_EQUAL(POSITION + SLIP_CLAMP_MAX_STEPS, setpoint);
+    TEST_ASSERT_EQUAL(POSITION + SLIP_CLAMP_RATE / 20, detector.respond(1000, POSITION, confirmMs + 50, MAX_MOTOR_SETPOINT));
+    TEST_ASSERT_EQUAL(POSITION + 100, detector.respond(1000, POSITION, confirmMs + 1000, POSITION + 100));
+    TEST_ASSERT_EQUAL(MAX_MOTOR_SETPOINT, detector.respond(MAX_MOTOR_SETPOINT, POSITION, confirmMs + 1000, MAX_MOTOR_SETPOINT));
+#elif SLIP_RESPONSE == SLIP_RESPONSE_HOLD
+    TEST_ASSERT_EQUAL(POSITION - SLIP_HOLD_STEPS, setpoint);
+#else
+    TEST_ASSERT_EQUAL(1000, setpoint);
+#endif
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_brief_slip_is_suspect_but_not_an_event);
+    RUN_TEST(test_event_opens_after_enter_time_and_closes_after_exit_time);
+    RUN_TEST(test_idle_ends_an_open_event);
+    RUN_TEST(test_response_only_acts_while_slipping);
+    return UNITY_END();
+}
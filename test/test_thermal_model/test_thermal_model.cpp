@@ -0,0 +1,113 @@
+#include <unity.h>
+#include "thermal_model.h"
+
+/**
+ * @file test_thermal_model.cpp
+ * @brief Node settling, look-ahead derating, and OTW learning of the thermal model.
+ */
+
+static const float AMBIENT = 40.0f;
+static const float DT = 0.1f;
+
+/**
+ * @brief Run the model at constant currents for a number of seconds.
+ */
+static float run(ThermalModel &model, float runA, float holdA, float duty, float seconds)
+{
+    float derate = 1.0f;
+    for (float t = 0.0f; t < seconds; t += DT)
+    {
+        derate = model.update(runA, holdA, duty, AMBIENT, DT);
+    }
+    return derate;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_hold_current_stays_cool()
+{
+    ThermalModel model;
+    model.begin(AMBIENT);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, run(model, 4.0f, 1.0f, 0.0f, 3600.0f));
+
+    ThermalState state = model.read();
+    TEST_ASSERT_LESS_THAN(MOTOR_COIL_DERATE_C, state.coilC);
+    TEST_ASSERT_LESS_THAN(DRIVER_DERATE_C, state.driverC);
+}
+
+void test_nodes_settle_at_ambient_plus_power_times_rth()
+{
+    ThermalModel model;
+    model.begin(AMBIENT);
+    run(model, 2.0f, 2.0f, 0.5f, 10.0f * MOTOR_COIL_TAU_S);
+
+    ThermalState state = model.read();
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, AMBIENT + state.coilW * MOTOR_COIL_RTH_C_PER_W, state.coilC);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, AMBIENT + state.driverW * DRIVER_RTH_C_PER_W, state.driverC);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, state.coilC, state.coilPredictedC);
+}
+
+void test_lookahead_derates_before_the_limit_is_reached()
+{
+    ThermalModel model;
+    model.begin(AMBIENT);
+    float derate = run(model, MOTOR_FULL_SCALE_CURRENT_A, MOTOR_FULL_SCALE_CURRENT_A, 1.0f, 10.0f);
+
+    // Full current drives the driver towards a steady state far past OTW, so the look-ahead
+    // crosses the derate threshold while the junction itself is still below it.
+    ThermalState state = model.read();
+    TEST_ASSERT_LESS_THAN(DRIVER_DERATE_C, state.driverC);
+    TEST_ASSERT_GREATER_THAN(state.driverC, state.driverPredictedC);
+    TEST_ASSERT_LESS_THAN(1.0f, derate);
+}
+
+void test_derate_bottoms_out_when_hot()
+{
+    ThermalModel model;
+    model.begin(AMBIENT);
+    float derate = run(model, MOTOR_FULL_SCALE_CURRENT_A, MOTOR_FULL_SCALE_CURRENT_A, 1.0f, 600.0f);
+    TEST_ASSERT_EQUAL_FLOAT(THERMAL_MIN_DERATE, derate);
+    TEST_ASSERT_GREATER_THAN(DRIVER_OTW_C, model.read().driverC);
+}
+
+void test_otw_raises_driver_rth_once_per_edge()
+{
+    ThermalModel model;
+    model.begin(AMBIENT);
+    run(model, 3.0f, 3.0f, 1.0f, 10.0f * DRIVER_TAU_S);
+    float modelC = model.read().driverC;
+    TEST_ASSERT_LESS_THAN(DRIVER_OTW_C, modelC);
+
+    model.reportOverTemperature(true, false, AMBIENT);
+    ThermalState state = model.read();
+    float expected = (DRIVER_OTW_C - AMBIENT) / (modelC - AMBIENT);
+    expected = expected < THERMAL_MAX_RTH_SCALE ? expected : THERMAL_MAX_RTH_SCALE;
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, expected, state.driverRthScale);
+    TEST_ASSERT_EQUAL_FLOAT(DRIVER_OTW_C, state.driverC);
+    TEST_ASSERT_EQUAL(1, state.warnings);
+
+    // A held flag is not a new warning.
+    model.reportOverTemperature(true, false, AMBIENT);
+    TEST_ASSERT_EQUAL(1, model.read().warnings);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, expected, model.read().driverRthScale);
+
+    model.reportOverTemperature(true, true, AMBIENT);
+    TEST_ASSERT_EQUAL(1, model.read().shutdowns);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_hold_current_stays_cool);
+    RUN_TEST(test_nodes_settle_at_ambient_plus_power_times_rth);
+    RUN_TEST(test_lookahead_derates_before_the_limit_is_reached);
+    RUN_TEST(test_derate_bottoms_out_when_hot);
+    RUN_TEST(test_otw_raises_driver_rth_once_per_edge);
+    return UNITY_END();
+}
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Compare two runs of the native microbenchmarks and flag regressions.
+
+Both files come from the native_bench build (`pio run -e native_bench`) run with JSON
+output, typically one from the base commit and one from the change:
+
+    .pio/build/native_bench/program --benchmark_repetitions=10 \\
+        --benchmark_out=base.json --benchmark_out_format=json
+    python3 tools/bench_compare.py base.json new.json --threshold 5
+
+With repetitions the median aggregate is compared, otherwise the fastest run of each
+benchmark. Exits 1 if any benchmark got slower by more than the threshold, 2 if the
+files cannot be compared. Timings only mean something between runs on the same host.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Map benchmark name to CPU time in ns, preferring the median over repetitions."""
+    with open(path) as f:
+        data = json.load(f)
+    units = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+    fastest = {}
+    medians = {}
+    for entry in data.get("benchmarks", []):
+        if entry.get("error_occurred"):
+            continue
+        name = entry.get("run_name", entry["name"])
+        time = entry["cpu_time"] * units[entry.get("time_unit", "ns")]
+        if entry.get("run_type") == "aggregate":
+            if entry.get("aggregate_name") == "median":
+                medians[name] = time
+        elif name not in fastest or time < fastest[name]:
+            fastest[name] = time
+    fastest.update(medians)
+    return data.get("context", {}), fastest
+
+
+def format_ns(ns):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= scale:
+            return "%.3g %s" % (ns / scale, unit)
+    return "%.3g ns" % ns
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("base", help="JSON results from the baseline")
+    parser.add_argument("new", help="JSON results from the change")
+    parser.add_argument("--threshold", type=float, default=5.0,
+                        help="slowdown in percent that counts as a regression (default 5)")
+    parser.add_argument("--filter", default="", help="only compare benchmarks whose name contains this")
+    args = parser.parse_args(argv)
+
+    try:
+        base_context, base = load(args.base)
+        new_context, new = load(args.new)
+    except (OSError, ValueError, KeyError) as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 2
+    if base_context.get("host_name") != new_context.get("host_name"):
+        print("warning: results come from different hosts (%s, %s)"
+              % (base_context.get("host_name"), new_context.get("host_name")), file=sys.stderr)
+
+    names = [name for name in base if name in new and args.filter in name]
+    if not names:
+        print("ERROR: no benchmarks in common", file=sys.stderr)
+        return 2
+
+    regressions = 0
+    width = max(len(name) for name in names)
+    print("%-*s %12s %12s %9s" % (width, "benchmark", "base", "new", "change"))
+    for name in names:
+        if base[name] <= 0.0:
+            # On-target results can round to zero cycles once the timer overhead is subtracted.
+            print("%-*s %12s %12s %9s" % (width, name, format_ns(base[name]), format_ns(new[name]), "n/a"))
+            continue
+        change = (new[name] - base[name]) / base[name] * 100.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  REGRESSION"
+            regressions += 1
+        elif change < -args.threshold:
+            flag = "  faster"
+        print("%-*s %12s %12s %+8.1f%%%s" % (width, name, format_ns(base[name]), format_ns(new[name]), change, flag))
+    for name in sorted(set(base) ^ set(new)):
+        if args.filter in name:
+            print("%-*s only in %s" % (width, name, args.base if name in base else args.new))
+
+    if regressions:
+        print("%d of %d benchmarks regressed by more than %g%%" % (regressions, len(names), args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
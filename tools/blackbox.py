@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Download and decode the ECVT black-box flight recorder.
+
+The controller records every control tick into the "blackbox" flash partition
+(include/blackbox.h). "download" asks it to stream the partition over the serial
+port and saves the raw pages; "decode" turns a saved download into CSV, one row per
+sample, and lists the trigger events (driver faults, brake slams, manual marks).
+
+    python3 tools/blackbox.py download --port /dev/ttyUSB0 -o race.bbx
+    python3 tools/blackbox.py decode race.bbx -o race.csv
+    python3 tools/blackbox.py trigger --port /dev/ttyUSB0
+    python3 tools/blackbox.py info --port /dev/ttyUSB0
+
+Serial commands require pyserial.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+import time
+
+from telemetry_decode import CONTROL_MODES, FLAG_BITS, cobs_decode, crc16
+
+FRAME_TAG = 0x81
+MAGIC = 0x31584242
+VERSION = 1
+PAGE_SIZE = 1024  # BLACKBOX_PAGE_SIZE
+HEADER = struct.Struct("<IBBHIHHQH")  # magic, version, triggers, length, sequence, session, samples, start us, crc
+
+# Must match BlackboxField in include/blackbox.h, in order.
+FIELDS = ["engine_rpm", "motor_setpoint", "motor_position", "motor_velocity",
+          "brake_raw", "control_mode", "flags", "driver_fault"]
+TRIGGERS = [("fault", 0), ("brake_slam", 1), ("manual", 2), ("slip", 3)]
+COLUMNS = (["session", "sequence", "time_s"] + [f for f in FIELDS if f != "flags"]
+           + [name for name, _ in FLAG_BITS] + ["triggers"])
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def parse_page(page):
+    """Return (header dict, payload) or None if the page is blank, torn, or another version."""
+    if len(page) != PAGE_SIZE:
+        return None
+    magic, version, triggers, length, sequence, session, count, start_us, crc = HEADER.unpack_from(page)
+    if magic != MAGIC or version != VERSION or length > PAGE_SIZE - HEADER.size:
+        return None
+    payload = page[HEADER.size:HEADER.size + length]
+    if crc16(payload, crc16(page[:HEADER.size - 2])) != crc:
+        return None
+    return dict(triggers=triggers, sequence=sequence, session=session, count=count, start_us=start_us), payload
+
+
+def decode_samples(header, payload):
+    """Yield one dict per sample; each page starts from zero, so it decodes on its own."""
+    values = [0] * len(FIELDS)
+    time_us = header["start_us"]
+    pos = 0
+    for _ in range(header["count"]):
+        mask = payload[pos]
+        delta, pos = read_varint(payload, pos + 1)
+        time_us += delta
+        for i in range(len(FIELDS)):
+            if mask & (1 << i):
+                delta, pos = read_varint(payload, pos)
+                values[i] = (values[i] + unzigzag(delta) + 2 ** 31) % 2 ** 32 - 2 ** 31
+        yield time_us, dict(zip(FIELDS, values))
+
+
+def trigger_names(bits):
+    return "|".join(name for name, bit in TRIGGERS if bits & (1 << bit))
+
+
+def decode(pages, out, events=sys.stderr):
+    """Write every valid page, oldest first, as CSV rows. Returns (samples, valid pages, bad pages)."""
+    valid = []
+    bad = 0
+    for page in pages:
+        parsed = parse_page(page)
+        if parsed:
+            valid.append(parsed)
+        elif page.count(0xFF) != len(page):
+            bad += 1
+    valid.sort(key=lambda parsed: parsed[0]["sequence"])
+
+    writer = csv.DictWriter(out, fieldnames=COLUMNS)
+    writer.writeheader()
+    samples = 0
+    for header, payload in valid:
+        if header["triggers"] and events:
+            events.write("session %d t=%.3f s: %s\n" % (header["session"], header["start_us"] / 1e6,
+                                                       trigger_names(header["triggers"])))
+        for index, (time_us, values) in enumerate(decode_samples(header, payload)):
+            row = dict(session=header["session"], sequence=header["sequence"], time_s="%.6f" % (time_us / 1e6))
+            row.update((k, v) for k, v in values.items() if k != "flags")
+            for name, bit in FLAG_BITS:
+                row[name] = (values["flags"] >> bit) & 1
+            if 0 <= row["control_mode"] < len(CONTROL_MODES):
+                row["control_mode"] = CONTROL_MODES[row["control_mode"]]
+            row["triggers"] = trigger_names(header["triggers"]) if index == 0 else ""
+            writer.writerow(row)
+            samples += 1
+    return samples, len(valid), bad
+
+
+def read_pages(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    return [data[i:i + PAGE_SIZE] for i in range(0, len(data) - PAGE_SIZE + 1, PAGE_SIZE)]
+
+
+def download(port, output, timeout=5.0):
+    """Send "bbx dump" and save pages until the end frame. Telemetry frames in between are ignored."""
+    port.reset_input_buffer()
+    port.write(b"bbx dump\n")
+    buffer = bytearray()
+    pages = 0
+    last_data = time.monotonic()
+    while time.monotonic() - last_data < timeout:
+        data = port.read(4096)
+        if not data:
+            continue
+        last_data = time.monotonic()
+        buffer += data
+        while True:
+            end = buffer.find(0)
+            if end < 0:
+                break
+            frame = cobs_decode(bytes(buffer[:end]))
+            del buffer[:end + 1]
+            if not frame or len(frame) < 3 or frame[0] != FRAME_TAG:
+                continue
+            body, crc = frame[:-2], frame[-2] | (frame[-1] << 8)
+            if crc16(body) != crc:
+                sys.stderr.write("corrupt page frame skipped\n")
+                continue
+            if len(body) == 1:
+                return pages
+            output.write(body[1:])
+            pages += 1
+            if pages % 64 == 0:
+                sys.stderr.write("\r%d pages" % pages)
+    raise TimeoutError("no end-of-dump frame after %d pages" % pages)
+
+
+def command(args, line):
+    import serial
+
+    port = serial.Serial(args.port, args.baud, timeout=0.1)
+    port.write(line)
+    return port
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    for name in ("download", "trigger", "info"):
+        p = sub.add_parser(name)
+        p.add_argument("--port", required=True, help="controller serial port")
+        p.add_argument("--baud", type=int, default=921600, help="serial baud rate (TELEMETRY_BAUD)")
+        if name == "download":
+            p.add_argument("-o", "--output", required=True, help="file for the raw pages (.bbx)")
+    p = sub.add_parser("decode")
+    p.add_argument("input", help="raw pages saved by download")
+    p.add_argument("-o", "--output", help="CSV file (default: stdout)")
+    args = parser.parse_args(argv)
+
+    if args.command == "decode":
+        out = open(args.output, "w", newline="") if args.output else sys.stdout
+        samples, valid, bad = decode(read_pages(args.input), out)
+        if out is not sys.stdout:
+            out.close()
+        sys.stderr.write("%d samples from %d pages, %d corrupt pages\n" % (samples, valid, bad))
+    elif args.command == "download":
+        import serial
+
+        with serial.Serial(args.port, args.baud, timeout=0.1) as port, open(args.output, "wb") as out:
+            pages = download(port, out)
+        sys.stderr.write("\r%d pages saved to %s\n" % (pages, args.output))
+    elif args.command == "trigger":
+        command(args, b"bbx trigger\n").close()
+    else:
+        with command(args, b"bbx info\n") as port:
+            # The reply is a text line between binary telemetry frames.
+            buffer = b""
+            deadline = time.monotonic() + 1.0
+            while time.monotonic() < deadline:
+                buffer += port.read(4096)
+                start = buffer.find(b"blackbox:")
+                end = buffer.find(b"\n", start)
+                if start >= 0 and end >= 0:
+                    print(buffer[start:end].decode("ascii", errors="replace"))
+                    return 0
+        sys.stderr.write("no reply\n")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,295 @@
+#!/usr/bin/env python3
+"""Live calibration client for the ECVT controller.
+
+Talks the calibration protocol implemented in src/calibration.cpp over any
+python-can bus. Every frame carries one BajaCan float value:
+
+    CAL_COMMAND_ID          (command << 8) | param
+    CAL_WRITE_BASE_ID+param new value for param
+    CAL_RESPONSE_ID         (command << 20) | (status << 16) | payload
+    CAL_VALUE_BASE_ID+param value returned by READ
+
+The ``standin`` subcommand answers the protocol like the firmware does, so the
+client can be exercised on a virtual bus without hardware:
+
+    sudo ip link add dev vcan0 type vcan && sudo ip link set up vcan0
+    python3 tools/ecvt_cal.py standin &
+    python3 tools/ecvt_cal.py set rpm_kp 2.5 --apply
+    python3 tools/ecvt_cal.py commit
+
+Requires python-can (pip install python-can).
+"""
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+import can
+
+CAL_COMMAND_ID = 0x620
+CAL_RESPONSE_ID = 0x621
+CAL_WRITE_BASE_ID = 0x640
+CAL_VALUE_BASE_ID = 0x680
+
+CMD_READ, CMD_WRITE, CMD_APPLY, CMD_COMMIT, CMD_CHECKSUM, CMD_REVERT, CMD_DEFAULTS = range(1, 8)
+STATUS_NAMES = ["ok", "bad parameter", "out of range", "unknown command", "nvs write failed",
+                "conflicts with another parameter"]
+
+# Must match calParams in src/calibration.cpp, in order: (name, default, min, max).
+PARAMS = [
+    ("rpm_kp", 2.0, 0.0, 50.0),
+    ("rpm_kd", 0.0, 0.0, 50.0),
+    ("engine_engage_rpm", 2000, 1000, 4000),
+    ("engine_ideal_rpm_power", 3000, 1500, 4000),
+    ("engine_ideal_rpm_torque", 2500, 1500, 4000),
+    ("engine_max_rpm", 3600, 2000, 4500),
+    ("idle_motor_setpoint", 4000, 0, 31000),
+    ("low_max_setpoint", 20000, 0, 31000),
+    ("max_motor_setpoint", 31000, 0, 31000),
+    ("max_motor_setpoint_brake_mode", 25000, 0, 31000),
+    ("run_motor_current", 120, 0, 255),
+    ("hold_motor_current", 80, 0, 255),
+    ("max_acceleration_pos", 30000, 1000, 500000),
+    ("max_acceleration_neg", 120000, 1000, 500000),
+    ("ambient_temp_c", 40, -20, 80),
+]
+PARAM_INDEX = {p[0]: i for i, p in enumerate(PARAMS)}
+
+# Must match calOrderings in src/calibration.cpp: (lower, upper, strict).
+ORDERINGS = [
+    ("engine_engage_rpm", "engine_max_rpm", True),
+    ("engine_engage_rpm", "engine_ideal_rpm_power", True),
+    ("idle_motor_setpoint", "low_max_setpoint", False),
+    ("low_max_setpoint", "max_motor_setpoint", False),
+    ("low_max_setpoint", "max_motor_setpoint_brake_mode", False),
+]
+
+
+def conflict(values):
+    """Index of the lower parameter of the first violated ordering, or None."""
+    for lower, upper, strict in ORDERINGS:
+        a, b = values[PARAM_INDEX[lower]], values[PARAM_INDEX[upper]]
+        if not (a < b if strict else a <= b):
+            return PARAM_INDEX[lower]
+    return None
+
+
+def encode_value(value):
+    """BajaCan float payload: IEEE-754 single, little-endian."""
+    return struct.pack("<f", value)
+
+
+def decode_value(data):
+    return struct.unpack("<f", bytes(data[:4]))[0]
+
+
+def float32(value):
+    return decode_value(encode_value(value))
+
+
+def checksum(values):
+    """CRC-16/CCITT-FALSE over the little-endian bytes of every value, as calChecksum()."""
+    crc = 0xFFFF
+    for byte in b"".join(encode_value(v) for v in values):
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def send(bus, arbitration_id, value):
+    bus.send(can.Message(arbitration_id=arbitration_id, data=encode_value(value), is_extended_id=False))
+
+
+class CalibrationClient:
+    def __init__(self, bus, timeout):
+        self.bus = bus
+        self.timeout = timeout
+
+    def _response(self, command, value_id=None):
+        """Wait for the response to command; return (status, payload, value)."""
+        value = None
+        deadline = time.monotonic() + self.timeout
+        while time.monotonic() < deadline:
+            msg = self.bus.recv(deadline - time.monotonic())
+            if msg is None:
+                break
+            if value_id is not None and msg.arbitration_id == value_id:
+                value = decode_value(msg.data)
+            elif msg.arbitration_id == CAL_RESPONSE_ID:
+                code = int(decode_value(msg.data))
+                if (code >> 20) & 0xF != command:
+                    continue
+                status = (code >> 16) & 0xF
+                if status == 5 and (code & 0xFFFF) < len(PARAMS):
+                    raise RuntimeError("%s %s" % (PARAMS[code & 0xFFFF][0], STATUS_NAMES[status]))
+                if status != 0:
+                    raise RuntimeError(STATUS_NAMES[status] if status < len(STATUS_NAMES) else "status %d" % status)
+                if value_id is not None and value is None:
+                    continue
+                return code & 0xFFFF, value
+        raise TimeoutError("no response from controller")
+
+    def command(self, command, param=0):
+        send(self.bus, CAL_COMMAND_ID, (command << 8) | param)
+        return self._response(command)[0]
+
+    def read(self, param):
+        send(self.bus, CAL_COMMAND_ID, (CMD_READ << 8) | param)
+        return self._response(CMD_READ, CAL_VALUE_BASE_ID + param)[1]
+
+    def write(self, param, value):
+        send(self.bus, CAL_WRITE_BASE_ID + param, value)
+        self._response(CMD_WRITE)
+
+
+def param_index(name):
+    if name not in PARAM_INDEX:
+        raise SystemExit("unknown parameter '%s' (see 'list')" % name)
+    return PARAM_INDEX[name]
+
+
+def load_file(path):
+    with open(path) as f:
+        values = json.load(f)
+    for name in values:
+        param_index(name)
+    return [float32(values.get(name, default)) for name, default, _, _ in PARAMS]
+
+
+def run_standin(bus, nvs_path):
+    """Answer the protocol like the firmware, storing commits in a JSON file."""
+    defaults = [float32(p[1]) for p in PARAMS]
+    try:
+        active = load_file(nvs_path)
+    except (OSError, ValueError):
+        active = list(defaults)
+    staged = list(active)
+
+    def respond(command, status, payload):
+        send(bus, CAL_RESPONSE_ID, (command << 20) | (status << 16) | payload)
+
+    print("calibration stand-in running, checksum 0x%04X" % checksum(active))
+    for msg in bus:
+        value = decode_value(msg.data) if len(msg.data) >= 4 else 0.0
+        if CAL_WRITE_BASE_ID <= msg.arbitration_id < CAL_WRITE_BASE_ID + 0x40:
+            param = msg.arbitration_id - CAL_WRITE_BASE_ID
+            if param >= len(PARAMS):
+                respond(CMD_WRITE, 1, param)
+            elif not PARAMS[param][2] <= value <= PARAMS[param][3]:
+                respond(CMD_WRITE, 2, param)
+            else:
+                staged[param] = value
+                respond(CMD_WRITE, 0, param)
+        elif msg.arbitration_id == CAL_COMMAND_ID:
+            command, param = int(value) >> 8, int(value) & 0xFF
+            if command == CMD_READ:
+                if param >= len(PARAMS):
+                    respond(command, 1, param)
+                    continue
+                send(bus, CAL_VALUE_BASE_ID + param, staged[param])
+                respond(command, 0, param)
+            elif command == CMD_APPLY:
+                bad = conflict(staged)
+                if bad is not None:
+                    respond(command, 5, bad)
+                    continue
+                active = list(staged)
+                respond(command, 0, checksum(active))
+            elif command == CMD_COMMIT:
+                with open(nvs_path, "w") as f:
+                    json.dump({p[0]: v for p, v in zip(PARAMS, active)}, f, indent=2)
+                respond(command, 0, checksum(active))
+            elif command == CMD_CHECKSUM:
+                respond(command, 0, checksum(active))
+            elif command == CMD_REVERT:
+                staged = list(active)
+                respond(command, 0, 0)
+            elif command == CMD_DEFAULTS:
+                staged = list(defaults)
+                respond(command, 0, 0)
+            else:
+                respond(command, 3, param)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--interface", default="socketcan", help="python-can interface (default: socketcan)")
+    parser.add_argument("--channel", default="vcan0", help="CAN channel (default: vcan0)")
+    parser.add_argument("--timeout", type=float, default=0.5, help="response timeout in seconds")
+    sub = parser.add_subparsers(dest="action", required=True)
+
+    sub.add_parser("list", help="show the parameter registry")
+    get = sub.add_parser("get", help="read staged values")
+    get.add_argument("names", nargs="*", help="parameters to read (default: all)")
+    setp = sub.add_parser("set", help="stage new values: set NAME VALUE [NAME VALUE ...]")
+    setp.add_argument("pairs", nargs="+")
+    setp.add_argument("--apply", action="store_true", help="apply after writing")
+    sub.add_parser("apply", help="make staged values active at the next control tick")
+    sub.add_parser("commit", help="store the active values in NVS")
+    sub.add_parser("revert", help="discard staged writes")
+    sub.add_parser("defaults", help="stage the compiled-in defaults")
+    sub.add_parser("checksum", help="print the checksum of the active values")
+    dump = sub.add_parser("dump", help="save staged values to a JSON file")
+    dump.add_argument("file")
+    load = sub.add_parser("load", help="write and apply every value from a JSON file")
+    load.add_argument("file")
+    verify = sub.add_parser("verify", help="check the active values against a JSON file")
+    verify.add_argument("file")
+    standin = sub.add_parser("standin", help="answer the protocol like the controller (for vcan testing)")
+    standin.add_argument("--nvs", default="ecvt_cal_nvs.json", help="file used as NVS")
+
+    args = parser.parse_args(argv)
+
+    if args.action == "list":
+        for i, (name, default, lo, hi) in enumerate(PARAMS):
+            print("%2d  %-30s default %-8g range [%g, %g]" % (i, name, default, lo, hi))
+        return 0
+
+    with can.Bus(interface=args.interface, channel=args.channel, receive_own_messages=False) as bus:
+        if args.action == "standin":
+            run_standin(bus, args.nvs)
+            return 0
+
+        client = CalibrationClient(bus, args.timeout)
+        if args.action == "get":
+            for name in args.names or [p[0] for p in PARAMS]:
+                print("%s = %g" % (name, client.read(param_index(name))))
+        elif args.action == "set":
+            if len(args.pairs) % 2:
+                raise SystemExit("set expects NAME VALUE pairs")
+            for name, value in zip(args.pairs[::2], args.pairs[1::2]):
+                client.write(param_index(name), float(value))
+            if args.apply:
+                print("applied, checksum 0x%04X" % client.command(CMD_APPLY))
+        elif args.action == "apply":
+            print("applied, checksum 0x%04X" % client.command(CMD_APPLY))
+        elif args.action == "commit":
+            print("committed, checksum 0x%04X" % client.command(CMD_COMMIT))
+        elif args.action == "revert":
+            client.command(CMD_REVERT)
+        elif args.action == "defaults":
+            client.command(CMD_DEFAULTS)
+        elif args.action == "checksum":
+            print("0x%04X" % client.command(CMD_CHECKSUM))
+        elif args.action == "dump":
+            values = {p[0]: client.read(i) for i, p in enumerate(PARAMS)}
+            with open(args.file, "w") as f:
+                json.dump(values, f, indent=2)
+        elif args.action == "load":
+            for i, value in enumerate(load_file(args.file)):
+                client.write(i, value)
+            print("applied, checksum 0x%04X" % client.command(CMD_APPLY))
+        elif args.action == "verify":
+            expected = checksum(load_file(args.file))
+            actual = client.command(CMD_CHECKSUM)
+            print("controller 0x%04X, file 0x%04X" % (actual, expected))
+            return 0 if actual == expected else 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
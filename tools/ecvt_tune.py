@@ -0,0 +1,386 @@
+#!/usr/bin/env python3
+"""Tune ECVT calibration parameters against the host simulation.
+
+Every candidate parameter set boots the native firmware build (`pio run -e native`)
+with the set committed to NVS (`--cal NAME=VALUE`) and drives the vehicle plant through
+each scenario. The cost is an expression over the metrics the simulator prints, summed
+over scenarios. The search runs a grid first, then CMA-ES from the best grid point.
+
+Runs are spread over all cores: the pool hands the next (parameter set, scenario) run to
+whichever worker is free. The simulator is deterministic, so results are cached by the
+program's hash and arguments, and a rerun or a widened search only simulates new points.
+
+    python3 tools/ecvt_tune.py --param rpm_kp=0.5:8 --param max_acceleration_pos=10000:120000 \\
+        --scenario launch --scenario hill --grid 5 --generations 15 -o tune.csv
+
+Parameters are NAME=LO:HI with names from calParams in src/calibration.cpp. Cost
+variables: rpm_error_rms, time_to_ideal_s (the duration if never reached),
+sheave_travel_mm, max_speed_kph, distance_m, final_speed_kph, lost_steps.
+"""
+
+import argparse
+import ast
+import concurrent.futures
+import csv
+import hashlib
+import itertools
+import json
+import math
+import os
+import random
+import subprocess
+import sys
+import threading
+
+DEFAULT_PROGRAM = ".pio/build/native/program"
+DEFAULT_CACHE = ".pio/ecvt_tune_cache.jsonl"
+DEFAULT_COST = "rpm_error_rms + 100 * time_to_ideal_s + 0.2 * sheave_travel_mm + lost_steps"
+SIGNIFICANT_DIGITS = 4  # candidates are rounded so nearby points share cache entries
+
+
+def parse_param(text):
+    """NAME=LO:HI -> (name, lo, hi)."""
+    try:
+        name, span = text.split("=", 1)
+        lo, hi = (float(v) for v in span.split(":"))
+    except ValueError:
+        raise argparse.ArgumentTypeError("expected NAME=LO:HI, got %r" % text)
+    if not lo < hi:
+        raise argparse.ArgumentTypeError("%s: LO must be below HI" % name)
+    return name, lo, hi
+
+
+def round_value(value):
+    return float("%.*g" % (SIGNIFICANT_DIGITS, value))
+
+
+# --- Cost -------------------------------------------------------------------
+
+_COST_NODES = (ast.Expression, ast.BinOp, ast.UnaryOp, ast.Name, ast.Load, ast.Call,
+               ast.Add, ast.Sub, ast.Mult, ast.Div, ast.Pow, ast.USub, ast.UAdd)
+_COST_FUNCTIONS = {"abs": abs, "min": min, "max": max, "sqrt": math.sqrt}
+
+
+def compile_cost(expression, variables):
+    """Compile an arithmetic expression over metric names, rejecting anything else."""
+    tree = ast.parse(expression, mode="eval")
+    for node in ast.walk(tree):
+        if isinstance(node, ast.Constant) and isinstance(node.value, (int, float)):
+            continue
+        if not isinstance(node, _COST_NODES):
+            raise ValueError("unsupported syntax in cost: %s" % type(node).__name__)
+        if isinstance(node, ast.Name) and node.id not in variables and node.id not in _COST_FUNCTIONS:
+            raise ValueError("unknown cost variable %s" % node.id)
+        if isinstance(node, ast.Call) and not (isinstance(node.func, ast.Name) and node.func.id in _COST_FUNCTIONS):
+            raise ValueError("unsupported function in cost")
+    code = compile(tree, "<cost>", "eval")
+    return lambda metrics: float(eval(code, {"__builtins__": {}}, dict(_COST_FUNCTIONS, **metrics)))
+
+
+# --- Simulation runs --------------------------------------------------------
+
+METRICS = ["rpm_error_rms", "time_to_ideal_s", "sheave_travel_mm", "max_speed_kph", "distance_m",
+           "final_speed_kph", "lost_steps"]
+
+
+def parse_summary(stderr):
+    """Metrics from the simulator's "vehicle:" summary line."""
+    for line in stderr.splitlines():
+        if line.startswith("vehicle:"):
+            fields = dict(f.split("=", 1) for f in line.split()[1:])
+            return {name: float(fields[name]) for name in METRICS}
+    raise RuntimeError("no vehicle summary in simulator output:\n" + stderr[-2000:])
+
+
+class Simulator:
+    """Runs the native program and caches results by program hash and arguments."""
+
+    def __init__(self, program, common_args, cache_path):
+        self.program = program
+        self.common_args = common_args
+        with open(program, "rb") as f:
+            self.program_hash = hashlib.sha256(f.read()).hexdigest()
+        self.cache_path = cache_path
+        self.cache = {}
+        self.lock = threading.Lock()
+        self.simulated = 0
+        if cache_path and os.path.exists(cache_path):
+            with open(cache_path) as f:
+                for line in f:
+                    entry = json.loads(line)
+                    self.cache[entry["key"]] = entry["metrics"]
+
+    def command(self, params, scenario):
+        args = [self.program, "--plant", "vehicle", "--scenario", scenario] + self.common_args
+        for name, value in sorted(params.items()):
+            args += ["--cal", "%s=%r" % (name, value)]
+        return args
+
+    def run(self, params, scenario):
+        args = self.command(params, scenario)
+        key = hashlib.sha256(json.dumps([self.program_hash] + args[1:]).encode()).hexdigest()
+        with self.lock:
+            if key in self.cache:
+                return self.cache[key]
+        result = subprocess.run(args, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True)
+        if result.returncode != 0:
+            raise RuntimeError("%s failed:\n%s" % (" ".join(args), result.stderr[-2000:]))
+        metrics = parse_summary(result.stderr)
+        with self.lock:
+            self.cache[key] = metrics
+            self.simulated += 1
+            if self.cache_path:
+                with open(self.cache_path, "a") as f:
+                    f.write(json.dumps({"key": key, "args": args[1:], "metrics": metrics}) + "\n")
+        return metrics
+
+
+class Evaluator:
+    """Scores batches of parameter sets on a shared worker pool."""
+
+    def __init__(self, simulator, scenarios, cost, duration, jobs):
+        self.simulator = simulator
+        self.scenarios = scenarios
+        self.cost = cost
+        self.duration = duration
+        self.pool = concurrent.futures.ThreadPoolExecutor(max_workers=jobs)
+        self.history = []  # (params, cost, {scenario: metrics}) in evaluation order
+
+    def score(self, metrics):
+        metrics = dict(metrics)
+        if metrics["time_to_ideal_s"] < 0:
+            metrics["time_to_ideal_s"] = self.duration
+        return self.cost(metrics)
+
+    def evaluate(self, batch):
+        """Return the cost of each parameter set; one run per (set, scenario), all in flight at once."""
+        futures = {(i, scenario): self.pool.submit(self.simulator.run, params, scenario)
+                   for i, params in enumerate(batch) for scenario in self.scenarios}
+        costs = []
+        for i, params in enumerate(batch):
+            results = {scenario: futures[(i, scenario)].result() for scenario in self.scenarios}
+            cost = sum(self.score(metrics) for metrics in results.values())
+            self.history.append((params, cost, results))
+            costs.append(cost)
+        return costs
+
+    def best(self):
+        return min(self.history, key=lambda entry: entry[1])
+
+
+# --- Search -----------------------------------------------------------------
+
+def to_params(space, unit):
+    """Map a point in the unit cube to rounded parameter values."""
+    return {name: round_value(lo + min(max(u, 0.0), 1.0) * (hi - lo)) for (name, lo, hi), u in zip(space, unit)}
+
+
+def to_unit(space, params):
+    return [(params[name] - lo) / (hi - lo) for name, lo, hi in space]
+
+
+def grid_search(evaluator, space, points):
+    axes = [[i / (points - 1) for i in range(points)] if points > 1 else [0.5] for _ in space]
+    batch = [to_params(space, unit) for unit in itertools.product(*axes)]
+    evaluator.evaluate(batch)
+
+
+def symmetric_eigen(matrix, sweeps=50):
+    """Jacobi eigendecomposition: returns (eigenvalues, eigenvectors as columns)."""
+    n = len(matrix)
+    a = [row[:] for row in matrix]
+    v = [[float(i == j) for j in range(n)] for i in range(n)]
+    for _ in range(sweeps):
+        off = sum(a[i][j] ** 2 for i in range(n) for j in range(n) if i != j)
+        if off < 1e-30:
+            break
+        for p in range(n):
+            for q in range(p + 1, n):
+                if abs(a[p][q]) < 1e-300:
+                    continue
+                theta = (a[q][q] - a[p][p]) / (2 * a[p][q])
+                t = math.copysign(1.0, theta) / (abs(theta) + math.sqrt(theta * theta + 1))
+                c = 1 / math.sqrt(t * t + 1)
+                s = t * c
+                for k in range(n):
+                    akp, akq = a[k][p], a[k][q]
+                    a[k][p], a[k][q] = c * akp - s * akq, s * akp + c * akq
+                for k in range(n):
+                    apk, aqk = a[p][k], a[q][k]
+                    a[p][k], a[q][k] = c * apk - s * aqk, s * apk + c * aqk
+                for k in range(n):
+                    vkp, vkq = v[k][p], v[k][q]
+                    v[k][p], v[k][q] = c * vkp - s * vkq, s * vkp + c * vkq
+    return [a[i][i] for i in range(n)], v
+
+
+class CMAES:
+    """(mu/mu_w, lambda)-CMA-ES with rank-one and rank-mu covariance updates (Hansen's tutorial defaults)."""
+
+    def __init__(self, mean, sigma, rng, popsize=None):
+        n = self.n = len(mean)
+        self.rng = rng
+        self.mean = list(mean)
+        self.sigma = sigma
+        self.lam = popsize or 4 + int(3 * math.log(n))
+        self.mu = self.lam // 2
+        weights = [math.log(self.mu + 0.5) - math.log(i + 1) for i in range(self.mu)]
+        total = sum(weights)
+        self.weights = [w / total for w in weights]
+        self.mueff = 1 / sum(w * w for w in self.weights)
+        self.cc = (4 + self.mueff / n) / (n + 4 + 2 * self.mueff / n)
+        self.cs = (self.mueff + 2) / (n + self.mueff + 5)
+        self.c1 = 2 / ((n + 1.3) ** 2 + self.mueff)
+        self.cmu = min(1 - self.c1, 2 * (self.mueff - 2 + 1 / self.mueff) / ((n + 2) ** 2 + self.mueff))
+        self.damps = 1 + 2 * max(0.0, math.sqrt((self.mueff - 1) / (n + 1)) - 1) + self.cs
+        self.chin = math.sqrt(n) * (1 - 1 / (4 * n) + 1 / (21 * n * n))
+        self.pc = [0.0] * n
+        self.ps = [0.0] * n
+        self.C = [[float(i == j) for j in range(n)] for i in range(n)]
+        self.B = [row[:] for row in self.C]
+        self.D = [1.0] * n
+        self.generation = 0
+
+    def sample(self):
+        z = [self.rng.gauss(0, 1) for _ in range(self.n)]
+        y = [sum(self.B[i][j] * self.D[j] * z[j] for j in range(self.n)) for i in range(self.n)]
+        return [m + self.sigma * yi for m, yi in zip(self.mean, y)]
+
+    def ask(self, inside=lambda x: True, retries=20):
+        """Draw lambda candidates, resampling those outside the feasible box."""
+        candidates = []
+        for _ in range(self.lam):
+            x = self.sample()
+            for _ in range(retries):
+                if inside(x):
+                    break
+                x = self.sample()
+            candidates.append(x)
+        return candidates
+
+    def tell(self, candidates, costs):
+        n = self.n
+        order = sorted(range(len(candidates)), key=lambda k: costs[k])
+        old = self.mean
+        ys = [[(candidates[k][i] - old[i]) / self.sigma for i in range(n)] for k in order[:self.mu]]
+        yw = [sum(w * y[i] for w, y in zip(self.weights, ys)) for i in range(n)]
+        self.mean = [old[i] + self.sigma * yw[i] for i in range(n)]
+
+        # C^-1/2 * yw = B * diag(1/D) * B^T * yw
+        bt = [sum(self.B[j][i] * yw[j] for j in range(n)) / self.D[i] for i in range(n)]
+        invsqrt = [sum(self.B[i][j] * bt[j] for j in range(n)) for i in range(n)]
+        cs = self.cs
+        self.ps = [(1 - cs) * p + math.sqrt(cs * (2 - cs) * self.mueff) * v for p, v in zip(self.ps, invsqrt)]
+        self.generation += 1
+        psnorm = math.sqrt(sum(p * p for p in self.ps))
+        hsig = psnorm / math.sqrt(1 - (1 - cs) ** (2 * self.generation)) / self.chin < 1.4 + 2 / (n + 1)
+        cc = self.cc
+        self.pc = [(1 - cc) * p + (math.sqrt(cc * (2 - cc) * self.mueff) * v if hsig else 0.0)
+                   for p, v in zip(self.pc, yw)]
+
+        c1, cmu = self.c1, self.cmu
+        correction = 0.0 if hsig else c1 * cc * (2 - cc)
+        for i in range(n):
+            for j in range(n):
+                rank_mu = sum(w * y[i] * y[j] for w, y in zip(self.weights, ys))
+                self.C[i][j] = ((1 - c1 - cmu) * self.C[i][j] + c1 * self.pc[i] * self.pc[j] +
+                                correction * self.C[i][j] + cmu * rank_mu)
+        self.sigma *= math.exp((cs / self.damps) * (psnorm / self.chin - 1))
+
+        values, vectors = symmetric_eigen(self.C)
+        self.D = [math.sqrt(max(v, 1e-20)) for v in values]
+        self.B = vectors
+
+
+def cmaes_search(evaluator, space, start, sigma, generations, seed, log):
+    rng = random.Random(seed)
+    strategy = CMAES(to_unit(space, start), sigma, rng)
+    inside = lambda x: all(0.0 <= u <= 1.0 for u in x)
+    for generation in range(generations):
+        candidates = strategy.ask(inside)
+        costs = evaluator.evaluate([to_params(space, x) for x in candidates])
+        strategy.tell(candidates, costs)
+        params, cost, _ = evaluator.best()
+        log("cmaes %d/%d: generation best %.2f, overall best %.2f at %s, sigma %.3f\n" %
+            (generation + 1, generations, min(costs), cost, format_params(params), strategy.sigma))
+        if strategy.sigma < 1e-3:
+            break
+
+
+# --- Main -------------------------------------------------------------------
+
+def format_params(params):
+    return " ".join("%s=%g" % item for item in sorted(params.items()))
+
+
+def write_results(path, evaluator, space, scenarios):
+    with open(path, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow([name for name, _, _ in space] + ["cost"] +
+                        ["%s.%s" % (s, m) for s in scenarios for m in METRICS])
+        for params, cost, results in evaluator.history:
+            writer.writerow([params[name] for name, _, _ in space] + [cost] +
+                            [results[s][m] for s in scenarios for m in METRICS])
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--param", type=parse_param, action="append", required=True,
+                        help="calibration parameter to tune as NAME=LO:HI (repeatable)")
+    parser.add_argument("--scenario", action="append", help="vehicle scenario (repeatable, default launch)")
+    parser.add_argument("--selector", default="power", help="mode selector position (default power)")
+    parser.add_argument("--duration", type=float, default=20.0, help="virtual seconds per run (default 20)")
+    parser.add_argument("--cost", default=DEFAULT_COST, help="cost expression over the metrics (default: %(default)s)")
+    parser.add_argument("--grid", type=int, default=4, help="grid points per parameter, 0 to skip (default 4)")
+    parser.add_argument("--generations", type=int, default=10, help="CMA-ES generations, 0 to skip (default 10)")
+    parser.add_argument("--sigma", type=float, default=0.2, help="initial CMA-ES step as a fraction of each range")
+    parser.add_argument("--seed", type=int, default=1, help="CMA-ES random seed (default 1)")
+    parser.add_argument("--jobs", type=int, default=os.cpu_count(), help="parallel simulations (default: all cores)")
+    parser.add_argument("--program", default=DEFAULT_PROGRAM, help="native simulator (default %(default)s)")
+    parser.add_argument("--cache", default=DEFAULT_CACHE, help="result cache, empty to disable (default %(default)s)")
+    parser.add_argument("-o", "--output", help="CSV of every evaluated set")
+    args = parser.parse_args(argv)
+
+    space = args.param
+    scenarios = args.scenario or ["launch"]
+    try:
+        cost = compile_cost(args.cost, METRICS)
+    except (SyntaxError, ValueError) as e:
+        parser.error("--cost: %s" % e)
+    if not os.path.exists(args.program):
+        parser.error("%s not found; build it with: pio run -e native" % args.program)
+    if args.cache:
+        os.makedirs(os.path.dirname(args.cache) or ".", exist_ok=True)
+
+    simulator = Simulator(args.program, ["--duration", repr(args.duration), "--selector", args.selector],
+                          args.cache or None)
+    evaluator = Evaluator(simulator, scenarios, cost, args.duration, args.jobs)
+    log = sys.stderr.write
+
+    try:
+        if args.grid > 0:
+            grid_search(evaluator, space, args.grid)
+            params, best, _ = evaluator.best()
+            log("grid: %d sets, best %.2f at %s\n" % (len(evaluator.history), best, format_params(params)))
+        if args.generations > 0:
+            start = evaluator.best()[0] if evaluator.history else to_params(space, [0.5] * len(space))
+            cmaes_search(evaluator, space, start, args.sigma, args.generations, args.seed, log)
+    except RuntimeError as e:
+        log("ERROR: %s\n" % e)
+        return 1
+    finally:
+        evaluator.pool.shutdown()
+
+    if args.output:
+        write_results(args.output, evaluator, space, scenarios)
+    params, best, results = evaluator.best()
+    log("%d sets evaluated, %d simulations run (%d cached)\n" %
+        (len(evaluator.history), simulator.simulated, len(evaluator.history) * len(scenarios) - simulator.simulated))
+    for scenario in scenarios:
+        log("  %s: %s\n" % (scenario, " ".join("%s=%g" % (m, results[scenario][m]) for m in METRICS)))
+    print("best cost %.2f: %s" % (best, " ".join("--cal %s=%g" % item for item in sorted(params.items()))))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Collect on-target benchmark results from the esp32-bench firmware.
+
+Flash the benchmark firmware (`pio run -e esp32-bench -t upload`), then:
+
+    python3 tools/esp32_bench.py --port /dev/ttyUSB0 -o devkit.json
+
+The script asks the board for a run, prints a table of per-call times, and with -o writes
+the results in Google Benchmark's JSON layout so tools/bench_compare.py can compare two
+boards, builds, or commits. Each case is reported warm and cold (flash cache evicted before
+every call); the JSON time is the median and the table also shows the minimum and maximum.
+--input parses a saved capture instead of a port.
+
+Serial capture requires pyserial.
+"""
+
+import argparse
+import json
+import sys
+import time
+
+
+def parse_line(line):
+    """Split "kind,name,key=value,..." into (kind, name, fields); name is None if absent."""
+    parts = line.strip().split(",")
+    kind = parts[0]
+    name = None
+    fields = {}
+    for part in parts[1:]:
+        if "=" in part:
+            key, value = part.split("=", 1)
+            fields[key] = value
+        elif name is None:
+            name = part
+    return kind, name, fields
+
+
+def collect(lines):
+    """Gather results from an iterable of text lines, stopping at bench_done."""
+    start = {}
+    overhead = None
+    results = []
+    for line in lines:
+        if not line.startswith("bench"):
+            continue
+        kind, name, fields = parse_line(line)
+        if kind == "bench_start":
+            start = fields
+            results = []
+        elif kind == "bench_overhead":
+            overhead = int(fields["cycles"])
+        elif kind == "bench" and name:
+            result = {"name": name, "cache": fields["cache"], "calls": int(fields["calls"]),
+                      "cpu_mhz": int(fields["cpu_mhz"])}
+            for key in ("min_cycles", "median_cycles", "max_cycles"):
+                result[key] = int(fields[key])
+            result["mean_cycles"] = float(fields["mean_cycles"])
+            results.append(result)
+        elif kind == "bench_done":
+            expected = int(fields.get("results", len(results)))
+            if expected != len(results):
+                raise ValueError("run reported %d results but %d arrived" % (expected, len(results)))
+            return start, overhead, results
+    raise ValueError("no complete run (missing bench_done)")
+
+
+def serial_lines(port, baud, timeout):
+    import serial
+
+    with serial.Serial(port, baud, timeout=0.1) as link:
+        link.reset_input_buffer()
+        link.write(b"run\n")
+        deadline = time.monotonic() + timeout
+        pending = b""
+        while time.monotonic() < deadline:
+            pending += link.read(4096)
+            *complete, pending = pending.split(b"\n")
+            for line in complete:
+                yield line.decode("ascii", "replace")
+    raise TimeoutError("no bench_done from %s within %g s" % (port, timeout))
+
+
+def to_benchmark_json(start, results):
+    """Results in the layout Google Benchmark writes with --benchmark_out_format=json."""
+    benchmarks = []
+    for r in results:
+        ns = r["median_cycles"] * 1000.0 / r["cpu_mhz"]
+        benchmarks.append({"name": "%s/%s" % (r["name"], r["cache"]), "run_name": "%s/%s" % (r["name"], r["cache"]),
+                           "run_type": "iteration", "iterations": r["calls"], "real_time": ns, "cpu_time": ns,
+                           "time_unit": "ns", "min_cycles": r["min_cycles"], "median_cycles": r["median_cycles"],
+                           "mean_cycles": r["mean_cycles"], "max_cycles": r["max_cycles"]})
+    context = {"date": time.strftime("%Y-%m-%dT%H:%M:%S"), "host_name": start.get("board", "esp32"),
+               "mhz_per_cpu": int(start.get("cpu_mhz", 0)), "num_cpus": 1}
+    return {"context": context, "benchmarks": benchmarks}
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="serial port of the board running the esp32-bench firmware")
+    source.add_argument("--input", help="saved serial capture to parse instead")
+    parser.add_argument("--baud", type=int, default=921600, help="serial baud rate (TELEMETRY_BAUD)")
+    parser.add_argument("--timeout", type=float, default=60.0, help="seconds to wait for a run (default 60)")
+    parser.add_argument("-o", "--output", help="write Google Benchmark JSON for tools/bench_compare.py")
+    args = parser.parse_args(argv)
+
+    try:
+        if args.input:
+            with open(args.input, errors="replace") as f:
+                start, overhead, results = collect(f)
+        else:
+            start, overhead, results = collect(serial_lines(args.port, args.baud, args.timeout))
+    except (OSError, ValueError, TimeoutError) as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 1
+
+    print("board %s at %s MHz, timer overhead %s cycles (subtracted)"
+          % (start.get("board", "?"), start.get("cpu_mhz", "?"), overhead))
+    width = max(len(r["name"]) for r in results)
+    print("%-*s %5s %10s %10s %10s %10s" % (width, "case", "cache", "min_us", "median_us", "mean_us", "max_us"))
+    for r in results:
+        mhz = float(r["cpu_mhz"])
+        print("%-*s %5s %10.3f %10.3f %10.3f %10.3f" % (width, r["name"], r["cache"], r["min_cycles"] / mhz,
+                                                         r["median_cycles"] / mhz, r["mean_cycles"] / mhz,
+                                                         r["max_cycles"] / mhz))
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(to_benchmark_json(start, results), f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Download the ECVT sensor-to-step latency trace and convert it to Chrome trace JSON.
+
+The controller keeps the last TRACE_RING_SIZE pipeline events (include/latency_trace.h),
+each tagged with the engine rpm sample it belongs to. "download" sends "trace dump" and
+saves the raw events; "convert" writes a Chrome trace-event file (open it in
+chrome://tracing or https://ui.perfetto.dev) and prints the latency distribution of each
+stage and of the whole path, so the dominant stage stands out.
+
+    python3 tools/latency_trace.py download --port /dev/ttyUSB0 -o run.trace
+    python3 tools/latency_trace.py convert run.trace -o run.json
+
+Serial download requires pyserial.
+"""
+
+import argparse
+import json
+import struct
+import sys
+import time
+
+from telemetry_decode import cobs_decode, crc16
+
+FRAME_TAG = 0x82
+EVENT = struct.Struct("<IIiB")  # timestamp us, sample id, value, stage
+
+# Must match TraceStage in include/latency_trace.h, in order.
+STAGES = ["rpm_sample", "control_tick", "setpoint", "motor_tick", "step"]
+VALUE_NAMES = ["window_us", None, "setpoint", "setpoint", "steps"]
+
+
+def parse_events(data):
+    """Return (timestamp us, sample, value, stage) tuples with the 32-bit timestamps unwrapped."""
+    events = []
+    offset = 0
+    last = None
+    for raw, sample, value, stage in EVENT.iter_unpack(data[:len(data) - len(data) % EVENT.size]):
+        if last is not None and raw < last and last - raw > 1 << 31:
+            offset += 1 << 32
+        last = raw
+        if stage < len(STAGES):
+            events.append((raw + offset, sample, value, stage))
+    return events
+
+
+def group_samples(events):
+    """Map sample id to {stage: (timestamp us, value)}, keeping the first event of each stage."""
+    samples = {}
+    for timestamp, sample, value, stage in events:
+        samples.setdefault(sample, {}).setdefault(stage, (timestamp, value))
+    return samples
+
+
+def chrome_trace(samples):
+    """One track per stage; each stage spans from its own event to the sample's next recorded stage."""
+    trace = [{"name": "thread_name", "ph": "M", "pid": 1, "tid": tid, "args": {"name": name}}
+             for tid, name in enumerate(["hall_window"] + STAGES[:-1] + ["sensor_to_step"])]
+    for sample, stages in sorted(samples.items()):
+        ordered = sorted(stages)
+        if 0 in stages:
+            timestamp, window = stages[0]
+            trace.append({"name": "sample %d" % sample, "ph": "X", "pid": 1, "tid": 0,
+                          "ts": timestamp - window, "dur": window, "args": {"sample": sample}})
+        for here, after in zip(ordered, ordered[1:]):
+            timestamp, value = stages[here]
+            args = {"sample": sample}
+            if VALUE_NAMES[here]:
+                args[VALUE_NAMES[here]] = value
+            trace.append({"name": "%s -> %s" % (STAGES[here], STAGES[after]), "ph": "X", "pid": 1,
+                          "tid": here + 1, "ts": timestamp, "dur": stages[after][0] - timestamp, "args": args})
+        if 0 in stages and len(STAGES) - 1 in stages:
+            start = stages[0][0]
+            trace.append({"name": "sample %d" % sample, "ph": "X", "pid": 1, "tid": len(STAGES),
+                          "ts": start, "dur": stages[len(STAGES) - 1][0] - start,
+                          "args": {"sample": sample, "steps": stages[len(STAGES) - 1][1]}})
+    return {"traceEvents": trace, "displayTimeUnit": "ms"}
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def summarize(samples, out=sys.stderr):
+    """Print the latency distribution of each adjacent stage pair and of the complete path."""
+    rows = []
+    for stage in range(len(STAGES) - 1):
+        deltas = [s[stage + 1][0] - s[stage][0] for s in samples.values() if stage in s and stage + 1 in s]
+        rows.append(("%s -> %s" % (STAGES[stage], STAGES[stage + 1]), deltas))
+    complete = [s for s in samples.values() if len(s) == len(STAGES)]
+    rows.append(("sensor_to_step", [s[len(STAGES) - 1][0] - s[0][0] for s in complete]))
+
+    out.write("%-28s %6s %8s %8s %8s %8s %8s\n" % ("stage (us)", "n", "mean", "p50", "p95", "p99", "max"))
+    for name, deltas in rows:
+        if not deltas:
+            out.write("%-28s %6d\n" % (name, 0))
+            continue
+        out.write("%-28s %6d %8.0f %8d %8d %8d %8d\n" % (
+            name, len(deltas), sum(deltas) / len(deltas), percentile(deltas, 0.5),
+            percentile(deltas, 0.95), percentile(deltas, 0.99), max(deltas)))
+
+    means = [(sum(d) / len(d), name) for name, d in rows[:-1] if d]
+    if means:
+        out.write("dominant stage: %s (%.0f us mean)\n" % (max(means)[1], max(means)[0]))
+    out.write("%d samples, %d reached a step pulse\n" % (len(samples), len(complete)))
+
+
+def download(port, output, timeout=2.0):
+    """Send "trace dump" and save events until the end frame. Telemetry frames in between are ignored."""
+    port.reset_input_buffer()
+    port.write(b"trace dump\n")
+    buffer = bytearray()
+    events = 0
+    last_data = time.monotonic()
+    while time.monotonic() - last_data < timeout:
+        data = port.read(4096)
+        if not data:
+            continue
+        last_data = time.monotonic()
+        buffer += data
+        while True:
+            end = buffer.find(0)
+            if end < 0:
+                break
+            frame = cobs_decode(bytes(buffer[:end]))
+            del buffer[:end + 1]
+            if not frame or len(frame) < 3 or frame[0] != FRAME_TAG:
+                continue
+            body, crc = frame[:-2], frame[-2] | (frame[-1] << 8)
+            if crc16(body) != crc:
+                sys.stderr.write("corrupt trace frame skipped\n")
+                continue
+            if len(body) == 1:
+                return events
+            output.write(body[1:])
+            events += (len(body) - 1) // EVENT.size
+    raise TimeoutError("no end-of-dump frame after %d events" % events)
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("download")
+    p.add_argument("--port", required=True, help="controller serial port")
+    p.add_argument("--baud", type=int, default=921600, help="serial baud rate (TELEMETRY_BAUD)")
+    p.add_argument("-o", "--output", required=True, help="file for the raw events (.trace)")
+    p = sub.add_parser("convert")
+    p.add_argument("input", help="raw events saved by download")
+    p.add_argument("-o", "--output", help="Chrome trace JSON file (default: summary only)")
+    args = parser.parse_args(argv)
+
+    if args.command == "download":
+        import serial
+
+        with serial.Serial(args.port, args.baud, timeout=0.1) as port, open(args.output, "wb") as out:
+            events = download(port, out)
+        sys.stderr.write("%d events saved to %s\n" % (events, args.output))
+        return 0
+
+    with open(args.input, "rb") as f:
+        samples = group_samples(parse_events(f.read()))
+    if args.output:
+        with open(args.output, "w") as out:
+            json.dump(chrome_trace(samples), out)
+    summarize(samples)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""Check the step pulses DRV8462::moveSteps emitted against what the motor planner asked for.
+
+With STEP_CAPTURE_ENABLED the controller keeps the last STEP_CAPTURE_RING_SIZE moveSteps
+calls (include/step_capture.h): the planner's steps and rate, the pulses and half period
+written to the RMT, and the running pulse count on a PCNT loopback of the STEP pin.
+"download" sends "steps dump" and saves the raw records, from the board or from a saved
+simulator serial capture. "check" rebuilds position against time for the planned profile
+(the requested steps at the requested rate from the moment of the call) and for the emitted
+one (the written half period, cut off where the loopback count says the batch stopped), then
+reports the worst position and velocity error and why each call fell short:
+
+    truncated  more steps requested than MAX_PULSES
+    clamped    rate below what the 32767 us half period can express
+    rounded    written rate off the requested rate by more than --rate-tolerance
+    aborted    fewer pulses came out than were written before the next call stopped the train
+    dropped    steps requested at a rate of zero, so nothing was written
+    overrun    the requested steps do not fit in the time until the next call at that rate
+
+    python3 tools/step_verify.py download --port /dev/ttyUSB0 -o run.steps
+    .pio/build/native/program --plant vehicle --duration 12 --serial run.bin --command 11.5:"steps dump"
+    python3 tools/step_verify.py download --capture run.bin -o run.steps
+    python3 tools/step_verify.py check run.steps --csv calls.csv
+
+Serial download requires pyserial.
+"""
+
+import argparse
+import bisect
+import csv
+import math
+import struct
+import sys
+import time
+
+from telemetry_decode import cobs_decode, crc16
+
+FRAME_TAG = 0x83
+RECORD = struct.Struct("<IiiIHH")  # timestamp us, steps, speed Hz, loopback pulses, items, half period us
+MAX_PULSES = 2000       # include/DRV8462.h
+MAX_HALF_PERIOD_US = 32767
+CAUSES = ["truncated", "clamped", "rounded", "aborted", "dropped", "overrun"]
+
+
+class FrameCollector:
+    """Pull step capture records out of a serial byte stream, ignoring every other frame."""
+
+    def __init__(self, output):
+        self.output = output
+        self.buffer = bytearray()
+        self.records = 0
+        self.done = False
+
+    def feed(self, data):
+        self.buffer += data
+        while not self.done:
+            end = self.buffer.find(0)
+            if end < 0:
+                return
+            frame = cobs_decode(bytes(self.buffer[:end]))
+            del self.buffer[:end + 1]
+            if not frame or len(frame) < 3 or frame[0] != FRAME_TAG:
+                continue
+            body, crc = frame[:-2], frame[-2] | (frame[-1] << 8)
+            if crc16(body) != crc:
+                sys.stderr.write("corrupt step frame skipped\n")
+                continue
+            if len(body) == 1:
+                self.done = True
+                return
+            self.output.write(body[1:])
+            self.records += (len(body) - 1) // RECORD.size
+
+
+def download(port, output, timeout=2.0):
+    """Send "steps dump" and save records until the end frame. Telemetry frames in between are ignored."""
+    port.reset_input_buffer()
+    port.write(b"steps dump\n")
+    collector = FrameCollector(output)
+    last_data = time.monotonic()
+    while time.monotonic() - last_data < timeout:
+        data = port.read(4096)
+        if not data:
+            continue
+        last_data = time.monotonic()
+        collector.feed(data)
+        if collector.done:
+            return collector.records
+    raise TimeoutError("no end-of-dump frame after %d records" % collector.records)
+
+
+def parse_records(data):
+    """Return record dicts in call order, with the 32-bit timestamps and pulse counts unwrapped."""
+    records = []
+    time_offset = pulse_offset = 0
+    last = None
+    for raw_time, steps, speed, raw_pulses, items, half in RECORD.iter_unpack(data[:len(data) - len(data) % RECORD.size]):
+        if last is not None:
+            if raw_time < last[0] and last[0] - raw_time > 1 << 31:
+                time_offset += 1 << 32
+            if raw_pulses < last[1]:
+                pulse_offset += 1 << 32
+        last = (raw_time, raw_pulses)
+        records.append({"time_us": raw_time + time_offset, "steps": steps, "speed_hz": speed,
+                        "pulses": raw_pulses + pulse_offset, "items": items, "half_us": half})
+    return records
+
+
+def rising_edges(count, period_us, limit_us):
+    """Offsets of the first count rising edges at period_us that fall before limit_us."""
+    if count <= 0 or period_us <= 0:
+        return []
+    fit = int(math.ceil(limit_us / period_us))
+    return [i * period_us for i in range(min(count, fit))]
+
+
+def max_gap(planned, emitted):
+    """Largest difference between two pulse counts over time, given their edge offsets."""
+    worst = 0
+    for t in sorted(set(planned) | set(emitted)):
+        gap = abs(bisect.bisect_right(planned, t) - bisect.bisect_right(emitted, t))
+        worst = max(worst, gap)
+    return worst
+
+
+def check_call(record, following, loopback, rate_tolerance):
+    """Compare one call with its planned profile over the time until the next call."""
+    requested = abs(record["steps"])
+    speed = record["speed_hz"]
+    written = record["items"]
+    half = record["half_us"]
+    window = following["time_us"] - record["time_us"]
+    written_rate = 1e6 / (2 * half) if written and half else 0.0
+
+    if loopback:
+        emitted = following["pulses"] - record["pulses"]
+    else:
+        emitted = len(rising_edges(written, 2 * half, window))
+
+    causes = set()
+    if requested and written == 0:
+        causes.add("dropped")
+    if written == MAX_PULSES and requested > MAX_PULSES:
+        causes.add("truncated")
+    if requested and speed > 0 and 1e6 / speed / 2 > MAX_HALF_PERIOD_US:
+        causes.add("clamped")
+    if written and speed > 0 and abs(written_rate - speed) > speed * rate_tolerance / 100.0:
+        causes.add("rounded")
+    if emitted < written:
+        causes.add("aborted")
+    if requested and speed > 0 and requested * 1e6 / speed > window:
+        causes.add("overrun")
+
+    planned_edges = rising_edges(requested, 1e6 / speed, window) if speed > 0 else []
+    emitted_edges = rising_edges(emitted, 2 * half, window) if half else []
+    position_error = max(max_gap(planned_edges, emitted_edges), abs(requested - emitted))
+    velocity_error = (written_rate - speed) if requested else 0.0
+    direction = -1 if record["steps"] < 0 else 1
+    return {"time_us": record["time_us"], "steps": record["steps"], "speed_hz": speed, "written": written,
+            "half_us": half, "emitted": emitted * direction, "window_us": window,
+            "position_error": position_error, "velocity_error_hz": velocity_error,
+            "shortfall": (requested - emitted) * direction, "causes": causes}
+
+
+def check(records, rate_tolerance, out=sys.stdout):
+    """Check every call that has a following call, print the summary, and return the per-call results."""
+    loopback = any(b["pulses"] != a["pulses"] for a, b in zip(records, records[1:]))
+    if not loopback and any(r["items"] for r in records):
+        sys.stderr.write("warning: loopback count never moved (is STEP_LOOPBACK_PIN jumpered to STEP_PIN?); "
+                         "assuming written pulses came out on time\n")
+    calls = [check_call(a, b, loopback, rate_tolerance) for a, b in zip(records, records[1:])]
+    if not calls:
+        raise ValueError("need at least two calls")
+
+    start = calls[0]["time_us"]
+    drift = worst_drift = 0
+    for call in calls:
+        drift += call["shortfall"]
+        call["drift"] = drift
+        worst_drift = max(worst_drift, abs(drift))
+    worst_position = max(calls, key=lambda c: c["position_error"])
+    worst_velocity = max(calls, key=lambda c: abs(c["velocity_error_hz"]))
+    counts = {cause: sum(cause in c["causes"] for c in calls) for cause in CAUSES}
+
+    out.write("steps: calls=%d moving=%d span_s=%.2f loopback=%s position_error_max=%d at_s=%.3f drift_max=%d "
+              "velocity_error_max_hz=%.1f at_s=%.3f lost_pulses=%d %s\n" % (
+                  len(calls), sum(1 for c in calls if c["steps"]), (calls[-1]["time_us"] - start) / 1e6,
+                  "yes" if loopback else "no", worst_position["position_error"],
+                  (worst_position["time_us"] - start) / 1e6, worst_drift, worst_velocity["velocity_error_hz"],
+                  (worst_velocity["time_us"] - start) / 1e6,
+                  sum(abs(c["shortfall"]) for c in calls), " ".join("%s=%d" % (k, counts[k]) for k in CAUSES)))
+    for cause in CAUSES:
+        first = next((c for c in calls if cause in c["causes"]), None)
+        if first:
+            out.write("  first %-9s at %.3f s: steps=%d speed_hz=%d written=%d half_us=%d emitted=%d window_us=%d\n" % (
+                cause, (first["time_us"] - start) / 1e6, first["steps"], first["speed_hz"], first["written"],
+                first["half_us"], first["emitted"], first["window_us"]))
+    return calls
+
+
+def write_csv(calls, path):
+    start = calls[0]["time_us"]
+    with open(path, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["time_s", "steps", "speed_hz", "written", "half_us", "emitted", "window_us",
+                         "position_error", "velocity_error_hz", "drift", "causes"])
+        for c in calls:
+            writer.writerow(["%.6f" % ((c["time_us"] - start) / 1e6), c["steps"], c["speed_hz"], c["written"],
+                             c["half_us"], c["emitted"], c["window_us"], c["position_error"],
+                             "%.1f" % c["velocity_error_hz"], c["drift"], ";".join(sorted(c["causes"]))])
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+    p = sub.add_parser("download")
+    source = p.add_mutually_exclusive_group(required=True)
+    source.add_argument("--port", help="controller serial port")
+    source.add_argument("--capture", help="saved serial stream, e.g. the simulator's --serial file")
+    p.add_argument("--baud", type=int, default=921600, help="serial baud rate (TELEMETRY_BAUD)")
+    p.add_argument("-o", "--output", required=True, help="file for the raw records (.steps)")
+    p = sub.add_parser("check")
+    p.add_argument("input", help="raw records saved by download")
+    p.add_argument("--rate-tolerance", type=float, default=1.0,
+                   help="written rate error in percent that counts as rounding (default 1)")
+    p.add_argument("--csv", help="write one row per call")
+    args = parser.parse_args(argv)
+
+    if args.command == "download":
+        with open(args.output, "wb") as output:
+            if args.capture:
+                collector = FrameCollector(output)
+                with open(args.capture, "rb") as f:
+                    collector.feed(f.read())
+                if not collector.done:
+                    print("ERROR: no complete step dump in %s" % args.capture, file=sys.stderr)
+                    return 1
+                count = collector.records
+            else:
+                import serial
+
+                with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+                    count = download(port, output)
+        sys.stderr.write("%d records saved to %s\n" % (count, args.output))
+        return 0
+
+    with open(args.input, "rb") as f:
+        records = parse_records(f.read())
+    try:
+        calls = check(records, args.rate_tolerance)
+    except ValueError as e:
+        print("ERROR: %s" % e, file=sys.stderr)
+        return 1
+    if args.csv:
+        write_csv(calls, args.csv)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,336 @@
+#!/usr/bin/env python3
+"""Decode the ECVT binary telemetry stream.
+
+Reads COBS-framed TelemetryRecord frames (include/telemetry.h) from a serial port
+or a capture file and writes them as CSV, Parquet, or Teleplot ">name:value" lines.
+Deferred log frames (DLOG in include/deferred_log.h) are expanded to text using the
+format strings in the firmware ELF given with --elf, and shadow-mode record frames
+(include/shadow.h) to "shadow,..." lines keyed by candidate index (the "shadow"
+command lists the names). Both are printed to stderr together with any bytes that
+do not form a valid frame (debug prints), so nothing printed by the firmware is lost.
+
+    python3 tools/telemetry_decode.py --port /dev/ttyUSB0 --format teleplot \
+        --elf .pio/build/esp32doit-devkit-v1/firmware.elf
+    python3 tools/telemetry_decode.py --port /dev/ttyUSB0 --raw capture.bin --format csv -o run.csv
+    python3 tools/telemetry_decode.py capture.bin --format parquet -o run.parquet
+
+Serial input requires pyserial; Parquet output requires pandas and pyarrow.
+"""
+
+import argparse
+import csv
+import re
+import socket
+import struct
+import sys
+
+RECORD_VERSION = 1
+LOG_FRAME_TAG = 0x80
+LOG_HEADER = struct.Struct("<BIIHB")  # tag, format address, timestamp us, suppressed, argument count
+SHADOW_FRAME_TAG = 0x84
+SHADOW_RECORD = struct.Struct("<IBBhhh")  # time ms, candidate, mode, setpoint delta, predicted and active rpm error
+PRINTF_SPEC = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z)?([diouxXcfFeEgGsp%])")
+
+# Must match TelemetryRecord in include/telemetry.h, in order.
+FIELDS = [
+    ("version", "B"),
+    ("sequence", "H"),
+    ("timestamp_ms", "I"),
+    ("engine_rpm", "f"),
+    ("target_rpm", "f"),
+    ("vehicle_speed", "f"),
+    ("motor_position", "i"),
+    ("motor_setpoint", "i"),
+    ("motor_velocity", "f"),
+    ("control_mode", "B"),
+    ("flags", "B"),
+    ("launch_state", "B"),
+    ("driver_fault", "H"),
+    ("manual_mode_raw", "H"),
+    ("limit_switch_raw", "H"),
+    ("brake_raw", "H"),
+    ("ctrl_latency_us", "I"),
+    ("deadline_misses", "I"),
+    ("can_tx_dropped", "I"),
+]
+RECORD = struct.Struct("<" + "".join(f for _, f in FIELDS))
+FLAG_BITS = [("brake", 0), ("limit_switch", 1), ("brake_profile", 2), ("slip", 3), ("derate", 4)]
+CONTROL_MODES = ["TORQUE", "POWER", "MANUAL", "BRAKE", "DEBUG", "HOMING", "BRAKE_CHECK", "ACCELERATION"]
+COLUMNS = [name for name, _ in FIELDS if name != "flags"] + [name for name, _ in FLAG_BITS]
+
+
+def crc16(data, crc=0xFFFF):
+    """CRC-16/CCITT-FALSE, as crc16Update() in include/crc16.h."""
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class ElfStrings:
+    """Read NUL-terminated strings at load addresses from an ELF file (32 or 64 bit, little-endian)."""
+
+    active = None  # set from --elf
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        is64 = self.data[4] == 2
+        if is64:
+            shoff, = struct.unpack_from("<Q", self.data, 0x28)
+            shentsize, shnum = struct.unpack_from("<HH", self.data, 0x3A)
+            section = struct.Struct("<IIQQQQIIQQ")
+        else:
+            shoff, = struct.unpack_from("<I", self.data, 0x20)
+            shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+            section = struct.Struct("<IIIIIIIIII")
+        self.sections = []
+        for i in range(shnum):
+            _, kind, _, addr, offset, size = section.unpack_from(self.data, shoff + i * shentsize)[:6]
+            if kind == 1 and addr:  # SHT_PROGBITS with a load address
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.index(b"\0", start, offset + size)
+                return self.data[start:end].decode("utf-8", errors="replace")
+        return None
+
+
+def format_log(fmt, args):
+    """Expand a printf format with 32-bit argument words the way DeferredLog::format() does."""
+    words = iter(args)
+
+    def expand(match):
+        flags, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        word = next(words, 0)
+        if conversion in "di":
+            return ("%" + flags + "d") % (word - (1 << 32) if word & 0x80000000 else word)
+        if conversion in "ouxXc":
+            return ("%" + flags + conversion) % word
+        if conversion in "fFeEgG":
+            return ("%" + flags + conversion) % struct.unpack("<f", struct.pack("<I", word))[0]
+        if conversion == "s":
+            text = ElfStrings.active.string(word) if ElfStrings.active else None
+            return ("%" + flags + "s") % (text if text is not None else "<0x%08x>" % word)
+        return "0x%08x" % word
+
+    return PRINTF_SPEC.sub(expand, fmt)
+
+
+def decode_log(body):
+    """Return the text of a deferred log frame."""
+    _, address, timestamp_us, suppressed, count = LOG_HEADER.unpack_from(body)
+    args = struct.unpack_from("<%dI" % count, body, LOG_HEADER.size)
+    fmt = ElfStrings.active.string(address) if ElfStrings.active else None
+    if fmt is None:
+        text = "log@0x%08x %s\n" % (address, " ".join("0x%x" % a for a in args))
+    else:
+        text = format_log(fmt, args)
+    if suppressed:
+        text = text.rstrip("\n") + " (+%d suppressed)\n" % suppressed
+    return text
+
+
+def decode_shadow(body):
+    """Return the records of a shadow-mode frame as CSV text."""
+    return "".join("shadow,%d,%d,%d,%d,%d,%d\n" % record for record in SHADOW_RECORD.iter_unpack(body[1:]))
+
+
+def decode_frame(frame):
+    """Return a record dict, log text, or None if the frame is not valid."""
+    payload = cobs_decode(frame)
+    if payload is None or len(payload) < 3:
+        return None
+    body, crc = payload[:-2], payload[-2] | (payload[-1] << 8)
+    if crc16(body) != crc:
+        return None
+    if body[0] == LOG_FRAME_TAG and len(body) >= LOG_HEADER.size:
+        count = body[LOG_HEADER.size - 1]
+        return decode_log(body) if len(body) == LOG_HEADER.size + 4 * count else None
+    if body[0] == SHADOW_FRAME_TAG and len(body) > 1 and (len(body) - 1) % SHADOW_RECORD.size == 0:
+        return decode_shadow(body)
+    if len(body) != RECORD.size:
+        return None
+    record = dict(zip((name for name, _ in FIELDS), RECORD.unpack(body)))
+    if record["version"] != RECORD_VERSION:
+        return None
+    flags = record.pop("flags")
+    for name, bit in FLAG_BITS:
+        record[name] = (flags >> bit) & 1
+    return record
+
+
+class FrameReader:
+    """Split a byte stream on zero delimiters and decode each frame."""
+
+    def __init__(self, passthrough=sys.stderr):
+        self.buffer = bytearray()
+        self.passthrough = passthrough
+        self.last_sequence = None
+        self.dropped = 0
+        self.bad = 0
+        self.logs = 0
+
+    def feed(self, data):
+        self.buffer += data
+        while True:
+            end = self.buffer.find(0)
+            if end < 0:
+                return
+            frame = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+            record = decode_frame(frame) if frame else None
+            if record is None:
+                # Debug text printed between frames has no delimiter of its own, so look for a
+                # valid frame after each newline before giving the bytes up as text.
+                split = frame.rfind(b"\n")
+                while split >= 0 and record is None:
+                    record = decode_frame(frame[split + 1:])
+                    if record is None:
+                        split = frame.rfind(b"\n", 0, split)
+                self._passthrough(frame[:split + 1] if record else frame)
+                if record is None:
+                    continue
+            if isinstance(record, str):
+                self.logs += 1
+                if self.passthrough:
+                    self.passthrough.write(record)
+                continue
+            if self.last_sequence is not None:
+                self.dropped += (record["sequence"] - self.last_sequence - 1) & 0xFFFF
+            self.last_sequence = record["sequence"]
+            yield record
+
+    def _passthrough(self, frame):
+        # Debug text shares the UART; show printable lines, count everything else as corruption.
+        text = frame.decode("ascii", errors="replace")
+        lines = [line for line in text.splitlines() if line.strip() and line.isprintable()]
+        if lines and self.passthrough:
+            self.passthrough.write("\n".join(lines) + "\n")
+        elif frame:
+            self.bad += 1
+
+
+def teleplot_lines(record):
+    t = record["timestamp_ms"]
+    for name in COLUMNS:
+        if name in ("version", "sequence", "timestamp_ms"):
+            continue
+        value = record[name]
+        if name == "control_mode" and value < len(CONTROL_MODES):
+            yield ">control_mode:%d:%s|t" % (t, CONTROL_MODES[value])
+        else:
+            yield ">%s:%d:%s" % (name, t, value)
+
+
+def read_chunks(args):
+    if args.port:
+        import serial
+
+        with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+            raw = open(args.raw, "wb") if args.raw else None
+            try:
+                while True:
+                    data = port.read(4096)
+                    if raw and data:
+                        raw.write(data)
+                    yield data
+            finally:
+                if raw:
+                    raw.close()
+    else:
+        stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+        with stream:
+            while True:
+                data = stream.read(65536)
+                if not data:
+                    return
+                yield data
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", nargs="?", default="-", help="capture file, or - for stdin (ignored with --port)")
+    parser.add_argument("--port", help="serial port to read live")
+    parser.add_argument("--baud", type=int, default=921600, help="serial baud rate (TELEMETRY_BAUD)")
+    parser.add_argument("--raw", help="also save the raw serial bytes to this file")
+    parser.add_argument("--format", choices=["csv", "parquet", "teleplot"], default="csv")
+    parser.add_argument("-o", "--output", help="output file (default: stdout; required for parquet)")
+    parser.add_argument("--udp", help="send teleplot lines to HOST:PORT (Teleplot listens on 47269)")
+    parser.add_argument("--elf", help="firmware ELF used to expand deferred log messages")
+    args = parser.parse_args(argv)
+
+    if args.elf:
+        ElfStrings.active = ElfStrings(args.elf)
+
+    if args.format == "parquet" and not args.output:
+        parser.error("parquet output needs --output")
+
+    reader = FrameReader()
+    out = open(args.output, "w", newline="") if args.output and args.format != "parquet" else sys.stdout
+    rows = []
+    writer = None
+    udp = None
+    if args.udp:
+        host, port = args.udp.rsplit(":", 1)
+        udp = (socket.socket(socket.AF_INET, socket.SOCK_DGRAM), (host, int(port)))
+    if args.format == "csv":
+        writer = csv.DictWriter(out, fieldnames=COLUMNS)
+        writer.writeheader()
+
+    count = 0
+    try:
+        for chunk in read_chunks(args):
+            for record in reader.feed(chunk):
+                count += 1
+                if args.format == "csv":
+                    writer.writerow(record)
+                elif args.format == "parquet":
+                    rows.append(record)
+                else:
+                    lines = "\n".join(teleplot_lines(record))
+                    if udp:
+                        udp[0].sendto(lines.encode(), udp[1])
+                    else:
+                        out.write(lines + "\n")
+            out.flush()
+    except KeyboardInterrupt:
+        pass
+
+    if args.format == "parquet":
+        import pandas
+
+        pandas.DataFrame(rows, columns=COLUMNS).to_parquet(args.output, index=False)
+    if out is not sys.stdout:
+        out.close()
+
+    sys.stderr.write("%d records, %d log messages, %d dropped (sequence gaps), %d corrupt frames\n"
+                     % (count, reader.logs, reader.dropped, reader.bad))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())